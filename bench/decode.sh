@@ -0,0 +1,19 @@
+#!/bin/sh
+# SPDX-License-Identifier: GPL-2.0-or-later
+# Reads a synthetic video with full frames and with luma only, printing a JSON
+# line for each. Generating the video isn't timed.
+#
+# Usage: decode.sh make_videos kernels seconds
+set -e
+if [ $# -ne 3 ]; then
+  echo "Usage: $0 make_videos kernels seconds" >&2
+  exit 1
+fi
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+"$1" --count=1 --seconds="$3" "$work/videos" > /dev/null
+for video in "$work"/videos/*; do
+  "$2" decode "file:$video"
+  "$2" decode_gray "file:$video"
+done
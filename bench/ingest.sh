@@ -0,0 +1,32 @@
+#!/bin/sh
+# SPDX-License-Identifier: GPL-2.0-or-later
+# Ingests synthetic videos end to end into a fresh database and prints a JSON
+# line with files/s and seconds of video per second. Generating the videos
+# isn't timed.
+#
+# Usage: ingest.sh make_videos parse_directory version count seconds
+set -e
+if [ $# -ne 5 ]; then
+  echo "Usage: $0 make_videos parse_directory version count seconds" >&2
+  exit 1
+fi
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+"$1" --count="$4" --seconds="$5" "$work/videos" > /dev/null
+start=$(date +%s.%N)
+"$2" "$work/videos" "$work/database.sqlite" > "$work/log"
+end=$(date +%s.%N)
+if grep -q "files failed" "$work/log"; then
+  cat "$work/log" >&2
+  exit 1
+fi
+
+awk -v version="$3" -v count="$4" -v seconds="$5" \
+  -v start="$start" -v end="$end" 'BEGIN {
+  elapsed = end - start
+  printf "{\"benchmark\": \"ingest\", \"version\": \"%s\", \"files\": %d, " \
+    "\"video_seconds\": %d, \"seconds\": %.6f, \"files_per_second\": %.3f, " \
+    "\"video_seconds_per_second\": %.3f}\n", version, count, count * seconds,
+    elapsed, count / elapsed, count * seconds / elapsed
+}'
@@ -0,0 +1,285 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <libavutil/avutil.h>
+#include <libavutil/frame.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+#include "glyph.h"
+#include "output_data.h"
+#include "overlay.h"
+#include "stats.h"
+#include "video_data.h"
+
+/* Microbenchmarks of the parsing kernels on synthetic frames, so they don’t
+ * need private recordings. Each run prints one JSON object per line with the
+ * measurements, for comparing versions.
+ */
+
+/* The glyphs, as parse_directory loads them. */
+static const char keys[] = "0123456789_";
+#define GLYPH_COUNT (sizeof(keys) - 1)
+static const char glyphs_url[] = "file:../data/glyphs.png";
+
+/* Synthetic frames, cycled through so they aren’t all in cache. */
+#define FRAME_COUNT 8
+
+/* A synthetic video: 5 minutes, one line per second, starting at the time in
+ * its name (UTC). */
+#define VIDEO_LINES 300
+#define VIDEO_NAME "20240831090220_000001.TS"
+#define VIDEO_START 1725094940
+
+/* Each measurement lasts at least this long. */
+#define MIN_SECONDS 1.0
+
+/* Keeps results alive so the kernels aren’t optimized away. */
+static volatile double sink;
+
+static double now(void) {
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+typedef struct {
+  unsigned long iterations;
+  double seconds;
+} Timing;
+
+/**
+ * Runs the kernel with doubling iterations until it lasts MIN_SECONDS.
+ */
+static Timing measure(void (*kernel)(unsigned long iterations, void *data),
+  void *data) {
+  for (unsigned long iterations = 1;; iterations *= 2) {
+    double start = now();
+    kernel(iterations, data);
+    double seconds = now() - start;
+    if (seconds >= MIN_SECONDS)
+      return (Timing){ iterations, seconds };
+  }
+}
+
+static void report(const char name[], Timing timing, const char metric[],
+  double value, const char other_metric[], double other_value) {
+  printf("{\"benchmark\": \"%s\", \"version\": \"%s\", \"iterations\": %lu, "
+    "\"seconds\": %.6f, \"%s\": %.3f, \"%s\": %.3f}\n",
+    name, PROJECT_VERSION, timing.iterations, timing.seconds, metric, value,
+    other_metric, other_value);
+}
+
+static void load_kernel(unsigned long iterations, void *data) {
+  Glyph *glyphs = data;
+  for (unsigned long i = 0; i < iterations; ++i)
+    load_glyphs(glyphs_url, GLYPH_COUNT, keys, glyphs);
+}
+
+static void bench_load_glyphs(void) {
+  Glyph glyphs[GLYPH_COUNT];
+  Timing timing = measure(load_kernel, glyphs);
+  report("load_glyphs", timing,
+    "ms_per_load", timing.seconds * 1e3 / timing.iterations,
+    "loads_per_second", timing.iterations / timing.seconds);
+}
+
+typedef struct {
+  const Glyph *glyphs;
+  AVFrame *frames[FRAME_COUNT];
+} FillData;
+
+static void fill_kernel(unsigned long iterations, void *data) {
+  FillData *fill = data;
+  CharLine line;
+  for (unsigned long i = 0; i < iterations; ++i) {
+    fill_line(GLYPH_COUNT, fill->glyphs, fill->frames[i % FRAME_COUNT], &line);
+    sink = line.right[FRAME_STRING_LENGTH - 2];
+  }
+}
+
+static void bench_fill_line(const Glyph glyphs[GLYPH_COUNT]) {
+  FillData fill = { .glyphs = glyphs };
+  uint32_t seed = 1;
+  for (unsigned int i = 0; i < FRAME_COUNT; ++i) {
+    AVFrame *frame = av_frame_alloc();
+    if (frame == NULL)
+      errx(1, "Could not allocate frame");
+    frame->format = AV_PIX_FMT_GRAY8;
+    frame->width = EXPECTED_VIDEO_WIDTH;
+    frame->height = EXPECTED_VIDEO_HEIGHT;
+    if (0 != av_frame_get_buffer(frame, 0))
+      errx(1, "Could not allocate frame buffer");
+    overlay_noise(frame->data[0], frame->linesize[0], frame->width,
+      frame->height, &seed);
+    CharLine expected, read;
+    overlay_route(&expected, VIDEO_START, i);
+    overlay_draw(frame->data[0], frame->linesize[0], GLYPH_COUNT, glyphs,
+      &expected);
+
+    /* A benchmark of wrong results isn’t worth much. */
+    overlay_readable(GLYPH_COUNT, glyphs, &expected);
+    fill_line(GLYPH_COUNT, glyphs, frame, &read);
+    if (memcmp(&expected, &read, sizeof(CharLine)) != 0)
+      errx(1, "Synthetic frame %u read as “%.*s” “%.*s”", i,
+        FRAME_STRING_LENGTH, read.left, FRAME_STRING_LENGTH, read.right);
+    fill.frames[i] = frame;
+  }
+
+  Timing timing = measure(fill_kernel, &fill);
+  report("fill_line", timing,
+    "ns_per_cell", timing.seconds * 1e9
+      / (timing.iterations * 2.0 * FRAME_STRING_LENGTH),
+    "frames_per_second", timing.iterations / timing.seconds);
+  for (unsigned int i = 0; i < FRAME_COUNT; ++i)
+    av_frame_free(&fill.frames[i]);
+}
+
+static void point_kernel(unsigned long iterations, void *data) {
+  const CharLine *lines = data;
+  for (unsigned long i = 0; i < iterations; ++i)
+    sink = simple_point_from_char_line(lines[i % VIDEO_LINES]).lon;
+}
+
+static void lines_ok_kernel(unsigned long iterations, void *data) {
+  const CharLine *lines = data;
+  for (unsigned long i = 0; i < iterations; ++i)
+    sink = lines_ok(VIDEO_NAME, VIDEO_LINES, lines);
+}
+
+/**
+ * Benchmarks the line parsing: lines as fill_line reads them from a synthetic
+ * video.
+ */
+static void bench_lines(const Glyph glyphs[GLYPH_COUNT], bool whole_video) {
+  CharLine lines[VIDEO_LINES];
+  for (unsigned int i = 0; i < VIDEO_LINES; ++i) {
+    overlay_route(&lines[i], VIDEO_START, i);
+    overlay_readable(GLYPH_COUNT, glyphs, &lines[i]);
+  }
+  if (!simple_point_from_char_line(lines[0]).valid
+    || !lines_ok(VIDEO_NAME, VIDEO_LINES, lines))
+    errx(1, "Synthetic lines don’t parse");
+
+  Timing timing = measure(whole_video ? lines_ok_kernel : point_kernel, lines);
+  double lines_read = whole_video
+    ? (double)timing.iterations * VIDEO_LINES
+    : timing.iterations;
+  report(whole_video ? "lines_ok" : "simple_point", timing,
+    "ns_per_line", timing.seconds * 1e9 / lines_read,
+    "lines_per_second", lines_read / timing.seconds);
+}
+
+typedef struct {
+  const Glyph *glyphs;
+  const char *url;
+  VideoOptions options;
+} DecodeData;
+
+/**
+ * Bytes of the planes the decoder writes, over the frames lines are read from:
+ * the luma plane alone when decoding gray (where FFmpeg can, the chroma planes
+ * are then allocated but left as they are).
+ */
+typedef struct {
+  bool luma_only;
+  double bytes;
+  unsigned long frames;
+} WrittenBytes;
+
+/**
+ * Frame hook of get_video_strings adding up the WrittenBytes.
+ */
+static void count_written(const AVFrame *frame, void *data) {
+  WrittenBytes *written = data;
+  const AVPixFmtDescriptor *format = av_pix_fmt_desc_get(frame->format);
+  const int planes = written->luma_only ? 1 : av_pix_fmt_count_planes(
+    frame->format);
+  for (int plane = 0; plane < planes; ++plane) {
+    /* Chroma planes can be subsampled, not luma and alpha. */
+    const int height = plane == 1 || plane == 2
+      ? AV_CEIL_RSHIFT(frame->height, format->log2_chroma_h)
+      : frame->height;
+    written->bytes += (double)height
+      * av_image_get_linesize(frame->format, frame->width, plane);
+  }
+  written->frames++;
+}
+
+static void decode_kernel(unsigned long iterations, void *data) {
+  DecodeData *decode = data;
+  CharLine lines[VIDEO_LINES + 1];
+  for (unsigned long i = 0; i < iterations; ++i)
+    if (get_video_strings(decode->url, GLYPH_COUNT, decode->glyphs,
+        VIDEO_LINES + 1, lines, &decode->options) <= 0)
+      errx(1, "Could not read %s", decode->url);
+}
+
+/**
+ * Benchmarks reading a video as parse_directory does, decoding full frames or
+ * luma only. Reports the decode stage’s time per frame and the kilobytes of
+ * planes the decoder writes per frame (see WrittenBytes), a proxy for its
+ * memory bandwidth.
+ */
+static void bench_decode(const Glyph glyphs[GLYPH_COUNT], const char url[],
+  bool gray) {
+  WrittenBytes written = { .luma_only = gray && video_gray_supported() };
+  DecodeData decode = {
+    .glyphs = glyphs,
+    .url = url,
+    .options = {
+      .gray = gray,
+      .frame = count_written,
+      .frame_data = &written,
+    },
+  };
+  stats_begin(false, NULL);
+  stats_file_begin();
+  Timing timing = measure(decode_kernel, &decode);
+  stats_file_end(url);
+  const Stats *stats = stats_last_file();
+  const double frames = stats->counters[COUNTER_FRAMES_DECODED];
+  report(gray ? "decode_gray" : "decode", timing,
+    "ms_per_frame", stats->seconds[STAGE_DECODE] * 1e3 / frames,
+    "written_kb_per_frame", written.bytes / 1024 / written.frames);
+}
+
+/**
+ * kernels: runs a microbenchmark by name, from the build directory. The decode
+ * ones read a video, synthetic (see make_videos) or recorded.
+ *
+ * Usage: kernels load_glyphs|fill_line|simple_point|lines_ok
+ *        kernels decode|decode_gray video
+ */
+int main(int argc, char* argv[]) {
+  const bool decoding = argc == 3 && strncmp(argv[1], "decode", 6) == 0;
+  if (argc != 2 && !decoding)
+    errx(1, "Usage: %s load_glyphs|fill_line|simple_point|lines_ok"
+      " or decode|decode_gray video", argv[0]);
+  /* Video names and overlay times are local time. */
+  setenv("TZ", "UTC", 1);
+  tzset();
+
+  Glyph glyphs[GLYPH_COUNT];
+  load_glyphs(glyphs_url, GLYPH_COUNT, keys, glyphs);
+  if (strcmp(argv[1], "load_glyphs") == 0)
+    bench_load_glyphs();
+  else if (strcmp(argv[1], "fill_line") == 0)
+    bench_fill_line(glyphs);
+  else if (strcmp(argv[1], "simple_point") == 0)
+    bench_lines(glyphs, false);
+  else if (strcmp(argv[1], "lines_ok") == 0)
+    bench_lines(glyphs, true);
+  else if (decoding && strcmp(argv[1], "decode") == 0)
+    bench_decode(glyphs, argv[2], false);
+  else if (decoding && strcmp(argv[1], "decode_gray") == 0) {
+    if (!video_gray_supported())
+      warnx("FFmpeg has no --enable-gray, decoding all planes");
+    bench_decode(glyphs, argv[2], true);
+  }
+  else
+    errx(1, "Unknown benchmark “%s”", argv[1]);
+  return 0;
+}
@@ -0,0 +1,25 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#define _XOPEN_SOURCE 700
+#include <err.h>
+#include <stdlib.h>
+#include <time.h>
+#include "arguments.h"
+
+time_t argument_time(const char text[]) {
+  struct tm time = { 0 };
+  const char *end = strptime(text, "%Y-%m-%d %H:%M", &time);
+  if (end != NULL && *end == ':')
+    end = strptime(end, ":%S", &time);
+  if (end == NULL || *end != '\0')
+    errx(1, "Invalid time “%s”, expected “YYYY-MM-DD hh:mm[:ss]”", text);
+  time.tm_isdst = -1;
+  return mktime(&time);
+}
+
+double argument_double(const char text[]) {
+  char *end;
+  double ret = strtod(text, &end);
+  if (end == text || *end != '\0')
+    errx(1, "Invalid number “%s”", text);
+  return ret;
+}
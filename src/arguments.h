@@ -0,0 +1,14 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#pragma once
+
+#include <time.h>
+
+/**
+ * Reads a local time argument as “YYYY-MM-DD hh:mm[:ss]”, or exits.
+ */
+time_t argument_time(const char text[]);
+
+/**
+ * Reads a number argument, or exits.
+ */
+double argument_double(const char text[]);
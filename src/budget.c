@@ -0,0 +1,100 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include "budget.h"
+
+/* Where Linux has the pressure stall information. */
+static const char *const psi_files[] = {
+  "/proc/pressure/cpu", "/proc/pressure/io",
+};
+
+static double seconds(clockid_t clock) {
+  struct timespec now;
+  clock_gettime(clock, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+static void sleep_seconds(double duration) {
+  if (duration <= 0)
+    return;
+  struct timespec wait = {
+    .tv_sec = (time_t)duration,
+    .tv_nsec = (long)((duration - (time_t)duration) * 1e9),
+  };
+  nanosleep(&wait, NULL);
+}
+
+double budget_pressure(unsigned int count, const char *const files[count]) {
+  double pressure = -1;
+  for (unsigned int i = 0; i < count; ++i) {
+    FILE *file = fopen(files[i], "r");
+    if (file == NULL)
+      continue;
+    double average;
+    if (1 == fscanf(file, "some avg10=%lf", &average) && average > pressure)
+      pressure = average;
+    fclose(file);
+  }
+  if (pressure >= 0)
+    return pressure;
+  double load;
+  long processors = sysconf(_SC_NPROCESSORS_ONLN);
+  if (getloadavg(&load, 1) != 1 || processors < 1)
+    return 0;
+  return 100 * load / processors;
+}
+
+unsigned int budget_file_begin(Budget *budget) {
+  unsigned int threads = budget->threads;
+  if (budget->max_pressure > 0) {
+    const unsigned int count = sizeof(psi_files) / sizeof(psi_files[0]);
+    double pressure;
+    unsigned int backoff = 1;
+    while ((pressure = budget_pressure(count, psi_files))
+      > budget->max_pressure) {
+      warnx("Pressure at %.1f%%, waiting %u s", pressure, backoff);
+      sleep(backoff);
+      if (backoff < BUDGET_MAX_BACKOFF)
+        backoff *= 2;
+    }
+    /* All the threads up to half the limit, down to one at the limit. */
+    if (threads > 1 && pressure > budget->max_pressure / 2) {
+      double room = 2 * (1 - pressure / budget->max_pressure);
+      threads = 1 + (unsigned int)((threads - 1) * room);
+    }
+  }
+  budget->wall_start = seconds(CLOCK_MONOTONIC);
+  budget->cpu_start = seconds(CLOCK_PROCESS_CPUTIME_ID);
+  budget->read_bytes = 0;
+  return threads;
+}
+
+void budget_read(int size, void *data) {
+  Budget *budget = data;
+  budget->read_bytes += size;
+  double elapsed = seconds(CLOCK_MONOTONIC) - budget->wall_start;
+  double wait = 0;
+  if (budget->read_rate > 0)
+    wait = budget->read_bytes / budget->read_rate - elapsed;
+  /* Process CPU time counts the decoder threads too. */
+  if (budget->cpu_share > 0) {
+    double cpu = seconds(CLOCK_PROCESS_CPUTIME_ID) - budget->cpu_start;
+    if (cpu / budget->cpu_share - elapsed > wait)
+      wait = cpu / budget->cpu_share - elapsed;
+  }
+  sleep_seconds(wait);
+}
+
+bool budget_background(void) {
+  bool lowered = 0 == setpriority(PRIO_PROCESS, 0, 19);
+#ifdef SYS_ioprio_set
+  /* IOPRIO_WHO_PROCESS, this process, in the idle class (3). */
+  lowered = lowered && 0 == syscall(SYS_ioprio_set, 1, 0, 3 << 13);
+#endif
+  return lowered;
+}
@@ -0,0 +1,54 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Longest wait while the system is under pressure before checking again. */
+#define BUDGET_MAX_BACKOFF 64
+
+/**
+ * Limits on the resources an ingest takes from the rest of the system. Limits
+ * at 0 don’t apply. The rest is state, see budget_file_begin.
+ */
+typedef struct {
+  /* Most decoder threads, 0 for FFmpeg’s default. */
+  unsigned int threads;
+  /* CPU seconds per second, as top shows it: 1.5 is one and a half cores. */
+  double cpu_share;
+  /* Bytes of video read per second. */
+  double read_rate;
+  /* Percent of time tasks waited for the CPU or I/O over the last 10 s (PSI),
+   * or load average per processor where there’s no PSI, to wait under. */
+  double max_pressure;
+  /* Since the file began. */
+  double wall_start;
+  double cpu_start;
+  uint64_t read_bytes;
+} Budget;
+
+/**
+ * Reads the pressure as max_pressure counts it: the highest “some avg10” of
+ * the PSI files given, or the load average per processor when none can be
+ * read. Returns a percentage.
+ */
+double budget_pressure(unsigned int count, const char *const files[count]);
+
+/**
+ * Waits while the system pressure is over max_pressure, backing off from 1 s
+ * to BUDGET_MAX_BACKOFF, then starts a file. Returns the decoder threads for
+ * it: fewer, down to 1, the closer the pressure is to max_pressure.
+ */
+unsigned int budget_file_begin(Budget *budget);
+
+/**
+ * Read hook of get_video_strings (see VideoOptions): sleeps as needed to keep
+ * the file within read_rate and cpu_share.
+ */
+void budget_read(int size, void *budget);
+
+/**
+ * Lowers the scheduling priority of the process, for the CPU and, on Linux,
+ * for I/O, so other services go first. Returns whether it worked.
+ */
+bool budget_background(void);
@@ -0,0 +1,33 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#include <err.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "db.h"
+#include "partition.h"
+#include "point_index.h"
+#include "track.h"
+
+/**
+ * build_index: writes the index file query reads, from all the locations of
+ * the database, or of the partitions of a catalog. Kept apart from query so
+ * that only this one links SpatiaLite.
+ *
+ * Usage: build_index database index
+ */
+int main(int argc, char* argv[]) {
+  if (argc != 3)
+    errx(1, "Usage: %s database index", argv[0]);
+  SpatiaLite sp = open_and_init_db(argv[1]);
+  PartitionPeriod period;
+  if (partition_period(sp.db, &period))
+    partition_attach(sp.db, INT64_MIN, INT64_MAX);
+  TrackPoint *points;
+  unsigned int count = load_track(sp.db, INT64_MIN, INT64_MAX, &points);
+  close_db(sp);
+  if (!point_index_write(argv[2], count, points))
+    return 1;
+  free(points);
+  printf("Indexed %u locations\n", count);
+  return 0;
+}
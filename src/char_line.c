@@ -0,0 +1,45 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#define _DEFAULT_SOURCE
+#define _XOPEN_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "char_line.h"
+
+/* The clock ends the right line, as the glyphs read it: the separators aren’t
+ * glyphs, so they’re spaces. */
+#define CLOCK_FORMAT "%d %m %Y %H %M %S"
+#define CLOCK_LENGTH (sizeof("dd mm yyyy HH MM SS") - 1)
+#define CLOCK_OFFSET (FRAME_STRING_LENGTH - CLOCK_LENGTH - 1)
+
+/**
+ * Reads the clock’s fields, returns whether it could.
+ */
+static bool line_fields(const CharLine *line, struct tm *time) {
+  char text[CLOCK_LENGTH + 1];
+  memcpy(text, line->right + CLOCK_OFFSET, CLOCK_LENGTH);
+  text[CLOCK_LENGTH] = '\0';
+  *time = (struct tm){ 0 };
+  return NULL != strptime(text, CLOCK_FORMAT, time);
+}
+
+time_t line_time(const CharLine line) {
+  struct tm time;
+  if (!line_fields(&line, &time))
+    return 0;
+  time.tm_isdst = -1;
+  return mktime(&time);
+}
+
+time_t line_clock(const CharLine *line) {
+  struct tm time;
+  return line_fields(line, &time) ? timegm(&time) : 0;
+}
+
+void line_set_clock(CharLine *line, time_t clock) {
+  struct tm time;
+  char text[CLOCK_LENGTH + 1];
+  strftime(text, sizeof(text), CLOCK_FORMAT, gmtime_r(&clock, &time));
+  memset(line->right, ' ', FRAME_STRING_LENGTH);
+  memcpy(line->right + CLOCK_OFFSET, text, CLOCK_LENGTH);
+}
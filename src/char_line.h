@@ -1,5 +1,7 @@
 /* SPDX-License-Identifier: GPL-2.0-or-later */
 #pragma once
+#include <stdbool.h>
+#include <time.h>
 #include "definitions.h"
 
 /* Half the frame is reserved for each side. */
@@ -13,3 +15,20 @@ typedef struct {
   char left[FRAME_STRING_LENGTH];
   char right[FRAME_STRING_LENGTH];
 } CharLine;
+
+/**
+ * Tries to get the timestamp from the right line, 0 when it can’t.
+ */
+time_t line_time(const CharLine line);
+
+/**
+ * The clock of the right line as it reads, taken as UTC so it counts seconds
+ * regardless of daylight saving time, 0 when it can’t be read.
+ */
+time_t line_clock(const CharLine *line);
+
+/**
+ * Writes the clock (as from line_clock) as the right line, the way the glyphs
+ * read it.
+ */
+void line_set_clock(CharLine *line, time_t clock);
@@ -0,0 +1,286 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#include <err.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/avutil.h>
+#include <libavutil/mathematics.h>
+#include "clip.h"
+#include "track.h"
+
+/* Finds footage in the catalogue and copies it out of the videos. Database
+ * errors trigger errx(), while clip_write warns and returns false. */
+
+/* Meters in a degree of latitude, enough to filter bounding boxes. */
+#define METERS_PER_DEGREE 111320.0
+
+/**
+ * Runs a query of videos (path, start_time, end_time, first_pts, pts_time),
+ * already bound, into segments spanning the whole videos.
+ */
+static int segments_from(sqlite3_stmt *stmt, ClipSegment **segments) {
+  int count = 0;
+  int allocated = 4;
+  *segments = malloc(allocated * sizeof(ClipSegment));
+  if (*segments == NULL)
+    errx(1, "Could not allocate clip segments");
+  int step;
+  while (SQLITE_ROW == (step = sqlite3_step(stmt))) {
+    if (count == allocated) {
+      allocated *= 2;
+      *segments = reallocarray(*segments, allocated, sizeof(ClipSegment));
+      if (*segments == NULL)
+        errx(1, "Could not allocate clip segments");
+    }
+    ClipSegment *segment = &(*segments)[count++];
+    segment->path = strdup((const char *)sqlite3_column_text(stmt, 0));
+    if (segment->path == NULL)
+      errx(1, "Could not allocate clip path");
+    segment->from = sqlite3_column_int64(stmt, 1);
+    segment->to = sqlite3_column_int64(stmt, 2);
+    segment->first_pts = sqlite3_column_type(stmt, 3) == SQLITE_NULL
+      ? AV_NOPTS_VALUE
+      : sqlite3_column_int64(stmt, 3);
+    segment->pts_time = sqlite3_column_int64(stmt, 4);
+  }
+  if (SQLITE_DONE != step)
+    errx(1, "Could not step videos statement");
+  if (SQLITE_OK != sqlite3_finalize(stmt))
+    errx(1, "Could not finalize videos statement");
+  return count;
+}
+
+int clip_find_range(sqlite3 *db, time_t from, time_t to,
+  ClipSegment **segments) {
+  sqlite3_stmt *stmt;
+  const char query[] =
+    "SELECT path, start_time, end_time, first_pts,"
+    "  coalesce(pts_time, start_time) FROM videos"
+    "  WHERE end_time >= ? AND start_time <= ? AND path IS NOT NULL"
+    "  ORDER BY start_time;";
+  if (SQLITE_OK != sqlite3_prepare_v2(db, query, sizeof(query), &stmt, NULL))
+    errx(1, "Could not prepare videos statement");
+  if (SQLITE_OK != sqlite3_bind_int64(stmt, 1, from)
+    || SQLITE_OK != sqlite3_bind_int64(stmt, 2, to))
+    errx(1, "Could not bind videos time range");
+  int count = segments_from(stmt, segments);
+  for (int i = 0; i < count; ++i) {
+    ClipSegment *segment = &(*segments)[i];
+    segment->from = from > segment->from ? from : segment->from;
+    segment->to = to < segment->to ? to : segment->to;
+  }
+  return count;
+}
+
+int clip_find_near(sqlite3 *db, double lon, double lat, double radius,
+  ClipSegment **segments) {
+  sqlite3_stmt *stmt;
+  const char query[] =
+    "SELECT path, start_time, end_time, first_pts,"
+    "  coalesce(pts_time, start_time)"
+    "  FROM videos AS v JOIN videos_bbox AS b ON b.id = v.id"
+    "  WHERE b.max_lon >= ?1 AND b.min_lon <= ?2"
+    "  AND b.max_lat >= ?3 AND b.min_lat <= ?4 AND path IS NOT NULL"
+    "  ORDER BY start_time;";
+  if (SQLITE_OK != sqlite3_prepare_v2(db, query, sizeof(query), &stmt, NULL))
+    errx(1, "Could not prepare videos statement");
+  const double lat_margin = radius / METERS_PER_DEGREE;
+  const double lon_margin = lat_margin / fmax(cos(lat * M_PI / 180), 0.01);
+  if (SQLITE_OK != sqlite3_bind_double(stmt, 1, lon - lon_margin)
+    || SQLITE_OK != sqlite3_bind_double(stmt, 2, lon + lon_margin)
+    || SQLITE_OK != sqlite3_bind_double(stmt, 3, lat - lat_margin)
+    || SQLITE_OK != sqlite3_bind_double(stmt, 4, lat + lat_margin))
+    errx(1, "Could not bind videos box");
+  int count = segments_from(stmt, segments);
+
+  /* Boxes only tell which videos may pass by. */
+  int kept = 0;
+  for (int i = 0; i < count; ++i) {
+    ClipSegment segment = (*segments)[i];
+    TrackPoint *points;
+    unsigned int point_count = load_track(db, segment.from, segment.to,
+      &points);
+    time_t first = 0, last = 0;
+    for (unsigned int j = 0; j < point_count; ++j) {
+      if (great_circle_distance(lat, lon, points[j].lat, points[j].lon)
+        > radius)
+        continue;
+      if (first == 0)
+        first = points[j].timestamp;
+      last = points[j].timestamp;
+    }
+    free(points);
+    if (first == 0) {
+      free(segment.path);
+      continue;
+    }
+    segment.from = first - CLIP_PAD > segment.from
+      ? first - CLIP_PAD
+      : segment.from;
+    segment.to = last + CLIP_PAD < segment.to ? last + CLIP_PAD : segment.to;
+    (*segments)[kept++] = segment;
+  }
+  return kept;
+}
+
+int64_t clip_pts(const ClipSegment *segment, time_t time, int64_t second,
+  int64_t start_pts) {
+  const int64_t aligned_pts = segment->first_pts != AV_NOPTS_VALUE
+    ? segment->first_pts
+    : start_pts;
+  return aligned_pts + (time - segment->pts_time) * second;
+}
+
+void clip_free(int count, ClipSegment segments[count]) {
+  for (int i = 0; i < count; ++i)
+    free(segments[i].path);
+  free(segments);
+}
+
+/**
+ * Whether the stream is copied to the clip.
+ */
+static bool copied(const AVStream *stream) {
+  return stream->codecpar->codec_type == AVMEDIA_TYPE_VIDEO
+    || stream->codecpar->codec_type == AVMEDIA_TYPE_AUDIO;
+}
+
+/**
+ * Adds the copied streams of the first video to the clip and starts it.
+ */
+static bool start_output(AVFormatContext *out, const AVFormatContext *in,
+  const char filename[]) {
+  for (unsigned int i = 0; i < in->nb_streams; ++i) {
+    if (!copied(in->streams[i]))
+      continue;
+    AVStream *stream = avformat_new_stream(out, NULL);
+    if (stream == NULL
+      || avcodec_parameters_copy(stream->codecpar, in->streams[i]->codecpar)
+        < 0) {
+      warnx("Could not add stream to %s", filename);
+      return false;
+    }
+    /* The tag of the source container may not fit this one. */
+    stream->codecpar->codec_tag = 0;
+    stream->time_base = in->streams[i]->time_base;
+  }
+  if ((out->oformat->flags & AVFMT_NOFILE) == 0
+    && avio_open(&out->pb, filename, AVIO_FLAG_WRITE) < 0) {
+    warnx("Could not open %s", filename);
+    return false;
+  }
+  if (avformat_write_header(out, NULL) < 0) {
+    warnx("Could not write header of %s", filename);
+    return false;
+  }
+  return true;
+}
+
+/**
+ * Copies the packets of a segment, from the key frame at or before its first
+ * second, to the clip, starting at offset and moving it to the clip’s end
+ * (both in AV_TIME_BASE units).
+ */
+static bool copy_segment(AVFormatContext *out, const char filename[],
+  const ClipSegment *segment, int64_t *offset) {
+  AVFormatContext *in = NULL;
+  if (0 != avformat_open_input(&in, segment->path, NULL, NULL)
+    || avformat_find_stream_info(in, NULL) < 0) {
+    warnx("Could not open %s", segment->path);
+    avformat_close_input(&in);
+    return false;
+  }
+  int video = av_find_best_stream(in, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+  int *map = malloc(in->nb_streams * sizeof(int));
+  if (map == NULL)
+    errx(1, "Could not allocate stream map");
+  bool written = video >= 0
+    && (out->nb_streams > 0 || start_output(out, in, filename));
+  unsigned int mapped = 0;
+  for (unsigned int i = 0; i < in->nb_streams; ++i)
+    map[i] = copied(in->streams[i]) ? (int)mapped++ : -1;
+  if (written && mapped != out->nb_streams) {
+    warnx("%s doesn’t have the same streams as the clip", segment->path);
+    written = false;
+  }
+
+  /* The seconds to PTS, as get_video_strings aligns them. */
+  AVPacket pkt;
+  int64_t from_pts = 0, to_pts = 0;
+  if (written) {
+    const AVStream *stream = in->streams[video];
+    const int64_t second = stream->time_base.den / stream->time_base.num;
+    from_pts = clip_pts(segment, segment->from, second, stream->start_time);
+    to_pts = clip_pts(segment, segment->to + 1, second, stream->start_time);
+    if (av_seek_frame(in, video, from_pts, AVSEEK_FLAG_BACKWARD) < 0)
+      warnx("Could not seek %s, copying from its start", segment->path);
+  }
+  int64_t base = AV_NOPTS_VALUE;
+  int64_t end = *offset;
+  while (written && 0 == av_read_frame(in, &pkt)) {
+    const AVStream *stream = in->streams[pkt.stream_index];
+    int target = map[pkt.stream_index];
+    /* Nothing plays before the first key frame. */
+    if (base == AV_NOPTS_VALUE && pkt.stream_index == video
+      && (pkt.flags & AV_PKT_FLAG_KEY) != 0 && pkt.dts != AV_NOPTS_VALUE)
+      base = av_rescale_q(pkt.dts, stream->time_base, AV_TIME_BASE_Q);
+    if (pkt.stream_index == video && pkt.pts != AV_NOPTS_VALUE
+      && pkt.pts >= to_pts) {
+      av_packet_unref(&pkt);
+      break;
+    }
+    if (target < 0 || base == AV_NOPTS_VALUE || pkt.dts == AV_NOPTS_VALUE
+      || av_rescale_q(pkt.dts, stream->time_base, AV_TIME_BASE_Q) < base) {
+      av_packet_unref(&pkt);
+      continue;
+    }
+    /* Shifted to follow the previous segment. */
+    const int64_t shift =
+      av_rescale_q(*offset - base, AV_TIME_BASE_Q, stream->time_base);
+    pkt.dts += shift;
+    if (pkt.pts != AV_NOPTS_VALUE)
+      pkt.pts += shift;
+    int64_t packet_end = av_rescale_q(pkt.dts + pkt.duration,
+      stream->time_base, AV_TIME_BASE_Q);
+    end = packet_end > end ? packet_end : end;
+    pkt.stream_index = target;
+    av_packet_rescale_ts(&pkt, stream->time_base,
+      out->streams[target]->time_base);
+    pkt.pos = -1;
+    if (av_interleaved_write_frame(out, &pkt) < 0) {
+      warnx("Could not write to %s", filename);
+      written = false;
+    }
+    av_packet_unref(&pkt);
+  }
+  if (written && base == AV_NOPTS_VALUE)
+    warnx("No key frame to start the segment of %s", segment->path);
+  *offset = end;
+  free(map);
+  avformat_close_input(&in);
+  return written;
+}
+
+bool clip_write(const char filename[], int count,
+  const ClipSegment segments[count]) {
+  AVFormatContext *out = NULL;
+  if (avformat_alloc_output_context2(&out, NULL, NULL, filename) < 0) {
+    warnx("Could not find a container for %s", filename);
+    return false;
+  }
+  bool written = true;
+  int64_t offset = 0;
+  for (int i = 0; written && i < count; ++i)
+    written = copy_segment(out, filename, &segments[i], &offset);
+  /* Whatever was copied before a failure still plays. */
+  if (offset > 0 && av_write_trailer(out) < 0) {
+    warnx("Could not finish %s", filename);
+    written = false;
+  }
+  if ((out->oformat->flags & AVFMT_NOFILE) == 0)
+    avio_closep(&out->pb);
+  avformat_free_context(out);
+  return written;
+}
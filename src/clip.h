@@ -0,0 +1,61 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <sqlite3.h>
+
+/* Seconds added around the ones near a place. */
+#define CLIP_PAD 10
+
+/**
+ * Seconds to extract from a catalogued video (see the videos table).
+ */
+typedef struct {
+  char *path;
+  /* Inclusive, in overlay time. */
+  time_t from;
+  time_t to;
+  /* A presentation timestamp of the video, AV_NOPTS_VALUE when unknown (the
+   * stream start then), and the overlay time of its frame. */
+  int64_t first_pts;
+  time_t pts_time;
+} ClipSegment;
+
+/**
+ * Finds the videos with locations between the times (inclusive), in time
+ * order, and the seconds of each within them. The segments are allocated, see
+ * clip_free. Returns how many there are.
+ */
+int clip_find_range(sqlite3 *db, time_t from, time_t to,
+  ClipSegment **segments);
+
+/**
+ * Finds the videos passing within radius meters of the place, in time order,
+ * with the seconds from the first location that close to the last, CLIP_PAD
+ * more on each side. The segments are allocated, see clip_free. Returns how
+ * many there are.
+ */
+int clip_find_near(sqlite3 *db, double lon, double lat, double radius,
+  ClipSegment **segments);
+
+/**
+ * Presentation timestamp of the frame at the overlay time in the segment’s
+ * video, second being a second in its time base, and start_pts its stream’s
+ * start, used when the segment has no first_pts.
+ */
+int64_t clip_pts(const ClipSegment *segment, time_t time, int64_t second,
+  int64_t start_pts);
+
+void clip_free(int count, ClipSegment segments[count]);
+
+/**
+ * Writes the segments one after the other to the file, in the container its
+ * extension asks for, copying the packets of every audio and video stream
+ * without decoding them, from the key frame before each segment. The videos
+ * should all have the same streams. Returns false, with a warning, when it
+ * can’t.
+ */
+bool clip_write(const char filename[], int count,
+  const ClipSegment segments[count]);
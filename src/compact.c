@@ -0,0 +1,273 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#include <err.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sqlite3.h>
+#include "compact.h"
+
+/* Compact storage of a whole video track in a single blob, and the table-valued
+ * function that reads it back.
+ */
+
+/* A varint takes at most 10 bytes for 64 bits. */
+#define MAX_VARINT_SIZE 10
+
+/**
+ * Appends an unsigned varint (LEB128) at the position, returns the new one.
+ */
+static unsigned char *put_varint(unsigned char *position, uint64_t value) {
+  while (value >= 0x80) {
+    *position++ = (value & 0x7f) | 0x80;
+    value >>= 7;
+  }
+  *position++ = value;
+  return position;
+}
+
+/**
+ * Appends a signed value, zigzag encoded so small differences either way take
+ * few bytes.
+ */
+static unsigned char *put_signed(unsigned char *position, int64_t value) {
+  return put_varint(position, ((uint64_t)value << 1) ^ (uint64_t)(value >> 63));
+}
+
+/**
+ * Reads an unsigned varint, returns false if the blob ends before it does.
+ */
+static bool get_varint(const unsigned char **position,
+  const unsigned char *end, uint64_t *value) {
+  *value = 0;
+  for (unsigned int shift = 0; *position < end && shift < 64; shift += 7) {
+    unsigned char byte = *(*position)++;
+    *value |= (uint64_t)(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0)
+      return true;
+  }
+  return false;
+}
+
+/**
+ * Reads a zigzag encoded value.
+ */
+static bool get_signed(const unsigned char **position,
+  const unsigned char *end, int64_t *value) {
+  uint64_t raw;
+  if (!get_varint(position, end, &raw))
+    return false;
+  *value = (int64_t)(raw >> 1) ^ -(int64_t)(raw & 1);
+  return true;
+}
+
+int compact_encode(unsigned int count, const TrackPoint points[count],
+  unsigned char **blob) {
+  *blob = malloc(MAX_VARINT_SIZE * (1 + 3 * (size_t)count));
+  if (*blob == NULL)
+    errx(1, "Could not allocate compact track for %u points", count);
+  unsigned char *position = put_varint(*blob, count);
+  int64_t timestamp = 0, lon = 0, lat = 0;
+  for (unsigned int i = 0; i < count; ++i) {
+    int64_t this_lon = llround(points[i].lon * 1e6);
+    int64_t this_lat = llround(points[i].lat * 1e6);
+    position = put_signed(position, points[i].timestamp - timestamp);
+    position = put_signed(position, this_lon - lon);
+    position = put_signed(position, this_lat - lat);
+    timestamp = points[i].timestamp;
+    lon = this_lon;
+    lat = this_lat;
+  }
+  return position - *blob;
+}
+
+int compact_decode(int size, const unsigned char blob[size],
+  TrackPoint **points) {
+  const unsigned char *position = blob;
+  const unsigned char *end = blob + size;
+  uint64_t count;
+  *points = NULL;
+  /* Each point takes at least 3 bytes, which also bounds the allocation. */
+  if (!get_varint(&position, end, &count) || count > (uint64_t)size / 3)
+    return -1;
+  *points = reallocarray(NULL, count ? count : 1, sizeof(TrackPoint));
+  if (*points == NULL)
+    errx(1, "Could not allocate %lu compact track points",
+      (unsigned long)count);
+  int64_t timestamp = 0, lon = 0, lat = 0;
+  for (uint64_t i = 0; i < count; ++i) {
+    int64_t delta_timestamp, delta_lon, delta_lat;
+    if (!get_signed(&position, end, &delta_timestamp)
+      || !get_signed(&position, end, &delta_lon)
+      || !get_signed(&position, end, &delta_lat)) {
+      free(*points);
+      *points = NULL;
+      return -1;
+    }
+    timestamp += delta_timestamp;
+    lon += delta_lon;
+    lat += delta_lat;
+    (*points)[i].timestamp = timestamp;
+    (*points)[i].lon = lon * 1e-6;
+    (*points)[i].lat = lat * 1e-6;
+  }
+  return count;
+}
+
+/* Table-valued function, see https://sqlite.org/vtab.html#tabfunc2 */
+
+/* Columns of compact_points, the track is the hidden argument. */
+enum {
+  COLUMN_TIMESTAMP,
+  COLUMN_LON,
+  COLUMN_LAT,
+  COLUMN_TRACK,
+};
+
+typedef struct {
+  sqlite3_vtab_cursor base;
+  TrackPoint *points;
+  int count;
+  int current;
+} PointsCursor;
+
+static int points_connect(sqlite3 *db, void *aux, int argc,
+  const char *const *argv, sqlite3_vtab **vtab, char **error) {
+  (void)aux;
+  (void)argc;
+  (void)argv;
+  (void)error;
+  int rc = sqlite3_declare_vtab(db,
+    "CREATE TABLE x(timestamp INTEGER, lon REAL, lat REAL, track HIDDEN);");
+  if (rc != SQLITE_OK)
+    return rc;
+  *vtab = sqlite3_malloc(sizeof(sqlite3_vtab));
+  if (*vtab == NULL)
+    return SQLITE_NOMEM;
+  memset(*vtab, 0, sizeof(sqlite3_vtab));
+  return SQLITE_OK;
+}
+
+static int points_disconnect(sqlite3_vtab *vtab) {
+  sqlite3_free(vtab);
+  return SQLITE_OK;
+}
+
+/**
+ * The track argument is required. Points come out in timestamp order.
+ */
+static int points_best_index(sqlite3_vtab *vtab, sqlite3_index_info *info) {
+  (void)vtab;
+  for (int i = 0; i < info->nConstraint; ++i) {
+    if (info->aConstraint[i].iColumn != COLUMN_TRACK
+      || info->aConstraint[i].op != SQLITE_INDEX_CONSTRAINT_EQ)
+      continue;
+    if (!info->aConstraint[i].usable)
+      return SQLITE_CONSTRAINT;
+    info->aConstraintUsage[i].argvIndex = 1;
+    info->aConstraintUsage[i].omit = 1;
+    info->estimatedCost = 300;
+    info->estimatedRows = 300;
+    if (info->nOrderBy == 1 && info->aOrderBy[0].iColumn == COLUMN_TIMESTAMP
+      && !info->aOrderBy[0].desc)
+      info->orderByConsumed = 1;
+    return SQLITE_OK;
+  }
+  return SQLITE_CONSTRAINT;
+}
+
+static int points_open(sqlite3_vtab *vtab, sqlite3_vtab_cursor **cursor) {
+  (void)vtab;
+  PointsCursor *points_cursor = sqlite3_malloc(sizeof(PointsCursor));
+  if (points_cursor == NULL)
+    return SQLITE_NOMEM;
+  memset(points_cursor, 0, sizeof(PointsCursor));
+  *cursor = &points_cursor->base;
+  return SQLITE_OK;
+}
+
+static int points_close(sqlite3_vtab_cursor *cursor) {
+  PointsCursor *points_cursor = (PointsCursor *)cursor;
+  free(points_cursor->points);
+  sqlite3_free(points_cursor);
+  return SQLITE_OK;
+}
+
+static int points_filter(sqlite3_vtab_cursor *cursor, int index_number,
+  const char *index_string, int argc, sqlite3_value **argv) {
+  (void)index_number;
+  (void)index_string;
+  PointsCursor *points_cursor = (PointsCursor *)cursor;
+  free(points_cursor->points);
+  points_cursor->points = NULL;
+  points_cursor->count = 0;
+  points_cursor->current = 0;
+  /* A NULL track has no points. */
+  if (argc < 1 || sqlite3_value_type(argv[0]) != SQLITE_BLOB)
+    return SQLITE_OK;
+  const unsigned char *blob = sqlite3_value_blob(argv[0]);
+  int count = compact_decode(sqlite3_value_bytes(argv[0]), blob,
+    &points_cursor->points);
+  if (count < 0) {
+    sqlite3_free(cursor->pVtab->zErrMsg);
+    cursor->pVtab->zErrMsg = sqlite3_mprintf("Invalid compact track");
+    return SQLITE_CORRUPT;
+  }
+  points_cursor->count = count;
+  return SQLITE_OK;
+}
+
+static int points_next(sqlite3_vtab_cursor *cursor) {
+  ((PointsCursor *)cursor)->current++;
+  return SQLITE_OK;
+}
+
+static int points_eof(sqlite3_vtab_cursor *cursor) {
+  PointsCursor *points_cursor = (PointsCursor *)cursor;
+  return points_cursor->current >= points_cursor->count;
+}
+
+static int points_column(sqlite3_vtab_cursor *cursor,
+  sqlite3_context *context, int column) {
+  PointsCursor *points_cursor = (PointsCursor *)cursor;
+  const TrackPoint *point = &points_cursor->points[points_cursor->current];
+  switch (column) {
+    case COLUMN_TIMESTAMP:
+      sqlite3_result_int64(context, point->timestamp);
+      break;
+    case COLUMN_LON:
+      sqlite3_result_double(context, point->lon);
+      break;
+    case COLUMN_LAT:
+      sqlite3_result_double(context, point->lat);
+      break;
+    default:
+      sqlite3_result_null(context);
+      break;
+  }
+  return SQLITE_OK;
+}
+
+static int points_rowid(sqlite3_vtab_cursor *cursor, sqlite3_int64 *rowid) {
+  *rowid = ((PointsCursor *)cursor)->current;
+  return SQLITE_OK;
+}
+
+static const sqlite3_module points_module = {
+  .xConnect = points_connect,
+  .xBestIndex = points_best_index,
+  .xDisconnect = points_disconnect,
+  .xOpen = points_open,
+  .xClose = points_close,
+  .xFilter = points_filter,
+  .xNext = points_next,
+  .xEof = points_eof,
+  .xColumn = points_column,
+  .xRowid = points_rowid,
+};
+
+void compact_register(sqlite3 *db) {
+  if (SQLITE_OK !=
+      sqlite3_create_module(db, "compact_points", &points_module, NULL))
+    errx(1, "Could not register compact_points");
+}
@@ -0,0 +1,30 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#pragma once
+
+#include <sqlite3.h>
+#include "track.h"
+
+/**
+ * Encodes a track as varints: the number of points, then for each point the
+ * difference from the previous one (the first from zero) of the timestamp and
+ * of the longitude and latitude in microdegrees, which is the precision shown
+ * by the dash cam. The blob is allocated and should be freed by the caller.
+ * Returns the blob size.
+ */
+int compact_encode(unsigned int count, const TrackPoint points[count],
+  unsigned char **blob);
+
+/**
+ * Decodes a track encoded by compact_encode. The points array is allocated and
+ * should be freed by the caller. Returns the number of points, or negative if
+ * the blob is invalid.
+ */
+int compact_decode(int size, const unsigned char blob[size],
+  TrackPoint **points);
+
+/**
+ * Registers compact_points, a table-valued function returning the timestamp,
+ * lon, and lat of each point of an encoded track:
+ *   SELECT p.* FROM compact_tracks AS t, compact_points(t.track) AS p;
+ */
+void compact_register(sqlite3 *db);
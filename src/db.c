@@ -4,6 +4,7 @@
 #include <sqlite3.h>
 #include <spatialite/gaiageo.h>
 #include <spatialite.h>
+#include "compact.h"
 #include "db.h"
 
 /* Abstracts SpatiaLite database operations. Any errors/unexpected return values
@@ -33,8 +34,15 @@ static void db_no_param(sqlite3 *db, const char* sql) {
     errx(1, "Could not execute query “%s”", sql);
 }
 
+/* How long to wait for another process writing the database, in ms. SQLite
+ * sleeps and retries with growing delays meanwhile. */
+static const int busy_timeout = 60000;
+
 void begin_transaction(sqlite3 *db, const char* description) {
-  if (SQLITE_OK != sqlite3_exec(db, "BEGIN TRANSACTION;", NULL, NULL, NULL))
+  /* Taking the write lock upfront: a deferred transaction failing to upgrade
+   * its lock returns busy at once instead of waiting. */
+  if (SQLITE_OK != sqlite3_exec(db, "BEGIN IMMEDIATE TRANSACTION;",
+      NULL, NULL, NULL))
     errx(1, "Could not begin %s transaction", description);
 }
 
@@ -49,10 +57,12 @@ SpatiaLite open_and_init_db(const char filename[]) {
 
   /* Initialize db and SpatiaLite. */
   if (SQLITE_OK != sqlite3_open_v2(filename, &db,
-    SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, NULL))
+    SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_URI, NULL))
     errx(1, "Unable to open database “%s”", filename);
+  sqlite3_busy_timeout(db, busy_timeout);
   spatialite = spatialite_alloc_connection();
   spatialite_init_ex(db, spatialite, false);
+  compact_register(db);
 
   /* Initializes the SpatiaLite schema/triggers. */
   db_no_param(db, "PRAGMA trusted_schema = 1;");
@@ -81,6 +91,196 @@ SpatiaLite open_and_init_db(const char filename[]) {
       errx(1, "Could not update to version 2");
     __attribute__((fallthrough));
     case 2:
+    /* Work journal, see journal.h. */
+    if (SQLITE_OK != sqlite3_exec(db,
+        "CREATE TABLE journal ("
+        "  filename STRING PRIMARY KEY,"
+        "  state INTEGER NOT NULL,"
+        "  lines BLOB"
+        ");"
+        "PRAGMA user_version = 3;",
+        NULL, NULL, NULL))
+      errx(1, "Could not update to version 3");
+    __attribute__((fallthrough));
+    case 3:
+    /* Trips with simplified tracks, see trips.h. */
+    if (SQLITE_OK != sqlite3_exec(db,
+        "CREATE TABLE trips ("
+        "  id INTEGER PRIMARY KEY,"
+        "  start_time INTEGER NOT NULL,"
+        "  end_time INTEGER NOT NULL,"
+        "  points INTEGER NOT NULL"
+        ");"
+        "CREATE INDEX trips_time ON trips(end_time, start_time);"
+        "SELECT AddGeometryColumn("
+        "  'trips', 'track_10m', 4326, 'LINESTRING', 'XY', 1);"
+        "SELECT CreateSpatialIndex('trips', 'track_10m');"
+        "SELECT AddGeometryColumn("
+        "  'trips', 'track_100m', 4326, 'LINESTRING', 'XY', 1);"
+        "SELECT CreateSpatialIndex('trips', 'track_100m');"
+        "SELECT AddGeometryColumn("
+        "  'trips', 'track_1000m', 4326, 'LINESTRING', 'XY', 1);"
+        "SELECT CreateSpatialIndex('trips', 'track_1000m');"
+        "PRAGMA user_version = 4;",
+        NULL, NULL, NULL))
+      errx(1, "Could not update to version 4");
+    __attribute__((fallthrough));
+    case 4:
+    /* Location counts per web map tile, see density.h. The view has the tile
+     * outlines, for displaying. */
+    if (SQLITE_OK != sqlite3_exec(db,
+        "CREATE TABLE density ("
+        "  zoom INTEGER NOT NULL,"
+        "  tile_x INTEGER NOT NULL,"
+        "  tile_y INTEGER NOT NULL,"
+        "  count INTEGER NOT NULL,"
+        "  PRIMARY KEY (zoom, tile_x, tile_y)"
+        ") WITHOUT ROWID;"
+        "CREATE VIEW density_cells AS SELECT zoom, tile_x, tile_y, count,"
+        "  BuildMbr("
+        "    tile_x * 360.0 / (1 << zoom) - 180,"
+        "    Degrees(2 * Atan(Exp(PI()"
+        "      * (1 - 2.0 * (tile_y + 1) / (1 << zoom)))) - PI() / 2),"
+        "    (tile_x + 1) * 360.0 / (1 << zoom) - 180,"
+        "    Degrees(2 * Atan(Exp(PI()"
+        "      * (1 - 2.0 * tile_y / (1 << zoom)))) - PI() / 2),"
+        "    4326) AS cell"
+        "  FROM density;"
+        "PRAGMA user_version = 5;",
+        NULL, NULL, NULL))
+      errx(1, "Could not update to version 5");
+    __attribute__((fallthrough));
+    case 5:
+    /* Stays (stopped or parked), see stays.h. */
+    if (SQLITE_OK != sqlite3_exec(db,
+        "CREATE TABLE stays ("
+        "  id INTEGER PRIMARY KEY,"
+        "  start_time INTEGER NOT NULL,"
+        "  end_time INTEGER NOT NULL,"
+        "  points INTEGER NOT NULL"
+        ");"
+        "CREATE INDEX stays_time ON stays(end_time, start_time);"
+        "SELECT AddGeometryColumn("
+        "  'stays', 'centroid', 4326, 'POINT', 'XY', 1);"
+        "SELECT CreateSpatialIndex('stays', 'centroid');"
+        "PRAGMA user_version = 6;",
+        NULL, NULL, NULL))
+      errx(1, "Could not update to version 6");
+    __attribute__((fallthrough));
+    case 6:
+    /* Compact tracks, one per video, see compact.h. The view decodes them to
+     * points, only on connections with compact_points registered. */
+    if (SQLITE_OK != sqlite3_exec(db,
+        "CREATE TABLE compact_tracks ("
+        "  id INTEGER PRIMARY KEY,"
+        "  filename STRING NOT NULL UNIQUE,"
+        "  start_time INTEGER NOT NULL,"
+        "  end_time INTEGER NOT NULL,"
+        "  points INTEGER NOT NULL,"
+        "  track BLOB NOT NULL"
+        ");"
+        "CREATE INDEX compact_tracks_time"
+        "  ON compact_tracks(end_time, start_time);"
+        "CREATE INDEX compact_tracks_start ON compact_tracks(start_time);"
+        "CREATE VIRTUAL TABLE compact_tracks_bbox USING rtree("
+        "  id, min_lon, max_lon, min_lat, max_lat"
+        ");"
+        "CREATE VIEW compact_locations AS"
+        "  SELECT p.timestamp AS timestamp,"
+        "    MakePoint(p.lon, p.lat, 4326) AS place"
+        "  FROM compact_tracks AS t, compact_points(t.track) AS p;"
+        "PRAGMA user_version = 7;",
+        NULL, NULL, NULL))
+      errx(1, "Could not update to version 7");
+    __attribute__((fallthrough));
+    case 7:
+    /* End time of the locations collapsed from a stationary run. */
+    if (SQLITE_OK != sqlite3_exec(db,
+        "CREATE TABLE stationary ("
+        "  timestamp INTEGER PRIMARY KEY,"
+        "  end_time INTEGER NOT NULL"
+        ");"
+        "CREATE INDEX stationary_end_time ON stationary(end_time);"
+        "PRAGMA user_version = 8;",
+        NULL, NULL, NULL))
+      errx(1, "Could not update to version 8");
+    __attribute__((fallthrough));
+    case 8:
+    /* Partitions listed in a catalog database, see partition.h. */
+    if (SQLITE_OK != sqlite3_exec(db,
+        "CREATE TABLE partitions ("
+        "  name STRING PRIMARY KEY,"
+        "  filename STRING NOT NULL,"
+        "  start_time INTEGER NOT NULL,"
+        "  end_time INTEGER NOT NULL,"
+        "  sealed INTEGER NOT NULL DEFAULT 0"
+        ");"
+        "PRAGMA user_version = 9;",
+        NULL, NULL, NULL))
+      errx(1, "Could not update to version 9");
+    __attribute__((fallthrough));
+    case 9:
+    /* Claims of workers sharing the journal, see journal.h. */
+    if (SQLITE_OK != sqlite3_exec(db,
+        "ALTER TABLE journal ADD COLUMN owner STRING;"
+        "ALTER TABLE journal ADD COLUMN lease_until INTEGER;"
+        "PRAGMA user_version = 10;",
+        NULL, NULL, NULL))
+      errx(1, "Could not update to version 10");
+    __attribute__((fallthrough));
+    case 10:
+    /* Content fingerprints of the videos, see ls.h. */
+    if (SQLITE_OK != sqlite3_exec(db,
+        "ALTER TABLE imported ADD COLUMN fingerprint STRING;"
+        "CREATE INDEX imported_fingerprint ON imported(fingerprint);"
+        "ALTER TABLE journal ADD COLUMN fingerprint STRING;"
+        "PRAGMA user_version = 11;",
+        NULL, NULL, NULL))
+      errx(1, "Could not update to version 11");
+    __attribute__((fallthrough));
+    case 11:
+    /* Order in which workers claim files, see schedule.h. */
+    if (SQLITE_OK != sqlite3_exec(db,
+        "ALTER TABLE journal ADD COLUMN priority INTEGER NOT NULL DEFAULT 0;"
+        "PRAGMA user_version = 12;",
+        NULL, NULL, NULL))
+      errx(1, "Could not update to version 12");
+    __attribute__((fallthrough));
+    case 12:
+    /* Catalogue of the videos, see output_data.h. The view has their outlines,
+     * for displaying. */
+    if (SQLITE_OK != sqlite3_exec(db,
+        "CREATE TABLE videos ("
+        "  id INTEGER PRIMARY KEY,"
+        "  filename STRING NOT NULL UNIQUE,"
+        "  path STRING,"
+        "  start_time INTEGER NOT NULL,"
+        "  end_time INTEGER NOT NULL,"
+        "  points INTEGER NOT NULL,"
+        "  first_pts INTEGER"
+        ");"
+        "CREATE INDEX videos_time ON videos(end_time, start_time);"
+        "CREATE VIRTUAL TABLE videos_bbox USING rtree("
+        "  id, min_lon, max_lon, min_lat, max_lat"
+        ");"
+        "CREATE VIEW video_outlines AS"
+        "  SELECT v.id AS id, filename, path, start_time, end_time, points,"
+        "    BuildMbr(b.min_lon, b.min_lat, b.max_lon, b.max_lat, 4326)"
+        "    AS outline"
+        "  FROM videos AS v JOIN videos_bbox AS b ON b.id = v.id;"
+        "PRAGMA user_version = 13;",
+        NULL, NULL, NULL))
+      errx(1, "Could not update to version 13");
+    __attribute__((fallthrough));
+    case 13:
+    /* Overlay time of the frame at first_pts, see output_data.h. */
+    if (SQLITE_OK != sqlite3_exec(db,
+        "ALTER TABLE videos ADD COLUMN pts_time INTEGER;"
+        "PRAGMA user_version = 14;",
+        NULL, NULL, NULL))
+      errx(1, "Could not update to version 14");
+    __attribute__((fallthrough));
+    case 14:
       break;
   }
   commit_transaction(db, "user_version");
@@ -20,7 +20,8 @@ typedef struct {
 SpatiaLite open_and_init_db(const char filename[]);
 
 /**
- * Issues a transaction, erroring with the description when it fails.
+ * Issues a transaction holding the write lock, waiting for other processes
+ * writing, and erroring with the description when it fails.
  */
 void begin_transaction(sqlite3 *db, const char* description);
 
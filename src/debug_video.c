@@ -18,7 +18,7 @@ int main(int argc, char* argv[]) {
   CharLine lines[301];
   int read_lines = get_video_strings(argv[1],
     sizeof(keys) - 1, glyphs,
-    sizeof(lines)/sizeof(CharLine), lines);
+    sizeof(lines)/sizeof(CharLine), lines, NULL);
   if (read_lines <= 0)
     errx(1, "Got %d lines", read_lines);
   if (lines_ok(argv[1], read_lines, lines))
@@ -7,3 +7,7 @@
 
 /* Expected video size. */
 #define EXPECTED_VIDEO_WIDTH 2560
+#define EXPECTED_VIDEO_HEIGHT 1440
+
+/* First frame row that contains string data. */
+#define TOP_DATA_ROW 1393
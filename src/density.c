@@ -0,0 +1,101 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#include <err.h>
+#include <stdlib.h>
+#include <sqlite3.h>
+#include "density.h"
+
+/* Keeps the density table: how many locations fall in each web map tile, for
+ * each zoom level. A heatmap of everything is then a read of a few rows instead
+ * of going through all the locations. Any database errors trigger errx().
+ */
+
+void density_add(DensityChanges *changes, double lon, double lat, int delta) {
+  if (changes->count + DENSITY_MAX_ZOOM + 1 > changes->allocated) {
+    changes->allocated = changes->allocated == 0
+      ? 64 * (DENSITY_MAX_ZOOM + 1)
+      : changes->allocated * 2;
+    changes->cells = reallocarray(changes->cells, changes->allocated,
+      sizeof(*changes->cells));
+    if (changes->cells == NULL)
+      errx(1, "Could not allocate %u density changes", changes->allocated);
+  }
+  for (unsigned int zoom = 0; zoom <= DENSITY_MAX_ZOOM; ++zoom) {
+    changes->cells[changes->count].tile = tile_at(lon, lat, zoom);
+    changes->cells[changes->count].delta = delta;
+    changes->count++;
+  }
+}
+
+/**
+ * Orders changes by tile so the ones on the same tile are adjacent.
+ */
+static int compare_changes(const void *a, const void *b) {
+  const Tile *x = a;
+  const Tile *y = b;
+  if (x->zoom != y->zoom)
+    return x->zoom < y->zoom ? -1 : 1;
+  if (x->x != y->x)
+    return x->x < y->x ? -1 : 1;
+  if (x->y != y->y)
+    return x->y < y->y ? -1 : 1;
+  return 0;
+}
+
+/**
+ * Resets the statement and binds the tile as its first three parameters.
+ */
+static void bind_tile(sqlite3_stmt *stmt, Tile tile) {
+  if (SQLITE_OK != sqlite3_reset(stmt))
+    errx(1, "Could not reset density statement");
+  if (SQLITE_OK != sqlite3_bind_int(stmt, 1, tile.zoom)
+    || SQLITE_OK != sqlite3_bind_int64(stmt, 2, tile.x)
+    || SQLITE_OK != sqlite3_bind_int64(stmt, 3, tile.y))
+    errx(1, "Could not bind density cell");
+}
+
+void density_write(sqlite3 *db, DensityChanges *changes) {
+  sqlite3_stmt *upsert, *prune;
+  const char upsert_sql[] =
+    "INSERT INTO density(zoom, tile_x, tile_y, count) VALUES (?, ?, ?, ?)"
+    "  ON CONFLICT(zoom, tile_x, tile_y)"
+    "  DO UPDATE SET count = count + excluded.count;";
+  const char prune_sql[] =
+    "DELETE FROM density"
+    "  WHERE zoom = ? AND tile_x = ? AND tile_y = ? AND count <= 0;";
+  if (SQLITE_OK != sqlite3_prepare_v2(db, upsert_sql, sizeof(upsert_sql),
+      &upsert, NULL)
+    || SQLITE_OK != sqlite3_prepare_v2(db, prune_sql, sizeof(prune_sql),
+      &prune, NULL))
+    errx(1, "Could not prepare density statements");
+
+  /* The tile is the first member, so changes compare as tiles. */
+  qsort(changes->cells, changes->count, sizeof(*changes->cells),
+    compare_changes);
+  for (unsigned int i = 0; i < changes->count;) {
+    Tile tile = changes->cells[i].tile;
+    int delta = 0;
+    for (; i < changes->count
+      && compare_changes(&changes->cells[i].tile, &tile) == 0; ++i)
+      delta += changes->cells[i].delta;
+    if (delta == 0)
+      continue;
+
+    bind_tile(upsert, tile);
+    if (SQLITE_OK != sqlite3_bind_int(upsert, 4, delta))
+      errx(1, "Could not bind density change");
+    if (SQLITE_DONE != sqlite3_step(upsert))
+      errx(1, "Could not update density cell");
+    /* Replaced locations may leave empty cells behind. */
+    if (delta < 0) {
+      bind_tile(prune, tile);
+      if (SQLITE_DONE != sqlite3_step(prune))
+        errx(1, "Could not prune density cell");
+    }
+  }
+
+  if (SQLITE_OK != sqlite3_finalize(upsert)
+    || SQLITE_OK != sqlite3_finalize(prune))
+    errx(1, "Could not finalize density statements");
+  free(changes->cells);
+  *changes = (DensityChanges){ 0 };
+}
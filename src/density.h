@@ -0,0 +1,33 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#pragma once
+
+#include <sqlite3.h>
+#include "tile.h"
+
+/* The density table has location counts for every zoom up to this one. */
+#define DENSITY_MAX_ZOOM 18
+
+/**
+ * Changes to the density counts, accumulated while writing locations so each
+ * cell is only updated once.
+ */
+typedef struct {
+  unsigned int count;
+  unsigned int allocated;
+  struct {
+    Tile tile;
+    int delta;
+  } *cells;
+} DensityChanges;
+
+/**
+ * Counts a location (delta 1) or discounts a replaced one (delta -1) on all the
+ * zoom levels.
+ */
+void density_add(DensityChanges *changes, double lon, double lat, int delta);
+
+/**
+ * Writes the accumulated changes to the density table and frees them. Should be
+ * called within the transaction writing the locations.
+ */
+void density_write(sqlite3 *db, DensityChanges *changes);
@@ -0,0 +1,90 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#include <err.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <spatialite/gaiageo.h>
+#include "db.h"
+#include "flatgeobuf.h"
+#include "track.h"
+
+static void add_location(TrackPoint point, void *writer) {
+  const double xy[] = { point.lon, point.lat };
+  const int64_t values[] = { point.timestamp };
+  fgb_add(writer, 1, xy, values);
+}
+
+/**
+ * Streams the locations, a point per second with its time, in one pass by
+ * timestamp.
+ */
+static void export_locations(sqlite3 *db, FgbWriter *writer) {
+  const FgbColumn columns[] = { { "time", FGB_DATETIME } };
+  fgb_begin(writer, "locations", FGB_POINT, 1, columns);
+  track_each(db, INT64_MIN, INT64_MAX, add_location, writer);
+}
+
+/**
+ * Streams the trips, simplified to 10 m, in start time order.
+ */
+static void export_trips(sqlite3 *db, FgbWriter *writer) {
+  const FgbColumn columns[] = {
+    { "start_time", FGB_DATETIME },
+    { "end_time", FGB_DATETIME },
+    { "points", FGB_LONG },
+  };
+  fgb_begin(writer, "trips", FGB_LINESTRING, 3, columns);
+  const char query[] =
+    "SELECT start_time, end_time, points, track_10m FROM trips"
+    "  ORDER BY start_time;";
+  sqlite3_stmt *stmt;
+  if (SQLITE_OK != sqlite3_prepare_v2(db, query, sizeof(query), &stmt, NULL))
+    errx(1, "Could not prepare trips export statement");
+  int step;
+  while (SQLITE_ROW == (step = sqlite3_step(stmt))) {
+    gaiaGeomCollPtr geo = gaiaFromSpatiaLiteBlobWkb(
+      sqlite3_column_blob(stmt, 3), sqlite3_column_bytes(stmt, 3));
+    if (geo == NULL || geo->FirstLinestring == NULL)
+      errx(1, "Invalid trip track");
+    const int64_t values[] = {
+      sqlite3_column_int64(stmt, 0),
+      sqlite3_column_int64(stmt, 1),
+      sqlite3_column_int64(stmt, 2),
+    };
+    fgb_add(writer, geo->FirstLinestring->Points,
+      geo->FirstLinestring->Coords, values);
+    gaiaFreeGeomColl(geo);
+  }
+  if (SQLITE_DONE != step)
+    errx(1, "Could not step trips export statement");
+  if (SQLITE_OK != sqlite3_finalize(stmt))
+    errx(1, "Could not finalize trips export statement");
+}
+
+/**
+ * export_fgb: writes the locations or the trips of a database to a FlatGeobuf
+ * file, with its spatial index, for serving as a static file.
+ *
+ * Usage: export_fgb database file.fgb [locations|trips]
+ */
+int main(int argc, char* argv[]) {
+  if (argc != 3 && argc != 4)
+    errx(1, "Usage: %s database file.fgb [locations|trips]", argv[0]);
+  const char *layer = argc == 4 ? argv[3] : "locations";
+  if (strcmp(layer, "locations") != 0 && strcmp(layer, "trips") != 0)
+    errx(1, "Unknown layer “%s”, expected locations or trips", layer);
+
+  SpatiaLite sp = open_and_init_db(argv[1]);
+  FgbWriter writer;
+  if (strcmp(layer, "trips") == 0)
+    export_trips(sp.db, &writer);
+  else
+    export_locations(sp.db, &writer);
+  close_db(sp);
+  size_t count = writer.count;
+  if (!fgb_finish(&writer, argv[2]))
+    return 1;
+  printf("Exported %zu %s\n", count, layer);
+  return 0;
+}
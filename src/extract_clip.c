@@ -0,0 +1,65 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#define _XOPEN_SOURCE 700
+#include <err.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "arguments.h"
+#include "clip.h"
+#include "db.h"
+#include "partition.h"
+
+/**
+ * extract_clip: copies the footage of a time range, or of passing by a place,
+ * from the catalogued videos into one file, without re-encoding it.
+ *
+ * Usage:
+ *   extract_clip range database output from to  footage between the times
+ *   extract_clip near database output lon lat [meters]  footage near the place
+ */
+int main(int argc, char* argv[]) {
+  if (argc < 6)
+    errx(1, "Usage: %s range|near database output ...", argv[0]);
+  const char *command = argv[1];
+  ClipSegment *segments;
+  int count;
+  SpatiaLite sp = open_and_init_db(argv[2]);
+  /* A catalog reads the videos of its partitions, see partition.h. */
+  PartitionPeriod period;
+  const bool partitioned = partition_period(sp.db, &period);
+  if (strcmp(command, "range") == 0 && argc == 6) {
+    time_t from = argument_time(argv[4]), to = argument_time(argv[5]);
+    if (partitioned)
+      partition_attach(sp.db, from, to);
+    count = clip_find_range(sp.db, from, to, &segments);
+  }
+  else if (strcmp(command, "near") == 0 && (argc == 6 || argc == 7)) {
+    double radius = argc == 7 ? argument_double(argv[6]) : 50;
+    if (!(radius > 0))
+      errx(1, "Invalid radius “%s”", argv[6]);
+    if (partitioned)
+      partition_attach(sp.db, INT64_MIN, INT64_MAX);
+    count = clip_find_near(sp.db, argument_double(argv[4]),
+      argument_double(argv[5]), radius, &segments);
+  }
+  else {
+    errx(1, "Usage: %s range|near database output ...", argv[0]);
+  }
+  close_db(sp);
+  if (count == 0)
+    errx(1, "No catalogued video matches");
+
+  for (int i = 0; i < count; ++i) {
+    struct tm time;
+    char text[sizeof("YYYY-MM-DD hh:mm:ss")];
+    strftime(text, sizeof(text), "%Y-%m-%d %H:%M:%S",
+      localtime_r(&segments[i].from, &time));
+    printf("%s\t%s\t%jd s\n", segments[i].path, text,
+      (intmax_t)(segments[i].to - segments[i].from + 1));
+  }
+  bool written = clip_write(argv[3], count, segments);
+  clip_free(count, segments);
+  return written ? 0 : 1;
+}
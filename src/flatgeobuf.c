@@ -0,0 +1,419 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#include <err.h>
+#include <float.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "flatgeobuf.h"
+#include "point_index.h"
+
+/* FlatGeobuf and FlatBuffers are little-endian, written here as in memory. */
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "FlatGeobuf export needs a little-endian host"
+#endif
+
+static const unsigned char MAGIC[8] = { 'f', 'g', 'b', 3, 'f', 'g', 'b', 0 };
+
+/* Most fields of the tables written here (Header). */
+#define MAX_FIELDS 11
+
+/* Date time attributes, as ISO 8601 UTC. */
+#define DATETIME_FORMAT "%Y-%m-%dT%H:%M:%SZ"
+#define DATETIME_LENGTH (sizeof("YYYY-MM-DDThh:mm:ssZ") - 1)
+
+/**
+ * Node of the packed R-tree as in the file: the box and, for leaves, the offset
+ * of the feature, or else the position of the first child node.
+ */
+typedef struct {
+  double min_x;
+  double min_y;
+  double max_x;
+  double max_y;
+  uint64_t offset;
+} Node;
+
+/**
+ * Reserves size zeroed bytes at the end of the buffer, after padding so that
+ * the byte after the first prefix bytes is aligned. Returns their position.
+ */
+static size_t fb_allocate(FlatBuffer *buffer, size_t size, size_t align,
+  size_t prefix) {
+  size_t position = buffer->size;
+  position += (align - (position + prefix) % align) % align;
+  if (position + size > buffer->allocated) {
+    size_t allocated = buffer->allocated > 0 ? buffer->allocated : 256;
+    while (allocated < position + size)
+      allocated *= 2;
+    buffer->data = realloc(buffer->data, allocated);
+    if (buffer->data == NULL)
+      errx(1, "Could not allocate %zu bytes for a feature", allocated);
+    buffer->allocated = allocated;
+  }
+  memset(buffer->data + buffer->size, 0, position + size - buffer->size);
+  buffer->size = position + size;
+  return position;
+}
+
+static void fb_set(FlatBuffer *buffer, size_t position, const void *value,
+  size_t size) {
+  memcpy(buffer->data + position, value, size);
+}
+
+/**
+ * Points the offset field to an object written after it.
+ */
+static void fb_offset(FlatBuffer *buffer, size_t field, size_t target) {
+  uint32_t offset = target - field;
+  fb_set(buffer, field, &offset, sizeof(offset));
+}
+
+/**
+ * Adds a table preceded by its vtable, with fields of the given sizes (0 for
+ * absent ones), largest first so they’re aligned. Sets the position of each
+ * field and returns the position of the table.
+ */
+static size_t fb_table(FlatBuffer *buffer, unsigned int count,
+  const uint8_t sizes[count], size_t fields[count]) {
+  uint16_t vtable[2 + MAX_FIELDS] = { (2 + count) * sizeof(uint16_t) };
+  uint16_t end = sizeof(int32_t);
+  size_t align = sizeof(int32_t);
+  for (unsigned int size = 8; size > 0; size /= 2) {
+    for (unsigned int i = 0; i < count; ++i) {
+      if (sizes[i] != size)
+        continue;
+      end = (end + size - 1) / size * size;
+      vtable[2 + i] = end;
+      end += size;
+      if (size > align)
+        align = size;
+    }
+  }
+  vtable[1] = end;
+
+  size_t vtable_position = fb_allocate(buffer, vtable[0], sizeof(uint16_t), 0);
+  fb_set(buffer, vtable_position, vtable, vtable[0]);
+  size_t table = fb_allocate(buffer, end, align, 0);
+  int32_t to_vtable = table - vtable_position;
+  fb_set(buffer, table, &to_vtable, sizeof(to_vtable));
+  for (unsigned int i = 0; i < count; ++i)
+    fields[i] = table + vtable[2 + i];
+  return table;
+}
+
+/**
+ * Adds a vector of scalars. Returns its position.
+ */
+static size_t fb_vector(FlatBuffer *buffer, uint32_t count, size_t size,
+  const void *elements) {
+  size_t position = fb_allocate(buffer, sizeof(count) + count * size,
+    size > sizeof(count) ? size : sizeof(count), sizeof(count));
+  fb_set(buffer, position, &count, sizeof(count));
+  fb_set(buffer, position + sizeof(count), elements, count * size);
+  return position;
+}
+
+/**
+ * Adds a string, which is a vector of characters ending with a NUL.
+ */
+static size_t fb_string(FlatBuffer *buffer, const char text[]) {
+  uint32_t length = strlen(text);
+  size_t position = fb_allocate(buffer, sizeof(length) + length + 1,
+    sizeof(length), 0);
+  fb_set(buffer, position, &length, sizeof(length));
+  fb_set(buffer, position + sizeof(length), text, length);
+  return position;
+}
+
+void fgb_begin(FgbWriter *writer, const char name[],
+  FgbGeometryType geometry_type, unsigned int column_count,
+  const FgbColumn columns[column_count]) {
+  if (column_count > FGB_MAX_COLUMNS)
+    errx(1, "Too many columns for FlatGeobuf: %u", column_count);
+  *writer = (FgbWriter){
+    .name = name,
+    .geometry_type = geometry_type,
+    .column_count = column_count,
+    .features = tmpfile(),
+    .features_size = 0,
+    .count = 0,
+    .allocated = 1024,
+    .items = reallocarray(NULL, 1024, sizeof(FgbItem)),
+  };
+  for (unsigned int i = 0; i < column_count; ++i)
+    writer->columns[i] = columns[i];
+  if (writer->features == NULL)
+    err(1, "Could not create temporary file for features");
+  if (writer->items == NULL)
+    errx(1, "Could not allocate %zu features", writer->allocated);
+}
+
+/**
+ * Encodes the attributes as FlatGeobuf properties: each one is the column
+ * number followed by the value. Returns their size.
+ */
+static size_t encode_properties(const FgbWriter *writer,
+  const int64_t values[],
+  unsigned char properties[FGB_MAX_COLUMNS * (2 + 4 + DATETIME_LENGTH + 1)]) {
+  size_t size = 0;
+  for (uint16_t column = 0; column < writer->column_count; ++column) {
+    memcpy(properties + size, &column, sizeof(column));
+    size += sizeof(column);
+    if (writer->columns[column].type == FGB_LONG) {
+      memcpy(properties + size, &values[column], sizeof(int64_t));
+      size += sizeof(int64_t);
+      continue;
+    }
+    time_t timestamp = values[column];
+    struct tm time;
+    char text[DATETIME_LENGTH + 1];
+    uint32_t length = strftime(text, sizeof(text), DATETIME_FORMAT,
+      gmtime_r(&timestamp, &time));
+    memcpy(properties + size, &length, sizeof(length));
+    memcpy(properties + size + sizeof(length), text, length);
+    size += sizeof(length) + length;
+  }
+  return size;
+}
+
+void fgb_add(FgbWriter *writer, size_t vertices,
+  const double xy[2 * vertices], const int64_t values[]) {
+  if (writer->count == writer->allocated) {
+    writer->allocated *= 2;
+    writer->items = reallocarray(writer->items, writer->allocated,
+      sizeof(FgbItem));
+    if (writer->items == NULL)
+      errx(1, "Could not allocate %zu features", writer->allocated);
+  }
+  FgbItem *item = &writer->items[writer->count++];
+  *item = (FgbItem){
+    .min_x = DBL_MAX, .min_y = DBL_MAX, .max_x = -DBL_MAX, .max_y = -DBL_MAX,
+  };
+  for (size_t i = 0; i < vertices; ++i) {
+    item->min_x = xy[2 * i] < item->min_x ? xy[2 * i] : item->min_x;
+    item->max_x = xy[2 * i] > item->max_x ? xy[2 * i] : item->max_x;
+    item->min_y = xy[2 * i + 1] < item->min_y ? xy[2 * i + 1] : item->min_y;
+    item->max_y = xy[2 * i + 1] > item->max_y ? xy[2 * i + 1] : item->max_y;
+  }
+
+  /* Feature { geometry: Geometry { xy, type }, properties }. */
+  FlatBuffer *buffer = &writer->buffer;
+  buffer->size = 0;
+  size_t root = fb_allocate(buffer, sizeof(uint32_t), 4, 0);
+  size_t feature_fields[2];
+  fb_offset(buffer, root,
+    fb_table(buffer, 2, (const uint8_t[]){ 4, 4 }, feature_fields));
+  size_t geometry_fields[7];
+  fb_offset(buffer, feature_fields[0], fb_table(buffer, 7,
+      (const uint8_t[]){ 0, 4, 0, 0, 0, 0, 1 }, geometry_fields));
+  const uint8_t type = writer->geometry_type;
+  fb_set(buffer, geometry_fields[6], &type, sizeof(type));
+  fb_offset(buffer, geometry_fields[1],
+    fb_vector(buffer, 2 * vertices, sizeof(double), xy));
+  unsigned char properties[FGB_MAX_COLUMNS * (2 + 4 + DATETIME_LENGTH + 1)];
+  size_t properties_size = encode_properties(writer, values, properties);
+  fb_offset(buffer, feature_fields[1],
+    fb_vector(buffer, properties_size, 1, properties));
+
+  /* Written with its size in front. */
+  const uint32_t size = buffer->size;
+  item->offset = writer->features_size;
+  item->size = sizeof(size) + size;
+  if (fwrite(&size, sizeof(size), 1, writer->features) != 1
+    || fwrite(buffer->data, size, 1, writer->features) != 1)
+    err(1, "Could not write features to temporary file");
+  writer->features_size += item->size;
+}
+
+/**
+ * Writes the header: Header { name, envelope, geometry_type, columns,
+ * features_count, index_node_size, crs: Crs { code } }.
+ */
+static bool write_header(FgbWriter *writer, FILE *file,
+  const double envelope[4]) {
+  FlatBuffer *buffer = &writer->buffer;
+  buffer->size = 0;
+  size_t root = fb_allocate(buffer, sizeof(uint32_t), 4, 0);
+  size_t fields[MAX_FIELDS];
+  fb_offset(buffer, root, fb_table(buffer, MAX_FIELDS,
+      (const uint8_t[]){ 4, 4, 1, 0, 0, 0, 0, 4, 8, 2, 4 }, fields));
+  const uint8_t geometry_type = writer->geometry_type;
+  fb_set(buffer, fields[2], &geometry_type, sizeof(geometry_type));
+  const uint64_t features_count = writer->count;
+  fb_set(buffer, fields[8], &features_count, sizeof(features_count));
+  const uint16_t node_size = writer->count > 0 ? FGB_NODE_SIZE : 0;
+  fb_set(buffer, fields[9], &node_size, sizeof(node_size));
+  fb_offset(buffer, fields[0], fb_string(buffer, writer->name));
+  if (writer->count > 0)
+    fb_offset(buffer, fields[1], fb_vector(buffer, 4, sizeof(double),
+        envelope));
+
+  /* Column { name, type } tables, after the vector pointing to them. */
+  uint32_t offsets[FGB_MAX_COLUMNS] = { 0 };
+  size_t columns = fb_vector(buffer, writer->column_count, sizeof(uint32_t),
+    offsets);
+  fb_offset(buffer, fields[7], columns);
+  for (unsigned int i = 0; i < writer->column_count; ++i) {
+    size_t column_fields[2];
+    fb_offset(buffer, columns + sizeof(uint32_t) * (1 + i), fb_table(buffer, 2,
+        (const uint8_t[]){ 4, 1 }, column_fields));
+    const uint8_t type = writer->columns[i].type;
+    fb_set(buffer, column_fields[1], &type, sizeof(type));
+    fb_offset(buffer, column_fields[0],
+      fb_string(buffer, writer->columns[i].name));
+  }
+
+  size_t crs_fields[2];
+  fb_offset(buffer, fields[10], fb_table(buffer, 2,
+      (const uint8_t[]){ 0, 4 }, crs_fields));
+  const int32_t code = 4326;
+  fb_set(buffer, crs_fields[1], &code, sizeof(code));
+
+  const uint32_t size = buffer->size;
+  return fwrite(MAGIC, sizeof(MAGIC), 1, file) == 1
+    && fwrite(&size, sizeof(size), 1, file) == 1
+    && fwrite(buffer->data, size, 1, file) == 1;
+}
+
+static int compare_items(const void *a, const void *b) {
+  const FgbItem *item_a = a, *item_b = b;
+  if (item_a->hilbert != item_b->hilbert)
+    return item_a->hilbert < item_b->hilbert ? -1 : 1;
+  return item_a->offset < item_b->offset ? -1 : item_a->offset > item_b->offset;
+}
+
+/**
+ * Grows the node to include another.
+ */
+static void extend(Node *node, const Node *other) {
+  node->min_x = other->min_x < node->min_x ? other->min_x : node->min_x;
+  node->min_y = other->min_y < node->min_y ? other->min_y : node->min_y;
+  node->max_x = other->max_x > node->max_x ? other->max_x : node->max_x;
+  node->max_y = other->max_y > node->max_y ? other->max_y : node->max_y;
+}
+
+/**
+ * Builds the packed R-tree over the items, sorted, and sets their offsets in
+ * the file. The levels go from the root down to the leaves, as FlatGeobuf
+ * expects. Sets the number of nodes and returns them.
+ */
+static Node *build_tree(FgbWriter *writer, size_t *node_count) {
+  /* Level sizes from the leaves up, the same way readers compute them. */
+  size_t level_sizes[64];
+  unsigned int levels = 0;
+  size_t total = writer->count;
+  size_t level_nodes = writer->count;
+  level_sizes[levels++] = level_nodes;
+  do {
+    level_nodes = (level_nodes + FGB_NODE_SIZE - 1) / FGB_NODE_SIZE;
+    level_sizes[levels++] = level_nodes;
+    total += level_nodes;
+  } while (level_nodes != 1);
+  size_t level_starts[64];
+  size_t level_end = total;
+  for (unsigned int level = 0; level < levels; ++level) {
+    level_end -= level_sizes[level];
+    level_starts[level] = level_end;
+  }
+
+  Node *nodes = reallocarray(NULL, total, sizeof(Node));
+  if (nodes == NULL)
+    errx(1, "Could not allocate %zu index nodes", total);
+  uint64_t offset = 0;
+  for (size_t i = 0; i < writer->count; ++i) {
+    const FgbItem *item = &writer->items[i];
+    nodes[level_starts[0] + i] = (Node){
+      item->min_x, item->min_y, item->max_x, item->max_y, offset,
+    };
+    offset += item->size;
+  }
+  for (unsigned int level = 0; level + 1 < levels; ++level) {
+    size_t child = level_starts[level];
+    size_t end = child + level_sizes[level];
+    for (size_t parent = level_starts[level + 1]; child < end; ++parent) {
+      nodes[parent] = (Node){ DBL_MAX, DBL_MAX, -DBL_MAX, -DBL_MAX, child };
+      for (unsigned int i = 0; i < FGB_NODE_SIZE && child < end; ++i)
+        extend(&nodes[parent], &nodes[child++]);
+    }
+  }
+  *node_count = total;
+  return nodes;
+}
+
+/**
+ * Copies the features from the temporary file in the sorted order.
+ */
+static bool copy_features(FgbWriter *writer, FILE *file) {
+  unsigned char *feature = NULL;
+  size_t allocated = 0;
+  bool ret = true;
+  for (size_t i = 0; ret && i < writer->count; ++i) {
+    const FgbItem *item = &writer->items[i];
+    if (item->size > allocated) {
+      allocated = item->size;
+      free(feature);
+      feature = malloc(allocated);
+      if (feature == NULL)
+        errx(1, "Could not allocate %zu bytes for a feature", allocated);
+    }
+    ret = 0 == fseeko(writer->features, item->offset, SEEK_SET)
+      && fread(feature, item->size, 1, writer->features) == 1
+      && fwrite(feature, item->size, 1, file) == 1;
+  }
+  free(feature);
+  return ret;
+}
+
+bool fgb_finish(FgbWriter *writer, const char filename[]) {
+  double envelope[4] = { DBL_MAX, DBL_MAX, -DBL_MAX, -DBL_MAX };
+  for (size_t i = 0; i < writer->count; ++i) {
+    const FgbItem *item = &writer->items[i];
+    envelope[0] = item->min_x < envelope[0] ? item->min_x : envelope[0];
+    envelope[1] = item->min_y < envelope[1] ? item->min_y : envelope[1];
+    envelope[2] = item->max_x > envelope[2] ? item->max_x : envelope[2];
+    envelope[3] = item->max_y > envelope[3] ? item->max_y : envelope[3];
+  }
+
+  /* Hilbert curve order of the box centers, so nearby features share nodes. */
+  const double width = envelope[2] - envelope[0];
+  const double height = envelope[3] - envelope[1];
+  for (size_t i = 0; i < writer->count; ++i) {
+    FgbItem *item = &writer->items[i];
+    item->hilbert = point_index_hilbert(
+      width > 0 ? ((item->min_x + item->max_x) / 2 - envelope[0]) / width
+        * 65535 : 0,
+      height > 0 ? ((item->min_y + item->max_y) / 2 - envelope[1]) / height
+        * 65535 : 0);
+  }
+  qsort(writer->items, writer->count, sizeof(FgbItem), compare_items);
+  size_t node_count = 0;
+  Node *nodes = writer->count > 0 ? build_tree(writer, &node_count) : NULL;
+
+  /* Written aside and renamed over, so readers never see half a file. */
+  char *temporary = malloc(strlen(filename) + sizeof(".tmp"));
+  if (temporary == NULL)
+    errx(1, "Could not allocate FlatGeobuf file name");
+  strcpy(temporary, filename);
+  strcat(temporary, ".tmp");
+  FILE *file = fopen(temporary, "wb");
+  bool ret = file != NULL
+    && write_header(writer, file, envelope)
+    && (node_count == 0
+      || fwrite(nodes, sizeof(Node), node_count, file) == node_count)
+    && copy_features(writer, file);
+  if (file != NULL && 0 != fclose(file))
+    ret = false;
+  if (ret && 0 != rename(temporary, filename))
+    ret = false;
+  if (!ret) {
+    warn("Could not write FlatGeobuf “%s”", filename);
+    unlink(temporary);
+  }
+  free(temporary);
+  free(nodes);
+  fclose(writer->features);
+  free(writer->items);
+  free(writer->buffer.data);
+  return ret;
+}
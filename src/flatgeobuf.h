@@ -0,0 +1,98 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* Children per node of the packed R-tree, FlatGeobuf’s default. */
+#define FGB_NODE_SIZE 16
+
+/* Most attribute columns a layer can have. */
+#define FGB_MAX_COLUMNS 8
+
+/**
+ * Geometry types used here, numbered as in FlatGeobuf.
+ */
+typedef enum {
+  FGB_POINT = 1,
+  FGB_LINESTRING = 2,
+} FgbGeometryType;
+
+/**
+ * Attribute types used here, numbered as in FlatGeobuf. Both are given as
+ * int64_t, date times as Unix time.
+ */
+typedef enum {
+  FGB_LONG = 7,
+  FGB_DATETIME = 13,
+} FgbColumnType;
+
+typedef struct {
+  const char *name;
+  FgbColumnType type;
+} FgbColumn;
+
+/**
+ * A growing buffer where FlatBuffers tables are laid out front to back.
+ */
+typedef struct {
+  unsigned char *data;
+  size_t size;
+  size_t allocated;
+} FlatBuffer;
+
+/**
+ * Where a feature went in the temporary file, with its bounding box and its
+ * position along the Hilbert curve once all are known.
+ */
+typedef struct {
+  double min_x;
+  double min_y;
+  double max_x;
+  double max_y;
+  uint64_t offset;
+  uint32_t size;
+  uint32_t hilbert;
+} FgbItem;
+
+/**
+ * A FlatGeobuf file being written. Features are encoded as they come into a
+ * temporary file, and only their bounding boxes are kept in memory until the
+ * index is built.
+ */
+typedef struct {
+  const char *name;
+  FgbGeometryType geometry_type;
+  unsigned int column_count;
+  FgbColumn columns[FGB_MAX_COLUMNS];
+  FILE *features;
+  uint64_t features_size;
+  size_t count;
+  size_t allocated;
+  FgbItem *items;
+  FlatBuffer buffer;
+} FgbWriter;
+
+/**
+ * Starts a layer of the geometry type, with the attribute columns, in WGS 84.
+ * Features go in a temporary file; exits if it can’t be created.
+ */
+void fgb_begin(FgbWriter *writer, const char name[],
+  FgbGeometryType geometry_type, unsigned int column_count,
+  const FgbColumn columns[column_count]);
+
+/**
+ * Adds a feature: a point (vertices 1) or a linestring, its coordinates as
+ * lon, lat pairs, and a value for each column.
+ */
+void fgb_add(FgbWriter *writer, size_t vertices,
+  const double xy[2 * vertices], const int64_t values[]);
+
+/**
+ * Writes the file: the header, the packed Hilbert R-tree, and the features in
+ * the tree order. The file is replaced atomically. Frees the writer. Returns
+ * false with a warning if it can’t be written.
+ */
+bool fgb_finish(FgbWriter *writer, const char filename[]);
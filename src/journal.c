@@ -0,0 +1,221 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#include <err.h>
+#include <string.h>
+#include <sqlite3.h>
+#include "db.h"
+#include "journal.h"
+
+/* Keeps track of each video file through the ingest, so an interrupted run can
+ * resume without decoding again the files already read, and a file that fails
+ * doesn’t stop the others. Workers claim files with a lease: one that dies
+ * holding a file only delays it until the lease expires. Any database errors
+ * trigger errx().
+ */
+
+/**
+ * Prepares a statement and binds the filename as the first parameter.
+ */
+static sqlite3_stmt *prepare_for_file(sqlite3 *db, const char sql[],
+  const char filename[]) {
+  sqlite3_stmt *stmt;
+  if (SQLITE_OK != sqlite3_prepare_v2(db, sql, -1, &stmt, NULL))
+    errx(1, "Could not prepare journal statement “%s”", sql);
+  if (SQLITE_OK != sqlite3_bind_text(stmt, 1, filename, -1, SQLITE_TRANSIENT))
+    errx(1, "Could not bind journal file name “%s”", filename);
+  return stmt;
+}
+
+/**
+ * Steps a statement that doesn’t return rows and finalizes it.
+ */
+static void step_and_finalize(sqlite3_stmt *stmt) {
+  if (SQLITE_DONE != sqlite3_step(stmt))
+    errx(1, "Could not step journal statement");
+  if (SQLITE_OK != sqlite3_finalize(stmt))
+    errx(1, "Could not finalize journal statement");
+}
+
+void journal_queue(sqlite3 *db, const char filename[]) {
+  sqlite3_stmt *stmt = prepare_for_file(db,
+    "INSERT INTO journal(filename, state) VALUES (?1, ?2)"
+    "  ON CONFLICT(filename) DO UPDATE SET state = ?2, lines = NULL"
+    "  WHERE state <> ?3 AND (lease_until IS NULL"
+    "    OR lease_until <= CAST(strftime('%s', 'now') AS INTEGER));",
+    filename);
+  if (SQLITE_OK != sqlite3_bind_int(stmt, 2, JOURNAL_QUEUED)
+    || SQLITE_OK != sqlite3_bind_int(stmt, 3, JOURNAL_DECODED))
+    errx(1, "Could not bind journal states");
+  step_and_finalize(stmt);
+}
+
+void journal_set_fingerprint(sqlite3 *db, const char filename[],
+  const char fingerprint[]) {
+  sqlite3_stmt *stmt = prepare_for_file(db,
+    "UPDATE journal SET fingerprint = ?2 WHERE filename = ?1;", filename);
+  if (SQLITE_OK != sqlite3_bind_text(stmt, 2, fingerprint, -1,
+      SQLITE_TRANSIENT))
+    errx(1, "Could not bind journal fingerprint");
+  step_and_finalize(stmt);
+}
+
+void journal_set_priority(sqlite3 *db, const char filename[],
+  int64_t priority) {
+  sqlite3_stmt *stmt = prepare_for_file(db,
+    "UPDATE journal SET priority = ?2 WHERE filename = ?1;", filename);
+  if (SQLITE_OK != sqlite3_bind_int64(stmt, 2, priority))
+    errx(1, "Could not bind journal priority");
+  step_and_finalize(stmt);
+}
+
+JournalState journal_state(sqlite3 *db, const char filename[]) {
+  sqlite3_stmt *stmt = prepare_for_file(db,
+    "SELECT state FROM journal WHERE filename = ?1;", filename);
+  JournalState ret = JOURNAL_ABSENT;
+  switch (sqlite3_step(stmt)) {
+    case SQLITE_ROW:
+      ret = sqlite3_column_int(stmt, 0);
+      break;
+    case SQLITE_DONE:
+      break;
+    default:
+      errx(1, "Could not read journal state of “%s”", filename);
+  }
+  if (SQLITE_OK != sqlite3_finalize(stmt))
+    errx(1, "Could not finalize journal statement");
+  return ret;
+}
+
+void journal_set_state(sqlite3 *db, const char filename[], JournalState state)
+{
+  sqlite3_stmt *stmt = prepare_for_file(db,
+    "UPDATE journal SET state = ?2 WHERE filename = ?1;", filename);
+  if (SQLITE_OK != sqlite3_bind_int(stmt, 2, state))
+    errx(1, "Could not bind journal state");
+  step_and_finalize(stmt);
+}
+
+void journal_store_lines(sqlite3 *db, const char filename[],
+  unsigned int count, const CharLine lines[count]) {
+  sqlite3_stmt *stmt = prepare_for_file(db,
+    "UPDATE journal SET state = ?2, lines = ?3 WHERE filename = ?1;",
+    filename);
+  if (SQLITE_OK != sqlite3_bind_int(stmt, 2, JOURNAL_DECODED))
+    errx(1, "Could not bind journal state");
+  /* CharLine is plain fixed-size characters, stored as is. */
+  if (SQLITE_OK != sqlite3_bind_blob(stmt, 3, lines, count * sizeof(CharLine),
+      SQLITE_STATIC))
+    errx(1, "Could not bind journal lines");
+  step_and_finalize(stmt);
+}
+
+int journal_load_lines(sqlite3 *db, const char filename[],
+  unsigned int count, CharLine lines[count]) {
+  sqlite3_stmt *stmt = prepare_for_file(db,
+    "SELECT lines FROM journal WHERE filename = ?1 AND state = ?2;", filename);
+  if (SQLITE_OK != sqlite3_bind_int(stmt, 2, JOURNAL_DECODED))
+    errx(1, "Could not bind journal state");
+  int ret = -1;
+  if (SQLITE_ROW == sqlite3_step(stmt)) {
+    const void *blob = sqlite3_column_blob(stmt, 0);
+    int size = sqlite3_column_bytes(stmt, 0);
+    if (blob != NULL && size % sizeof(CharLine) == 0
+      && size / sizeof(CharLine) <= count) {
+      memcpy(lines, blob, size);
+      ret = size / sizeof(CharLine);
+    }
+  }
+  if (SQLITE_OK != sqlite3_finalize(stmt))
+    errx(1, "Could not finalize journal statement");
+  return ret;
+}
+
+void journal_commit(sqlite3 *db, const char filename[]) {
+  sqlite3_stmt *stmt = prepare_for_file(db,
+    "UPDATE journal SET state = ?2, lines = NULL WHERE filename = ?1;",
+    filename);
+  if (SQLITE_OK != sqlite3_bind_int(stmt, 2, JOURNAL_COMMITTED))
+    errx(1, "Could not bind journal state");
+  step_and_finalize(stmt);
+}
+
+unsigned int journal_queued(sqlite3 *db, time_t now) {
+  sqlite3_stmt *stmt;
+  const char count[] =
+    "SELECT count(*) FROM journal"
+    "  WHERE state IN (?1, ?2, ?3)"
+    "  AND (lease_until IS NULL OR lease_until <= ?4)"
+    "  AND filename NOT IN (SELECT filename FROM imported);";
+  if (SQLITE_OK != sqlite3_prepare_v2(db, count, sizeof(count), &stmt, NULL))
+    errx(1, "Could not prepare journal statement “%s”", count);
+  if (SQLITE_OK != sqlite3_bind_int(stmt, 1, JOURNAL_QUEUED)
+    || SQLITE_OK != sqlite3_bind_int(stmt, 2, JOURNAL_DECODING)
+    || SQLITE_OK != sqlite3_bind_int(stmt, 3, JOURNAL_DECODED)
+    || SQLITE_OK != sqlite3_bind_int64(stmt, 4, now))
+    errx(1, "Could not bind journal queue count");
+  if (SQLITE_ROW != sqlite3_step(stmt))
+    errx(1, "Could not count the journal queue");
+  unsigned int queued = sqlite3_column_int(stmt, 0);
+  if (SQLITE_OK != sqlite3_finalize(stmt))
+    errx(1, "Could not finalize journal statement");
+  return queued;
+}
+
+bool journal_claim(sqlite3 *db, const char owner[], time_t now,
+  unsigned int lease_seconds, size_t size, char filename[size]) {
+  begin_transaction(db, "journal claim");
+  sqlite3_stmt *stmt;
+  const char select[] =
+    "SELECT filename FROM journal"
+    "  WHERE state IN (?1, ?2, ?3)"
+    "  AND (lease_until IS NULL OR lease_until <= ?4)"
+    "  AND filename NOT IN (SELECT filename FROM imported)"
+    "  ORDER BY priority DESC, filename LIMIT 1;";
+  if (SQLITE_OK != sqlite3_prepare_v2(db, select, -1, &stmt, NULL))
+    errx(1, "Could not prepare journal statement “%s”", select);
+  /* Decoding without a lease was interrupted on a run without workers. */
+  if (SQLITE_OK != sqlite3_bind_int(stmt, 1, JOURNAL_QUEUED)
+    || SQLITE_OK != sqlite3_bind_int(stmt, 2, JOURNAL_DECODING)
+    || SQLITE_OK != sqlite3_bind_int(stmt, 3, JOURNAL_DECODED)
+    || SQLITE_OK != sqlite3_bind_int64(stmt, 4, now))
+    errx(1, "Could not bind journal claim");
+  bool claimed = false;
+  switch (sqlite3_step(stmt)) {
+    case SQLITE_ROW: {
+      const char *name = (const char *)sqlite3_column_text(stmt, 0);
+      if (name == NULL || strlen(name) >= size)
+        errx(1, "Could not fit journal file name");
+      strcpy(filename, name);
+      claimed = true;
+      break;
+    }
+    case SQLITE_DONE:
+      break;
+    default:
+      errx(1, "Could not read journal claim");
+  }
+  if (SQLITE_OK != sqlite3_finalize(stmt))
+    errx(1, "Could not finalize journal statement");
+  if (claimed) {
+    stmt = prepare_for_file(db,
+      "UPDATE journal SET owner = ?2, lease_until = ?3 WHERE filename = ?1;",
+      filename);
+    if (SQLITE_OK != sqlite3_bind_text(stmt, 2, owner, -1, SQLITE_TRANSIENT)
+      || SQLITE_OK != sqlite3_bind_int64(stmt, 3, now + lease_seconds))
+      errx(1, "Could not bind journal claim");
+    step_and_finalize(stmt);
+  }
+  commit_transaction(db, "journal claim");
+  return claimed;
+}
+
+bool journal_heartbeat(sqlite3 *db, const char filename[], const char owner[],
+  time_t now, unsigned int lease_seconds) {
+  sqlite3_stmt *stmt = prepare_for_file(db,
+    "UPDATE journal SET lease_until = ?3 WHERE filename = ?1 AND owner = ?2;",
+    filename);
+  if (SQLITE_OK != sqlite3_bind_text(stmt, 2, owner, -1, SQLITE_TRANSIENT)
+    || SQLITE_OK != sqlite3_bind_int64(stmt, 3, now + lease_seconds))
+    errx(1, "Could not bind journal heartbeat");
+  step_and_finalize(stmt);
+  return sqlite3_changes(db) == 1;
+}
@@ -0,0 +1,96 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include <sqlite3.h>
+#include "char_line.h"
+
+/**
+ * Ingest state of a single video file, as stored in the journal table. The
+ * values are persisted, so they must not be renumbered.
+ */
+typedef enum {
+  JOURNAL_ABSENT = 0,
+  JOURNAL_QUEUED = 1,
+  JOURNAL_DECODING = 2,
+  JOURNAL_DECODED = 3,
+  JOURNAL_COMMITTED = 4,
+  JOURNAL_FAILED = 5,
+} JournalState;
+
+/**
+ * Adds a video file (by basename) to the journal. Files interrupted or failed
+ * on a previous run go back to the queue, except the ones already decoded,
+ * which keep their lines, and the ones a worker holds a lease on.
+ */
+void journal_queue(sqlite3 *db, const char filename[]);
+
+/**
+ * Sets the content fingerprint of a video file already in the journal (see
+ * ls.h), which goes to the imported table with it.
+ */
+void journal_set_fingerprint(sqlite3 *db, const char filename[],
+  const char fingerprint[]);
+
+/**
+ * Sets the priority of a video file already in the journal: workers claim the
+ * files of higher priority first.
+ */
+void journal_set_priority(sqlite3 *db, const char filename[],
+  int64_t priority);
+
+/**
+ * Counts the video files workers can still claim at the time (see
+ * journal_claim), whoever listed them.
+ */
+unsigned int journal_queued(sqlite3 *db, time_t now);
+
+/**
+ * Gets the state of a video file, JOURNAL_ABSENT if not in the journal.
+ */
+JournalState journal_state(sqlite3 *db, const char filename[]);
+
+/**
+ * Sets the state of a video file already in the journal.
+ */
+void journal_set_state(sqlite3 *db, const char filename[], JournalState state);
+
+/**
+ * Stores the lines read from a video file and marks it as decoded.
+ */
+void journal_store_lines(sqlite3 *db, const char filename[],
+  unsigned int count, const CharLine lines[count]);
+
+/**
+ * Loads the lines stored for a decoded video file. Returns the number of lines
+ * loaded or negative if there are none or they don’t fit.
+ */
+int journal_load_lines(sqlite3 *db, const char filename[],
+  unsigned int count, CharLine lines[count]);
+
+/**
+ * Marks the video file as committed and drops its lines. Should be called
+ * within the transaction that writes the lines to the database.
+ */
+void journal_commit(sqlite3 *db, const char filename[]);
+
+/**
+ * For several processes, possibly on several hosts, sharing a database: claims
+ * the file of highest priority, then first by name, that is queued or decoded
+ * and not claimed, or whose claim expired, and that isn’t imported yet, for
+ * owner until now plus lease_seconds. Claiming takes the write lock, so two
+ * workers never get the same file. Returns whether a file was claimed, its
+ * name in filename.
+ */
+bool journal_claim(sqlite3 *db, const char owner[], time_t now,
+  unsigned int lease_seconds, size_t size, char filename[size]);
+
+/**
+ * Extends the claim of owner on the file to now plus lease_seconds. Returns
+ * false when the claim was lost to another worker after expiring.
+ */
+bool journal_heartbeat(sqlite3 *db, const char filename[], const char owner[],
+  time_t now, unsigned int lease_seconds);
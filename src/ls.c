@@ -1,9 +1,12 @@
 /* SPDX-License-Identifier: GPL-2.0-or-later */
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <stdio.h>
 #include <dirent.h>
 #include <err.h>
+#include <inttypes.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sqlite3.h>
@@ -15,6 +18,179 @@
 
 /* Passed to the dir_filter function. */
 sqlite3_stmt *stmt;
+sqlite3_stmt *fingerprint_stmt;
+sqlite3_stmt *journal_stmt;
+const char *filter_directory;
+
+/* Fingerprints computed while filtering a directory, by name, for the files
+ * listed. */
+typedef struct {
+  char name[sizeof(((struct dirent *)NULL)->d_name)];
+  char fingerprint[FINGERPRINT_SIZE];
+} Fingerprinted;
+static Fingerprinted *fingerprinted;
+static size_t fingerprinted_count;
+static size_t fingerprinted_allocated;
+
+/**
+ * Continues a 64-bit FNV-1a hash over the bytes.
+ */
+static uint64_t fnv1a(uint64_t hash, size_t size, const uint8_t bytes[size]) {
+  for (size_t i = 0; i < size; ++i) {
+    hash ^= bytes[i];
+    hash *= 0x100000001b3;
+  }
+  return hash;
+}
+
+bool fingerprint_file(const char filename[],
+  char fingerprint[FINGERPRINT_SIZE]) {
+  FILE *file = fopen(filename, "rb");
+  if (file == NULL) {
+    warn("Could not open %s", filename);
+    return false;
+  }
+  struct stat status;
+  uint8_t *chunk = malloc(FINGERPRINT_CHUNK);
+  if (chunk == NULL)
+    errx(1, "Could not allocate fingerprint buffer");
+  uint64_t hash = 0xcbf29ce484222325;
+  bool read = 0 == fstat(fileno(file), &status);
+  if (read) {
+    size_t size = fread(chunk, 1, FINGERPRINT_CHUNK, file);
+    hash = fnv1a(hash, size, chunk);
+    read = !ferror(file);
+  }
+  /* The end, without hashing again bytes of the start. */
+  if (read && status.st_size > FINGERPRINT_CHUNK) {
+    off_t tail = status.st_size - FINGERPRINT_CHUNK;
+    if (tail < FINGERPRINT_CHUNK)
+      tail = FINGERPRINT_CHUNK;
+    read = 0 == fseeko(file, tail, SEEK_SET);
+    if (read) {
+      size_t size = fread(chunk, 1, FINGERPRINT_CHUNK, file);
+      hash = fnv1a(hash, size, chunk);
+      read = !ferror(file);
+    }
+  }
+  if (!read)
+    warn("Could not read %s", filename);
+  else
+    snprintf(fingerprint, FINGERPRINT_SIZE, "%jd:%016" PRIx64,
+      (intmax_t)status.st_size, hash);
+  free(chunk);
+  fclose(file);
+  return read;
+}
+
+/**
+ * Gets the fingerprint the journal has for a file, which another worker
+ * listing the directory computed already. Returns false when there’s none.
+ */
+static bool journal_fingerprint(const char name[],
+  char fingerprint[FINGERPRINT_SIZE]) {
+  if (SQLITE_OK != sqlite3_bind_text(journal_stmt, 1, name, -1,
+      SQLITE_TRANSIENT))
+    errx(1, "Error binding to journal fingerprint statement");
+  bool known = false;
+  switch (sqlite3_step(journal_stmt)) {
+    case SQLITE_ROW: {
+      const char *text = (const char *)sqlite3_column_text(journal_stmt, 0);
+      known = text != NULL && strlen(text) < FINGERPRINT_SIZE;
+      if (known)
+        strcpy(fingerprint, text);
+      break;
+    }
+    case SQLITE_DONE:
+      break;
+    default:
+      errx(1, "Error while stepping journal fingerprint statement");
+  }
+  if (SQLITE_OK != sqlite3_reset(journal_stmt))
+    errx(1, "Error while resetting journal fingerprint statement");
+  return known;
+}
+
+/**
+ * Keeps the fingerprint of a file filtered, empty when it couldn’t be read.
+ */
+static void keep_fingerprint(const char name[],
+  const char fingerprint[FINGERPRINT_SIZE]) {
+  if (fingerprinted_count == fingerprinted_allocated) {
+    fingerprinted_allocated =
+      fingerprinted_allocated > 0 ? 2 * fingerprinted_allocated : 64;
+    fingerprinted = reallocarray(fingerprinted, fingerprinted_allocated,
+      sizeof(Fingerprinted));
+    if (fingerprinted == NULL)
+      errx(1, "Could not allocate fingerprints");
+  }
+  Fingerprinted *kept = &fingerprinted[fingerprinted_count++];
+  snprintf(kept->name, sizeof(kept->name), "%s", name);
+  strcpy(kept->fingerprint, fingerprint);
+}
+
+static int compare_fingerprinted(const void *a, const void *b) {
+  return strcmp(((const Fingerprinted *)a)->name,
+    ((const Fingerprinted *)b)->name);
+}
+
+static int compare_name(const void *name, const void *kept) {
+  return strcmp(name, ((const Fingerprinted *)kept)->name);
+}
+
+/**
+ * Copies the fingerprints kept while filtering a directory for the files
+ * listed from it, then forgets them.
+ */
+static void take_fingerprints(int count, struct dirent *list[count],
+  char fingerprints[count][FINGERPRINT_SIZE]) {
+  if (fingerprinted_count > 0)
+    qsort(fingerprinted, fingerprinted_count, sizeof(Fingerprinted),
+      compare_fingerprinted);
+  for (int i = 0; i < count; ++i) {
+    const Fingerprinted *kept = fingerprinted_count == 0 ? NULL
+      : bsearch(list[i]->d_name, fingerprinted, fingerprinted_count,
+        sizeof(Fingerprinted), compare_name);
+    strcpy(fingerprints[i], kept != NULL ? kept->fingerprint : "");
+  }
+  fingerprinted_count = 0;
+}
+
+/**
+ * Whether a listed file is a copy of a video imported under another name,
+ * which is then reported.
+ */
+static bool imported_copy(const char name[]) {
+  char *filename = malloc(strlen(filter_directory) + strlen(name) + 2);
+  if (filename == NULL)
+    errx(1, "Could not allocate file name");
+  sprintf(filename, "%s/%s", filter_directory, name);
+  char fingerprint[FINGERPRINT_SIZE];
+  bool copy = false;
+  bool known = journal_fingerprint(name, fingerprint)
+    || fingerprint_file(filename, fingerprint);
+  keep_fingerprint(name, known ? fingerprint : "");
+  if (known) {
+    if (SQLITE_OK != sqlite3_bind_text(fingerprint_stmt, 1, fingerprint, -1,
+        SQLITE_TRANSIENT))
+      errx(1, "Error binding to fingerprint verification statement");
+    switch (sqlite3_step(fingerprint_stmt)) {
+      case SQLITE_ROW:
+        printf("Skipping “%s”, a copy of “%s”\n", filename,
+          sqlite3_column_text(fingerprint_stmt, 0));
+        copy = true;
+        break;
+      case SQLITE_DONE:
+        break;
+      default:
+        errx(1, "Error while stepping fingerprint verification statement");
+    }
+    if (SQLITE_OK != sqlite3_reset(fingerprint_stmt))
+      errx(1, "Error while resetting fingerprint verification statement");
+  }
+  free(filename);
+  return copy;
+}
 
 /**
  * Filtering function for scandir. Returns true for video filenamess that aren’t
@@ -44,14 +220,18 @@ static int dir_filter(const struct dirent* entry) {
     errx(1, "Error while clearing filename verification statement bindings");
   if (SQLITE_OK != sqlite3_reset(stmt))
     errx(1, "Error while resetting filename verification statement");
-  return !filename_imported;
+  return !filename_imported && !imported_copy(entry->d_name);
 }
 
 int list_to_import(const char directory_name[], const char database[],
-  struct dirent *** restrict list) {
+  struct dirent *** restrict list,
+  char (** restrict fingerprints)[FINGERPRINT_SIZE]) {
   /* Invalid directory: nothing imported. */
-  if (strlen(directory_name) == 0)
+  if (strlen(directory_name) == 0) {
+    if (fingerprints != NULL)
+      *fingerprints = NULL;
     return 0;
+  }
 
   /* Open database and prepare long-running statement. */
   SpatiaLite sp = open_and_init_db(database);
@@ -59,21 +239,43 @@ int list_to_import(const char directory_name[], const char database[],
   if (SQLITE_OK != sqlite3_prepare_v2(sp.db, find_file, sizeof(find_file),
       &stmt, NULL))
     errx(1, "Error preparing filename verification statement");
+  const char find_fingerprint[] =
+    "SELECT filename FROM imported WHERE fingerprint = ? LIMIT 1;";
+  if (SQLITE_OK != sqlite3_prepare_v2(sp.db, find_fingerprint, -1,
+      &fingerprint_stmt, NULL))
+    errx(1, "Error preparing fingerprint verification statement");
+  const char find_journal[] = "SELECT fingerprint FROM journal"
+    "  WHERE filename = ? AND fingerprint IS NOT NULL;";
+  if (SQLITE_OK != sqlite3_prepare_v2(sp.db, find_journal, -1,
+      &journal_stmt, NULL))
+    errx(1, "Error preparing journal fingerprint statement");
 
   /* Find files in main directory. */
+  filter_directory = directory_name;
   int main_ret = scandir(directory_name, list, dir_filter, alphasort);
+  int main_count = main_ret > 0 ? main_ret : 0;
+  char (*prints)[FINGERPRINT_SIZE] =
+    calloc(main_count > 0 ? main_count : 1, FINGERPRINT_SIZE);
+  if (prints == NULL)
+    errx(1, "Could not allocate fingerprints");
+  take_fingerprints(main_count, *list, prints);
 
   /* Find files in RO directory. */
   struct dirent **ro_list;
   char *ro_directory_name = malloc(strlen(directory_name) + sizeof(RO_SUFFIX));
   strcpy(ro_directory_name, directory_name);
   strcat(ro_directory_name, RO_SUFFIX);
+  filter_directory = ro_directory_name;
   int ro_ret = scandir(ro_directory_name, &ro_list, dir_filter, alphasort);
   free(ro_directory_name);
 
   /* Append files in the RO directory only if it exists. */
   if (ro_ret >= 0) {
     *list = reallocarray(*list, main_ret + ro_ret, sizeof(struct dirent*));
+    prints = reallocarray(prints, main_count + ro_ret + 1, FINGERPRINT_SIZE);
+    if (prints == NULL)
+      errx(1, "Could not allocate fingerprints");
+    take_fingerprints(ro_ret, ro_list, &prints[main_count]);
     for (int i = 0; i < ro_ret; ++i) {
       (*list)[main_ret + i] = ro_list[i];
       /* Need to prefix the “RO/” to filenames found there. */
@@ -92,6 +294,17 @@ int list_to_import(const char directory_name[], const char database[],
   /* Cleanup everything before returning. */
   if (SQLITE_OK != sqlite3_finalize(stmt))
     errx(1, "Could not finalize filename verification statement");
+  if (SQLITE_OK != sqlite3_finalize(fingerprint_stmt))
+    errx(1, "Could not finalize fingerprint verification statement");
+  if (SQLITE_OK != sqlite3_finalize(journal_stmt))
+    errx(1, "Could not finalize journal fingerprint statement");
   close_db(sp);
+  free(fingerprinted);
+  fingerprinted = NULL;
+  fingerprinted_count = fingerprinted_allocated = 0;
+  if (fingerprints != NULL)
+    *fingerprints = prints;
+  else
+    free(prints);
   return main_ret;
 }
@@ -2,10 +2,30 @@
 #pragma once
 
 #include <dirent.h>
+#include <stdbool.h>
+
+/* Bytes hashed at the start and at the end of a video for its fingerprint. */
+#define FINGERPRINT_CHUNK (1024 * 1024)
+
+/* Size of a fingerprint string, with the terminating null. */
+#define FINGERPRINT_SIZE 40
+
+/**
+ * Fingerprints the contents of a video file, whatever its name: its size and
+ * a 64-bit FNV-1a hash of its first and last FINGERPRINT_CHUNK bytes, as text.
+ * Returns false, with a warning, when the file can’t be read.
+ */
+bool fingerprint_file(const char filename[],
+  char fingerprint[FINGERPRINT_SIZE]);
 
 /**
  * Lists .TS files on directory and directory/RO but exclude names already
- * present on the imported table of the database.
+ * present on the imported table of the database, and copies of videos imported
+ * under another name or path (same fingerprint). Fingerprints the journal has
+ * already, from a previous listing, aren’t computed again. Unless NULL,
+ * fingerprints gets those of the files listed, in the same order, empty for
+ * the ones that couldn’t be read, to be freed.
  */
 int list_to_import(const char directory[], const char database[],
-  struct dirent *** restrict list);
+  struct dirent *** restrict list,
+  char (** restrict fingerprints)[FINGERPRINT_SIZE]);
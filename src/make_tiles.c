@@ -0,0 +1,21 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#include <err.h>
+#include <stdio.h>
+#include "db.h"
+#include "mbtiles.h"
+
+/**
+ * make_tiles: keeps an MBTiles file of vector tiles of the trips up to date,
+ * rendering only the tiles around videos imported since the last run.
+ *
+ * Usage: make_tiles database tiles.mbtiles
+ */
+int main(int argc, char* argv[]) {
+  if (argc != 3)
+    errx(1, "Usage: %s database tiles.mbtiles", argv[0]);
+  SpatiaLite sp = open_and_init_db(argv[1]);
+  unsigned int count = mbtiles_update(sp.db, argv[2]);
+  close_db(sp);
+  printf("Rendered %u tiles\n", count);
+  return 0;
+}
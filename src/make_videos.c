@@ -0,0 +1,312 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#define _XOPEN_SOURCE 700
+#include <err.h>
+#include <errno.h>
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/opt.h>
+#include "glyph.h"
+#include "overlay.h"
+
+/* Ways the generated videos can differ from the dash cam’s. */
+typedef struct {
+  unsigned int count;
+  unsigned int seconds;
+  unsigned int fps;
+  unsigned int gop;
+  unsigned int width;
+  unsigned int height;
+  time_t start;
+  /* Second of each video from which its clock reads a second ahead, 0 for
+   * none, like a clock set while recording. */
+  unsigned int clock_jump;
+  /* Second of each video from which its timestamps are PTS_GAP seconds ahead,
+   * with the clock going on, 0 for none, like an encoder restarting. */
+  unsigned int pts_gap;
+} VideoSpec;
+
+/* Seconds skipped by the timestamps at VideoSpec’s pts_gap. */
+#define PTS_GAP 5
+
+/* An encoder writing to a muxer. */
+typedef struct {
+  AVFormatContext *format;
+  AVCodecContext *codec;
+  AVStream *stream;
+  AVPacket *packet;
+} Output;
+
+/**
+ * Opens the TS file and an H.264 encoder for it.
+ */
+static Output open_output(const char filename[], const VideoSpec *spec) {
+  Output output;
+  if (0 > avformat_alloc_output_context2(&output.format, NULL, "mpegts",
+      filename))
+    errx(1, "Could not create the container for %s", filename);
+  const AVCodec *codec = avcodec_find_encoder(AV_CODEC_ID_H264);
+  if (codec == NULL)
+    errx(1, "No H.264 encoder available");
+  output.stream = avformat_new_stream(output.format, NULL);
+  output.codec = avcodec_alloc_context3(codec);
+  output.packet = av_packet_alloc();
+  if (output.stream == NULL || output.codec == NULL || output.packet == NULL)
+    errx(1, "Could not allocate the encoder");
+
+  output.codec->width = spec->width;
+  output.codec->height = spec->height;
+  output.codec->pix_fmt = AV_PIX_FMT_YUV420P;
+  output.codec->time_base = (AVRational){ 1, spec->fps };
+  output.codec->framerate = (AVRational){ spec->fps, 1 };
+  output.codec->gop_size = spec->gop;
+  /* Frames come out as they go in, like the dash cam’s: get_video_strings
+   * expects a frame for each packet. */
+  output.codec->max_b_frames = 0;
+  /* x264 options, other encoders ignore them. The text must survive. */
+  av_opt_set(output.codec->priv_data, "preset", "ultrafast", 0);
+  av_opt_set(output.codec->priv_data, "tune", "zerolatency", 0);
+  av_opt_set(output.codec->priv_data, "crf", "18", 0);
+  if (output.format->oformat->flags & AVFMT_GLOBALHEADER)
+    output.codec->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+  if (0 != avcodec_open2(output.codec, codec, NULL))
+    errx(1, "Could not open the %s encoder", codec->name);
+
+  output.stream->time_base = output.codec->time_base;
+  if (0 > avcodec_parameters_from_context(output.stream->codecpar,
+      output.codec))
+    errx(1, "Could not copy the encoder parameters");
+  if (0 > avio_open(&output.format->pb, filename, AVIO_FLAG_WRITE))
+    errx(1, "Could not open %s", filename);
+  if (0 > avformat_write_header(output.format, NULL))
+    errx(1, "Could not write the header of %s", filename);
+  return output;
+}
+
+/**
+ * Sends a frame (NULL to flush) and writes the packets the encoder has ready.
+ */
+static void encode(Output *output, const AVFrame *frame) {
+  if (0 != avcodec_send_frame(output->codec, frame))
+    errx(1, "Could not encode frame");
+  while (0 == avcodec_receive_packet(output->codec, output->packet)) {
+    av_packet_rescale_ts(output->packet, output->codec->time_base,
+      output->stream->time_base);
+    output->packet->stream_index = output->stream->index;
+    if (0 != av_interleaved_write_frame(output->format, output->packet))
+      errx(1, "Could not write packet");
+  }
+}
+
+static void close_output(Output *output) {
+  encode(output, NULL);
+  if (0 != av_write_trailer(output->format))
+    errx(1, "Could not write the trailer");
+  avio_closep(&output->format->pb);
+  av_packet_free(&output->packet);
+  avcodec_free_context(&output->codec);
+  avformat_free_context(output->format);
+}
+
+/**
+ * Writes a video of the route from its first second, with the text changing
+ * every spec->fps frames over a still noisy background, and the
+ * discontinuities of the spec.
+ */
+static void make_video(const char filename[], const VideoSpec *spec,
+  unsigned int first_second, unsigned int glyph_count,
+  const Glyph glyphs[glyph_count], const AVFrame *background) {
+  Output output = open_output(filename, spec);
+  AVFrame *frame = av_frame_alloc();
+  if (frame == NULL)
+    errx(1, "Could not allocate frame");
+  frame->format = AV_PIX_FMT_YUV420P;
+  frame->width = spec->width;
+  frame->height = spec->height;
+  if (0 != av_frame_get_buffer(frame, 0))
+    errx(1, "Could not allocate frame buffer");
+
+  /* Text that fill_line can’t reach isn’t drawn. */
+  const bool has_text = spec->width >= EXPECTED_VIDEO_WIDTH
+    && spec->height >= TOP_DATA_ROW + GLYPH_HEIGHT;
+  CharLine line;
+  for (unsigned int i = 0; i < spec->seconds * spec->fps; ++i) {
+    if (0 != av_frame_make_writable(frame))
+      errx(1, "Could not write to frame");
+    if (0 != av_frame_copy(frame, background))
+      errx(1, "Could not copy the background");
+    const unsigned int second = i / spec->fps;
+    if (has_text) {
+      const bool jumped = spec->clock_jump > 0 && second >= spec->clock_jump;
+      overlay_route(&line, spec->start + jumped, first_second + second);
+      overlay_draw(frame->data[0], frame->linesize[0], glyph_count, glyphs,
+        &line);
+    }
+    const bool gap = spec->pts_gap > 0 && second >= spec->pts_gap;
+    frame->pts = i + (gap ? PTS_GAP * spec->fps : 0);
+    encode(&output, frame);
+  }
+  av_frame_free(&frame);
+  close_output(&output);
+}
+
+/**
+ * Noise luma and neutral chroma, shared by all frames: it’s the text that
+ * changes.
+ */
+static AVFrame *make_background(const VideoSpec *spec) {
+  AVFrame *background = av_frame_alloc();
+  if (background == NULL)
+    errx(1, "Could not allocate frame");
+  background->format = AV_PIX_FMT_YUV420P;
+  background->width = spec->width;
+  background->height = spec->height;
+  if (0 != av_frame_get_buffer(background, 0))
+    errx(1, "Could not allocate frame buffer");
+  uint32_t seed = 1;
+  overlay_noise(background->data[0], background->linesize[0], spec->width,
+    spec->height, &seed);
+  for (unsigned int plane = 1; plane < 3; ++plane)
+    memset(background->data[plane], 128,
+      background->linesize[plane] * ((spec->height + 1) / 2));
+  return background;
+}
+
+/**
+ * Parses a positive number option or exits.
+ */
+static unsigned int positive(const char name[], const char value[]) {
+  char *end;
+  unsigned long number = strtoul(value, &end, 10);
+  if (*end != '\0' || number == 0 || number > 100000)
+    errx(1, "Invalid %s “%s”", name, value);
+  return number;
+}
+
+/**
+ * make_videos: writes synthetic dash cam videos: H.264 in MPEG-TS with the
+ * text overlay of a drive, named and timed like the dash cam’s, so the whole
+ * ingest can run without recordings. Each video continues the drive where the
+ * previous one stopped.
+ *
+ * Usage: make_videos [--count=N] [--seconds=S] [--fps=F] [--gop=FRAMES]
+ *   [--size=WIDTHxHEIGHT] [--start=YYYYMMDDhhmmss] [--clock-jump=SECOND]
+ *   [--pts-gap=SECOND] directory
+ *   --count    number of videos, 1 by default
+ *   --seconds  length of each video, 300 by default (at most 301 are read)
+ *   --fps      frames per second, 30 by default
+ *   --gop      frames between key frames, one second by default
+ *   --size     2560x1440 by default, the text is only drawn at least this big
+ *   --start    local time of the first video, 20240831090220 by default
+ *   --clock-jump  from this second of each video, the clock reads a second
+ *              ahead of the drive
+ *   --pts-gap  from this second of each video, the timestamps skip PTS_GAP
+ *              seconds while the clock goes on
+ */
+int main(int argc, char* argv[]) {
+  VideoSpec spec = {
+    .count = 1,
+    .seconds = 300,
+    .fps = 30,
+    .gop = 0,
+    .width = EXPECTED_VIDEO_WIDTH,
+    .height = EXPECTED_VIDEO_HEIGHT,
+  };
+  const char *start = "20240831090220";
+  const struct option long_options[] = {
+    {"count", required_argument, NULL, 'n'},
+    {"seconds", required_argument, NULL, 's'},
+    {"fps", required_argument, NULL, 'f'},
+    {"gop", required_argument, NULL, 'g'},
+    {"size", required_argument, NULL, 'z'},
+    {"start", required_argument, NULL, 't'},
+    {"clock-jump", required_argument, NULL, 'j'},
+    {"pts-gap", required_argument, NULL, 'p'},
+    {0},
+  };
+  int option;
+  while (-1 != (option = getopt_long(argc, argv, "", long_options, NULL))) {
+    switch (option) {
+      case 'n':
+        spec.count = positive("count", optarg);
+        break;
+      case 's':
+        spec.seconds = positive("seconds", optarg);
+        break;
+      case 'f':
+        spec.fps = positive("fps", optarg);
+        break;
+      case 'g':
+        spec.gop = positive("gop", optarg);
+        break;
+      case 'z':
+        if (2 != sscanf(optarg, "%ux%u", &spec.width, &spec.height)
+          || spec.width < 16 || spec.height < 16
+          || spec.width % 2 != 0 || spec.height % 2 != 0)
+          errx(1, "Invalid size “%s”", optarg);
+        break;
+      case 't':
+        start = optarg;
+        break;
+      case 'j':
+        spec.clock_jump = positive("clock jump", optarg);
+        break;
+      case 'p':
+        spec.pts_gap = positive("PTS gap", optarg);
+        break;
+      default:
+        errx(1, "Usage: %s [--count=N] [--seconds=S] [--fps=F] [--gop=FRAMES]"
+          " [--size=WIDTHxHEIGHT] [--start=YYYYMMDDhhmmss]"
+          " [--clock-jump=SECOND] [--pts-gap=SECOND] directory",
+          argv[0]);
+    }
+  }
+  if (argc - optind != 1)
+    errx(1, "Got %d arguments, expected 1 (directory)", argc - optind);
+  const char *directory = argv[optind];
+  if (spec.gop == 0)
+    spec.gop = spec.fps;
+
+  /* Names and overlay are local time, like the dash cam’s. */
+  struct tm start_time = { 0 };
+  const char *end = strptime(start, "%Y%m%d%H%M%S", &start_time);
+  if (end == NULL || *end != '\0')
+    errx(1, "Invalid start time “%s”", start);
+  start_time.tm_isdst = -1;
+  spec.start = mktime(&start_time);
+  if (spec.width < EXPECTED_VIDEO_WIDTH
+    || spec.height < TOP_DATA_ROW + GLYPH_HEIGHT)
+    warnx("Videos smaller than %ux%u have no text", EXPECTED_VIDEO_WIDTH,
+      TOP_DATA_ROW + GLYPH_HEIGHT);
+
+  const char keys[] = "0123456789_";
+  Glyph glyphs[sizeof(keys) - 1];
+  load_glyphs("../data/glyphs.png", sizeof(keys) - 1, keys, glyphs);
+  if (0 != mkdir(directory, 0777) && errno != EEXIST)
+    err(1, "Could not create %s", directory);
+
+  AVFrame *background = make_background(&spec);
+  for (unsigned int i = 0; i < spec.count; ++i) {
+    const unsigned int first_second = i * spec.seconds;
+    const time_t video_time = spec.start + first_second;
+    struct tm local;
+    char date[sizeof("YYYYMMDDhhmmss")];
+    strftime(date, sizeof(date), "%Y%m%d%H%M%S",
+      localtime_r(&video_time, &local));
+    char *filename =
+      malloc(strlen(directory) + sizeof("/YYYYMMDDhhmmss_xxxxxx.TS"));
+    sprintf(filename, "%s/%s_%06u.TS", directory, date, (i + 1) % 1000000);
+    make_video(filename, &spec, first_second, sizeof(keys) - 1, glyphs,
+      background);
+    printf("Wrote “%s”\n", filename);
+    free(filename);
+  }
+  av_frame_free(&background);
+  return 0;
+}
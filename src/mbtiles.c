@@ -0,0 +1,375 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#include <err.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <zlib.h>
+#include <sqlite3.h>
+#include <spatialite/gaiageo.h>
+#include "db.h"
+#include "mbtiles.h"
+#include "mvt.h"
+#include "output_data.h"
+
+/* Keeps an MBTiles file of vector tiles of the trips, so web maps don’t query
+ * the database while panning. The file records which imported videos it has
+ * rendered, and each update only renders the tiles around the trips of the new
+ * ones. Any database errors trigger errx().
+ */
+
+/* Attributes of the trips in the tiles. */
+static const char *const keys[] = { "start_time", "end_time" };
+
+static const char schema[] =
+  "CREATE TABLE IF NOT EXISTS mbtiles.metadata (name TEXT, value TEXT);"
+  "CREATE UNIQUE INDEX IF NOT EXISTS mbtiles.metadata_name"
+  "  ON metadata(name);"
+  "CREATE TABLE IF NOT EXISTS mbtiles.tiles ("
+  "  zoom_level INTEGER,"
+  "  tile_column INTEGER,"
+  "  tile_row INTEGER,"
+  "  tile_data BLOB"
+  ");"
+  "CREATE UNIQUE INDEX IF NOT EXISTS mbtiles.tile_index"
+  "  ON tiles(zoom_level, tile_column, tile_row);"
+  "CREATE TABLE IF NOT EXISTS mbtiles.rendered ("
+  "  filename STRING PRIMARY KEY"
+  ");"
+  "INSERT OR REPLACE INTO mbtiles.metadata VALUES"
+  "  ('name', 'onde_dirigi trips'),"
+  "  ('format', 'pbf'),"
+  "  ('type', 'overlay'),"
+  "  ('minzoom', '0'),"
+  "  ('maxzoom', '14'),"
+  "  ('json', '{\"vector_layers\": [{\"id\": \"trips\", \"fields\": "
+  "{\"start_time\": \"Number\", \"end_time\": \"Number\"}, "
+  "\"minzoom\": 0, \"maxzoom\": 14}]}');"
+  "CREATE TEMP TABLE dirty_trips (id INTEGER PRIMARY KEY);"
+  "CREATE TEMP TABLE dirty_tiles ("
+  "  zoom INTEGER, x INTEGER, y INTEGER, PRIMARY KEY (zoom, x, y)"
+  ") WITHOUT ROWID;";
+
+/**
+ * Simplified track column of the trips table for drawing at the zoom level,
+ * close to a pixel (256 per tile) at its finest.
+ */
+static const char *track_column(unsigned int zoom) {
+  return zoom <= 8 ? "track_1000m" : zoom <= 11 ? "track_100m" : "track_10m";
+}
+
+/**
+ * Compresses data for the tile_data column.
+ */
+static unsigned char *gzip(const unsigned char data[], size_t size,
+  size_t *compressed_size) {
+  z_stream stream = { 0 };
+  if (Z_OK != deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16,
+      8, Z_DEFAULT_STRATEGY))
+    errx(1, "Could not initialize tile compression");
+  size_t bound = deflateBound(&stream, size);
+  unsigned char *compressed = malloc(bound);
+  if (compressed == NULL)
+    errx(1, "Could not allocate %zu bytes for a tile", bound);
+  stream.next_in = (unsigned char *)data;
+  stream.avail_in = size;
+  stream.next_out = compressed;
+  stream.avail_out = bound;
+  if (Z_STREAM_END != deflate(&stream, Z_FINISH))
+    errx(1, "Could not compress tile");
+  *compressed_size = stream.total_out;
+  deflateEnd(&stream);
+  return compressed;
+}
+
+/**
+ * Adds the parts of a trip near the tile: runs of segments whose bounding box
+ * touches the tile with its buffer, so long trips aren’t repeated whole in
+ * every tile they cross.
+ */
+static void add_trip(MvtLayer *layer, Tile tile, uint64_t id,
+  const int64_t values[], gaiaLinestringPtr line, int32_t xy[]) {
+  const int32_t low = -MBTILES_BUFFER;
+  const int32_t high = MVT_EXTENT + MBTILES_BUFFER;
+  size_t run = 0;
+  for (int i = 0; i < line->Points; ++i) {
+    double lon, lat, x, y;
+    gaiaGetPoint(line->Coords, i, &lon, &lat);
+    tile_position(lon, lat, tile.zoom, &x, &y);
+    xy[2 * i] = lround((x - tile.x) * MVT_EXTENT);
+    xy[2 * i + 1] = lround((y - tile.y) * MVT_EXTENT);
+    if (i == 0)
+      continue;
+    const int32_t *a = &xy[2 * i - 2], *b = &xy[2 * i];
+    bool near = (a[0] >= low || b[0] >= low) && (a[0] <= high || b[0] <= high)
+      && (a[1] >= low || b[1] >= low) && (a[1] <= high || b[1] <= high);
+    if (near) {
+      run++;
+      continue;
+    }
+    if (run > 0)
+      mvt_add_line(layer, id, values, run + 1, &xy[2 * (i - 1 - run)]);
+    run = 0;
+  }
+  if (run > 0)
+    mvt_add_line(layer, id, values, run + 1,
+      &xy[2 * (line->Points - 1 - run)]);
+}
+
+unsigned char *mbtiles_render(sqlite3 *db, Tile tile, size_t *size) {
+  double west, south, east, north;
+  tile_bounds(tile, &west, &south, &east, &north);
+  const double margin_x = (east - west) * MBTILES_BUFFER / MVT_EXTENT;
+  const double margin_y = (north - south) * MBTILES_BUFFER / MVT_EXTENT;
+  const char *column = track_column(tile.zoom);
+  char *query = sqlite3_mprintf(
+    "SELECT id, start_time, end_time, %s FROM trips WHERE id IN ("
+    "  SELECT pkid FROM idx_trips_%s"
+    "    WHERE xmin <= ?3 AND xmax >= ?1 AND ymin <= ?4 AND ymax >= ?2"
+    ") ORDER BY id;",
+    column, column);
+  if (query == NULL)
+    errx(1, "Could not allocate tile query");
+  sqlite3_stmt *stmt;
+  if (SQLITE_OK != sqlite3_prepare_v2(db, query, -1, &stmt, NULL))
+    errx(1, "Could not prepare tile statement");
+  sqlite3_free(query);
+  if (SQLITE_OK != sqlite3_bind_double(stmt, 1, west - margin_x)
+    || SQLITE_OK != sqlite3_bind_double(stmt, 2, south - margin_y)
+    || SQLITE_OK != sqlite3_bind_double(stmt, 3, east + margin_x)
+    || SQLITE_OK != sqlite3_bind_double(stmt, 4, north + margin_y))
+    errx(1, "Could not bind tile bounds");
+
+  MvtLayer layer;
+  mvt_begin(&layer, sizeof(keys) / sizeof(keys[0]), keys);
+  int32_t *xy = NULL;
+  int allocated = 0;
+  int step;
+  while (SQLITE_ROW == (step = sqlite3_step(stmt))) {
+    gaiaGeomCollPtr geo = gaiaFromSpatiaLiteBlobWkb(
+      sqlite3_column_blob(stmt, 3), sqlite3_column_bytes(stmt, 3));
+    if (geo == NULL || geo->FirstLinestring == NULL)
+      errx(1, "Invalid trip track");
+    gaiaLinestringPtr line = geo->FirstLinestring;
+    if (line->Points > allocated) {
+      allocated = line->Points;
+      xy = reallocarray(xy, 2 * allocated, sizeof(int32_t));
+      if (xy == NULL)
+        errx(1, "Could not allocate %d trip points", allocated);
+    }
+    const int64_t values[] = {
+      sqlite3_column_int64(stmt, 1),
+      sqlite3_column_int64(stmt, 2),
+    };
+    add_trip(&layer, tile, sqlite3_column_int64(stmt, 0), values, line, xy);
+    gaiaFreeGeomColl(geo);
+  }
+  if (SQLITE_DONE != step)
+    errx(1, "Could not step tile statement");
+  if (SQLITE_OK != sqlite3_finalize(stmt))
+    errx(1, "Could not finalize tile statement");
+  free(xy);
+
+  bool empty = layer.feature_count == 0;
+  size_t encoded_size;
+  unsigned char *encoded = mvt_finish(&layer, "trips", &encoded_size);
+  unsigned char *ret = empty ? NULL : gzip(encoded, encoded_size, size);
+  free(encoded);
+  return ret;
+}
+
+/**
+ * Runs a statement once with the given bindings, for the update steps.
+ */
+static void run(sqlite3_stmt *stmt, int count, const int64_t values[count],
+  const char description[]) {
+  if (SQLITE_OK != sqlite3_reset(stmt))
+    errx(1, "Could not reset %s statement", description);
+  for (int i = 0; i < count; ++i)
+    if (SQLITE_OK != sqlite3_bind_int64(stmt, i + 1, values[i]))
+      errx(1, "Could not bind %s", description);
+  if (SQLITE_DONE != sqlite3_step(stmt))
+    errx(1, "Could not step %s statement", description);
+}
+
+static sqlite3_stmt *prepare(sqlite3 *db, const char query[],
+  const char description[]) {
+  sqlite3_stmt *stmt;
+  if (SQLITE_OK != sqlite3_prepare_v2(db, query, -1, &stmt, NULL))
+    errx(1, "Could not prepare %s statement: %s", description,
+      sqlite3_errmsg(db));
+  return stmt;
+}
+
+static void finalize(sqlite3_stmt *stmt, int step, const char description[]) {
+  if (SQLITE_DONE != step)
+    errx(1, "Could not step %s statement", description);
+  if (SQLITE_OK != sqlite3_finalize(stmt))
+    errx(1, "Could not finalize %s statement", description);
+}
+
+/**
+ * Marks the trips around the videos imported since the last update.
+ */
+static void find_dirty_trips(sqlite3 *db) {
+  sqlite3_stmt *videos = prepare(db,
+    "SELECT filename FROM imported"
+    "  WHERE filename NOT IN (SELECT filename FROM mbtiles.rendered);",
+    "new videos");
+  sqlite3_stmt *mark = prepare(db,
+    "INSERT OR IGNORE INTO temp.dirty_trips"
+    "  SELECT id FROM trips WHERE end_time >= ?1 AND start_time <= ?2;",
+    "dirty trips");
+  int step;
+  while (SQLITE_ROW == (step = sqlite3_step(videos))) {
+    time_t start = video_start_time(
+      (const char *)sqlite3_column_text(videos, 0));
+    if (start != -1)
+      run(mark, 2, (const int64_t[]){ start, start + MBTILES_VIDEO_SECONDS },
+        "dirty trips");
+  }
+  finalize(videos, step, "new videos");
+  if (SQLITE_OK != sqlite3_finalize(mark))
+    errx(1, "Could not finalize dirty trips statement");
+}
+
+/**
+ * Marks the tiles at the zoom level that a segment, between tile positions,
+ * crosses or passes within MBTILES_BUFFER of: a column at a time, the rows the
+ * part of the segment over it spans.
+ */
+static void mark_segment(sqlite3_stmt *mark, unsigned int zoom, double ax,
+  double ay, double bx, double by) {
+  const double buffer = (double)MBTILES_BUFFER / MVT_EXTENT;
+  const double last = (double)((uint64_t)1 << zoom) - 1;
+  const double west = fmin(ax, bx), east = fmax(ax, bx);
+  const double first_column = fmax(floor(west - buffer), 0);
+  const double last_column = fmin(floor(east + buffer), last);
+  for (double x = first_column; x <= last_column; ++x) {
+    double y_from = ay, y_to = by;
+    if (bx != ax) {
+      const double from = fmax(west, x - buffer);
+      const double to = fmin(east, x + 1 + buffer);
+      y_from = ay + (from - ax) * (by - ay) / (bx - ax);
+      y_to = ay + (to - ax) * (by - ay) / (bx - ax);
+    }
+    const double first_row = fmax(floor(fmin(y_from, y_to) - buffer), 0);
+    const double last_row = fmin(floor(fmax(y_from, y_to) + buffer), last);
+    for (double y = first_row; y <= last_row; ++y)
+      run(mark, 3, (const int64_t[]){ zoom, x, y }, "dirty tiles");
+  }
+}
+
+/**
+ * Marks the tiles the segments of the dirty trips’ tracks cross, at every
+ * zoom level, see mark_segment. A long trip only dirties the tiles along it,
+ * not all of its bounding box.
+ */
+static void find_dirty_tiles(sqlite3 *db) {
+  sqlite3_stmt *trips = prepare(db,
+    "SELECT track_10m FROM trips WHERE id IN temp.dirty_trips;",
+    "dirty trip tracks");
+  sqlite3_stmt *mark = prepare(db,
+    "INSERT OR IGNORE INTO temp.dirty_tiles VALUES (?, ?, ?);",
+    "dirty tiles");
+  int step;
+  while (SQLITE_ROW == (step = sqlite3_step(trips))) {
+    gaiaGeomCollPtr geo = gaiaFromSpatiaLiteBlobWkb(
+      sqlite3_column_blob(trips, 0), sqlite3_column_bytes(trips, 0));
+    if (geo == NULL || geo->FirstLinestring == NULL)
+      errx(1, "Invalid trip track");
+    gaiaLinestringPtr line = geo->FirstLinestring;
+    for (unsigned int zoom = 0; zoom <= MBTILES_MAX_ZOOM; ++zoom) {
+      double ax, ay, bx, by;
+      double lon, lat;
+      gaiaGetPoint(line->Coords, 0, &lon, &lat);
+      tile_position(lon, lat, zoom, &bx, &by);
+      /* A single point is a segment to itself. */
+      if (line->Points == 1)
+        mark_segment(mark, zoom, bx, by, bx, by);
+      for (int i = 1; i < line->Points; ++i) {
+        ax = bx;
+        ay = by;
+        gaiaGetPoint(line->Coords, i, &lon, &lat);
+        tile_position(lon, lat, zoom, &bx, &by);
+        mark_segment(mark, zoom, ax, ay, bx, by);
+      }
+    }
+    gaiaFreeGeomColl(geo);
+  }
+  finalize(trips, step, "dirty trip tracks");
+  if (SQLITE_OK != sqlite3_finalize(mark))
+    errx(1, "Could not finalize dirty tiles statement");
+}
+
+/**
+ * Renders the dirty tiles again, removing the ones left empty. Returns how many
+ * there were.
+ */
+static unsigned int render_dirty_tiles(sqlite3 *db) {
+  sqlite3_stmt *tiles = prepare(db,
+    "SELECT zoom, x, y FROM temp.dirty_tiles;", "dirty tiles");
+  /* MBTiles rows count from the south. */
+  sqlite3_stmt *write = prepare(db,
+    "INSERT OR REPLACE INTO mbtiles.tiles VALUES (?1, ?2, (1 << ?1) - 1 - ?3,"
+    "  ?4);",
+    "tile");
+  sqlite3_stmt *delete = prepare(db,
+    "DELETE FROM mbtiles.tiles WHERE zoom_level = ?1 AND tile_column = ?2"
+    "  AND tile_row = (1 << ?1) - 1 - ?3;",
+    "empty tile");
+  unsigned int count = 0;
+  int step;
+  while (SQLITE_ROW == (step = sqlite3_step(tiles))) {
+    Tile tile = {
+      .zoom = sqlite3_column_int(tiles, 0),
+      .x = sqlite3_column_int64(tiles, 1),
+      .y = sqlite3_column_int64(tiles, 2),
+    };
+    const int64_t position[] = { tile.zoom, tile.x, tile.y };
+    size_t size;
+    unsigned char *data = mbtiles_render(db, tile, &size);
+    if (data == NULL) {
+      run(delete, 3, position, "empty tile");
+    }
+    else {
+      if (SQLITE_OK != sqlite3_reset(write)
+        || SQLITE_OK != sqlite3_bind_blob(write, 4, data, size, free))
+        errx(1, "Could not bind tile data");
+      run(write, 3, position, "tile");
+    }
+    count++;
+  }
+  finalize(tiles, step, "dirty tiles");
+  if (SQLITE_OK != sqlite3_finalize(write)
+    || SQLITE_OK != sqlite3_finalize(delete))
+    errx(1, "Could not finalize tile statements");
+  return count;
+}
+
+unsigned int mbtiles_update(sqlite3 *db, const char filename[]) {
+  char *attach = sqlite3_mprintf("ATTACH %Q AS mbtiles;", filename);
+  if (attach == NULL)
+    errx(1, "Could not allocate MBTiles attachment");
+  if (SQLITE_OK != sqlite3_exec(db, attach, NULL, NULL, NULL))
+    errx(1, "Could not attach “%s”: %s", filename, sqlite3_errmsg(db));
+  sqlite3_free(attach);
+
+  begin_transaction(db, "tiles");
+  if (SQLITE_OK != sqlite3_exec(db, schema, NULL, NULL, NULL))
+    errx(1, "Could not create MBTiles schema: %s", sqlite3_errmsg(db));
+  find_dirty_trips(db);
+  find_dirty_tiles(db);
+  unsigned int count = render_dirty_tiles(db);
+  if (SQLITE_OK != sqlite3_exec(db,
+      "INSERT OR IGNORE INTO mbtiles.rendered SELECT filename FROM imported;"
+      "DROP TABLE temp.dirty_trips;"
+      "DROP TABLE temp.dirty_tiles;",
+      NULL, NULL, NULL))
+    errx(1, "Could not record rendered videos");
+  commit_transaction(db, "tiles");
+
+  if (SQLITE_OK != sqlite3_exec(db, "DETACH mbtiles;", NULL, NULL, NULL))
+    errx(1, "Could not detach “%s”", filename);
+  return count;
+}
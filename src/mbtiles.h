@@ -0,0 +1,31 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#pragma once
+
+#include <stddef.h>
+#include <sqlite3.h>
+#include "tile.h"
+
+/* Highest zoom with tiles, viewers scale these up beyond it. */
+#define MBTILES_MAX_ZOOM 14
+
+/* Margin drawn around each tile, in tile coordinates (see mvt.h), so lines
+ * don’t stop short at the edges. */
+#define MBTILES_BUFFER 64
+
+/* Latest a video’s locations can be after the time in its name, as accepted by
+ * lines_ok. */
+#define MBTILES_VIDEO_SECONDS 330
+
+/**
+ * Renders the trips in a tile as a gzipped Mapbox Vector Tile with a “trips”
+ * layer, simplified for the zoom level. Returns NULL when there are none, else
+ * the tile, to be freed by the caller, and sets its size.
+ */
+unsigned char *mbtiles_render(sqlite3 *db, Tile tile, size_t *size);
+
+/**
+ * Brings an MBTiles file, created if needed, up to date with the database: the
+ * tiles covering the trips of videos imported since the last update are
+ * rendered again, at every zoom level. Returns the number of tiles rendered.
+ */
+unsigned int mbtiles_update(sqlite3 *db, const char filename[]);
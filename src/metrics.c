@@ -0,0 +1,97 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#include <err.h>
+#include <stdlib.h>
+#include <string.h>
+#include "metrics.h"
+
+#define PREFIX "onde_dirigi_"
+
+static const char *const reject_names[REJECT_COUNT] = {
+  "unreadable", "invalid",
+};
+
+static void header(FILE *out, const char name[], const char type[],
+  const char help[]) {
+  fprintf(out, "# HELP " PREFIX "%s %s\n# TYPE " PREFIX "%s %s\n",
+    name, help, name, type);
+}
+
+/**
+ * A per second gauge of the last file, 0 before there’s one.
+ */
+static void rate(FILE *out, const char name[], const char help[],
+  unsigned long count, double seconds) {
+  header(out, name, "gauge", help);
+  fprintf(out, PREFIX "%s %.3f\n", name, seconds > 0 ? count / seconds : 0);
+}
+
+void metrics_print(FILE *out, const Progress *progress, const Stats *run,
+  const Stats *last_file) {
+  header(out, "queue_depth", "gauge", "Files waiting to be read.");
+  fprintf(out, PREFIX "queue_depth %u\n", progress->queued);
+  header(out, "files_in_flight", "gauge", "Files being read or written.");
+  fprintf(out, PREFIX "files_in_flight %u\n", progress->in_flight);
+  header(out, "files_imported_total", "counter", "Files imported.");
+  fprintf(out, PREFIX "files_imported_total %lu\n", progress->imported);
+  header(out, "files_rejected_total", "counter", "Files not imported.");
+  for (unsigned int i = 0; i < REJECT_COUNT; ++i)
+    fprintf(out, PREFIX "files_rejected_total{reason=\"%s\"} %lu\n",
+      reject_names[i], progress->rejected[i]);
+
+  for (unsigned int i = 0; i < COUNTER_COUNT; ++i) {
+    char name[64];
+    snprintf(name, sizeof(name), "%s_total", stats_counter_names[i]);
+    header(out, name, "counter", "Ingest events, see stats.h.");
+    fprintf(out, PREFIX "%s %lu\n", name, run->counters[i]);
+  }
+
+  rate(out, "decode_frames_per_second", "Frames decoded per second, last file.",
+    last_file->counters[COUNTER_FRAMES_DECODED], last_file->elapsed);
+  rate(out, "cells_per_second", "Cells matched per second, last file.",
+    last_file->counters[COUNTER_CELLS_MATCHED], last_file->elapsed);
+  rate(out, "rows_per_second", "Rows inserted per second, last file.",
+    last_file->counters[COUNTER_ROWS_INSERTED], last_file->elapsed);
+
+  header(out, "stage_seconds", "histogram", "Latency of each stage call.");
+  for (unsigned int i = 0; i < STAGE_COUNT; ++i) {
+    const char *stage = stats_stage_names[i];
+    unsigned long cumulative = 0;
+    for (unsigned int j = 0; j < STATS_BUCKET_COUNT; ++j) {
+      cumulative += run->buckets[i][j];
+      fprintf(out, PREFIX "stage_seconds_bucket{stage=\"%s\",le=\"%g\"} %lu\n",
+        stage, stats_bucket_limits[j], cumulative);
+    }
+    fprintf(out, PREFIX "stage_seconds_bucket{stage=\"%s\",le=\"+Inf\"} %lu\n",
+      stage, run->calls[i]);
+    fprintf(out, PREFIX "stage_seconds_sum{stage=\"%s\"} %.6f\n",
+      stage, run->seconds[i]);
+    fprintf(out, PREFIX "stage_seconds_count{stage=\"%s\"} %lu\n",
+      stage, run->calls[i]);
+  }
+}
+
+bool metrics_write(const char filename[], const Progress *progress,
+  const Stats *run, const Stats *last_file) {
+  /* Scrapers never see half a file. */
+  char *temporary = malloc(strlen(filename) + sizeof(".tmp"));
+  if (temporary == NULL)
+    errx(1, "Could not allocate file name");
+  strcpy(temporary, filename);
+  strcat(temporary, ".tmp");
+  FILE *out = fopen(temporary, "w");
+  if (out == NULL) {
+    warn("Could not open %s", temporary);
+    free(temporary);
+    return false;
+  }
+  metrics_print(out, progress, run, last_file);
+  bool written = 0 == fclose(out);
+  if (!written)
+    warn("Could not write %s", temporary);
+  else if (0 != rename(temporary, filename)) {
+    warn("Could not replace %s", filename);
+    written = false;
+  }
+  free(temporary);
+  return written;
+}
@@ -0,0 +1,41 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#pragma once
+
+#include <stdbool.h>
+#include <stdio.h>
+#include "stats.h"
+
+/**
+ * Why a file wasn’t imported.
+ */
+typedef enum {
+  REJECT_UNREADABLE,  /* no lines could be read from the video */
+  REJECT_INVALID,     /* the lines failed lines_ok */
+  REJECT_COUNT,
+} RejectReason;
+
+/**
+ * Where an ingest run is, besides its stats.
+ */
+typedef struct {
+  unsigned int queued;
+  unsigned int in_flight;
+  unsigned long imported;
+  unsigned long rejected[REJECT_COUNT];
+} Progress;
+
+/**
+ * Prints the metrics in the Prometheus text exposition format: progress
+ * gauges and counters, the run’s stats as counters and per stage latency
+ * histograms, and the last file’s throughput as gauges.
+ */
+void metrics_print(FILE *out, const Progress *progress, const Stats *run,
+  const Stats *last_file);
+
+/**
+ * Replaces the file with the metrics at once, for node_exporter’s textfile
+ * collector or curl through any static file server. Returns false, with a
+ * warning, when it couldn’t.
+ */
+bool metrics_write(const char filename[], const Progress *progress,
+  const Stats *run, const Stats *last_file);
@@ -0,0 +1,154 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#include <err.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mvt.h"
+
+/* Protocol buffers wire types. */
+#define VARINT 0
+#define LENGTH 2
+
+/* Field numbers of vector_tile.proto. */
+#define TILE_LAYERS 3
+#define LAYER_NAME 1
+#define LAYER_FEATURES 2
+#define LAYER_KEYS 3
+#define LAYER_VALUES 4
+#define LAYER_EXTENT 5
+#define LAYER_VERSION 15
+#define FEATURE_ID 1
+#define FEATURE_TAGS 2
+#define FEATURE_TYPE 3
+#define FEATURE_GEOMETRY 4
+#define VALUE_INT 4
+
+/* Geometry type and commands. */
+#define LINESTRING 2
+#define MOVE_TO 1
+#define LINE_TO 2
+
+static void put_bytes(MvtBuffer *buffer, const void *bytes, size_t size) {
+  if (size == 0)
+    return;
+  if (buffer->size + size > buffer->allocated) {
+    size_t allocated = buffer->allocated > 0 ? buffer->allocated : 256;
+    while (allocated < buffer->size + size)
+      allocated *= 2;
+    buffer->data = realloc(buffer->data, allocated);
+    if (buffer->data == NULL)
+      errx(1, "Could not allocate %zu bytes for a vector tile", allocated);
+    buffer->allocated = allocated;
+  }
+  memcpy(buffer->data + buffer->size, bytes, size);
+  buffer->size += size;
+}
+
+static void put_varint(MvtBuffer *buffer, uint64_t value) {
+  unsigned char bytes[10];
+  size_t size = 0;
+  do {
+    bytes[size++] = (value & 0x7f) | (value > 0x7f ? 0x80 : 0);
+    value >>= 7;
+  } while (value > 0);
+  put_bytes(buffer, bytes, size);
+}
+
+static void put_key(MvtBuffer *buffer, unsigned int field, unsigned int type) {
+  put_varint(buffer, field << 3 | type);
+}
+
+/**
+ * Puts a length delimited field: a message, a string, or a packed array.
+ */
+static void put_message(MvtBuffer *buffer, unsigned int field,
+  const void *bytes, size_t size) {
+  put_key(buffer, field, LENGTH);
+  put_varint(buffer, size);
+  put_bytes(buffer, bytes, size);
+}
+
+static uint32_t zigzag(int32_t value) {
+  return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+void mvt_begin(MvtLayer *layer, unsigned int key_count,
+  const char *const keys[key_count]) {
+  if (key_count > MVT_MAX_KEYS)
+    errx(1, "Too many vector tile attributes: %u", key_count);
+  *layer = (MvtLayer){ .key_count = key_count };
+  for (unsigned int i = 0; i < key_count; ++i)
+    layer->keys[i] = keys[i];
+}
+
+void mvt_add_line(MvtLayer *layer, uint64_t id, const int64_t values[],
+  size_t count, const int32_t xy[2 * count]) {
+  size_t distinct = count > 0;
+  for (size_t i = 1; i < count; ++i)
+    distinct += xy[2 * i] != xy[2 * i - 2] || xy[2 * i + 1] != xy[2 * i - 1];
+  if (distinct < 2)
+    return;
+
+  MvtBuffer *scratch = &layer->scratch;
+  MvtBuffer feature = { NULL, 0, 0 };
+  put_key(&feature, FEATURE_ID, VARINT);
+  put_varint(&feature, id);
+  put_key(&feature, FEATURE_TYPE, VARINT);
+  put_varint(&feature, LINESTRING);
+
+  /* Each value is its own Value message, referenced by position. */
+  scratch->size = 0;
+  for (unsigned int i = 0; i < layer->key_count; ++i) {
+    MvtBuffer value = { NULL, 0, 0 };
+    put_key(&value, VALUE_INT, VARINT);
+    put_varint(&value, values[i]);
+    put_message(&layer->values, LAYER_VALUES, value.data, value.size);
+    free(value.data);
+    put_varint(scratch, i);
+    put_varint(scratch, layer->value_count++);
+  }
+  if (layer->key_count > 0)
+    put_message(&feature, FEATURE_TAGS, scratch->data, scratch->size);
+
+  /* A move to the first point and a line to the rest, as deltas. */
+  scratch->size = 0;
+  put_varint(scratch, MOVE_TO | 1 << 3);
+  put_varint(scratch, zigzag(xy[0]));
+  put_varint(scratch, zigzag(xy[1]));
+  put_varint(scratch, LINE_TO | (distinct - 1) << 3);
+  for (size_t i = 1, last = 0; i < count; ++i) {
+    int32_t dx = xy[2 * i] - xy[2 * last];
+    int32_t dy = xy[2 * i + 1] - xy[2 * last + 1];
+    if (dx == 0 && dy == 0)
+      continue;
+    put_varint(scratch, zigzag(dx));
+    put_varint(scratch, zigzag(dy));
+    last = i;
+  }
+  put_message(&feature, FEATURE_GEOMETRY, scratch->data, scratch->size);
+
+  put_message(&layer->features, LAYER_FEATURES, feature.data, feature.size);
+  free(feature.data);
+  layer->feature_count++;
+}
+
+unsigned char *mvt_finish(MvtLayer *layer, const char name[], size_t *size) {
+  MvtBuffer encoded = { NULL, 0, 0 };
+  put_key(&encoded, LAYER_VERSION, VARINT);
+  put_varint(&encoded, 2);
+  put_message(&encoded, LAYER_NAME, name, strlen(name));
+  put_bytes(&encoded, layer->features.data, layer->features.size);
+  for (unsigned int i = 0; i < layer->key_count; ++i)
+    put_message(&encoded, LAYER_KEYS, layer->keys[i], strlen(layer->keys[i]));
+  put_bytes(&encoded, layer->values.data, layer->values.size);
+  put_key(&encoded, LAYER_EXTENT, VARINT);
+  put_varint(&encoded, MVT_EXTENT);
+
+  MvtBuffer tile = { NULL, 0, 0 };
+  put_message(&tile, TILE_LAYERS, encoded.data, encoded.size);
+  free(encoded.data);
+  free(layer->features.data);
+  free(layer->values.data);
+  free(layer->scratch.data);
+  *size = tile.size;
+  return tile.data;
+}
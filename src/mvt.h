@@ -0,0 +1,54 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Size of a vector tile in its own coordinates, the usual one. */
+#define MVT_EXTENT 4096
+
+/* Most attributes a layer can have. */
+#define MVT_MAX_KEYS 8
+
+/**
+ * A growing buffer of protocol buffers data.
+ */
+typedef struct {
+  unsigned char *data;
+  size_t size;
+  size_t allocated;
+} MvtBuffer;
+
+/**
+ * A Mapbox Vector Tile layer being encoded. Features and their attribute values
+ * are encoded as they are added, then wrapped into the tile.
+ */
+typedef struct {
+  unsigned int key_count;
+  const char *keys[MVT_MAX_KEYS];
+  size_t feature_count;
+  uint32_t value_count;
+  MvtBuffer features;
+  MvtBuffer values;
+  MvtBuffer scratch;
+} MvtLayer;
+
+/**
+ * Starts a layer with integer attributes of the given names.
+ */
+void mvt_begin(MvtLayer *layer, unsigned int key_count,
+  const char *const keys[key_count]);
+
+/**
+ * Adds a linestring in tile coordinates (x to the east, y to the south, 0 to
+ * MVT_EXTENT inside the tile), with a value for each attribute. Repeated
+ * points are dropped, and so is the line when less than two are left.
+ */
+void mvt_add_line(MvtLayer *layer, uint64_t id, const int64_t values[],
+  size_t count, const int32_t xy[2 * count]);
+
+/**
+ * Encodes a tile with just this layer and frees the layer. Returns the tile,
+ * to be freed by the caller, and sets its size.
+ */
+unsigned char *mvt_finish(MvtLayer *layer, const char name[], size_t *size);
@@ -10,50 +10,29 @@
 #include <sqlite3.h>
 #include <spatialite/gaiageo.h>
 #include <spatialite.h>
+#include "compact.h"
 #include "db.h"
+#include "density.h"
+#include "journal.h"
 #include "output_data.h"
+#include "stats.h"
+#include "stays.h"
+#include "track.h"
+#include "trips.h"
 
-/**
- * Gets the timestamp based on the video filename.
- */
-static time_t video_start_time(const char video_name[]) {
+time_t video_start_time(const char video_name[]) {
   struct tm time;
   char name_date[] = "YYYYMMDDhhmmss";
+  if (strlen(video_name) < sizeof("YYYYMMDDhhmmss_xxxxxx.TS") - 1)
+    return -1;
   strncpy(name_date, &video_name[strlen(video_name) - 24],
     sizeof(name_date) - 1);
   if (0 == strptime(name_date, "%Y%m%d%H%M%S", &time))
-    errx(1, "Unable to read video filename time");
-  time.tm_isdst = -1;
-  return mktime(&time);
-}
-
-/**
- * Tries to get the timestamp from the right line.
- */
-static time_t line_time(const CharLine line) {
-  struct tm time;
-  char line_right[20];
-  strncpy(line_right, line.right + FRAME_STRING_LENGTH - 20, 19);
-  line_right[sizeof(line_right) - 1] = '\0';
-  if (0 == strptime(line_right, "%d %m %Y %H %M %S", &time)) {
-    return 0;
-  }
+    return -1;
   time.tm_isdst = -1;
   return mktime(&time);
 }
 
-/**
- * Coordinates and whether they’re valid.
- */
-typedef struct {
-  bool valid;
-  double lon;
-  double lat;
-} SimplePoint;
-
-/**
- * Tries to get and validate the coordinates from the left line.
- */
 SimplePoint simple_point_from_char_line(const CharLine line) {
   SimplePoint ret = {
     .valid = false,
@@ -87,11 +66,11 @@ SimplePoint simple_point_from_char_line(const CharLine line) {
 
 bool lines_ok(const char video_name[],
   unsigned int count, const CharLine lines[count]) {
-  /* Initialize “Great Circle” ellipsoid constants from GRS80. */
-  const double ellipse_a = 6378137;
-  const double ellipse_b = 6356752.3141403561458;
-
   const time_t video_time = video_start_time(video_name);
+  if (video_time == -1) {
+    warnx("Unable to read video filename time “%s”", video_name);
+    return false;
+  }
   time_t previous_time = video_time;
   SimplePoint previous_point = { .valid = false };
   for (unsigned int i = 0; i < count; ++i) {
@@ -107,8 +86,7 @@ bool lines_ok(const char video_name[],
 
     if (this_point.valid) {
       if (previous_point.valid) {
-        double distance = gaiaGreatCircleDistance(
-          ellipse_a, ellipse_b,
+        double distance = great_circle_distance(
           previous_point.lat, previous_point.lon,
           this_point.lat, this_point.lon);
         /* More than 200 m/s is probably wrong coordinates. */
@@ -122,29 +100,143 @@ bool lines_ok(const char video_name[],
   return true;
 }
 
-void append_lines(const char video_name[], unsigned int count,
-  const CharLine lines[count], const char database_name[]) {
-  SpatiaLite sp = open_and_init_db(database_name);
-  sqlite3* db = sp.db;
+unsigned int stationary_step(unsigned int count, const CharLine lines[count],
+  void *radius) {
+  if (count == 0)
+    return 1;
+  const SimplePoint last = simple_point_from_char_line(lines[count - 1]);
+  const time_t last_time = line_time(lines[count - 1]);
+  if (!last.valid || last_time == 0)
+    return 1;
+  /* How long the locations stayed close to the last one. */
+  time_t since = last_time;
+  for (unsigned int i = count - 1; i > 0; --i) {
+    SimplePoint point = simple_point_from_char_line(lines[i - 1]);
+    time_t point_time = line_time(lines[i - 1]);
+    if (!point.valid || point_time == 0 || point_time > since
+      || great_circle_distance(last.lat, last.lon, point.lat, point.lon)
+        > *(double *)radius)
+      break;
+    since = point_time;
+  }
+  time_t step = (last_time - since) / 2;
+  return step < 1 ? 1 : step > STATIONARY_MAX_STEP ? STATIONARY_MAX_STEP : step;
+}
+
+/**
+ * Marks covered the seconds from the rows of the query, each a time range
+ * (inclusive) overlapping the coverage, bound as the first two parameters.
+ */
+static void cover_ranges(sqlite3 *db, const char query[], Coverage *coverage) {
   sqlite3_stmt *stmt;
+  if (SQLITE_OK != sqlite3_prepare_v2(db, query, -1, &stmt, NULL))
+    errx(1, "Could not prepare coverage statement “%s”", query);
+  if (SQLITE_OK != sqlite3_bind_int64(stmt, 1, coverage->start)
+    || SQLITE_OK != sqlite3_bind_int64(stmt, 2,
+      coverage->start + COVERAGE_SECONDS - 1))
+    errx(1, "Could not bind coverage range");
+  int step;
+  while (SQLITE_ROW == (step = sqlite3_step(stmt))) {
+    time_t from = sqlite3_column_int64(stmt, 0) - coverage->start;
+    time_t to = sqlite3_column_int64(stmt, 1) - coverage->start;
+    for (time_t i = from < 0 ? 0 : from; i <= to && i < COVERAGE_SECONDS; ++i)
+      coverage->covered[i] = true;
+  }
+  if (SQLITE_DONE != step)
+    errx(1, "Could not step coverage statement “%s”", query);
+  if (SQLITE_OK != sqlite3_finalize(stmt))
+    errx(1, "Could not finalize coverage statement");
+}
 
-  begin_transaction(db, "data");
+unsigned int coverage_load(sqlite3 *db, time_t start, Coverage *coverage) {
+  coverage->start = start;
+  memset(coverage->covered, 0, sizeof(coverage->covered));
+  cover_ranges(db, "SELECT timestamp, timestamp FROM locations"
+    "  WHERE timestamp BETWEEN ?1 AND ?2;", coverage);
+  cover_ranges(db, "SELECT timestamp, end_time FROM stationary"
+    "  WHERE end_time >= ?1 AND timestamp <= ?2;", coverage);
+  /* Seconds skipped while stationary aren’t in the track, but were read. */
+  cover_ranges(db, "SELECT start_time, end_time FROM compact_tracks"
+    "  WHERE end_time >= ?1 AND start_time <= ?2;", coverage);
+  unsigned int covered = 0;
+  for (unsigned int i = 0; i < VIDEO_SECONDS; ++i)
+    covered += coverage->covered[i];
+  return covered;
+}
+
+unsigned int coverage_step(unsigned int count, const CharLine lines[count],
+  void *data) {
+  const Coverage *coverage = data;
+  unsigned int step = coverage->step == NULL
+    ? 1
+    : coverage->step(count, lines, coverage->step_data);
+  if (step < 1)
+    step = 1;
+  if (count == 0)
+    return step;
+  /* A misread time would skip the wrong seconds. */
+  const time_t last_time = line_time(lines[count - 1]);
+  if (last_time < coverage->start
+    || last_time >= coverage->start + COVERAGE_SECONDS)
+    return step;
+  for (time_t i = last_time - coverage->start + step; i < COVERAGE_SECONDS; ++i)
+    if (!coverage->covered[i])
+      return i - (last_time - coverage->start);
+  return COVERAGE_SECONDS;
+}
 
-  /* Add locations and timestamps to database. */
+/**
+ * Adds locations and timestamps to the locations table, replacing the ones at
+ * the same timestamps. A location with until after its timestamp stands for a
+ * stationary run, its end time goes in the stationary table.
+ */
+static void append_locations(sqlite3 *db, unsigned int count,
+  const TrackPoint points[count], const time_t until[count],
+  DensityChanges *density) {
+  sqlite3_stmt *stmt;
   const char insert[] =
     "INSERT OR REPLACE INTO locations(timestamp, place) VALUES (?, ?);";
   if (SQLITE_OK != sqlite3_prepare_v2(db, insert, sizeof(insert), &stmt, NULL))
     errx(1, "Could not prepare insert statement");
+  sqlite3_stmt *delete_end, *insert_end;
+  const char delete_run_end[] = "DELETE FROM stationary WHERE timestamp = ?;";
+  const char insert_run_end[] =
+    "INSERT INTO stationary(timestamp, end_time) VALUES (?, ?);";
+  if (SQLITE_OK != sqlite3_prepare_v2(db, delete_run_end,
+      sizeof(delete_run_end), &delete_end, NULL)
+    || SQLITE_OK != sqlite3_prepare_v2(db, insert_run_end,
+      sizeof(insert_run_end), &insert_end, NULL))
+    errx(1, "Could not prepare stationary end statements");
+  sqlite3_stmt *previous;
+  const char find_previous[] =
+    "SELECT X(place), Y(place) FROM locations WHERE timestamp = ?;";
+  if (SQLITE_OK != sqlite3_prepare_v2(db, find_previous, sizeof(find_previous),
+      &previous, NULL))
+    errx(1, "Could not prepare previous location statement");
   for (unsigned int i = 0; i < count; ++i) {
-    SimplePoint simple = simple_point_from_char_line(lines[i]);
-    if (!simple.valid) continue;
+    /* A replaced location no longer counts for the density. */
+    if (SQLITE_OK != sqlite3_reset(previous)
+      || SQLITE_OK != sqlite3_bind_int64(previous, 1, points[i].timestamp))
+      errx(1, "Could not bind previous location timestamp");
+    switch (sqlite3_step(previous)) {
+      case SQLITE_ROW:
+        density_add(density, sqlite3_column_double(previous, 0),
+          sqlite3_column_double(previous, 1), -1);
+        break;
+      case SQLITE_DONE:
+        break;
+      default:
+        errx(1, "Could not step previous location statement");
+    }
+    density_add(density, points[i].lon, points[i].lat, 1);
+
     unsigned char *wkb;
     int wkb_size;
     gaiaGeomCollPtr geo = gaiaAllocGeomColl();
     if (geo == NULL)
       errx(1, "Could not allocate geometry collection");
     geo->Srid = 4326;
-    gaiaAddPointToGeomColl(geo, simple.lon, simple.lat);
+    gaiaAddPointToGeomColl(geo, points[i].lon, points[i].lat);
     gaiaToSpatiaLiteBlobWkb(geo, &wkb, &wkb_size);
     gaiaFreeGeomColl(geo);
     if (SQLITE_OK != sqlite3_reset(stmt))
@@ -152,26 +244,426 @@ void append_lines(const char video_name[], unsigned int count,
     sqlite3_clear_bindings(stmt);
     static_assert(sizeof(time_t) == sizeof(int64_t),
       "time_t should be compatible with int64_t");
-    if (SQLITE_OK != sqlite3_bind_int64(stmt, 1, line_time(lines[i])))
+    if (SQLITE_OK != sqlite3_bind_int64(stmt, 1, points[i].timestamp))
       errx(1, "Could not bind timestamp");
     // Also frees the blob allocated for the wkb
     if (SQLITE_OK != sqlite3_bind_blob(stmt, 2, wkb, wkb_size, free))
       errx(1, "Could not bind location");
     if (SQLITE_DONE != sqlite3_step(stmt))
       errx(1, "Statement is not done after step");
+
+    /* Replaces the end time too, when it’s a stationary run. */
+    if (SQLITE_OK != sqlite3_reset(delete_end)
+      || SQLITE_OK != sqlite3_bind_int64(delete_end, 1, points[i].timestamp))
+      errx(1, "Could not bind stationary end deletion");
+    if (SQLITE_DONE != sqlite3_step(delete_end))
+      errx(1, "Could not delete stationary end time");
+    if (until[i] > points[i].timestamp) {
+      if (SQLITE_OK != sqlite3_reset(insert_end)
+        || SQLITE_OK != sqlite3_bind_int64(insert_end, 1, points[i].timestamp)
+        || SQLITE_OK != sqlite3_bind_int64(insert_end, 2, until[i]))
+        errx(1, "Could not bind stationary end time");
+      if (SQLITE_DONE != sqlite3_step(insert_end))
+        errx(1, "Could not insert stationary end time");
+    }
   }
-  if (SQLITE_OK != sqlite3_finalize(stmt))
+  stats_count(COUNTER_ROWS_INSERTED, count);
+  if (SQLITE_OK != sqlite3_finalize(stmt)
+    || SQLITE_OK != sqlite3_finalize(previous)
+    || SQLITE_OK != sqlite3_finalize(delete_end)
+    || SQLITE_OK != sqlite3_finalize(insert_end))
     errx(1, "Could not finalize insertions");
+}
+
+/**
+ * Replaces the compact track of the video with the points, which should be in
+ * timestamp order. Points at timestamps already in the database are left out.
+ */
+static void append_compact(sqlite3 *db, const char video_record_name[],
+  unsigned int count, const TrackPoint points[count],
+  DensityChanges *density) {
+  sqlite3_stmt *stmt;
+
+  /* A video imported again replaces its previous track. */
+  const char find_previous[] =
+    "SELECT id, track FROM compact_tracks WHERE filename = ?;";
+  if (SQLITE_OK != sqlite3_prepare_v2(db, find_previous, sizeof(find_previous),
+      &stmt, NULL))
+    errx(1, "Could not prepare previous track statement");
+  if (SQLITE_OK != sqlite3_bind_text(stmt, 1, video_record_name,
+      strlen(video_record_name), SQLITE_STATIC))
+    errx(1, "Could not bind previous track file name");
+  int step = sqlite3_step(stmt);
+  if (SQLITE_ROW == step) {
+    sqlite3_int64 id = sqlite3_column_int64(stmt, 0);
+    TrackPoint *previous;
+    int previous_count = compact_decode(sqlite3_column_bytes(stmt, 1),
+      sqlite3_column_blob(stmt, 1), &previous);
+    if (previous_count < 0)
+      errx(1, "Invalid compact track for “%s”", video_record_name);
+    for (int i = 0; i < previous_count; ++i)
+      density_add(density, previous[i].lon, previous[i].lat, -1);
+    free(previous);
+
+    sqlite3_stmt *delete;
+    const char delete_track[] =
+      "DELETE FROM compact_tracks WHERE id = ?1;"
+      "DELETE FROM compact_tracks_bbox WHERE id = ?1;";
+    const char *next = delete_track;
+    while (*next != '\0') {
+      if (SQLITE_OK != sqlite3_prepare_v2(db, next, -1, &delete, &next))
+        errx(1, "Could not prepare previous track deletion");
+      if (SQLITE_OK != sqlite3_bind_int64(delete, 1, id))
+        errx(1, "Could not bind previous track id");
+      if (SQLITE_DONE != sqlite3_step(delete))
+        errx(1, "Could not delete previous track");
+      if (SQLITE_OK != sqlite3_finalize(delete))
+        errx(1, "Could not finalize previous track deletion");
+    }
+  }
+  else if (SQLITE_DONE != step)
+    errx(1, "Could not step previous track statement");
+  if (SQLITE_OK != sqlite3_finalize(stmt))
+    errx(1, "Could not finalize previous track statement");
+  if (count == 0)
+    return;
+
+  /* Leave out what other videos already have. */
+  TrackPoint *existing;
+  unsigned int existing_count = load_track(db,
+    points[0].timestamp, points[count - 1].timestamp, &existing);
+  TrackPoint *added = malloc(count * sizeof(TrackPoint));
+  if (added == NULL)
+    errx(1, "Could not allocate %u track points", count);
+  unsigned int added_count = 0;
+  double min_lon = points[0].lon, max_lon = points[0].lon;
+  double min_lat = points[0].lat, max_lat = points[0].lat;
+  for (unsigned int i = 0, j = 0; i < count; ++i) {
+    while (j < existing_count && existing[j].timestamp < points[i].timestamp)
+      j++;
+    if (j < existing_count && existing[j].timestamp == points[i].timestamp)
+      continue;
+    added[added_count++] = points[i];
+    density_add(density, points[i].lon, points[i].lat, 1);
+    min_lon = points[i].lon < min_lon ? points[i].lon : min_lon;
+    max_lon = points[i].lon > max_lon ? points[i].lon : max_lon;
+    min_lat = points[i].lat < min_lat ? points[i].lat : min_lat;
+    max_lat = points[i].lat > max_lat ? points[i].lat : max_lat;
+  }
+  free(existing);
+  if (added_count == 0) {
+    free(added);
+    return;
+  }
+
+  unsigned char *blob;
+  int blob_size = compact_encode(added_count, added, &blob);
+  const char insert[] =
+    "INSERT INTO compact_tracks(filename, start_time, end_time, points, track)"
+    "  VALUES (?, ?, ?, ?, ?);";
+  if (SQLITE_OK != sqlite3_prepare_v2(db, insert, sizeof(insert), &stmt, NULL))
+    errx(1, "Could not prepare track insertion");
+  if (SQLITE_OK != sqlite3_bind_text(stmt, 1, video_record_name,
+      strlen(video_record_name), SQLITE_STATIC)
+    || SQLITE_OK != sqlite3_bind_int64(stmt, 2, added[0].timestamp)
+    || SQLITE_OK !=
+      sqlite3_bind_int64(stmt, 3, added[added_count - 1].timestamp)
+    || SQLITE_OK != sqlite3_bind_int(stmt, 4, added_count))
+    errx(1, "Could not bind track");
+  free(added);
+  // Also frees the blob
+  if (SQLITE_OK != sqlite3_bind_blob(stmt, 5, blob, blob_size, free))
+    errx(1, "Could not bind track blob");
+  if (SQLITE_DONE != sqlite3_step(stmt))
+    errx(1, "Could not insert track");
+  if (SQLITE_OK != sqlite3_finalize(stmt))
+    errx(1, "Could not finalize track insertion");
+
+  const char insert_bbox[] =
+    "INSERT INTO compact_tracks_bbox(id, min_lon, max_lon, min_lat, max_lat)"
+    "  VALUES (?, ?, ?, ?, ?);";
+  if (SQLITE_OK != sqlite3_prepare_v2(db, insert_bbox, sizeof(insert_bbox),
+      &stmt, NULL))
+    errx(1, "Could not prepare track box insertion");
+  if (SQLITE_OK != sqlite3_bind_int64(stmt, 1, sqlite3_last_insert_rowid(db))
+    || SQLITE_OK != sqlite3_bind_double(stmt, 2, min_lon)
+    || SQLITE_OK != sqlite3_bind_double(stmt, 3, max_lon)
+    || SQLITE_OK != sqlite3_bind_double(stmt, 4, min_lat)
+    || SQLITE_OK != sqlite3_bind_double(stmt, 5, max_lat))
+    errx(1, "Could not bind track box");
+  if (SQLITE_DONE != sqlite3_step(stmt))
+    errx(1, "Could not insert track box");
+  if (SQLITE_OK != sqlite3_finalize(stmt))
+    errx(1, "Could not finalize track box insertion");
+  stats_count(COUNTER_ROWS_INSERTED, 2);
+}
+
+/**
+ * Valid points of the lines in timestamp order, one per timestamp (the last one
+ * read). The points array is allocated and should be freed by the caller.
+ * Returns the number of points.
+ */
+static unsigned int points_from_lines(unsigned int count,
+  const CharLine lines[count], TrackPoint **points) {
+  *points = malloc((count ? count : 1) * sizeof(TrackPoint));
+  if (*points == NULL)
+    errx(1, "Could not allocate %u track points", count);
+  unsigned int found = 0;
+  for (unsigned int i = 0; i < count; ++i) {
+    SimplePoint simple = simple_point_from_char_line(lines[i]);
+    if (!simple.valid) continue;
+    TrackPoint point = { line_time(lines[i]), simple.lon, simple.lat };
+    /* Lines are almost in order, so insertion is cheap. */
+    unsigned int j = found;
+    while (j > 0 && (*points)[j - 1].timestamp > point.timestamp)
+      j--;
+    if (j > 0 && (*points)[j - 1].timestamp == point.timestamp) {
+      (*points)[j - 1] = point;
+      continue;
+    }
+    memmove(&(*points)[j + 1], &(*points)[j],
+      (found - j) * sizeof(TrackPoint));
+    (*points)[j] = point;
+    found++;
+  }
+  return found;
+}
+
+/**
+ * Deletes the rows of the statements in sql (bound to the file name) one after
+ * the other.
+ */
+static void delete_for_file(sqlite3 *db, const char sql[],
+  const char video_record_name[]) {
+  sqlite3_stmt *stmt;
+  const char *next = sql;
+  while (*next != '\0') {
+    if (SQLITE_OK != sqlite3_prepare_v2(db, next, -1, &stmt, &next))
+      errx(1, "Could not prepare deletion “%s”", next);
+    if (SQLITE_OK != sqlite3_bind_text(stmt, 1, video_record_name, -1,
+        SQLITE_STATIC))
+      errx(1, "Could not bind deleted file name");
+    if (SQLITE_DONE != sqlite3_step(stmt))
+      errx(1, "Could not delete rows of “%s”", video_record_name);
+    if (SQLITE_OK != sqlite3_finalize(stmt))
+      errx(1, "Could not finalize deletion");
+  }
+}
+
+/**
+ * Deletes the video’s row in the videos table and its box and, unless compact
+ * (compact tracks are replaced whole), the locations and stationary runs over
+ * its span, discounting them from the density. Sets from and to to the span,
+ * leaving them as they are when the video wasn’t catalogued.
+ */
+static void delete_previous(sqlite3 *db, const char video_record_name[],
+  bool compact, DensityChanges *density, time_t *from, time_t *to) {
+  sqlite3_stmt *stmt;
+  const char find_span[] =
+    "SELECT start_time, end_time FROM videos WHERE filename = ?;";
+  if (SQLITE_OK != sqlite3_prepare_v2(db, find_span, sizeof(find_span), &stmt,
+      NULL))
+    errx(1, "Could not prepare previous span statement");
+  if (SQLITE_OK != sqlite3_bind_text(stmt, 1, video_record_name, -1,
+      SQLITE_STATIC))
+    errx(1, "Could not bind previous span file name");
+  int step = sqlite3_step(stmt);
+  if (SQLITE_ROW == step) {
+    *from = sqlite3_column_int64(stmt, 0);
+    *to = sqlite3_column_int64(stmt, 1);
+  }
+  else if (SQLITE_DONE != step)
+    errx(1, "Could not step previous span statement");
+  if (SQLITE_OK != sqlite3_finalize(stmt))
+    errx(1, "Could not finalize previous span statement");
+  if (SQLITE_DONE != step) {
+    delete_for_file(db,
+      "DELETE FROM videos_bbox WHERE id IN"
+      "  (SELECT id FROM videos WHERE filename = ?1);"
+      "DELETE FROM videos WHERE filename = ?1;", video_record_name);
+  }
+  if (compact || SQLITE_DONE == step)
+    return;
+
+  const char find_locations[] =
+    "SELECT X(place), Y(place) FROM locations"
+    "  WHERE timestamp BETWEEN ?1 AND ?2;";
+  if (SQLITE_OK != sqlite3_prepare_v2(db, find_locations,
+      sizeof(find_locations), &stmt, NULL))
+    errx(1, "Could not prepare previous locations statement");
+  if (SQLITE_OK != sqlite3_bind_int64(stmt, 1, *from)
+    || SQLITE_OK != sqlite3_bind_int64(stmt, 2, *to))
+    errx(1, "Could not bind previous locations span");
+  while (SQLITE_ROW == (step = sqlite3_step(stmt)))
+    density_add(density, sqlite3_column_double(stmt, 0),
+      sqlite3_column_double(stmt, 1), -1);
+  if (SQLITE_DONE != step)
+    errx(1, "Could not step previous locations statement");
+  if (SQLITE_OK != sqlite3_finalize(stmt))
+    errx(1, "Could not finalize previous locations statement");
+  const char delete_span[] =
+    "DELETE FROM locations WHERE timestamp BETWEEN ?1 AND ?2;"
+    "DELETE FROM stationary WHERE timestamp BETWEEN ?1 AND ?2;";
+  const char *next = delete_span;
+  while (*next != '\0') {
+    if (SQLITE_OK != sqlite3_prepare_v2(db, next, -1, &stmt, &next))
+      errx(1, "Could not prepare deletion “%s”", next);
+    if (SQLITE_OK != sqlite3_bind_int64(stmt, 1, *from)
+      || SQLITE_OK != sqlite3_bind_int64(stmt, 2, *to))
+      errx(1, "Could not bind deleted span");
+    if (SQLITE_DONE != sqlite3_step(stmt))
+      errx(1, "Could not delete the previous rows of “%s”", video_record_name);
+    if (SQLITE_OK != sqlite3_finalize(stmt))
+      errx(1, "Could not finalize deletion");
+  }
+}
+
+/**
+ * Extends the box (min_lon, max_lon, min_lat, max_lat) to the points, starting
+ * from the first one when the box is still empty. Returns whether the box has
+ * any point.
+ */
+static bool box_extend(double box[4], bool boxed, unsigned int count,
+  const TrackPoint points[count]) {
+  for (unsigned int i = 0; i < count; ++i) {
+    if (!boxed) {
+      box[0] = box[1] = points[i].lon;
+      box[2] = box[3] = points[i].lat;
+      boxed = true;
+    }
+    box[0] = points[i].lon < box[0] ? points[i].lon : box[0];
+    box[1] = points[i].lon > box[1] ? points[i].lon : box[1];
+    box[2] = points[i].lat < box[2] ? points[i].lat : box[2];
+    box[3] = points[i].lat > box[3] ? points[i].lat : box[3];
+  }
+  return boxed;
+}
 
-  /* Record which files were imported. */
+/**
+ * Writes the video’s row in the videos table and its bounding box. The span
+ * goes from the time in the name for the given seconds (0 when unknown),
+ * stretched to the points, which are in timestamp order. The box covers the
+ * points and the locations already in the database over the span, for the
+ * seconds skipped. Writing again only widens the span, and keeps the path
+ * when the name has no directory (reprocess) and the first PTS when unknown.
+ * Videos without a time aren’t catalogued, those without locations have no
+ * box.
+ */
+static void record_video(sqlite3 *db, const char video_record_name[],
+  const char video_name[], unsigned int count, const TrackPoint points[count],
+  const int64_t *first_pts, time_t pts_time, unsigned int seconds) {
+  time_t start = video_start_time(video_record_name);
+  if (start == -1 && count > 0)
+    start = points[0].timestamp;
+  if (start == -1) {
+    delete_for_file(db,
+      "DELETE FROM videos_bbox WHERE id IN"
+      "  (SELECT id FROM videos WHERE filename = ?1);"
+      "DELETE FROM videos WHERE filename = ?1;", video_record_name);
+    return;
+  }
+  time_t end = start + (seconds > 0 ? seconds - 1 : 0);
+  if (count > 0) {
+    start = points[0].timestamp < start ? points[0].timestamp : start;
+    end = points[count - 1].timestamp > end ? points[count - 1].timestamp : end;
+  }
+  double box[4] = { 0 };
+  bool boxed = box_extend(box, false, count, points);
+  TrackPoint *known;
+  unsigned int known_count = load_track(db, start, end, &known);
+  boxed = box_extend(box, boxed, known_count, known);
+  free(known);
+
+  /* FFmpeg URLs of files, as parse_directory opens them. */
+  if (strncmp(video_name, "file:", 5) == 0)
+    video_name += 5;
+  sqlite3_stmt *stmt;
+  const char insert[] =
+    "INSERT INTO videos"
+    "  (filename, path, start_time, end_time, points, first_pts, pts_time)"
+    "  VALUES (?, ?, ?, ?, ?, ?, ?)"
+    "  ON CONFLICT(filename) DO UPDATE SET"
+    "  path = coalesce(excluded.path, path),"
+    "  start_time = min(excluded.start_time, start_time),"
+    "  end_time = max(excluded.end_time, end_time), points = excluded.points,"
+    "  first_pts = coalesce(excluded.first_pts, first_pts),"
+    "  pts_time = coalesce(excluded.pts_time, pts_time)"
+    "  RETURNING id;";
+  if (SQLITE_OK != sqlite3_prepare_v2(db, insert, sizeof(insert), &stmt, NULL))
+    errx(1, "Could not prepare video insertion");
+  if (SQLITE_OK != sqlite3_bind_text(stmt, 1, video_record_name, -1,
+      SQLITE_STATIC)
+    || SQLITE_OK != (strchr(video_name, '/') == NULL
+      ? sqlite3_bind_null(stmt, 2)
+      : sqlite3_bind_text(stmt, 2, video_name, -1, SQLITE_STATIC))
+    || SQLITE_OK != sqlite3_bind_int64(stmt, 3, start)
+    || SQLITE_OK != sqlite3_bind_int64(stmt, 4, end)
+    || SQLITE_OK != sqlite3_bind_int(stmt, 5, count)
+    || SQLITE_OK != (first_pts == NULL
+      ? sqlite3_bind_null(stmt, 6)
+      : sqlite3_bind_int64(stmt, 6, *first_pts))
+    || SQLITE_OK != (first_pts == NULL
+      ? sqlite3_bind_null(stmt, 7)
+      : sqlite3_bind_int64(stmt, 7, pts_time)))
+    errx(1, "Could not bind video");
+  if (SQLITE_ROW != sqlite3_step(stmt))
+    errx(1, "Could not insert video");
+  sqlite3_int64 id = sqlite3_column_int64(stmt, 0);
+  if (SQLITE_OK != sqlite3_finalize(stmt))
+    errx(1, "Could not finalize video insertion");
+  stats_count(COUNTER_ROWS_INSERTED, 1);
+
+  if (!boxed) {
+    delete_for_file(db,
+      "DELETE FROM videos_bbox WHERE id IN"
+      "  (SELECT id FROM videos WHERE filename = ?1);", video_record_name);
+    return;
+  }
+  const char insert_bbox[] =
+    "INSERT OR REPLACE INTO videos_bbox(id, min_lon, max_lon, min_lat, max_lat)"
+    "  VALUES (?, ?, ?, ?, ?);";
+  if (SQLITE_OK != sqlite3_prepare_v2(db, insert_bbox, sizeof(insert_bbox),
+      &stmt, NULL))
+    errx(1, "Could not prepare video box insertion");
+  if (SQLITE_OK != sqlite3_bind_int64(stmt, 1, id)
+    || SQLITE_OK != sqlite3_bind_double(stmt, 2, box[0])
+    || SQLITE_OK != sqlite3_bind_double(stmt, 3, box[1])
+    || SQLITE_OK != sqlite3_bind_double(stmt, 4, box[2])
+    || SQLITE_OK != sqlite3_bind_double(stmt, 5, box[3]))
+    errx(1, "Could not bind video box");
+  if (SQLITE_DONE != sqlite3_step(stmt))
+    errx(1, "Could not insert video box");
+  if (SQLITE_OK != sqlite3_finalize(stmt))
+    errx(1, "Could not finalize video box insertion");
+  stats_count(COUNTER_ROWS_INSERTED, 1);
+}
+
+void catalogue_video(const char video_name[], const char database_name[],
+  const int64_t *first_pts, unsigned int seconds) {
+  SpatiaLite sp = open_and_init_db(database_name);
+  const char *video_record_name = strrchr(video_name, '/');
+  video_record_name = video_record_name == NULL
+    ? video_name
+    : video_record_name + 1;
+  begin_transaction(sp.db, "catalogue");
+  record_video(sp.db, video_record_name, video_name, 0, NULL, first_pts,
+    video_start_time(video_record_name), seconds);
+  commit_transaction(sp.db, "catalogue");
+  close_db(sp);
+}
+
+void record_imported(sqlite3 *db, const char video_record_name[]) {
+  sqlite3_stmt *stmt;
+  /* Writing again a video not in the journal (reprocess) keeps its
+   * fingerprint. */
   const char record_file[] =
-    "INSERT OR REPLACE INTO imported(filename) VALUES (?);";
+    "INSERT INTO imported(filename, fingerprint) VALUES (?1,"
+    "  (SELECT fingerprint FROM journal WHERE filename = ?1))"
+    "  ON CONFLICT(filename) DO UPDATE"
+    "  SET fingerprint = coalesce(excluded.fingerprint, fingerprint);";
   if (SQLITE_OK !=
       sqlite3_prepare_v2(db, record_file, sizeof(record_file), &stmt, NULL))
     errx(1, "Could not prepare record file statement");
-  char video_record_name[] = "YYYYMMDDhhmmss_xxxxxx.TS";
-  strncpy(video_record_name, &video_name[strlen(video_name) - 24],
-    sizeof(video_record_name) - 1);
   if (SQLITE_OK != sqlite3_bind_text(stmt, 1,
       video_record_name, strlen(video_record_name), SQLITE_STATIC))
     errx(1, "Could not bind file name");
@@ -179,7 +671,104 @@ void append_lines(const char video_name[], unsigned int count,
     errx(1, "Could not perform file name insertion");
   if (SQLITE_OK != sqlite3_finalize(stmt))
     errx(1, "Could not finalize file name insertion");
+  journal_commit(db, video_record_name);
+}
+
+void append_lines(const char video_name[], unsigned int count,
+  const CharLine lines[count], const char database_name[],
+  const AppendOptions *options) {
+  const AppendOptions defaults = { .compact = false, .stationary_radius = 0 };
+  if (options == NULL)
+    options = &defaults;
+  SpatiaLite sp = open_and_init_db(database_name);
+  sqlite3* db = sp.db;
+  const char *video_record_name = strrchr(video_name, '/');
+  video_record_name = video_record_name == NULL
+    ? video_name
+    : video_record_name + 1;
+
+  begin_transaction(db, "data");
+  DensityChanges density = { 0 };
+  time_t first_time = 0;
+  time_t last_time = 0;
+
+  TrackPoint *points;
+  unsigned int point_count = points_from_lines(count, lines, &points);
+  time_t *until = malloc((point_count ? point_count : 1) * sizeof(time_t));
+  if (until == NULL)
+    errx(1, "Could not allocate %u stationary end times", point_count);
+  if (point_count > 0) {
+    first_time = points[0].timestamp;
+    last_time = points[point_count - 1].timestamp;
+  }
+  if (options->replace) {
+    time_t from = 0, to = 0;
+    delete_previous(db, video_record_name, options->compact, &density, &from,
+      &to);
+    /* The trips and stays of the seconds deleted change too. */
+    if (from != 0) {
+      first_time = first_time == 0 || from < first_time ? from : first_time;
+      last_time = to > last_time ? to : last_time;
+    }
+  }
+  /* The PTS of the first line with a time, to seek to that time. */
+  const int64_t *first_pts = NULL;
+  time_t pts_time = 0;
+  for (unsigned int i = 0; options->pts != NULL && i < count; ++i) {
+    pts_time = line_time(lines[i]);
+    if (pts_time != 0) {
+      first_pts = &options->pts[i];
+      break;
+    }
+  }
+  record_video(db, video_record_name, video_name, point_count, points,
+    first_pts, pts_time, options->seconds);
+  if (options->stationary_radius > 0) {
+    point_count = collapse_stationary(point_count, points,
+      options->stationary_radius, until);
+  }
+  else {
+    for (unsigned int i = 0; i < point_count; ++i)
+      until[i] = points[i].timestamp;
+  }
+
+  double start = stats_start();
+  if (options->compact) {
+    /* Compact tracks keep the ends of each stationary run. */
+    TrackPoint *ends = malloc((2 * point_count + 1) * sizeof(TrackPoint));
+    if (ends == NULL)
+      errx(1, "Could not allocate %u track points", 2 * point_count);
+    unsigned int end_count = 0;
+    for (unsigned int i = 0; i < point_count; ++i) {
+      ends[end_count++] = points[i];
+      if (until[i] > points[i].timestamp) {
+        ends[end_count] = points[i];
+        ends[end_count++].timestamp = until[i];
+      }
+    }
+    append_compact(db, video_record_name, end_count, ends, &density);
+    free(ends);
+  }
+  else {
+    append_locations(db, point_count, points, until, &density);
+  }
+  free(points);
+  free(until);
+  stats_stop(STAGE_INSERT, start);
+
+  /* Keep the derived tables up to date in the same transaction. */
+  start = stats_start();
+  if (first_time != 0) {
+    update_trips(db, first_time, last_time);
+    update_stays(db, first_time, last_time);
+  }
+  density_write(db, &density);
+
+  record_imported(db, video_record_name);
+  stats_stop(STAGE_DERIVE, start);
 
+  start = stats_start();
   commit_transaction(db, "data");
+  stats_stop(STAGE_COMMIT, start);
   close_db(sp);
 }
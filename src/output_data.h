@@ -1,8 +1,31 @@
 /* SPDX-License-Identifier: GPL-2.0-or-later */
 #pragma once
 #include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <sqlite3.h>
 #include "char_line.h"
 
+/**
+ * Gets the timestamp based on the video filename, or -1 if the name doesn’t
+ * follow the dash cam pattern.
+ */
+time_t video_start_time(const char video_name[]);
+
+/**
+ * Coordinates and whether they’re valid.
+ */
+typedef struct {
+  bool valid;
+  double lon;
+  double lat;
+} SimplePoint;
+
+/**
+ * Tries to get and validate the coordinates from the left line.
+ */
+SimplePoint simple_point_from_char_line(const CharLine line);
+
 /**
  * Checks whether lines make sense for a single input video. Namely they should
  * be within the video’s name timestamp range and the points should be
@@ -11,9 +34,105 @@
 bool lines_ok(const char video_name[],
   unsigned int count, const CharLine lines[count]);
 
+/* Most seconds skipped by stationary_step. */
+#define STATIONARY_MAX_STEP 8
+
+/**
+ * Adaptive sampling for get_video_strings (see VideoOptions). Once the last
+ * locations stayed within the radius (pointer to a double, in meters) of the
+ * last one, skips seconds, half as many as they stayed, up to
+ * STATIONARY_MAX_STEP. Reads every second again as soon as the location
+ * changes.
+ */
+unsigned int stationary_step(unsigned int count, const CharLine lines[count],
+  void *radius);
+
+/* Seconds of a video the coverage looks at, as many as lines_ok accepts. */
+#define COVERAGE_SECONDS 331
+
+/* Seconds a video file spans. */
+#define VIDEO_SECONDS 300
+
+/**
+ * Which seconds from a video’s start the database already has, for
+ * coverage_step.
+ */
+typedef struct {
+  time_t start;
+  bool covered[COVERAGE_SECONDS];
+  /* Sampling hook applied first, as in VideoOptions, NULL for none. */
+  unsigned int (*step)(unsigned int count, const CharLine lines[count],
+    void *data);
+  /* Passed to step. */
+  void *step_data;
+} Coverage;
+
+/**
+ * Fills the coverage of the seconds from start: the ones with a location, in a
+ * stationary run, or within the time range of a compact track. Returns how
+ * many of the first VIDEO_SECONDS are covered.
+ */
+unsigned int coverage_load(sqlite3 *db, time_t start, Coverage *coverage);
+
+/**
+ * Sampling for get_video_strings (see VideoOptions) skipping the covered
+ * seconds (coverage is a pointer to a Coverage), after its own step. Skips
+ * past the end when everything left is covered.
+ */
+unsigned int coverage_step(unsigned int count, const CharLine lines[count],
+  void *coverage);
+
+/**
+ * How append_lines stores the locations.
+ */
+typedef struct {
+  /* One compact track per video (see compact.h) instead of a row per location
+   * in the locations table. Locations already in the database for the same
+   * timestamps are kept. */
+  bool compact;
+  /* Collapses each run of locations within this distance in meters of its
+   * first one into a single location, with the run’s end time in the
+   * stationary table (compact tracks keep the run’s first and last locations).
+   * 0 keeps every location. */
+  double stationary_radius;
+  /* Presentation timestamps of the frames the lines were read from, as
+   * get_video_strings gives them, NULL when unknown. */
+  const int64_t *pts;
+  /* Length of the video in seconds, 0 when unknown. */
+  unsigned int seconds;
+  /* Deletes first what was written for the video before, over its catalogued
+   * span: its videos row and, unless compact, the locations and stationary
+   * runs of that time (whichever video they came from) with their density
+   * counts, so the seconds no longer read are gone. For reprocess. */
+  bool replace;
+} AppendOptions;
+
 /**
  * Write lines to a database. Creates the database if non-existent. Appends the
- * video filename when imported.
+ * video filename when imported, and catalogues the video in the videos table:
+ * its path (when video_name has one), its time span from the time in its name
+ * for its length (stretched to its locations), the bounding box (in the
+ * videos_bbox R-tree) of the locations in the span, how many it had, and the
+ * presentation timestamp of its first line with that line’s time (pts_time).
+ * Options may be NULL for the defaults.
  */
 void append_lines(const char video_name[],
-  unsigned int count, const CharLine lines[count], const char database_name[]);
+  unsigned int count, const CharLine lines[count], const char database_name[],
+  const AppendOptions *options);
+
+/**
+ * Catalogues a video without its lines, as append_lines does, for one whose
+ * seconds are all in the database already: the box is then that of the
+ * locations in its span. The first PTS (NULL when unknown) and the length in
+ * seconds are the file’s, and the time in the name is taken as that of the
+ * first frame.
+ */
+void catalogue_video(const char video_name[], const char database_name[],
+  const int64_t *first_pts, unsigned int seconds);
+
+/**
+ * Records the video (by basename) in the imported table, with the fingerprint
+ * the journal has for it, and commits it in the journal. Done by append_lines,
+ * and on the catalog when partitioned.
+ */
+void record_imported(sqlite3 *db, const char video_record_name[]);
@@ -0,0 +1,105 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "overlay.h"
+
+/* Renders the dash cam text overlay, the inverse of fill_line, for synthetic
+ * frames and videos.
+ */
+
+/* Luma of the glyphs’ white and black pixels. Not the limits of video range:
+ * fill_line’s 16-bit sums would overflow on a whole glyph at full contrast. */
+#define WHITE 200
+#define BLACK 56
+
+/* Noise amplitude around mid gray. */
+#define NOISE 20
+
+void overlay_text(CharLine *line, unsigned int speed, double lon, double lat,
+  time_t time) {
+  char left[FRAME_STRING_LENGTH + 1];
+  snprintf(left, sizeof(left), " %u KM/H N%09.6f W%09.6f",
+    speed > 999 ? 999 : speed, fabs(lat), fabs(lon));
+  memset(line->left, ' ', FRAME_STRING_LENGTH);
+  memcpy(line->left, left, strlen(left));
+
+  /* The last cell is always blank. */
+  char right[sizeof("dd/mm/yyyy HH:MM:SS")];
+  struct tm local;
+  strftime(right, sizeof(right), "%d/%m/%Y %H:%M:%S",
+    localtime_r(&time, &local));
+  memset(line->right, ' ', FRAME_STRING_LENGTH);
+  memcpy(line->right + FRAME_STRING_LENGTH - sizeof(right), right,
+    sizeof(right) - 1);
+}
+
+void overlay_route(CharLine *line, time_t start, unsigned int second) {
+  /* About 23 m/s, or 82 km/h. */
+  overlay_text(line, 72 + second % 20, -71.608715 + second * 0.0002,
+    26.434600 + second * 0.0001, start + second);
+}
+
+/**
+ * Glyph of a character, or NULL.
+ */
+static const Glyph *find_glyph(unsigned int glyph_count,
+  const Glyph glyphs[glyph_count], char key) {
+  for (unsigned int i = 0; i < glyph_count; ++i)
+    if (glyphs[i].key == key)
+      return &glyphs[i];
+  return NULL;
+}
+
+void overlay_readable(unsigned int glyph_count,
+  const Glyph glyphs[glyph_count], CharLine *line) {
+  for (unsigned int i = 0; i < FRAME_STRING_LENGTH; ++i) {
+    if (find_glyph(glyph_count, glyphs, line->left[i]) == NULL)
+      line->left[i] = ' ';
+    if (find_glyph(glyph_count, glyphs, line->right[i]) == NULL)
+      line->right[i] = ' ';
+  }
+}
+
+void overlay_noise(uint8_t *luma, int linesize, unsigned int width,
+  unsigned int height, uint32_t *seed) {
+  for (unsigned int i = 0; i < height; ++i) {
+    for (unsigned int j = 0; j < width; ++j) {
+      /* Numerical Recipes’ linear congruential generator. */
+      *seed = *seed * 1664525 + 1013904223;
+      luma[i * linesize + j] = 128 - NOISE + (*seed >> 24) % (2 * NOISE + 1);
+    }
+  }
+}
+
+/**
+ * Draws a glyph with its top left corner at the column of the data rows.
+ */
+static void draw_glyph(uint8_t *luma, int linesize, const Glyph *glyph,
+  unsigned int column) {
+  for (unsigned int i = 0; i < GLYPH_HEIGHT; ++i) {
+    uint8_t *row = luma + (TOP_DATA_ROW + i) * linesize + column;
+    for (unsigned int j = 0; j < GLYPH_WIDTH; ++j) {
+      if (glyph->multiplier[i][j] > 0)
+        row[j] = WHITE;
+      else if (glyph->multiplier[i][j] < 0)
+        row[j] = BLACK;
+    }
+  }
+}
+
+void overlay_draw(uint8_t *luma, int linesize, unsigned int glyph_count,
+  const Glyph glyphs[glyph_count], const CharLine *line) {
+  /* Same columns as fill_line: the left string from the left edge, the right
+   * one up to the right edge. */
+  const unsigned int right_start = EXPECTED_VIDEO_WIDTH
+    - FRAME_STRING_LENGTH * GLYPH_WIDTH;
+  for (unsigned int i = 0; i < FRAME_STRING_LENGTH; ++i) {
+    const Glyph *left = find_glyph(glyph_count, glyphs, line->left[i]);
+    if (left != NULL)
+      draw_glyph(luma, linesize, left, i * GLYPH_WIDTH);
+    const Glyph *right = find_glyph(glyph_count, glyphs, line->right[i]);
+    if (right != NULL)
+      draw_glyph(luma, linesize, right, right_start + i * GLYPH_WIDTH);
+  }
+}
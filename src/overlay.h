@@ -0,0 +1,42 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#pragma once
+
+#include <stdint.h>
+#include <time.h>
+#include "char_line.h"
+#include "glyph.h"
+
+/**
+ * Writes the text the dash cam shows for a location into line: speed and
+ * coordinates on the left, date and time on the right, padded with spaces.
+ */
+void overlay_text(CharLine *line, unsigned int speed, double lon, double lat,
+  time_t time);
+
+/**
+ * Writes the text at a second into a synthetic drive heading north-east from
+ * start, at a speed lines_ok accepts.
+ */
+void overlay_route(CharLine *line, time_t start, unsigned int second);
+
+/**
+ * What fill_line reads from a frame with the text drawn: the characters with a
+ * glyph stay, the rest become ' '.
+ */
+void overlay_readable(unsigned int glyph_count,
+  const Glyph glyphs[glyph_count], CharLine *line);
+
+/**
+ * Fills a luma plane with noise around mid gray, as a stand-in for the road.
+ * The seed is updated, so consecutive frames differ.
+ */
+void overlay_noise(uint8_t *luma, int linesize, unsigned int width,
+  unsigned int height, uint32_t *seed);
+
+/**
+ * Draws the line with the glyphs into a luma plane at least
+ * EXPECTED_VIDEO_WIDTH wide, at the rows fill_line reads: white where the glyph
+ * is, black around it. Characters without a glyph are left as they are.
+ */
+void overlay_draw(uint8_t *luma, int linesize, unsigned int glyph_count,
+  const Glyph glyphs[glyph_count], const CharLine *line);
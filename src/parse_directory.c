@@ -1,28 +1,497 @@
 /* SPDX-License-Identifier: GPL-2.0-or-later */
 #include <err.h>
+#include <errno.h>
+#include <getopt.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <libavutil/avutil.h>
+#include "budget.h"
+#include "db.h"
 #include "glyph.h"
+#include "journal.h"
 #include "video_data.h"
 #include "output_data.h"
+#include "partition.h"
+#include "schedule.h"
+#include "stats.h"
+#include "sprites.h"
+#include "strip_cache.h"
 #include "ls.h"
+#include "metrics.h"
+
+/**
+ * The journal (like the imported table) keys files by their basename, while the
+ * listing may have a subdirectory prefix.
+ */
+static const char *journal_name(const char listed_name[]) {
+  const char *basename = strrchr(listed_name, '/');
+  return basename == NULL ? listed_name : basename + 1;
+}
+
+/**
+ * Claims the next file for this worker, returning its index in the listing, or
+ * -1 when there are none left. A file another worker listed but this one
+ * didn’t (it showed up in between) stays claimed until the lease expires.
+ */
+static int claim_next(sqlite3 *db, const char owner[], unsigned int lease,
+  int n, struct dirent **list) {
+  char name[256];
+  while (journal_claim(db, owner, time(NULL), lease, sizeof(name), name)) {
+    for (int i = 0; i < n; ++i)
+      if (strcmp(journal_name(list[i]->d_name), name) == 0)
+        return i;
+    warnx("Claimed “%s”, which is not listed here", name);
+  }
+  return -1;
+}
+
+/**
+ * Loads which seconds of the video the database, or its partition, already
+ * has. Returns how many of its VIDEO_SECONDS are covered, 0 when the name has
+ * no time.
+ */
+static unsigned int load_coverage(sqlite3 *db, bool partitioned,
+  PartitionPeriod period, const char video_url[], Coverage *coverage) {
+  time_t start = video_start_time(video_url);
+  if (start == -1) {
+    coverage->start = 0;
+    memset(coverage->covered, 0, sizeof(coverage->covered));
+    return 0;
+  }
+  if (!partitioned)
+    return coverage_load(db, start, coverage);
+  char *partition = partition_for(db, period, start);
+  SpatiaLite sp = open_and_init_db(partition);
+  unsigned int covered = coverage_load(sp.db, start, coverage);
+  close_db(sp);
+  free(partition);
+  return covered;
+}
+
+/**
+ * What is kept of the frames read, besides their lines.
+ */
+typedef struct {
+  StripWriter *strips;
+  SpriteWriter *sprites;
+} FrameKeepers;
+
+/**
+ * Frame hook of get_video_strings: adds its strip to the cache and its
+ * thumbnail to the sprites, when kept.
+ */
+static void keep_frame(const AVFrame *frame, void *data) {
+  const FrameKeepers *keepers = data;
+  if (keepers->strips != NULL)
+    strips_add(keepers->strips, frame);
+  if (keepers->sprites != NULL)
+    sprites_add(keepers->sprites, frame);
+}
+
+/**
+ * Writes the sprites of the frames read with the times of their lines, when
+ * the lines are valid, or drops them.
+ */
+static void close_sprites(SpriteWriter *sprites, bool valid,
+  unsigned int count, const CharLine lines[count]) {
+  time_t times[count > 0 ? count : 1];
+  for (unsigned int i = 0; valid && i < count; ++i)
+    times[i] = line_time(lines[i]);
+  sprites_close(sprites, count, valid ? times : NULL);
+}
+
+/* Seconds between updates of the metrics file while a video is read. */
+#define METRICS_INTERVAL 15
+
+/**
+ * Updates the metrics file, if there’s one. Workers count the queue in the
+ * journal they share (journal is NULL otherwise).
+ */
+static void update_metrics(const char metrics_filename[], Progress *progress,
+  sqlite3 *journal) {
+  if (metrics_filename == NULL)
+    return;
+  if (journal != NULL)
+    progress->queued = journal_queued(journal, time(NULL));
+  metrics_write(metrics_filename, progress, stats_run(), stats_last_file());
+}
+
+/**
+ * Ends the file’s stats and updates the metrics file, if there’s one.
+ */
+static void file_done(const char name[], Progress *progress,
+  const char metrics_filename[], sqlite3 *journal) {
+  stats_file_end(name);
+  progress->in_flight = 0;
+  update_metrics(metrics_filename, progress, journal);
+}
+
+/**
+ * Seconds between renewals of a claim of lease seconds: a third of it, so a
+ * missed renewal still leaves time for the next.
+ */
+static unsigned int heartbeat_interval(unsigned int lease) {
+  return lease > 2 ? lease / 3 : 1;
+}
+
+/**
+ * What is done while a video is read, through the read hook of
+ * get_video_strings.
+ */
+typedef struct {
+  /* Paces the reads, NULL for none. */
+  Budget *budget;
+  /* Updates the metrics every METRICS_INTERVAL seconds, as reading a video
+   * can take minutes. */
+  const char *metrics_filename;
+  Progress *progress;
+  sqlite3 *journal;
+  time_t metrics_due;
+  /* Workers renew their claim on the file every heartbeat_interval, so that
+   * no other worker takes over a long video still being read. NULL owner
+   * otherwise. */
+  const char *owner;
+  const char *name;
+  unsigned int lease;
+  time_t heartbeat_due;
+  bool lost;
+} ReadHook;
+
+/**
+ * Read hook of get_video_strings, see ReadHook.
+ */
+static void while_reading(int size, void *data) {
+  ReadHook *hook = data;
+  if (hook->budget != NULL)
+    budget_read(size, hook->budget);
+  if (hook->metrics_filename == NULL && hook->owner == NULL)
+    return;
+  const time_t now = time(NULL);
+  if (hook->metrics_filename != NULL && now >= hook->metrics_due) {
+    update_metrics(hook->metrics_filename, hook->progress, hook->journal);
+    hook->metrics_due = now + METRICS_INTERVAL;
+  }
+  if (hook->owner != NULL && !hook->lost && now >= hook->heartbeat_due) {
+    hook->lost =
+      !journal_heartbeat(hook->journal, hook->name, hook->owner, now,
+        hook->lease);
+    hook->heartbeat_due = now + heartbeat_interval(hook->lease);
+  }
+}
 
 /**
  * parse_directory: finds all the videos in the directory that were not imported
  * to the database, parses them, and if returned lines are sound, imports the
- * coordinates and timestamps.
+ * coordinates and timestamps. Progress is kept in the journal table: files that
+ * fail are skipped and retried on the next run, and files already decoded when
+ * a run was interrupted are written without decoding them again.
+ *
+ * Usage: parse_directory [--compact] [--stationary=METERS]
+ *   [--partition=month|year] [--stats] [--trace=FILE] [--metrics=FILE]
+ *   [--cache=DIRECTORY] [--worker] [--lease=SECONDS] [--decode-all]
+ *   [--order=KEYS] [--window=FROM,TO] [--background] [--threads=N]
+ *   [--cpu=CORES] [--read-rate=MB] [--max-pressure=PERCENT]
+ *   [--sprites=DIRECTORY] [--sprite-interval=N] [--gray]
+ *   [--clock-check=N]
+ *   video_directory database
+ *   --compact     store one compact track per video, see compact.h
+ *   --stationary  collapse locations staying within METERS into one, and skip
+ *                 reading seconds while stationary
+ *   --partition   the database is a catalog of one database per month or year,
+ *                 see partition.h
+ *   --stats       print time per stage and counters for each file and the run
+ *   --trace       write the stages as Chrome trace events to FILE, see stats.h
+ *   --metrics     keep Prometheus metrics of the run in FILE, see metrics.h
+ *   --cache       keep the data rows of the frames read in DIRECTORY, for
+ *                 reprocess, see strip_cache.h
+ *   --worker      claim files from the journal, so several processes, possibly
+ *                 on several hosts, share the directory, see journal.h
+ *   --lease       seconds a claimed file is held for, 600 by default, renewed
+ *                 while it is read; a worker that dies holding one only delays
+ *                 it that long
+ *   --decode-all  read every second, even the ones the database already has
+ *                 (from another camera or a copy of the video); by default
+ *                 those are skipped, and videos fully covered are only
+ *                 catalogued from their headers
+ *   --order       read first the videos in RO/, overlapping the window, or
+ *                 newest, by each of ro, window and newest given (comma
+ *                 separated) in turn; workers claim in this order
+ *   --window      local times YYYYMMDDhhmmss for --order=window, which is the
+ *                 order when only the window is given
+ *   --background  lower the CPU and I/O priority, see budget.h
+ *   --threads     most decoder threads, fewer as pressure builds up
+ *   --cpu         most CPU time per second, counting all threads
+ *   --read-rate   most megabytes of video read per second
+ *   --max-pressure  wait before each video while the CPU or I/O pressure (PSI,
+ *                 or load per processor) is over PERCENT
+ *   --sprites     keep a sheet of thumbnails of the frames read for each video
+ *                 in DIRECTORY, see sprites.h
+ *   --sprite-interval  a thumbnail every N frames read, 10 by default, up to
+ *                 VIDEO_SECONDS, the most frames read from a video
+ *   --gray        decode the luma plane alone where FFmpeg can, see
+ *                 video_data.h; the sprites are then gray
+ *   --clock-check  read the clock on every Nth second read only, counting it
+ *                 from the video timestamps in between, see video_data.h
  */
 int main(int argc, char* argv[]) {
+  AppendOptions append_options = { .compact = false, .stationary_radius = 0 };
+  VideoOptions video_options = { .step = NULL };
+  bool partitioned = false;
+  PartitionPeriod period = PARTITION_MONTH;
+  bool summary = false;
+  const char *trace_filename = NULL;
+  const char *metrics_filename = NULL;
+  const char *cache_directory = NULL;
+  const char *sprite_directory = NULL;
+  unsigned int sprite_interval = 10;
+  bool worker = false;
+  unsigned int lease = 600;
+  bool decode_all = false;
+  Schedule schedule = { .key_count = 0 };
+  bool window = false;
+  Budget budget = { .threads = 0 };
+  bool background = false;
+  const struct option long_options[] = {
+    {"compact", no_argument, NULL, 'c'},
+    {"stationary", required_argument, NULL, 's'},
+    {"partition", required_argument, NULL, 'p'},
+    {"stats", no_argument, NULL, 'S'},
+    {"trace", required_argument, NULL, 't'},
+    {"metrics", required_argument, NULL, 'm'},
+    {"cache", required_argument, NULL, 'C'},
+    {"worker", no_argument, NULL, 'w'},
+    {"lease", required_argument, NULL, 'l'},
+    {"decode-all", no_argument, NULL, 'a'},
+    {"order", required_argument, NULL, 'o'},
+    {"window", required_argument, NULL, 'W'},
+    {"background", no_argument, NULL, 'b'},
+    {"threads", required_argument, NULL, 'T'},
+    {"cpu", required_argument, NULL, 'P'},
+    {"read-rate", required_argument, NULL, 'r'},
+    {"max-pressure", required_argument, NULL, 'x'},
+    {"sprites", required_argument, NULL, 'i'},
+    {"sprite-interval", required_argument, NULL, 'I'},
+    {"gray", no_argument, NULL, 'g'},
+    {"clock-check", required_argument, NULL, 'k'},
+    {0},
+  };
+  int option;
+  while (-1 != (option = getopt_long(argc, argv, "", long_options, NULL))) {
+    char *end;
+    switch (option) {
+      case 'c':
+        append_options.compact = true;
+        break;
+      case 's':
+        append_options.stationary_radius = strtod(optarg, &end);
+        if (*end != '\0' || !(append_options.stationary_radius > 0))
+          errx(1, "Invalid stationary radius “%s”", optarg);
+        video_options.step = stationary_step;
+        video_options.step_data = &append_options.stationary_radius;
+        break;
+      case 'p':
+        partitioned = true;
+        if (strcmp(optarg, "month") == 0)
+          period = PARTITION_MONTH;
+        else if (strcmp(optarg, "year") == 0)
+          period = PARTITION_YEAR;
+        else
+          errx(1, "Invalid partition period “%s”", optarg);
+        break;
+      case 'S':
+        summary = true;
+        break;
+      case 't':
+        trace_filename = optarg;
+        break;
+      case 'm':
+        metrics_filename = optarg;
+        break;
+      case 'C':
+        cache_directory = optarg;
+        break;
+      case 'w':
+        worker = true;
+        break;
+      case 'a':
+        decode_all = true;
+        break;
+      case 'o':
+        if (!schedule_parse_order(optarg, &schedule))
+          errx(1, "Invalid order “%s”", optarg);
+        break;
+      case 'W':
+        if (!schedule_parse_window(optarg, &schedule))
+          errx(1, "Invalid window “%s”", optarg);
+        window = true;
+        break;
+      case 'b':
+        background = true;
+        break;
+      case 'T': {
+        long threads = strtol(optarg, &end, 10);
+        if (*end != '\0' || threads < 1 || threads > 256)
+          errx(1, "Invalid number of threads “%s”", optarg);
+        budget.threads = threads;
+        break;
+      }
+      case 'P':
+        budget.cpu_share = strtod(optarg, &end);
+        if (*end != '\0' || !(budget.cpu_share > 0))
+          errx(1, "Invalid CPU share “%s”", optarg);
+        break;
+      case 'r':
+        budget.read_rate = strtod(optarg, &end) * 1e6;
+        if (*end != '\0' || !(budget.read_rate > 0))
+          errx(1, "Invalid read rate “%s”", optarg);
+        break;
+      case 'x':
+        budget.max_pressure = strtod(optarg, &end);
+        if (*end != '\0' || !(budget.max_pressure > 0))
+          errx(1, "Invalid pressure “%s”", optarg);
+        break;
+      case 'l': {
+        long seconds = strtol(optarg, &end, 10);
+        if (*end != '\0' || seconds < 1 || seconds > 86400)
+          errx(1, "Invalid lease “%s”", optarg);
+        lease = seconds;
+        break;
+      }
+      case 'i':
+        sprite_directory = optarg;
+        break;
+      case 'g':
+        video_options.gray = true;
+        break;
+      case 'k': {
+        long lines = strtol(optarg, &end, 10);
+        if (*end != '\0' || lines < 1 || lines > VIDEO_SECONDS)
+          errx(1, "Invalid clock check “%s”", optarg);
+        video_options.clock_check = lines;
+        break;
+      }
+      case 'I': {
+        /* A video has at most a frame read per second, so past that only its
+         * first would ever be kept: likely a count of video frames. */
+        long frames = strtol(optarg, &end, 10);
+        if (*end != '\0' || frames < 1 || frames > VIDEO_SECONDS)
+          errx(1, "Invalid sprite interval “%s”", optarg);
+        sprite_interval = frames;
+        break;
+      }
+      default:
+        errx(1, "Usage: %s [--compact] [--stationary=METERS]"
+          " [--partition=month|year] [--stats] [--trace=FILE]"
+          " [--metrics=FILE] [--cache=DIRECTORY] [--worker] [--lease=SECONDS]"
+          " [--decode-all] [--order=KEYS] [--window=FROM,TO] [--background]"
+          " [--threads=N] [--cpu=CORES] [--read-rate=MB]"
+          " [--max-pressure=PERCENT] [--sprites=DIRECTORY]"
+          " [--sprite-interval=N] [--gray] [--clock-check=N]"
+          " video_directory database",
+          argv[0]);
+    }
+  }
+  argc -= optind - 1;
+  argv += optind - 1;
   if (argc != 3) {
     errx(1,
       "Got %d arguments, expected 2 (video directory and database)", argc - 1);
   }
+  if (window && schedule.key_count == 0)
+    schedule_parse_order("window", &schedule);
+  for (unsigned int i = 0; i < schedule.key_count; ++i)
+    if (schedule.keys[i] == SCHEDULE_WINDOW && !window)
+      errx(1, "Ordering by window needs --window");
+  if (background && !budget_background())
+    warn("Could not lower the priority");
+  if (video_options.gray && !video_gray_supported())
+    warnx("FFmpeg has no --enable-gray, decoding all planes");
+  const bool governed = budget.threads > 0 || budget.cpu_share > 0
+    || budget.read_rate > 0 || budget.max_pressure > 0;
+  ReadHook read_hook = {
+    .budget = budget.cpu_share > 0 || budget.read_rate > 0 ? &budget : NULL,
+    .metrics_filename = metrics_filename,
+  };
+  if (read_hook.budget != NULL || read_hook.metrics_filename != NULL
+    || worker) {
+    video_options.read = while_reading;
+    video_options.read_data = &read_hook;
+  }
   const char keys[] = "0123456789_";
   Glyph glyphs[sizeof(keys) - 1];
   load_glyphs("../data/glyphs.png", sizeof(keys) - 1, keys, glyphs);
 
+  if (cache_directory != NULL && 0 != mkdir(cache_directory, 0777)
+    && errno != EEXIST)
+    err(1, "Could not create %s", cache_directory);
+  if (sprite_directory != NULL && 0 != mkdir(sprite_directory, 0777)
+    && errno != EEXIST)
+    err(1, "Could not create %s", sprite_directory);
+  if (summary || trace_filename != NULL || metrics_filename != NULL)
+    stats_begin(summary, trace_filename);
+
+  /* The fingerprints of the files listed let the listing skip copies once the
+   * video is imported. */
   struct dirent **list;
-  int n = list_to_import(argv[1], argv[2], &list);
+  char (*fingerprints)[FINGERPRINT_SIZE];
+  double start = stats_start();
+  int n = list_to_import(argv[1], argv[2], &list, &fingerprints);
+  stats_stop(STAGE_LIST, start);
+
+  /* Most wanted first, also for the workers claiming from the journal. */
+  int64_t *priorities = calloc(n > 0 ? n : 1, sizeof(int64_t));
+  if (priorities == NULL)
+    errx(1, "Could not allocate priorities");
+  for (int i = 0; i < n; ++i)
+    priorities[i] = schedule_priority(&schedule,
+      strncmp(list[i]->d_name, "RO/", 3) == 0,
+      video_start_time(list[i]->d_name));
+
+  /* The journal lets an interrupted run resume where it stopped. */
+  SpatiaLite sp = open_and_init_db(argv[2]);
+  begin_transaction(sp.db, "journal queue");
   for (int i = 0; i < n; ++i) {
+    const char *name = journal_name(list[i]->d_name);
+    journal_queue(sp.db, name);
+    journal_set_priority(sp.db, name, priorities[i]);
+    if (fingerprints[i][0] != '\0')
+      journal_set_fingerprint(sp.db, name, fingerprints[i]);
+  }
+  commit_transaction(sp.db, "journal queue");
+  free(fingerprints);
+  /* Without workers, files are read in the listing’s order. */
+  if (schedule.key_count > 0)
+    schedule_sort(n, list, priorities);
+  free(priorities);
+  char owner[300];
+  if (worker) {
+    char host[256] = "";
+    gethostname(host, sizeof(host) - 1);
+    snprintf(owner, sizeof(owner), "%s:%ld", host, (long)getpid());
+  }
+
+  Progress progress = { .queued = n > 0 ? n : 0 };
+  sqlite3 *journal = worker ? sp.db : NULL;
+  read_hook.progress = &progress;
+  read_hook.journal = journal;
+  if (worker) {
+    read_hook.owner = owner;
+    read_hook.lease = lease;
+  }
+  update_metrics(metrics_filename, &progress, journal);
+  for (int next = 0; ; ++next) {
+    int i = next < n ? next : -1;
+    /* Before claiming, so no lease runs out while waiting. */
+    if (governed && (worker || i >= 0))
+      video_options.threads = budget_file_begin(&budget);
+    if (worker)
+      i = claim_next(sp.db, owner, lease, n, list);
+    if (i < 0)
+      break;
     /* Convert list item to FFmpeg URL. */
     char* video_url =
       malloc(strlen(argv[1]) + strlen(list[i]->d_name) + sizeof("file:/"));
@@ -30,25 +499,168 @@ int main(int argc, char* argv[]) {
     strcat(video_url, argv[1]);
     strcat(video_url, "/");
     strcat(video_url, list[i]->d_name);
-    printf("Reading file “%s”\n", video_url);
-    free(list[i]);
+    const char *name = journal_name(list[i]->d_name);
+    stats_file_begin();
+    /* Workers also take files others listed. */
+    if (progress.queued > 0)
+      progress.queued--;
+    progress.in_flight = 1;
+    update_metrics(metrics_filename, &progress, journal);
+    read_hook.metrics_due = time(NULL) + METRICS_INTERVAL;
+    read_hook.name = name;
+    read_hook.heartbeat_due = time(NULL) + heartbeat_interval(lease);
+    read_hook.lost = false;
 
-    /* Get string lines from the video. */
+    /* Get string lines from the video, unless a previous run already did. */
     CharLine lines[301];
-    int read_lines = get_video_strings(video_url,
-      sizeof(keys) - 1, glyphs,
+    /* Timestamps of the frames, only known when decoding. */
+    int64_t pts[sizeof(lines)/sizeof(CharLine)];
+    AppendOptions file_options = append_options;
+    SpriteWriter sprites;
+    bool sprites_open = false;
+    int read_lines = journal_load_lines(sp.db, name,
       sizeof(lines)/sizeof(CharLine), lines);
-    if (read_lines <= 0)
-      errx(1, "Got %d lines", read_lines);
+    if (read_lines >= 0) {
+      printf("Resuming file “%s”\n", video_url);
+    }
+    else {
+      /* Seconds already in the database are written identically again. */
+      VideoOptions options = video_options;
+      Coverage coverage = {
+        .step = video_options.step,
+        .step_data = video_options.step_data,
+      };
+      if (!decode_all) {
+        unsigned int covered = load_coverage(sp.db, partitioned, period,
+          video_url, &coverage);
+        if (covered == VIDEO_SECONDS) {
+          printf("Skipping file “%s”, already covered\n", video_url);
+          int64_t first_pts;
+          unsigned int seconds;
+          if (video_probe(video_url, &first_pts, &seconds)) {
+            const int64_t *known_pts =
+              first_pts == AV_NOPTS_VALUE ? NULL : &first_pts;
+            if (partitioned) {
+              char *partition =
+                partition_for(sp.db, period, video_start_time(video_url));
+              catalogue_video(video_url, partition, known_pts, seconds);
+              free(partition);
+            }
+            else {
+              catalogue_video(video_url, argv[2], known_pts, seconds);
+            }
+          }
+          begin_transaction(sp.db, "import record");
+          record_imported(sp.db, name);
+          commit_transaction(sp.db, "import record");
+          progress.imported++;
+          file_done(name, &progress, metrics_filename, journal);
+          free(video_url);
+          continue;
+        }
+        options.step = coverage_step;
+        options.step_data = &coverage;
+      }
+      printf("Reading file “%s”\n", video_url);
+      journal_set_state(sp.db, name, JOURNAL_DECODING);
+      StripWriter strips;
+      FrameKeepers keepers = { .strips = NULL };
+      if (cache_directory != NULL) {
+        strips_create(&strips, cache_directory, name);
+        keepers.strips = &strips;
+      }
+      if (sprite_directory != NULL) {
+        sprites_create(&sprites, sprite_directory, name, sprite_interval,
+          sizeof(lines)/sizeof(CharLine),
+          options.gray && video_gray_supported());
+        keepers.sprites = &sprites;
+        sprites_open = true;
+      }
+      if (keepers.strips != NULL || keepers.sprites != NULL) {
+        options.frame = keep_frame;
+        options.frame_data = &keepers;
+      }
+      options.pts = pts;
+      options.seconds = &file_options.seconds;
+      read_lines = get_video_strings(video_url,
+        sizeof(keys) - 1, glyphs,
+        sizeof(lines)/sizeof(CharLine), lines, &options);
+      /* Kept even when the lines aren’t OK: reprocessing may change that. */
+      if (cache_directory != NULL)
+        strips_close(&strips, read_lines > 0);
+      /* The claim expired in between heartbeats (a stalled read) and another
+       * worker took over. */
+      if (worker && (read_hook.lost
+          || !journal_heartbeat(sp.db, name, owner, time(NULL), lease))) {
+        warnx("Lost the claim on “%s”", name);
+        if (sprites_open)
+          close_sprites(&sprites, false, 0, lines);
+        file_done(name, &progress, metrics_filename, journal);
+        free(video_url);
+        continue;
+      }
+      if (read_lines <= 0) {
+        warnx("Got %d lines", read_lines);
+        if (sprites_open)
+          close_sprites(&sprites, false, 0, lines);
+        journal_set_state(sp.db, name, JOURNAL_FAILED);
+        progress.rejected[REJECT_UNREADABLE]++;
+        file_done(name, &progress, metrics_filename, journal);
+        free(video_url);
+        continue;
+      }
+      journal_store_lines(sp.db, name, read_lines, lines);
+      file_options.pts = pts;
+    }
 
     /* Write lines to database when they are valid. */
-    if (lines_ok(video_url, read_lines, lines))
-      append_lines(video_url, read_lines, lines, argv[2]);
-    else
+    start = stats_start();
+    bool valid = lines_ok(video_url, read_lines, lines);
+    stats_stop(STAGE_CHECK, start);
+    if (sprites_open)
+      close_sprites(&sprites, valid, read_lines, lines);
+    if (!valid) {
       printf("Lines are not OK\n");
+      journal_set_state(sp.db, name, JOURNAL_FAILED);
+      progress.rejected[REJECT_INVALID]++;
+    }
+    else if (partitioned) {
+      /* Only the video’s partition is written. The catalog keeps the import
+       * record, as that’s where the listing looks. Writing again a video whose
+       * record is missing after a crash replaces the same locations. */
+      char *partition =
+        partition_for(sp.db, period, video_start_time(video_url));
+      append_lines(video_url, read_lines, lines, partition, &file_options);
+      free(partition);
+      begin_transaction(sp.db, "import record");
+      record_imported(sp.db, name);
+      commit_transaction(sp.db, "import record");
+    }
+    else {
+      append_lines(video_url, read_lines, lines, argv[2], &file_options);
+    }
+    if (valid)
+      progress.imported++;
+    file_done(name, &progress, metrics_filename, journal);
 
     free(video_url);
   }
+  for (int i = 0; i < n; ++i)
+    free(list[i]);
   free(list);
+  /* Partitions that ended over a period ago are done with. */
+  if (partitioned) {
+    time_t previous = partition_start(period,
+      partition_start(period, time(NULL)) - 1);
+    int sealed = partition_seal(sp.db, previous);
+    if (sealed > 0)
+      printf("Sealed %d partitions\n", sealed);
+  }
+  close_db(sp);
+  unsigned long failed =
+    progress.rejected[REJECT_UNREADABLE] + progress.rejected[REJECT_INVALID];
+  if (failed > 0)
+    printf("%lu of %d files failed\n", failed, n);
+  stats_end();
   return 0;
 }
@@ -0,0 +1,447 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#include <err.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sqlite3.h>
+#include "db.h"
+#include "partition.h"
+
+/* Splits the data into one database per month or year, listed in a catalog
+ * database. Ingest only writes to the partition of each video, and partitions
+ * done with are compacted and attached read-only. Any database errors trigger
+ * errx().
+ */
+
+/* Longest partition name, “YYYY-MM”, with the terminator. */
+#define NAME_SIZE sizeof("YYYY-MM")
+
+/* Attached partitions are named with this prefix and the partition name. */
+#define ALIAS_PREFIX "p_"
+
+/**
+ * Name and time range (inclusive) of the period containing the time.
+ */
+static void period_range(PartitionPeriod period, time_t time,
+  char name[NAME_SIZE], time_t *start, time_t *end) {
+  struct tm first;
+  if (localtime_r(&time, &first) == NULL)
+    errx(1, "Could not convert time %lld", (long long)time);
+  first.tm_mday = 1;
+  first.tm_hour = first.tm_min = first.tm_sec = 0;
+  first.tm_isdst = -1;
+  if (period == PARTITION_YEAR)
+    first.tm_mon = 0;
+  struct tm next = first;
+  if (period == PARTITION_YEAR)
+    next.tm_year++;
+  else
+    next.tm_mon++;
+  strftime(name, NAME_SIZE, period == PARTITION_YEAR ? "%Y" : "%Y-%m",
+    &first);
+  *start = mktime(&first);
+  *end = mktime(&next) - 1;
+}
+
+time_t partition_start(PartitionPeriod period, time_t time) {
+  char name[NAME_SIZE];
+  time_t start, end;
+  period_range(period, time, name, &start, &end);
+  return start;
+}
+
+/**
+ * Path of a partition file, which is stored relative to the catalog.
+ */
+static char *partition_path(sqlite3 *catalog, const char filename[]) {
+  const char *catalog_path = sqlite3_db_filename(catalog, "main");
+  if (catalog_path == NULL || catalog_path[0] == '\0')
+    errx(1, "Partitions need the catalog to be a database file");
+  const char *slash = strrchr(catalog_path, '/');
+  int directory_length = slash == NULL ? 0 : slash - catalog_path + 1;
+  char *path = malloc(directory_length + strlen(filename) + 1);
+  if (path == NULL)
+    errx(1, "Could not allocate partition path");
+  memcpy(path, catalog_path, directory_length);
+  strcpy(path + directory_length, filename);
+  return path;
+}
+
+/**
+ * Attached database name of a partition.
+ */
+static void partition_alias(const char name[],
+  char alias[sizeof(ALIAS_PREFIX) + NAME_SIZE]) {
+  strcpy(alias, ALIAS_PREFIX);
+  strcat(alias, name);
+  for (char *c = alias; *c != '\0'; ++c)
+    if (*c == '-')
+      *c = '_';
+}
+
+bool partition_period(sqlite3 *catalog, PartitionPeriod *period) {
+  sqlite3_stmt *stmt;
+  const char any[] = "SELECT length(name) FROM partitions LIMIT 1;";
+  if (SQLITE_OK != sqlite3_prepare_v2(catalog, any, sizeof(any), &stmt, NULL))
+    errx(1, "Could not prepare partition period statement");
+  int step = sqlite3_step(stmt);
+  if (SQLITE_ROW == step)
+    *period = sqlite3_column_int(stmt, 0) == sizeof("YYYY") - 1
+      ? PARTITION_YEAR
+      : PARTITION_MONTH;
+  else if (SQLITE_DONE != step)
+    errx(1, "Could not step partition period statement");
+  if (SQLITE_OK != sqlite3_finalize(stmt))
+    errx(1, "Could not finalize partition period statement");
+  return SQLITE_ROW == step;
+}
+
+char *partition_for(sqlite3 *catalog, PartitionPeriod period, time_t time) {
+  char name[NAME_SIZE];
+  time_t start, end;
+  period_range(period, time, name, &start, &end);
+  sqlite3_stmt *stmt;
+
+  /* Periods are told apart by the name length. */
+  const char other_period[] =
+    "SELECT name FROM partitions WHERE length(name) <> ? LIMIT 1;";
+  if (SQLITE_OK != sqlite3_prepare_v2(catalog, other_period,
+      sizeof(other_period), &stmt, NULL))
+    errx(1, "Could not prepare partition period statement");
+  if (SQLITE_OK != sqlite3_bind_int(stmt, 1, strlen(name)))
+    errx(1, "Could not bind partition name length");
+  if (SQLITE_ROW == sqlite3_step(stmt))
+    errx(1, "Catalog has partition “%s” of another period",
+      sqlite3_column_text(stmt, 0));
+  if (SQLITE_OK != sqlite3_finalize(stmt))
+    errx(1, "Could not finalize partition period statement");
+
+  const char find[] =
+    "SELECT filename, sealed FROM partitions WHERE name = ?;";
+  if (SQLITE_OK != sqlite3_prepare_v2(catalog, find, sizeof(find), &stmt,
+      NULL))
+    errx(1, "Could not prepare partition statement");
+  if (SQLITE_OK != sqlite3_bind_text(stmt, 1, name, -1, SQLITE_STATIC))
+    errx(1, "Could not bind partition name");
+  char *path = NULL;
+  bool sealed = false;
+  switch (sqlite3_step(stmt)) {
+    case SQLITE_ROW:
+      path = partition_path(catalog,
+        (const char *)sqlite3_column_text(stmt, 0));
+      sealed = sqlite3_column_int(stmt, 1);
+      break;
+    case SQLITE_DONE:
+      break;
+    default:
+      errx(1, "Could not step partition statement");
+  }
+  if (SQLITE_OK != sqlite3_finalize(stmt))
+    errx(1, "Could not finalize partition statement");
+
+  if (path != NULL && sealed) {
+    warnx("Reopening sealed partition “%s”", name);
+    const char reopen[] = "UPDATE partitions SET sealed = 0 WHERE name = ?;";
+    if (SQLITE_OK != sqlite3_prepare_v2(catalog, reopen, sizeof(reopen),
+        &stmt, NULL))
+      errx(1, "Could not prepare partition reopening");
+    if (SQLITE_OK != sqlite3_bind_text(stmt, 1, name, -1, SQLITE_STATIC))
+      errx(1, "Could not bind partition name");
+    if (SQLITE_DONE != sqlite3_step(stmt))
+      errx(1, "Could not reopen partition");
+    if (SQLITE_OK != sqlite3_finalize(stmt))
+      errx(1, "Could not finalize partition reopening");
+  }
+  if (path != NULL)
+    return path;
+
+  /* New partition, named after the catalog file without its extension. */
+  const char *catalog_path = sqlite3_db_filename(catalog, "main");
+  const char *basename = catalog_path == NULL ? NULL
+    : strrchr(catalog_path, '/');
+  basename = basename == NULL ? catalog_path : basename + 1;
+  if (basename == NULL || basename[0] == '\0')
+    errx(1, "Partitions need the catalog to be a database file");
+  const char *extension = strrchr(basename, '.');
+  int stem_length = extension == NULL || extension == basename
+    ? (int)strlen(basename)
+    : extension - basename;
+  char *filename = sqlite3_mprintf("%.*s.%s.sqlite", stem_length, basename,
+    name);
+  if (filename == NULL)
+    errx(1, "Could not allocate partition file name");
+  path = partition_path(catalog, filename);
+
+  /* Creates the partition schema before listing it. */
+  SpatiaLite sp = open_and_init_db(path);
+  close_db(sp);
+  const char insert[] =
+    "INSERT INTO partitions(name, filename, start_time, end_time)"
+    "  VALUES (?, ?, ?, ?);";
+  if (SQLITE_OK != sqlite3_prepare_v2(catalog, insert, sizeof(insert), &stmt,
+      NULL))
+    errx(1, "Could not prepare partition insertion");
+  if (SQLITE_OK != sqlite3_bind_text(stmt, 1, name, -1, SQLITE_STATIC)
+    || SQLITE_OK != sqlite3_bind_text(stmt, 2, filename, -1, sqlite3_free)
+    || SQLITE_OK != sqlite3_bind_int64(stmt, 3, start)
+    || SQLITE_OK != sqlite3_bind_int64(stmt, 4, end))
+    errx(1, "Could not bind partition");
+  if (SQLITE_DONE != sqlite3_step(stmt))
+    errx(1, "Could not insert partition");
+  if (SQLITE_OK != sqlite3_finalize(stmt))
+    errx(1, "Could not finalize partition insertion");
+  return path;
+}
+
+/**
+ * A unified view: a query per attached partition (formatted with the alias
+ * twice), joined with UNION ALL between the prefix and suffix.
+ */
+static const struct {
+  const char *name;
+  const char *prefix;
+  const char *partition;
+  const char *suffix;
+} views[] = {
+  {
+    "all_locations",
+    "",
+    "SELECT '%s' AS partition, timestamp, place FROM %s.locations",
+    "",
+  },
+  {
+    "all_trips",
+    "",
+    "SELECT '%s' AS partition, id, start_time, end_time, points,"
+    "  track_10m, track_100m, track_1000m FROM %s.trips",
+    "",
+  },
+  {
+    "all_stays",
+    "",
+    "SELECT '%s' AS partition, id, start_time, end_time, points, centroid"
+    "  FROM %s.stays",
+    "",
+  },
+  {
+    "all_compact_tracks",
+    "",
+    "SELECT '%s' AS partition, id, filename, start_time, end_time, points,"
+    "  track FROM %s.compact_tracks",
+    "",
+  },
+  {
+    "all_density",
+    "SELECT zoom, tile_x, tile_y, sum(count) AS count FROM (",
+    "SELECT '%s' AS partition, zoom, tile_x, tile_y, count FROM %s.density",
+    ") GROUP BY zoom, tile_x, tile_y",
+  },
+  {
+    "all_stationary",
+    "",
+    "SELECT '%s' AS partition, timestamp, end_time FROM %s.stationary",
+    "",
+  },
+  {
+    "all_videos",
+    "",
+    "SELECT '%s' AS partition, id, filename, path, start_time, end_time,"
+    "  points, first_pts, pts_time FROM %s.videos",
+    "",
+  },
+  {
+    "all_videos_bbox",
+    "",
+    "SELECT '%s' AS partition, id, min_lon, max_lon, min_lat, max_lat"
+    "  FROM %s.videos_bbox",
+    "",
+  },
+};
+
+/**
+ * Views under the names of the tables, over the unified views, shadowing the
+ * catalog’s own (empty) tables. Ids of videos are only unique within their
+ * partition, so they get its name.
+ */
+static const struct {
+  const char *name;
+  const char *select;
+} tables[] = {
+  {"locations", "SELECT timestamp, place FROM all_locations"},
+  {"stationary", "SELECT timestamp, end_time FROM all_stationary"},
+  {
+    "compact_tracks",
+    "SELECT id, filename, start_time, end_time, points, track"
+    "  FROM all_compact_tracks",
+  },
+  {
+    "videos",
+    "SELECT partition || ':' || id AS id, filename, path, start_time,"
+    "  end_time, points, first_pts, pts_time FROM all_videos",
+  },
+  {
+    "videos_bbox",
+    "SELECT partition || ':' || id AS id, min_lon, max_lon, min_lat, max_lat"
+    "  FROM all_videos_bbox",
+  },
+};
+
+/**
+ * Recreates the unified views over the attached partitions, and the ones
+ * under the tables’ names when there are some.
+ */
+static void create_views(sqlite3 *catalog) {
+  bool any = false;
+  const char attached[] =
+    "SELECT name FROM pragma_database_list"
+    "  WHERE substr(name, 1, length(?1)) = ?1 ORDER BY name;";
+  sqlite3_stmt *stmt;
+  if (SQLITE_OK != sqlite3_prepare_v2(catalog, attached, sizeof(attached),
+      &stmt, NULL))
+    errx(1, "Could not prepare attached partitions statement");
+  if (SQLITE_OK != sqlite3_bind_text(stmt, 1, ALIAS_PREFIX, -1, SQLITE_STATIC))
+    errx(1, "Could not bind attached partition prefix");
+  for (size_t i = 0; i < sizeof(views) / sizeof(views[0]); ++i) {
+    sqlite3_str *sql = sqlite3_str_new(catalog);
+    sqlite3_str_appendf(sql, "DROP VIEW IF EXISTS temp.%s;", views[i].name);
+    if (SQLITE_OK != sqlite3_reset(stmt))
+      errx(1, "Could not reset attached partitions statement");
+    int step;
+    bool first = true;
+    while (SQLITE_ROW == (step = sqlite3_step(stmt))) {
+      const char *alias = (const char *)sqlite3_column_text(stmt, 0);
+      if (first)
+        sqlite3_str_appendf(sql, "CREATE TEMP VIEW %s AS %s", views[i].name,
+          views[i].prefix);
+      else
+        sqlite3_str_appendall(sql, " UNION ALL ");
+      sqlite3_str_appendf(sql, views[i].partition, alias, alias);
+      first = false;
+    }
+    if (SQLITE_DONE != step)
+      errx(1, "Could not step attached partitions statement");
+    if (!first)
+      sqlite3_str_appendf(sql, "%s;", views[i].suffix);
+    any = any || !first;
+    char *query = sqlite3_str_finish(sql);
+    if (query == NULL)
+      errx(1, "Could not allocate view %s", views[i].name);
+    if (SQLITE_OK != sqlite3_exec(catalog, query, NULL, NULL, NULL))
+      errx(1, "Could not create view %s: %s", views[i].name,
+        sqlite3_errmsg(catalog));
+    sqlite3_free(query);
+  }
+  if (SQLITE_OK != sqlite3_finalize(stmt))
+    errx(1, "Could not finalize attached partitions statement");
+  for (size_t i = 0; i < sizeof(tables) / sizeof(tables[0]); ++i) {
+    char *query = any
+      ? sqlite3_mprintf("DROP VIEW IF EXISTS temp.%s;"
+        "CREATE TEMP VIEW %s AS %s;", tables[i].name, tables[i].name,
+        tables[i].select)
+      : sqlite3_mprintf("DROP VIEW IF EXISTS temp.%s;", tables[i].name);
+    if (query == NULL)
+      errx(1, "Could not allocate view %s", tables[i].name);
+    if (SQLITE_OK != sqlite3_exec(catalog, query, NULL, NULL, NULL))
+      errx(1, "Could not create view %s: %s", tables[i].name,
+        sqlite3_errmsg(catalog));
+    sqlite3_free(query);
+  }
+}
+
+/**
+ * Appends the path to a URI filename, escaping what SQLite would interpret.
+ */
+static void append_uri_path(sqlite3_str *uri, const char path[]) {
+  for (const char *c = path; *c != '\0'; ++c) {
+    if (*c == '%' || *c == '?' || *c == '#')
+      sqlite3_str_appendf(uri, "%%%02X", (unsigned char)*c);
+    else
+      sqlite3_str_appendchar(uri, 1, *c);
+  }
+}
+
+int partition_attach(sqlite3 *catalog, time_t from, time_t to) {
+  const char overlapping[] =
+    "SELECT name, filename, sealed FROM partitions"
+    "  WHERE end_time >= ? AND start_time <= ? ORDER BY start_time;";
+  sqlite3_stmt *stmt;
+  if (SQLITE_OK != sqlite3_prepare_v2(catalog, overlapping,
+      sizeof(overlapping), &stmt, NULL))
+    errx(1, "Could not prepare overlapping partitions statement");
+  if (SQLITE_OK != sqlite3_bind_int64(stmt, 1, from)
+    || SQLITE_OK != sqlite3_bind_int64(stmt, 2, to))
+    errx(1, "Could not bind partition time range");
+  int attached = 0;
+  int step;
+  while (SQLITE_ROW == (step = sqlite3_step(stmt))) {
+    char alias[sizeof(ALIAS_PREFIX) + NAME_SIZE];
+    partition_alias((const char *)sqlite3_column_text(stmt, 0), alias);
+    if (sqlite3_db_filename(catalog, alias) != NULL)
+      continue;
+    char *path = partition_path(catalog,
+      (const char *)sqlite3_column_text(stmt, 1));
+    sqlite3_str *uri = sqlite3_str_new(catalog);
+    sqlite3_str_appendall(uri, "file:");
+    append_uri_path(uri, path);
+    if (sqlite3_column_int(stmt, 2))
+      sqlite3_str_appendall(uri, "?mode=ro");
+    free(path);
+    char *uri_string = sqlite3_str_finish(uri);
+    char *attach = sqlite3_mprintf("ATTACH %Q AS %s;", uri_string, alias);
+    sqlite3_free(uri_string);
+    if (attach == NULL)
+      errx(1, "Could not allocate partition attachment");
+    if (SQLITE_OK != sqlite3_exec(catalog, attach, NULL, NULL, NULL))
+      errx(1, "Could not attach partition %s: %s", alias,
+        sqlite3_errmsg(catalog));
+    sqlite3_free(attach);
+    attached++;
+  }
+  if (SQLITE_DONE != step)
+    errx(1, "Could not step overlapping partitions statement");
+  if (SQLITE_OK != sqlite3_finalize(stmt))
+    errx(1, "Could not finalize overlapping partitions statement");
+  create_views(catalog);
+  return attached;
+}
+
+int partition_seal(sqlite3 *catalog, time_t before) {
+  const char ended[] =
+    "SELECT name, filename FROM partitions"
+    "  WHERE end_time < ? AND sealed = 0 ORDER BY start_time;";
+  sqlite3_stmt *stmt;
+  if (SQLITE_OK != sqlite3_prepare_v2(catalog, ended, sizeof(ended), &stmt,
+      NULL))
+    errx(1, "Could not prepare ended partitions statement");
+  if (SQLITE_OK != sqlite3_bind_int64(stmt, 1, before))
+    errx(1, "Could not bind partition end");
+  sqlite3_stmt *seal;
+  const char mark_sealed[] = "UPDATE partitions SET sealed = 1 WHERE name = ?;";
+  if (SQLITE_OK != sqlite3_prepare_v2(catalog, mark_sealed,
+      sizeof(mark_sealed), &seal, NULL))
+    errx(1, "Could not prepare partition sealing");
+  int sealed = 0;
+  int step;
+  while (SQLITE_ROW == (step = sqlite3_step(stmt))) {
+    char *path = partition_path(catalog,
+      (const char *)sqlite3_column_text(stmt, 1));
+    SpatiaLite sp = open_and_init_db(path);
+    if (SQLITE_OK != sqlite3_exec(sp.db, "VACUUM;", NULL, NULL, NULL))
+      errx(1, "Could not compact partition “%s”", path);
+    close_db(sp);
+    free(path);
+    if (SQLITE_OK != sqlite3_reset(seal)
+      || SQLITE_OK !=
+        sqlite3_bind_value(seal, 1, sqlite3_column_value(stmt, 0)))
+      errx(1, "Could not bind sealed partition");
+    if (SQLITE_DONE != sqlite3_step(seal))
+      errx(1, "Could not seal partition");
+    sealed++;
+  }
+  if (SQLITE_DONE != step)
+    errx(1, "Could not step ended partitions statement");
+  if (SQLITE_OK != sqlite3_finalize(stmt)
+    || SQLITE_OK != sqlite3_finalize(seal))
+    errx(1, "Could not finalize partition sealing");
+  return sealed;
+}
@@ -0,0 +1,53 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#pragma once
+
+#include <stdbool.h>
+#include <time.h>
+#include <sqlite3.h>
+
+/**
+ * Time span of each partition, in local time like the videos.
+ */
+typedef enum {
+  PARTITION_MONTH,
+  PARTITION_YEAR,
+} PartitionPeriod;
+
+/**
+ * Start of the period containing the time.
+ */
+time_t partition_start(PartitionPeriod period, time_t time);
+
+/**
+ * Finds the period of the catalog’s partitions. Returns false when it has
+ * none, that is when it isn’t a catalog.
+ */
+bool partition_period(sqlite3 *catalog, PartitionPeriod *period);
+
+/**
+ * File name of the partition database holding the time, next to the catalog
+ * database. The partition is created with the whole schema and listed in the
+ * catalog’s partitions table when needed, and reopened if sealed. All the
+ * partitions of a catalog should have the same period. The returned string
+ * should be freed by the caller.
+ */
+char *partition_for(sqlite3 *catalog, PartitionPeriod period, time_t time);
+
+/**
+ * Attaches to the catalog the partitions overlapping the time range (inclusive)
+ * that aren’t attached yet, sealed ones read-only, and recreates the unified
+ * TEMP views over all the attached partitions: all_locations, all_trips,
+ * all_stays, all_compact_tracks, all_density, all_stationary, all_videos and
+ * all_videos_bbox. TEMP views named locations, stationary, compact_tracks,
+ * videos and videos_bbox over them then shadow the catalog’s own tables, so
+ * that reading those (track.h, clip.h) reads the partitions. SQLite limits how
+ * many can be attached at once (10 by default). Should be called outside of
+ * transactions. Returns the number of partitions attached.
+ */
+int partition_attach(sqlite3 *catalog, time_t from, time_t to);
+
+/**
+ * Seals the partitions that ended before the time: compacts them (VACUUM) and
+ * marks them to be attached read-only. Returns the number of partitions sealed.
+ */
+int partition_seal(sqlite3 *catalog, time_t before);
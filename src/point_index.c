@@ -0,0 +1,430 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#include <err.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "point_index.h"
+
+/* A standalone index of all the locations, for answering queries without
+ * SpatiaLite: the points sorted by time for time queries, and a packed static
+ * R-tree over them in Hilbert curve order for space queries. The file is only
+ * mapped, so opening it costs nothing.
+ */
+
+#define MAGIC "ONDEIDX1"
+
+/* Meters per microdegree of latitude, close enough for ranking. */
+#define METERS_PER_MICRODEGREE (6378137 * M_PI / 180 / 1e6)
+
+uint32_t point_index_hilbert(uint32_t x, uint32_t y) {
+  uint32_t d = 0;
+  for (uint32_t s = 1 << 15; s > 0; s >>= 1) {
+    uint32_t rx = (x & s) > 0;
+    uint32_t ry = (y & s) > 0;
+    d += s * s * ((3 * rx) ^ ry);
+    /* Rotates the quadrant. */
+    if (ry == 0) {
+      if (rx == 1) {
+        x = 0xffff - x;
+        y = 0xffff - y;
+      }
+      uint32_t t = x;
+      x = y;
+      y = t;
+    }
+  }
+  return d;
+}
+
+/* Hilbert curve position of a point, for sorting. */
+typedef struct {
+  uint32_t key;
+  uint32_t position;
+} HilbertKey;
+
+static int compare_keys(const void *a, const void *b) {
+  const HilbertKey *key_a = a, *key_b = b;
+  return key_a->key < key_b->key ? -1 : key_a->key > key_b->key;
+}
+
+/**
+ * Grows the box to include another.
+ */
+static void extend(IndexBox *box, IndexBox other) {
+  box->min_lon = other.min_lon < box->min_lon ? other.min_lon : box->min_lon;
+  box->min_lat = other.min_lat < box->min_lat ? other.min_lat : box->min_lat;
+  box->max_lon = other.max_lon > box->max_lon ? other.max_lon : box->max_lon;
+  box->max_lat = other.max_lat > box->max_lat ? other.max_lat : box->max_lat;
+}
+
+static IndexBox point_box(IndexPoint point) {
+  return (IndexBox){ point.lon, point.lat, point.lon, point.lat };
+}
+
+/**
+ * Number of children of a node of the level at local position.
+ */
+static size_t child_count(const IndexHeader *header, unsigned int level,
+  size_t local) {
+  size_t total = level == 0
+    ? header->count
+    : header->level_offsets[level] - header->level_offsets[level - 1];
+  size_t first = local * header->node_size;
+  return total - first < header->node_size ? total - first : header->node_size;
+}
+
+/**
+ * Writes all of the array or fails.
+ */
+static bool write_all(FILE *file, const void *data, size_t size,
+  size_t count) {
+  return count == 0 || fwrite(data, size, count, file) == count;
+}
+
+bool point_index_write(const char filename[], size_t count,
+  const TrackPoint points[count]) {
+  if (count > UINT32_MAX) {
+    warnx("Too many points for an index: %zu", count);
+    return false;
+  }
+  IndexPoint *index_points = reallocarray(NULL, count + 1, sizeof(IndexPoint));
+  HilbertKey *keys = reallocarray(NULL, count + 1, sizeof(HilbertKey));
+  uint32_t *order = reallocarray(NULL, count + 1, sizeof(uint32_t));
+  if (index_points == NULL || keys == NULL || order == NULL)
+    errx(1, "Could not allocate index for %zu points", count);
+
+  IndexBox all = { INT32_MAX, INT32_MAX, INT32_MIN, INT32_MIN };
+  for (size_t i = 0; i < count; ++i) {
+    index_points[i] = (IndexPoint){
+      points[i].timestamp,
+      lround(points[i].lon * 1e6),
+      lround(points[i].lat * 1e6),
+    };
+    extend(&all, point_box(index_points[i]));
+  }
+
+  /* Leaves in Hilbert curve order over the bounding box of everything. */
+  const double width = (double)all.max_lon - all.min_lon + 1;
+  const double height = (double)all.max_lat - all.min_lat + 1;
+  for (size_t i = 0; i < count; ++i) {
+    keys[i].key = point_index_hilbert(
+      ((double)index_points[i].lon - all.min_lon) / width * 65536,
+      ((double)index_points[i].lat - all.min_lat) / height * 65536);
+    keys[i].position = i;
+  }
+  qsort(keys, count, sizeof(HilbertKey), compare_keys);
+  for (size_t i = 0; i < count; ++i)
+    order[i] = keys[i].position;
+  free(keys);
+
+  /* Level sizes, from the leaves up to a single root. */
+  IndexHeader header = {
+    .magic = MAGIC,
+    .node_size = POINT_INDEX_NODE_SIZE,
+    .levels = 0,
+    .count = count,
+  };
+  size_t level_nodes = count;
+  size_t total = 0;
+  while (level_nodes > 1 || (header.levels == 0 && level_nodes == 1)) {
+    level_nodes = (level_nodes + POINT_INDEX_NODE_SIZE - 1)
+      / POINT_INDEX_NODE_SIZE;
+    header.level_offsets[header.levels++] = total;
+    total += level_nodes;
+  }
+  header.level_offsets[header.levels] = total;
+
+  IndexBox *boxes = reallocarray(NULL, total + 1, sizeof(IndexBox));
+  if (boxes == NULL)
+    errx(1, "Could not allocate %zu index nodes", total);
+  for (unsigned int level = 0; level < header.levels; ++level) {
+    for (size_t node = header.level_offsets[level];
+        node < header.level_offsets[level + 1]; ++node) {
+      size_t local = node - header.level_offsets[level];
+      size_t first = local * POINT_INDEX_NODE_SIZE;
+      size_t children = child_count(&header, level, local);
+      boxes[node] = (IndexBox){ INT32_MAX, INT32_MAX, INT32_MIN, INT32_MIN };
+      for (size_t i = first; i < first + children; ++i)
+        extend(&boxes[node], level == 0
+          ? point_box(index_points[order[i]])
+          : boxes[header.level_offsets[level - 1] + i]);
+    }
+  }
+
+  /* Written aside and renamed over, so readers never see half a file. */
+  char *temporary = malloc(strlen(filename) + sizeof(".tmp"));
+  if (temporary == NULL)
+    errx(1, "Could not allocate index file name");
+  strcpy(temporary, filename);
+  strcat(temporary, ".tmp");
+  FILE *file = fopen(temporary, "wb");
+  const uint32_t padding = 0;
+  bool ret = file != NULL
+    && write_all(file, &header, sizeof(header), 1)
+    && write_all(file, index_points, sizeof(IndexPoint), count)
+    && write_all(file, order, sizeof(uint32_t), count)
+    && write_all(file, &padding, sizeof(uint32_t), count % 2)
+    && write_all(file, boxes, sizeof(IndexBox), total);
+  if (file != NULL && 0 != fclose(file))
+    ret = false;
+  if (ret && 0 != rename(temporary, filename))
+    ret = false;
+  if (!ret) {
+    warn("Could not write index “%s”", filename);
+    unlink(temporary);
+  }
+  free(temporary);
+  free(index_points);
+  free(order);
+  free(boxes);
+  return ret;
+}
+
+bool point_index_open(const char filename[], PointIndex *index) {
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) {
+    warn("Could not open index “%s”", filename);
+    return false;
+  }
+  struct stat status;
+  if (0 != fstat(fd, &status) || (size_t)status.st_size < sizeof(IndexHeader)) {
+    warnx("Index “%s” is too short", filename);
+    close(fd);
+    return false;
+  }
+  index->size = status.st_size;
+  index->map = mmap(NULL, index->size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (index->map == MAP_FAILED) {
+    warn("Could not map index “%s”", filename);
+    return false;
+  }
+
+  index->header = index->map;
+  const IndexHeader *header = index->header;
+  const size_t order_size =
+    (header->count + header->count % 2) * sizeof(uint32_t);
+  if (memcmp(header->magic, MAGIC, sizeof(header->magic)) != 0
+    || header->node_size != POINT_INDEX_NODE_SIZE
+    || header->levels > POINT_INDEX_MAX_LEVELS
+    || header->count > UINT32_MAX
+    || index->size != sizeof(IndexHeader)
+      + header->count * sizeof(IndexPoint) + order_size
+      + header->level_offsets[header->levels] * sizeof(IndexBox)) {
+    warnx("“%s” is not a valid index", filename);
+    munmap(index->map, index->size);
+    return false;
+  }
+  index->points = (const IndexPoint *)(header + 1);
+  index->order = (const uint32_t *)(index->points + header->count);
+  index->boxes =
+    (const IndexBox *)((const char *)index->order + order_size);
+  return true;
+}
+
+void point_index_close(PointIndex *index) {
+  munmap(index->map, index->size);
+  index->map = NULL;
+}
+
+/**
+ * Position of the first point at or after the time.
+ */
+static size_t lower_bound(const PointIndex *index, time_t time) {
+  size_t low = 0, high = index->header->count;
+  while (low < high) {
+    size_t middle = low + (high - low) / 2;
+    if (index->points[middle].timestamp < time)
+      low = middle + 1;
+    else
+      high = middle;
+  }
+  return low;
+}
+
+size_t point_index_range(const PointIndex *index, time_t from, time_t to,
+  size_t *first) {
+  *first = lower_bound(index, from);
+  if (to < from)
+    return 0;
+  size_t end = to == INT64_MAX
+    ? index->header->count
+    : lower_bound(index, to + 1);
+  return end - *first;
+}
+
+ptrdiff_t point_index_at(const PointIndex *index, time_t time) {
+  const size_t count = index->header->count;
+  if (count == 0)
+    return -1;
+  size_t after = lower_bound(index, time);
+  if (after == count)
+    return count - 1;
+  if (after == 0
+    || index->points[after].timestamp - time
+      < time - index->points[after - 1].timestamp)
+    return after;
+  return after - 1;
+}
+
+static bool intersects(IndexBox a, IndexBox b) {
+  return a.min_lon <= b.max_lon && b.min_lon <= a.max_lon
+    && a.min_lat <= b.max_lat && b.min_lat <= a.max_lat;
+}
+
+size_t point_index_box(const PointIndex *index, IndexBox box,
+  void (*visit)(size_t position, void *data), void *data) {
+  const IndexHeader *header = index->header;
+  if (header->levels == 0)
+    return 0;
+  /* Depth first: at most a node’s children per level are pending. */
+  struct { unsigned int level; size_t node; }
+    stack[POINT_INDEX_MAX_LEVELS * POINT_INDEX_NODE_SIZE];
+  size_t top = 0;
+  stack[top].level = header->levels - 1;
+  stack[top++].node = header->level_offsets[header->levels - 1];
+  size_t found = 0;
+  while (top > 0) {
+    top--;
+    const unsigned int level = stack[top].level;
+    const size_t node = stack[top].node;
+    if (!intersects(index->boxes[node], box))
+      continue;
+    const size_t local = node - header->level_offsets[level];
+    const size_t first = local * header->node_size;
+    const size_t children = child_count(header, level, local);
+    for (size_t i = first; i < first + children; ++i) {
+      if (level > 0) {
+        stack[top].level = level - 1;
+        stack[top++].node = header->level_offsets[level - 1] + i;
+      }
+      else if (intersects(point_box(index->points[index->order[i]]), box)) {
+        visit(index->order[i], data);
+        found++;
+      }
+    }
+  }
+  return found;
+}
+
+/* Node or point waiting in the nearest search, by distance. Level -1 for
+ * points. */
+typedef struct {
+  double distance;
+  int level;
+  size_t id;
+} Candidate;
+
+typedef struct {
+  Candidate *items;
+  size_t count;
+  size_t allocated;
+} Queue;
+
+static void queue_push(Queue *queue, Candidate candidate) {
+  if (queue->count == queue->allocated) {
+    queue->allocated = queue->allocated == 0 ? 64 : queue->allocated * 2;
+    queue->items = reallocarray(queue->items, queue->allocated,
+      sizeof(Candidate));
+    if (queue->items == NULL)
+      errx(1, "Could not allocate %zu nearest candidates", queue->allocated);
+  }
+  size_t i = queue->count++;
+  while (i > 0 && queue->items[(i - 1) / 2].distance > candidate.distance) {
+    queue->items[i] = queue->items[(i - 1) / 2];
+    i = (i - 1) / 2;
+  }
+  queue->items[i] = candidate;
+}
+
+static Candidate queue_pop(Queue *queue) {
+  Candidate ret = queue->items[0];
+  Candidate last = queue->items[--queue->count];
+  size_t i = 0;
+  for (;;) {
+    size_t child = 2 * i + 1;
+    if (child >= queue->count)
+      break;
+    if (child + 1 < queue->count
+      && queue->items[child + 1].distance < queue->items[child].distance)
+      child++;
+    if (queue->items[child].distance >= last.distance)
+      break;
+    queue->items[i] = queue->items[child];
+    i = child;
+  }
+  if (queue->count > 0)
+    queue->items[i] = last;
+  return ret;
+}
+
+/**
+ * Distance in meters from the coordinates to the box, on a plane scaled for
+ * the latitude of the coordinates. The same scale for all boxes keeps the
+ * search order exact, and nearby distances are close to the real ones.
+ */
+static double box_distance(double lon, double lat, double x_scale,
+  IndexBox box) {
+  double dx = lon < box.min_lon ? box.min_lon - lon
+    : lon > box.max_lon ? lon - box.max_lon : 0;
+  double dy = lat < box.min_lat ? box.min_lat - lat
+    : lat > box.max_lat ? lat - box.max_lat : 0;
+  return hypot(dx * x_scale, dy * METERS_PER_MICRODEGREE);
+}
+
+size_t point_index_nearest(const PointIndex *index, double lon, double lat,
+  size_t count, size_t positions[count], double distances[count]) {
+  const IndexHeader *header = index->header;
+  if (header->levels == 0 || count == 0)
+    return 0;
+  const double x = lon * 1e6, y = lat * 1e6;
+  const double x_scale = METERS_PER_MICRODEGREE * cos(lat * M_PI / 180);
+  Queue queue = { 0 };
+  const size_t root = header->level_offsets[header->levels - 1];
+  queue_push(&queue, (Candidate){
+    box_distance(x, y, x_scale, index->boxes[root]),
+    header->levels - 1,
+    root,
+  });
+  size_t found = 0;
+  while (queue.count > 0 && found < count) {
+    Candidate candidate = queue_pop(&queue);
+    /* Points come out of the queue nearest first. */
+    if (candidate.level < 0) {
+      positions[found] = candidate.id;
+      if (distances != NULL)
+        distances[found] = candidate.distance;
+      found++;
+      continue;
+    }
+    const unsigned int level = candidate.level;
+    const size_t local = candidate.id - header->level_offsets[level];
+    const size_t first = local * header->node_size;
+    const size_t children = child_count(header, level, local);
+    for (size_t i = first; i < first + children; ++i) {
+      if (level > 0) {
+        const size_t node = header->level_offsets[level - 1] + i;
+        queue_push(&queue, (Candidate){
+          box_distance(x, y, x_scale, index->boxes[node]),
+          level - 1,
+          node,
+        });
+      }
+      else {
+        const size_t position = index->order[i];
+        queue_push(&queue, (Candidate){
+          box_distance(x, y, x_scale, point_box(index->points[position])),
+          -1,
+          position,
+        });
+      }
+    }
+  }
+  free(queue.items);
+  return found;
+}
@@ -0,0 +1,112 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include "track.h"
+
+/* Children per R-tree node. */
+#define POINT_INDEX_NODE_SIZE 16
+
+/* Enough R-tree levels for 2^32 points. */
+#define POINT_INDEX_MAX_LEVELS 16
+
+/**
+ * A location in the index file, coordinates in microdegrees.
+ */
+typedef struct {
+  int64_t timestamp;
+  int32_t lon;
+  int32_t lat;
+} IndexPoint;
+
+/**
+ * Bounding box of an R-tree node, in microdegrees.
+ */
+typedef struct {
+  int32_t min_lon;
+  int32_t min_lat;
+  int32_t max_lon;
+  int32_t max_lat;
+} IndexBox;
+
+/**
+ * Start of the index file, followed by the points in timestamp order, the
+ * point positions in Hilbert curve order (the R-tree leaves), and the R-tree
+ * nodes level by level from the leaves up. Numbers are in the host’s byte
+ * order.
+ */
+typedef struct {
+  char magic[8];
+  uint32_t node_size;
+  uint32_t levels;
+  uint64_t count;
+  /* First node of each level, and the number of nodes at the end. */
+  uint64_t level_offsets[POINT_INDEX_MAX_LEVELS + 1];
+} IndexHeader;
+
+/**
+ * An index file mapped in memory.
+ */
+typedef struct {
+  void *map;
+  size_t size;
+  const IndexHeader *header;
+  const IndexPoint *points;
+  const uint32_t *order;
+  const IndexBox *boxes;
+} PointIndex;
+
+/**
+ * Writes an index file of the points, which should be in timestamp order. The
+ * file is replaced atomically, so it can be queried meanwhile. Returns false
+ * with a warning if it can’t be written.
+ */
+bool point_index_write(const char filename[], size_t count,
+  const TrackPoint points[count]);
+
+/**
+ * Position of a cell of a 65536×65536 grid along a Hilbert curve, which keeps
+ * close cells mostly close.
+ */
+uint32_t point_index_hilbert(uint32_t x, uint32_t y);
+
+/**
+ * Maps an index file. Returns false with a warning if it can’t be read or it’s
+ * not an index file.
+ */
+bool point_index_open(const char filename[], PointIndex *index);
+
+/**
+ * Unmaps an index file.
+ */
+void point_index_close(PointIndex *index);
+
+/**
+ * Points between the timestamps (inclusive): sets first to the position of the
+ * first one and returns how many there are.
+ */
+size_t point_index_range(const PointIndex *index, time_t from, time_t to,
+  size_t *first);
+
+/**
+ * Position of the point closest in time, or -1 when the index is empty.
+ */
+ptrdiff_t point_index_at(const PointIndex *index, time_t time);
+
+/**
+ * Calls visit with the position of each point inside the box (inclusive), in
+ * no particular order. Returns the number of points found.
+ */
+size_t point_index_box(const PointIndex *index, IndexBox box,
+  void (*visit)(size_t position, void *data), void *data);
+
+/**
+ * Finds up to count points closest to the coordinates, nearest first. Fills
+ * their positions, and their approximate distances in meters when distances
+ * isn’t NULL. Returns the number of points found.
+ */
+size_t point_index_nearest(const PointIndex *index, double lon, double lat,
+  size_t count, size_t positions[count], double distances[count]);
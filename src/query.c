@@ -0,0 +1,96 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#define _XOPEN_SOURCE 700
+#include <err.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "arguments.h"
+#include "point_index.h"
+
+/**
+ * Prints a point of the index: local time, lon and lat.
+ */
+static void print_point(const PointIndex *index, size_t position) {
+  const IndexPoint *point = &index->points[position];
+  time_t timestamp = point->timestamp;
+  struct tm time;
+  char text[sizeof("YYYY-MM-DD hh:mm:ss")];
+  strftime(text, sizeof(text), "%Y-%m-%d %H:%M:%S",
+    localtime_r(&timestamp, &time));
+  printf("%s\t%.6f\t%.6f", text, point->lon * 1e-6, point->lat * 1e-6);
+}
+
+static void print_visited(size_t position, void *index) {
+  print_point(index, position);
+  putchar('\n');
+}
+
+/**
+ * query: answers time and place questions from an index file (see
+ * build_index), which is only mapped into memory, so it starts instantly and
+ * doesn’t link SpatiaLite.
+ *
+ * Usage:
+ *   query at index "YYYY-MM-DD hh:mm" where was I at that time
+ *   query range index from to         locations between the times
+ *   query near index lon lat [count]  when was I closest to the place
+ *   query box index west south east north  locations in the box
+ */
+int main(int argc, char* argv[]) {
+  if (argc < 4)
+    errx(1, "Usage: %s at|range|near|box index ...", argv[0]);
+  const char *command = argv[1];
+
+  PointIndex index;
+  if (!point_index_open(argv[2], &index))
+    return 1;
+  if (strcmp(command, "at") == 0 && argc == 4) {
+    ptrdiff_t position = point_index_at(&index, argument_time(argv[3]));
+    if (position >= 0) {
+      print_point(&index, position);
+      putchar('\n');
+    }
+  }
+  else if (strcmp(command, "range") == 0 && argc == 5) {
+    size_t first;
+    size_t count = point_index_range(&index, argument_time(argv[3]),
+      argument_time(argv[4]), &first);
+    for (size_t i = first; i < first + count; ++i)
+      print_visited(i, &index);
+  }
+  else if (strcmp(command, "near") == 0 && (argc == 5 || argc == 6)) {
+    double requested = argc == 6 ? argument_double(argv[5]) : 1;
+    if (!(requested >= 1))
+      errx(1, "Invalid count “%s”", argv[5]);
+    size_t count = requested;
+    size_t *positions = malloc((count + 1) * sizeof(size_t));
+    double *distances = malloc((count + 1) * sizeof(double));
+    if (positions == NULL || distances == NULL)
+      errx(1, "Could not allocate %zu results", count);
+    size_t found = point_index_nearest(&index, argument_double(argv[3]),
+      argument_double(argv[4]), count, positions, distances);
+    for (size_t i = 0; i < found; ++i) {
+      print_point(&index, positions[i]);
+      printf("\t%.0f m\n", distances[i]);
+    }
+    free(positions);
+    free(distances);
+  }
+  else if (strcmp(command, "box") == 0 && argc == 7) {
+    IndexBox box = {
+      .min_lon = lround(argument_double(argv[3]) * 1e6),
+      .min_lat = lround(argument_double(argv[4]) * 1e6),
+      .max_lon = lround(argument_double(argv[5]) * 1e6),
+      .max_lat = lround(argument_double(argv[6]) * 1e6),
+    };
+    point_index_box(&index, box, print_visited, &index);
+  }
+  else {
+    errx(1, "Usage: %s at|range|near|box index ...", argv[0]);
+  }
+  point_index_close(&index);
+  return 0;
+}
@@ -0,0 +1,184 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#include <dirent.h>
+#include <err.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "db.h"
+#include "glyph.h"
+#include "output_data.h"
+#include "partition.h"
+#include "strip_cache.h"
+
+/* The glyphs, as parse_directory loads them. */
+static const char keys[] = "0123456789_";
+#define GLYPH_COUNT (sizeof(keys) - 1)
+
+/* As many lines as parse_directory reads from a video. */
+#define MAX_LINES 301
+
+/**
+ * A cache file recognized by a thread.
+ */
+typedef struct {
+  const char *directory;
+  const char *cache_name;
+  const Glyph *glyphs;
+  pthread_t thread;
+  int read_lines;
+  CharLine lines[MAX_LINES];
+  int64_t pts[MAX_LINES];
+} Job;
+
+static void *recognize(void *data) {
+  Job *job = data;
+  char *filename =
+    malloc(strlen(job->directory) + strlen(job->cache_name) + 2);
+  if (filename == NULL)
+    errx(1, "Could not allocate file name");
+  sprintf(filename, "%s/%s", job->directory, job->cache_name);
+  job->read_lines = strips_lines(filename, GLYPH_COUNT, job->glyphs,
+    MAX_LINES, job->lines, job->pts);
+  free(filename);
+  return NULL;
+}
+
+/**
+ * Filtering function for scandir: the finished cache files.
+ */
+static int cache_filter(const struct dirent *entry) {
+  const char *extension = strrchr(entry->d_name, '.');
+  return entry->d_name[0] != '.' && extension != NULL
+    && strcmp(extension, STRIP_EXTENSION) == 0;
+}
+
+/**
+ * reprocess: runs the recognition and validation again over the strips
+ * parse_directory --cache kept, without decoding the videos, and writes the
+ * lines that are OK to the database, replacing what those videos wrote before
+ * over their span (see AppendOptions.replace). A catalog of partitions (see
+ * partition.h) has each video written to its partition. Recognition runs on
+ * several threads, writing on the main one.
+ *
+ * Usage: reprocess [--compact] [--stationary=METERS] [--jobs=N]
+ *   cache_directory database
+ *   --compact     same as parse_directory’s
+ *   --stationary  same as parse_directory’s, over the seconds that were read
+ *   --jobs        threads recognizing strips, the online processors by default
+ */
+int main(int argc, char* argv[]) {
+  AppendOptions append_options = {
+    .compact = false,
+    .stationary_radius = 0,
+    .replace = true,
+  };
+  long jobs = sysconf(_SC_NPROCESSORS_ONLN);
+  const struct option long_options[] = {
+    {"compact", no_argument, NULL, 'c'},
+    {"stationary", required_argument, NULL, 's'},
+    {"jobs", required_argument, NULL, 'j'},
+    {0},
+  };
+  int option;
+  while (-1 != (option = getopt_long(argc, argv, "", long_options, NULL))) {
+    char *end;
+    switch (option) {
+      case 'c':
+        append_options.compact = true;
+        break;
+      case 's':
+        append_options.stationary_radius = strtod(optarg, &end);
+        if (*end != '\0' || !(append_options.stationary_radius > 0))
+          errx(1, "Invalid stationary radius “%s”", optarg);
+        break;
+      case 'j':
+        jobs = strtol(optarg, &end, 10);
+        if (*end != '\0' || jobs < 1 || jobs > 1024)
+          errx(1, "Invalid number of jobs “%s”", optarg);
+        break;
+      default:
+        errx(1, "Usage: %s [--compact] [--stationary=METERS] [--jobs=N]"
+          " cache_directory database", argv[0]);
+    }
+  }
+  argc -= optind - 1;
+  argv += optind - 1;
+  if (argc != 3)
+    errx(1, "Got %d arguments, expected 2 (cache directory and database)",
+      argc - 1);
+  if (jobs < 1)
+    jobs = 1;
+
+  Glyph glyphs[GLYPH_COUNT];
+  load_glyphs("../data/glyphs.png", GLYPH_COUNT, keys, glyphs);
+  SpatiaLite sp = open_and_init_db(argv[2]);
+  PartitionPeriod period;
+  const bool partitioned = partition_period(sp.db, &period);
+
+  struct dirent **list;
+  int n = scandir(argv[1], &list, cache_filter, alphasort);
+  if (n < 0)
+    err(1, "Could not list %s", argv[1]);
+
+  Job *batch = malloc(jobs * sizeof(Job));
+  if (batch == NULL)
+    errx(1, "Could not allocate %ld jobs", jobs);
+  int failed = 0;
+  for (int first = 0; first < n; first += jobs) {
+    int count = n - first < jobs ? n - first : jobs;
+    for (int i = 0; i < count; ++i) {
+      batch[i] = (Job){
+        .directory = argv[1],
+        .cache_name = list[first + i]->d_name,
+        .glyphs = glyphs,
+      };
+      if (0 != pthread_create(&batch[i].thread, NULL, recognize, &batch[i]))
+        errx(1, "Could not start thread");
+    }
+
+    /* SQLite writes one at a time anyway. */
+    for (int i = 0; i < count; ++i) {
+      Job *job = &batch[i];
+      pthread_join(job->thread, NULL);
+      /* The video’s name, without the extension of the cache. */
+      char *video_name = strdup(job->cache_name);
+      if (video_name == NULL)
+        errx(1, "Could not allocate file name");
+      video_name[strlen(video_name) - strlen(STRIP_EXTENSION)] = '\0';
+      printf("Reprocessing “%s”\n", video_name);
+      if (job->read_lines <= 0) {
+        warnx("Got %d lines", job->read_lines);
+        failed++;
+      }
+      else if (!lines_ok(video_name, job->read_lines, job->lines)) {
+        printf("Lines are not OK\n");
+        failed++;
+      }
+      else {
+        append_options.pts = job->pts;
+        if (partitioned) {
+          char *partition =
+            partition_for(sp.db, period, video_start_time(video_name));
+          append_lines(video_name, job->read_lines, job->lines, partition,
+            &append_options);
+          free(partition);
+        }
+        else {
+          append_lines(video_name, job->read_lines, job->lines, argv[2],
+            &append_options);
+        }
+      }
+      free(video_name);
+      free(list[first + i]);
+    }
+  }
+  free(batch);
+  free(list);
+  close_db(sp);
+  if (failed > 0)
+    printf("%d of %d files failed\n", failed, n);
+  return 0;
+}
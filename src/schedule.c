@@ -0,0 +1,116 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#define _XOPEN_SOURCE 700
+#include <err.h>
+#include <stdlib.h>
+#include <string.h>
+#include "output_data.h"
+#include "schedule.h"
+
+/* Keys as given on the command line. */
+static const char *const key_names[SCHEDULE_KEY_COUNT] = {
+  "ro", "window", "newest",
+};
+
+/* Bits each key takes in a priority, the first key in the highest ones. Start
+ * times fit in 36 bits until year 4147. */
+static const unsigned int key_bits[SCHEDULE_KEY_COUNT] = { 1, 1, 36 };
+
+bool schedule_parse_order(const char order[], Schedule *schedule) {
+  schedule->key_count = 0;
+  const char *key = order;
+  while (*key != '\0') {
+    size_t length = strcspn(key, ",");
+    unsigned int i = 0;
+    while (i < SCHEDULE_KEY_COUNT && (strlen(key_names[i]) != length
+        || strncmp(key, key_names[i], length) != 0))
+      ++i;
+    if (i == SCHEDULE_KEY_COUNT || schedule->key_count == SCHEDULE_KEY_COUNT)
+      return false;
+    /* Each key once: the priority only has room for each once. */
+    for (unsigned int j = 0; j < schedule->key_count; ++j)
+      if (schedule->keys[j] == i)
+        return false;
+    schedule->keys[schedule->key_count++] = i;
+    key += length;
+    if (*key == ',' && *++key == '\0')
+      return false;
+  }
+  return schedule->key_count > 0;
+}
+
+/**
+ * Parses a local time YYYYMMDDhhmmss, returning where it stopped or NULL.
+ */
+static const char *parse_time(const char text[], time_t *time) {
+  struct tm tm = { 0 };
+  const char *end = strptime(text, "%Y%m%d%H%M%S", &tm);
+  if (end == NULL)
+    return NULL;
+  tm.tm_isdst = -1;
+  *time = mktime(&tm);
+  return end;
+}
+
+bool schedule_parse_window(const char window[], Schedule *schedule) {
+  const char *end = parse_time(window, &schedule->window_from);
+  if (end == NULL || *end != ',')
+    return false;
+  end = parse_time(end + 1, &schedule->window_to);
+  return end != NULL && *end == '\0'
+    && schedule->window_from <= schedule->window_to;
+}
+
+int64_t schedule_priority(const Schedule *schedule, bool read_only,
+  time_t start) {
+  int64_t priority = 0;
+  for (unsigned int i = 0; i < schedule->key_count; ++i) {
+    int64_t value = 0;
+    switch (schedule->keys[i]) {
+      case SCHEDULE_READ_ONLY:
+        value = read_only;
+        break;
+      case SCHEDULE_WINDOW:
+        value = start != -1 && start <= schedule->window_to
+          && start + VIDEO_SECONDS > schedule->window_from;
+        break;
+      case SCHEDULE_NEWEST:
+        value = start > 0 ? start : 0;
+        break;
+      default:
+        break;
+    }
+    priority = (priority << key_bits[schedule->keys[i]]) | value;
+  }
+  return priority;
+}
+
+/**
+ * A listed file with its priority, for sorting.
+ */
+typedef struct {
+  struct dirent *entry;
+  int64_t priority;
+} Scheduled;
+
+static int compare_scheduled(const void *a, const void *b) {
+  const Scheduled *first = a, *second = b;
+  if (first->priority != second->priority)
+    return first->priority > second->priority ? -1 : 1;
+  return strcmp(first->entry->d_name, second->entry->d_name);
+}
+
+void schedule_sort(int n, struct dirent *list[n], int64_t priorities[n]) {
+  if (n <= 1)
+    return;
+  Scheduled *scheduled = malloc(n * sizeof(Scheduled));
+  if (scheduled == NULL)
+    errx(1, "Could not allocate schedule");
+  for (int i = 0; i < n; ++i)
+    scheduled[i] = (Scheduled){ list[i], priorities[i] };
+  qsort(scheduled, n, sizeof(Scheduled), compare_scheduled);
+  for (int i = 0; i < n; ++i) {
+    list[i] = scheduled[i].entry;
+    priorities[i] = scheduled[i].priority;
+  }
+  free(scheduled);
+}
@@ -0,0 +1,57 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#pragma once
+
+#include <dirent.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+/**
+ * What makes a video go first, see Schedule.
+ */
+typedef enum {
+  /* Locked by the dash cam, in RO/. */
+  SCHEDULE_READ_ONLY,
+  /* Overlapping the time window. */
+  SCHEDULE_WINDOW,
+  /* Started later. */
+  SCHEDULE_NEWEST,
+  SCHEDULE_KEY_COUNT,
+} ScheduleKey;
+
+/**
+ * Order in which the videos are read: by each key in turn, ties going by name.
+ * With no keys, by name, RO/ last.
+ */
+typedef struct {
+  unsigned int key_count;
+  ScheduleKey keys[SCHEDULE_KEY_COUNT];
+  /* For SCHEDULE_WINDOW, local time like the names, inclusive. */
+  time_t window_from;
+  time_t window_to;
+} Schedule;
+
+/**
+ * Parses the keys from a comma separated list of ro, window and newest, each
+ * at most once. Returns false when it isn’t one.
+ */
+bool schedule_parse_order(const char order[], Schedule *schedule);
+
+/**
+ * Parses the window from two local times YYYYMMDDhhmmss separated by a comma.
+ * Returns false when it isn’t one.
+ */
+bool schedule_parse_window(const char window[], Schedule *schedule);
+
+/**
+ * Priority of a video, higher going first: whether it’s in RO/ and its start
+ * time (see video_start_time), -1 when unknown.
+ */
+int64_t schedule_priority(const Schedule *schedule, bool read_only,
+  time_t start);
+
+/**
+ * Sorts the listing by decreasing priority, then by name, along with the
+ * priorities.
+ */
+void schedule_sort(int n, struct dirent *list[n], int64_t priorities[n]);
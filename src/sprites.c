@@ -0,0 +1,204 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libavcodec/avcodec.h>
+#include <libswscale/swscale.h>
+#include "sprites.h"
+#include "stats.h"
+
+/* JPEG quantizer scale: 2 is best, 31 worst. */
+#define SPRITE_QUALITY 5
+
+static char *sprite_filename(const char directory[], const char video_name[],
+  const char extension[]) {
+  char *filename = malloc(strlen(directory) + strlen(video_name)
+    + strlen(extension) + sizeof("/.tmp"));
+  if (filename == NULL)
+    errx(1, "Could not allocate file name");
+  sprintf(filename, "%s/%s%s", directory, video_name, extension);
+  return filename;
+}
+
+void sprites_create(SpriteWriter *writer, const char directory[],
+  const char video_name[], unsigned int interval, unsigned int frame_count,
+  bool gray) {
+  *writer = (SpriteWriter){
+    .interval = interval > 0 ? interval : 1,
+    .gray = gray,
+    .filename = sprite_filename(directory, video_name, SPRITE_EXTENSION),
+    .index_filename =
+      sprite_filename(directory, video_name, SPRITE_INDEX_EXTENSION),
+  };
+  writer->capacity = (frame_count + writer->interval - 1) / writer->interval;
+  writer->lines = malloc((writer->capacity + 1) * sizeof(unsigned int));
+  if (writer->lines == NULL)
+    errx(1, "Could not allocate sprite lines");
+}
+
+/**
+ * Allocates the whole sheet, black, once the first frame tells its aspect.
+ */
+static bool allocate_sheet(SpriteWriter *writer, const AVFrame *frame) {
+  /* Chroma is subsampled, so the thumbnails start at even rows. */
+  writer->height = SPRITE_WIDTH * frame->height / frame->width / 2 * 2;
+  if (writer->height < 2)
+    writer->height = 2;
+  const unsigned int columns = writer->capacity < SPRITE_COLUMNS
+    ? writer->capacity
+    : SPRITE_COLUMNS;
+  AVFrame *sheet = writer->sheet = av_frame_alloc();
+  if (sheet == NULL)
+    errx(1, "Could not allocate sprite sheet");
+  sheet->format = AV_PIX_FMT_YUVJ420P;
+  sheet->width = columns * SPRITE_WIDTH;
+  sheet->height =
+    (writer->capacity + SPRITE_COLUMNS - 1) / SPRITE_COLUMNS * writer->height;
+  if (0 != av_frame_get_buffer(sheet, 0)) {
+    warnx("Could not allocate sprite sheet %s", writer->filename);
+    return false;
+  }
+  memset(sheet->data[0], 0, sheet->linesize[0] * sheet->height);
+  memset(sheet->data[1], 128, sheet->linesize[1] * sheet->height / 2);
+  memset(sheet->data[2], 128, sheet->linesize[2] * sheet->height / 2);
+  return true;
+}
+
+void sprites_add(SpriteWriter *writer, const AVFrame *frame) {
+  const unsigned int line = writer->frames++;
+  if (writer->failed || line % writer->interval != 0
+    || writer->count == writer->capacity)
+    return;
+  double start = stats_start();
+  if (writer->sheet == NULL && !allocate_sheet(writer, frame)) {
+    writer->failed = true;
+    stats_stop(STAGE_SPRITES, start);
+    return;
+  }
+  /* The luma plane alone is a gray image. */
+  writer->scale = sws_getCachedContext(writer->scale, frame->width,
+    frame->height, writer->gray ? AV_PIX_FMT_GRAY8 : frame->format,
+    SPRITE_WIDTH, writer->height,
+    AV_PIX_FMT_YUVJ420P, SWS_AREA, NULL, NULL, NULL);
+  if (writer->scale == NULL) {
+    warnx("Could not scale frames for %s", writer->filename);
+    writer->failed = true;
+    stats_stop(STAGE_SPRITES, start);
+    return;
+  }
+  AVFrame *sheet = writer->sheet;
+  const int x = writer->count % SPRITE_COLUMNS * SPRITE_WIDTH;
+  const int y = writer->count / SPRITE_COLUMNS * writer->height;
+  uint8_t *const tile[4] = {
+    sheet->data[0] + y * sheet->linesize[0] + x,
+    sheet->data[1] + y / 2 * sheet->linesize[1] + x / 2,
+    sheet->data[2] + y / 2 * sheet->linesize[2] + x / 2,
+    NULL,
+  };
+  sws_scale(writer->scale, (const uint8_t *const *)frame->data,
+    frame->linesize, 0, frame->height, tile, sheet->linesize);
+  writer->lines[writer->count++] = line;
+  stats_stop(STAGE_SPRITES, start);
+}
+
+/**
+ * Encodes the rows of the sheet with thumbnails to a JPEG file.
+ */
+static bool write_sheet(SpriteWriter *writer, const char filename[]) {
+  const AVCodec *codec = avcodec_find_encoder(AV_CODEC_ID_MJPEG);
+  AVCodecContext *context = codec != NULL
+    ? avcodec_alloc_context3(codec)
+    : NULL;
+  AVPacket *pkt = av_packet_alloc();
+  if (context == NULL || pkt == NULL) {
+    warnx("No JPEG encoder for %s", filename);
+    avcodec_free_context(&context);
+    av_packet_free(&pkt);
+    return false;
+  }
+  writer->sheet->height = (writer->count + SPRITE_COLUMNS - 1)
+    / SPRITE_COLUMNS * writer->height;
+  context->width = writer->sheet->width;
+  context->height = writer->sheet->height;
+  context->pix_fmt = AV_PIX_FMT_YUVJ420P;
+  context->time_base = (AVRational){ 1, 1 };
+  context->flags |= AV_CODEC_FLAG_QSCALE;
+  context->global_quality = FF_QP2LAMBDA * SPRITE_QUALITY;
+  bool written = 0 == avcodec_open2(context, codec, NULL)
+    && 0 == avcodec_send_frame(context, writer->sheet)
+    && 0 == avcodec_receive_packet(context, pkt);
+  if (!written) {
+    warnx("Could not encode sprite sheet %s", filename);
+  }
+  else {
+    FILE *file = fopen(filename, "wb");
+    written = file != NULL
+      && fwrite(pkt->data, 1, pkt->size, file) == (size_t)pkt->size;
+    if (file != NULL && 0 != fclose(file))
+      written = false;
+    if (!written)
+      warn("Could not write %s", filename);
+  }
+  av_packet_free(&pkt);
+  avcodec_free_context(&context);
+  return written;
+}
+
+/**
+ * Writes where each thumbnail with a time is.
+ */
+static bool write_index(const SpriteWriter *writer, const char filename[],
+  unsigned int count, const time_t times[count]) {
+  FILE *file = fopen(filename, "w");
+  if (file == NULL) {
+    warn("Could not write %s", filename);
+    return false;
+  }
+  bool written = true;
+  for (unsigned int i = 0; written && i < writer->count; ++i) {
+    const unsigned int line = writer->lines[i];
+    if (line >= count || times[line] == 0)
+      continue;
+    written = 0 < fprintf(file, "%jd\t%u\t%u\t%u\t%d\n",
+      (intmax_t)times[line], i % SPRITE_COLUMNS * SPRITE_WIDTH,
+      i / SPRITE_COLUMNS * writer->height, SPRITE_WIDTH, writer->height);
+  }
+  if (0 != fclose(file))
+    written = false;
+  if (!written)
+    warn("Could not write %s", filename);
+  return written;
+}
+
+bool sprites_close(SpriteWriter *writer, unsigned int count,
+  const time_t times[count]) {
+  char *temporary = malloc(strlen(writer->filename) + sizeof(".tmp"));
+  char *index_temporary =
+    malloc(strlen(writer->index_filename) + sizeof(".tmp"));
+  if (temporary == NULL || index_temporary == NULL)
+    errx(1, "Could not allocate file name");
+  sprintf(temporary, "%s.tmp", writer->filename);
+  sprintf(index_temporary, "%s.tmp", writer->index_filename);
+  bool keep = times != NULL && !writer->failed && writer->count > 0
+    && write_sheet(writer, temporary)
+    && write_index(writer, index_temporary, count, times);
+  /* The index last, so it never points into an older sheet for long. */
+  if (keep && (0 != rename(temporary, writer->filename)
+      || 0 != rename(index_temporary, writer->index_filename))) {
+    warn("Could not replace sprites %s", writer->filename);
+    keep = false;
+  }
+  if (!keep) {
+    remove(temporary);
+    remove(index_temporary);
+  }
+  free(temporary);
+  free(index_temporary);
+  free(writer->filename);
+  free(writer->index_filename);
+  free(writer->lines);
+  av_frame_free(&writer->sheet);
+  sws_freeContext(writer->scale);
+  return keep;
+}
@@ -0,0 +1,63 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#pragma once
+
+#include <stdbool.h>
+#include <time.h>
+#include <libavutil/frame.h>
+
+/* Width of a thumbnail, the height keeps the frame’s aspect. */
+#define SPRITE_WIDTH 160
+/* Thumbnails per row of a sheet. */
+#define SPRITE_COLUMNS 10
+
+/* Extensions of the sheet and its index, after the video name. */
+#define SPRITE_EXTENSION ".sprite.jpg"
+#define SPRITE_INDEX_EXTENSION ".sprite.tsv"
+
+/**
+ * Downsizes some of the frames get_video_strings decoded into a sheet of
+ * thumbnails, a JPEG image, with an index of the time of each thumbnail and
+ * where it is in the sheet: tab separated timestamp, x, y, width and height.
+ * Both files only appear under their names once closed with the times.
+ */
+typedef struct {
+  /* A thumbnail every this many frames read. */
+  unsigned int interval;
+  unsigned int capacity;
+  unsigned int frames;
+  unsigned int count;
+  /* Which frame each thumbnail is from. */
+  unsigned int *lines;
+  int height;
+  AVFrame *sheet;
+  struct SwsContext *scale;
+  /* The frames only have luma, the thumbnails are gray. */
+  bool gray;
+  char *filename;
+  char *index_filename;
+  bool failed;
+} SpriteWriter;
+
+/**
+ * Starts the sheet of a video in the directory, with room for the thumbnails
+ * of up to frame_count frames, gray when they’re decoded in gray (see
+ * VideoOptions).
+ */
+void sprites_create(SpriteWriter *writer, const char directory[],
+  const char video_name[], unsigned int interval, unsigned int frame_count,
+  bool gray);
+
+/**
+ * Takes a thumbnail of the frame if it’s one of every interval frames added.
+ */
+void sprites_add(SpriteWriter *writer, const AVFrame *frame);
+
+/**
+ * Writes the sheet and its index, the times being those of the frames added,
+ * in order, replacing any previous ones of the video; or drops them when times
+ * is NULL, leaving the previous ones as they were. Thumbnails of frames
+ * without a time (0) are left out of the index. Returns whether they were
+ * written, with a warning when they couldn’t be.
+ */
+bool sprites_close(SpriteWriter *writer, unsigned int count,
+  const time_t times[count]);
@@ -0,0 +1,166 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#include <err.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "stats.h"
+
+bool stats_enabled = false;
+
+const double stats_bucket_limits[STATS_BUCKET_COUNT] = {
+  1e-5, 1e-4, 1e-3, 1e-2, 1e-1, 1, 10,
+};
+
+const char *const stats_stage_names[STAGE_COUNT] = {
+  "list", "read", "decode", "fill", "check", "insert", "derive", "commit",
+  "sprites",
+};
+
+const char *const stats_counter_names[COUNTER_COUNT] = {
+  "packets_read", "packets_skipped", "frames_decoded", "cells_matched",
+  "rows_inserted",
+};
+
+static bool print_summary = false;
+static FILE *trace = NULL;
+static bool in_file = false;
+static double file_start, run_start;
+static Stats file, last_file, run;
+
+double stats_now(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+/**
+ * Writes a complete event to the trace, with the JSON object args unless NULL.
+ * Times are in microseconds, the name is escaped.
+ */
+static void trace_event(const char category[], const char name[],
+  double start, double end, const char args[]) {
+  fprintf(trace, ",\n{\"cat\": \"%s\", \"ph\": \"X\", \"pid\": %ld, "
+    "\"tid\": 1, \"ts\": %.3f, \"dur\": %.3f, ",
+    category, (long)getpid(), start * 1e6, (end - start) * 1e6);
+  if (args != NULL)
+    fprintf(trace, "\"args\": %s, ", args);
+  fputs("\"name\": \"", trace);
+  for (const char *c = name; *c != '\0'; ++c) {
+    if (*c == '"' || *c == '\\')
+      fputc('\\', trace);
+    if ((unsigned char)*c >= ' ')
+      fputc(*c, trace);
+  }
+  fputs("\"}", trace);
+}
+
+void stats_record(Stage stage, double start) {
+  double end = stats_now();
+  Stats *stats = in_file ? &file : &run;
+  stats->seconds[stage] += end - start;
+  stats->calls[stage]++;
+  unsigned int bucket = 0;
+  while (bucket < STATS_BUCKET_COUNT
+    && end - start > stats_bucket_limits[bucket])
+    bucket++;
+  if (bucket < STATS_BUCKET_COUNT)
+    stats->buckets[stage][bucket]++;
+  /* A file has thousands of packets, only their total is worth seeing, see
+   * stats_file_end. */
+  if (trace != NULL && stage != STAGE_READ)
+    trace_event("stage", stats_stage_names[stage], start, end, NULL);
+}
+
+void stats_add(Counter counter, unsigned long count) {
+  (in_file ? &file : &run)->counters[counter] += count;
+}
+
+void stats_begin(bool summary, const char trace_filename[]) {
+  print_summary = summary;
+  if (trace_filename != NULL) {
+    trace = fopen(trace_filename, "w");
+    if (trace == NULL)
+      err(1, "Could not open trace file %s", trace_filename);
+    /* Events follow with a leading comma, after this one naming the process. */
+    fprintf(trace, "[{\"name\": \"process_name\", \"ph\": \"M\", "
+      "\"pid\": %ld, \"args\": {\"name\": \"ingest %ld\"}}",
+      (long)getpid(), (long)getpid());
+  }
+  stats_enabled = true;
+  run_start = stats_now();
+}
+
+/**
+ * Prints the stages with calls and the counters.
+ */
+static void print_stats(const char title[], double seconds,
+  const Stats *stats) {
+  printf("%s: %.3f s\n", title, seconds);
+  for (unsigned int i = 0; i < STAGE_COUNT; ++i) {
+    if (stats->calls[i] > 0)
+      printf("  %-8s %10.3f s %10lu calls\n", stats_stage_names[i],
+        stats->seconds[i], stats->calls[i]);
+  }
+  for (unsigned int i = 0; i < COUNTER_COUNT; ++i)
+    printf("  %-16s %10lu\n", stats_counter_names[i], stats->counters[i]);
+}
+
+void stats_file_begin(void) {
+  if (!stats_enabled)
+    return;
+  memset(&file, 0, sizeof(file));
+  in_file = true;
+  file_start = stats_now();
+}
+
+void stats_file_end(const char name[]) {
+  if (!stats_enabled)
+    return;
+  double end = stats_now();
+  in_file = false;
+  file.elapsed = end - file_start;
+  for (unsigned int i = 0; i < STAGE_COUNT; ++i) {
+    run.seconds[i] += file.seconds[i];
+    run.calls[i] += file.calls[i];
+    for (unsigned int j = 0; j < STATS_BUCKET_COUNT; ++j)
+      run.buckets[i][j] += file.buckets[i][j];
+  }
+  for (unsigned int i = 0; i < COUNTER_COUNT; ++i)
+    run.counters[i] += file.counters[i];
+  if (trace != NULL) {
+    char reads[64];
+    snprintf(reads, sizeof(reads), "{\"read_ms\": %.3f, \"reads\": %lu}",
+      file.seconds[STAGE_READ] * 1e3, file.calls[STAGE_READ]);
+    trace_event("file", name, file_start, end, reads);
+  }
+  if (print_summary) {
+    char title[256];
+    snprintf(title, sizeof(title), "Stats for “%s”", name);
+    print_stats(title, file.elapsed, &file);
+  }
+  last_file = file;
+}
+
+const Stats *stats_run(void) {
+  if (stats_enabled)
+    run.elapsed = stats_now() - run_start;
+  return &run;
+}
+
+const Stats *stats_last_file(void) {
+  return &last_file;
+}
+
+void stats_end(void) {
+  if (!stats_enabled)
+    return;
+  if (print_summary)
+    print_stats("Stats for the run", stats_run()->elapsed, &run);
+  if (trace != NULL) {
+    fputs("\n]\n", trace);
+    if (0 != fclose(trace))
+      warn("Could not write trace file");
+    trace = NULL;
+  }
+  stats_enabled = false;
+}
@@ -0,0 +1,129 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#pragma once
+
+#include <stdbool.h>
+#include <time.h>
+
+/**
+ * Timed stages of the ingest.
+ */
+typedef enum {
+  STAGE_LIST,    /* list_to_import */
+  STAGE_READ,    /* av_read_frame */
+  STAGE_DECODE,  /* sending a packet and receiving its frame */
+  STAGE_FILL,    /* fill_line */
+  STAGE_CHECK,   /* lines_ok */
+  STAGE_INSERT,  /* locations or compact track rows */
+  STAGE_DERIVE,  /* trips, stays, density and import record */
+  STAGE_COMMIT,  /* SQLite commit */
+  STAGE_SPRITES, /* scaling frames into thumbnail sprites */
+  STAGE_COUNT,
+} Stage;
+
+/**
+ * Counted events of the ingest.
+ */
+typedef enum {
+  COUNTER_PACKETS_READ,
+  COUNTER_PACKETS_SKIPPED,
+  COUNTER_FRAMES_DECODED,
+  COUNTER_CELLS_MATCHED,
+  COUNTER_ROWS_INSERTED,
+  COUNTER_COUNT,
+} Counter;
+
+/* Upper limits in seconds of the stage call latency buckets, beyond the last
+ * one calls only count in the total. */
+#define STATS_BUCKET_COUNT 7
+extern const double stats_bucket_limits[STATS_BUCKET_COUNT];
+
+/**
+ * Time spent and calls per stage, and counters, for a file or a run.
+ * .buckets: calls per latency bucket, not cumulative.
+ * .elapsed: wall clock seconds of the file, or of the run so far.
+ */
+typedef struct {
+  double seconds[STAGE_COUNT];
+  unsigned long calls[STAGE_COUNT];
+  unsigned long buckets[STAGE_COUNT][STATS_BUCKET_COUNT];
+  unsigned long counters[COUNTER_COUNT];
+  double elapsed;
+} Stats;
+
+/* Names of the stages and counters, as identifiers. */
+extern const char *const stats_stage_names[STAGE_COUNT];
+extern const char *const stats_counter_names[COUNTER_COUNT];
+
+/* Whether anything is recorded. Only set through stats_begin. */
+extern bool stats_enabled;
+
+/**
+ * Monotonic clock in seconds.
+ */
+double stats_now(void);
+
+/**
+ * Adds a stage call that started at start to the file’s stats and the trace.
+ */
+void stats_record(Stage stage, double start);
+
+/**
+ * Adds to a counter of the file’s stats.
+ */
+void stats_add(Counter counter, unsigned long count);
+
+/**
+ * Start time for stats_stop, or 0 without a clock read when disabled.
+ */
+static inline double stats_start(void) {
+  return stats_enabled ? stats_now() : 0;
+}
+
+/**
+ * Records a stage call started at stats_start. Costs a branch when disabled.
+ */
+static inline void stats_stop(Stage stage, double start) {
+  if (stats_enabled)
+    stats_record(stage, start);
+}
+
+/**
+ * Adds to a counter. Costs a branch when disabled.
+ */
+static inline void stats_count(Counter counter, unsigned long count) {
+  if (stats_enabled)
+    stats_add(counter, count);
+}
+
+/**
+ * Enables the stats, also printing a summary per file and per run to stdout
+ * when summary is set, and writing a Chrome trace event file (for
+ * chrome://tracing or Perfetto) when trace_filename isn’t NULL.
+ */
+void stats_begin(bool summary, const char trace_filename[]);
+
+/**
+ * Starts a file’s stats. Stage calls outside files only count for the run.
+ */
+void stats_file_begin(void);
+
+/**
+ * Ends the file’s stats: prints them, adds them to the run and traces the file
+ * as a whole, with the time and number of its packet reads as arguments.
+ */
+void stats_file_end(const char name[]);
+
+/**
+ * The run’s stats so far, from the files ended and the calls outside files.
+ */
+const Stats *stats_run(void);
+
+/**
+ * The stats of the last file ended, all 0 before the first one.
+ */
+const Stats *stats_last_file(void);
+
+/**
+ * Prints the run’s stats and finishes the trace file.
+ */
+void stats_end(void);
@@ -0,0 +1,175 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#include <err.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <sqlite3.h>
+#include <spatialite/gaiageo.h>
+#include "stays.h"
+
+/* Keeps the stays table: where the car stopped, from when to when. Any database
+ * errors trigger errx().
+ */
+
+unsigned int find_stays(unsigned int count, const TrackPoint points[count],
+  Stay **stays) {
+  unsigned int found = 0;
+  unsigned int allocated = 0;
+  *stays = NULL;
+  for (unsigned int i = 0; i < count;) {
+    /* Locations close enough to the first one. */
+    unsigned int j = i + 1;
+    while (j < count
+      && great_circle_distance(points[i].lat, points[i].lon,
+        points[j].lat, points[j].lon) <= STAY_RADIUS)
+      j++;
+    if (difftime(points[j - 1].timestamp, points[i].timestamp)
+      < STAY_MIN_DURATION) {
+      i++;
+      continue;
+    }
+
+    if (found == allocated) {
+      allocated = allocated == 0 ? 8 : allocated * 2;
+      *stays = reallocarray(*stays, allocated, sizeof(Stay));
+      if (*stays == NULL)
+        errx(1, "Could not allocate %u stays", allocated);
+    }
+    Stay *stay = &(*stays)[found++];
+    stay->start = points[i].timestamp;
+    stay->end = points[j - 1].timestamp;
+    stay->points = j - i;
+    stay->lon = 0;
+    stay->lat = 0;
+    for (unsigned int k = i; k < j; ++k) {
+      stay->lon += points[k].lon;
+      stay->lat += points[k].lat;
+    }
+    stay->lon /= stay->points;
+    stay->lat /= stay->points;
+    i = j;
+  }
+  return found;
+}
+
+/* Seconds of locations loaded at a time when looking for the ends of a stay. */
+#define STATIONARY_CHUNK 600
+
+/**
+ * Goes through the locations next to the timestamp, before it (direction -1) or
+ * after it (direction 1), while they are close to the first one. Returns the
+ * timestamp of the last one close enough, or the given timestamp when there are
+ * no locations.
+ */
+static time_t stationary_until(sqlite3 *db, time_t from, int direction) {
+  time_t ret = from;
+  bool anchored = false;
+  double lon = 0, lat = 0;
+  time_t next = from + direction;
+  for (;;) {
+    time_t chunk_end = next + direction * (STATIONARY_CHUNK - 1);
+    TrackPoint *points;
+    unsigned int count = direction < 0
+      ? load_track(db, chunk_end, next, &points)
+      : load_track(db, next, chunk_end, &points);
+    for (unsigned int k = 0; k < count; ++k) {
+      const TrackPoint *point = &points[direction < 0 ? count - 1 - k : k];
+      if (!anchored) {
+        lon = point->lon;
+        lat = point->lat;
+        anchored = true;
+      }
+      if (great_circle_distance(lat, lon, point->lat, point->lon)
+        > STAY_RADIUS) {
+        free(points);
+        return ret;
+      }
+      ret = point->timestamp;
+    }
+    free(points);
+    /* Jump over the gap to the next locations. */
+    next = direction < 0
+      ? track_time_before(db, chunk_end)
+      : track_time_after(db, chunk_end);
+    if (next == -1)
+      return ret;
+  }
+}
+
+void update_stays(sqlite3 *db, time_t from, time_t to) {
+  sqlite3_stmt *stmt;
+
+  /* A stay may have started before the new locations, or continue after them,
+   * even in another video. Include the stationary locations just before and
+   * after, and the stays touching all of those. */
+  time_t window_from = stationary_until(db, from, -1);
+  time_t window_to = stationary_until(db, to, 1);
+  const char touching[] =
+    "SELECT min(start_time), max(end_time) FROM stays"
+    "  WHERE end_time >= ? AND start_time <= ?;";
+  if (SQLITE_OK != sqlite3_prepare_v2(db, touching, sizeof(touching), &stmt,
+      NULL))
+    errx(1, "Could not prepare stay range statement");
+  if (SQLITE_OK != sqlite3_bind_int64(stmt, 1, window_from)
+    || SQLITE_OK != sqlite3_bind_int64(stmt, 2, window_to))
+    errx(1, "Could not bind stay range");
+  if (SQLITE_ROW != sqlite3_step(stmt))
+    errx(1, "Could not step stay range statement");
+  if (sqlite3_column_type(stmt, 0) != SQLITE_NULL) {
+    time_t start = sqlite3_column_int64(stmt, 0);
+    time_t end = sqlite3_column_int64(stmt, 1);
+    window_from = start < window_from ? start : window_from;
+    window_to = end > window_to ? end : window_to;
+  }
+  if (SQLITE_OK != sqlite3_finalize(stmt))
+    errx(1, "Could not finalize stay range statement");
+
+  const char delete[] =
+    "DELETE FROM stays WHERE end_time >= ? AND start_time <= ?;";
+  if (SQLITE_OK != sqlite3_prepare_v2(db, delete, sizeof(delete), &stmt,
+      NULL))
+    errx(1, "Could not prepare stay deletion");
+  if (SQLITE_OK != sqlite3_bind_int64(stmt, 1, window_from)
+    || SQLITE_OK != sqlite3_bind_int64(stmt, 2, window_to))
+    errx(1, "Could not bind stay deletion range");
+  if (SQLITE_DONE != sqlite3_step(stmt))
+    errx(1, "Could not delete stays");
+  if (SQLITE_OK != sqlite3_finalize(stmt))
+    errx(1, "Could not finalize stay deletion");
+
+  /* Find the stays again in the whole window. */
+  TrackPoint *points;
+  unsigned int count = load_track(db, window_from, window_to, &points);
+  Stay *stays;
+  unsigned int stay_count = find_stays(count, points, &stays);
+  free(points);
+  const char insert[] =
+    "INSERT INTO stays(start_time, end_time, points, centroid)"
+    "  VALUES (?, ?, ?, ?);";
+  if (SQLITE_OK != sqlite3_prepare_v2(db, insert, sizeof(insert), &stmt, NULL))
+    errx(1, "Could not prepare stay insertion");
+  for (unsigned int i = 0; i < stay_count; ++i) {
+    unsigned char *wkb;
+    int wkb_size;
+    gaiaGeomCollPtr geo = gaiaAllocGeomColl();
+    if (geo == NULL)
+      errx(1, "Could not allocate geometry collection");
+    geo->Srid = 4326;
+    gaiaAddPointToGeomColl(geo, stays[i].lon, stays[i].lat);
+    gaiaToSpatiaLiteBlobWkb(geo, &wkb, &wkb_size);
+    gaiaFreeGeomColl(geo);
+    if (SQLITE_OK != sqlite3_reset(stmt))
+      errx(1, "Could not reset stay insertion");
+    if (SQLITE_OK != sqlite3_bind_int64(stmt, 1, stays[i].start)
+      || SQLITE_OK != sqlite3_bind_int64(stmt, 2, stays[i].end)
+      || SQLITE_OK != sqlite3_bind_int(stmt, 3, stays[i].points))
+      errx(1, "Could not bind stay");
+    // Also frees the blob allocated for the wkb
+    if (SQLITE_OK != sqlite3_bind_blob(stmt, 4, wkb, wkb_size, free))
+      errx(1, "Could not bind stay centroid");
+    if (SQLITE_DONE != sqlite3_step(stmt))
+      errx(1, "Could not insert stay");
+  }
+  if (SQLITE_OK != sqlite3_finalize(stmt))
+    errx(1, "Could not finalize stay insertion");
+  free(stays);
+}
@@ -0,0 +1,38 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#pragma once
+
+#include <time.h>
+#include <sqlite3.h>
+#include "track.h"
+
+/* Distance in meters from the first location of a stay to the others. */
+#define STAY_RADIUS 50
+
+/* Shortest stay recorded, in seconds. */
+#define STAY_MIN_DURATION 300
+
+/**
+ * A period when the locations didn’t go further than STAY_RADIUS from where it
+ * started. Gaps (camera turned off while parked) are part of the stay.
+ */
+typedef struct {
+  time_t start;
+  time_t end;
+  unsigned int points;
+  double lon;
+  double lat;
+} Stay;
+
+/**
+ * Finds the stays in a track. The stays array is allocated and should be freed
+ * by the caller. Returns the number of stays.
+ */
+unsigned int find_stays(unsigned int count, const TrackPoint points[count],
+  Stay **stays);
+
+/**
+ * Finds the stays again around locations written between the timestamps,
+ * including the ones that started or continue in other videos. Should be
+ * called within the transaction writing the locations.
+ */
+void update_stays(sqlite3 *db, time_t from, time_t to);
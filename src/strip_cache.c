@@ -0,0 +1,131 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "strip_cache.h"
+#include "video_data.h"
+
+/* A cache file is gzipped: the magic, then the strip size as a check, then for
+ * each strip its 64-bit pts and STRIP_SIZE bytes, rows one after the other.
+ * Numbers are in native byte order: the cache is for the machine that wrote it.
+ */
+static const char magic[] = "ODSTRIP1";
+
+/* Fast compression: the noise doesn’t compress much better anyway. */
+static const char write_mode[] = "wb1";
+
+bool strips_create(StripWriter *writer, const char directory[],
+  const char video_name[]) {
+  writer->filename = malloc(strlen(directory) + strlen(video_name)
+    + sizeof("/" STRIP_EXTENSION));
+  writer->temporary = malloc(strlen(directory) + strlen(video_name)
+    + sizeof("/" STRIP_EXTENSION ".tmp"));
+  if (writer->filename == NULL || writer->temporary == NULL)
+    errx(1, "Could not allocate file name");
+  sprintf(writer->filename, "%s/%s" STRIP_EXTENSION, directory, video_name);
+  sprintf(writer->temporary, "%s.tmp", writer->filename);
+  writer->file = gzopen(writer->temporary, write_mode);
+  const uint32_t size = STRIP_SIZE;
+  if (writer->file == NULL
+    || gzwrite(writer->file, magic, sizeof(magic)) != sizeof(magic)
+    || gzwrite(writer->file, &size, sizeof(size)) != sizeof(size)) {
+    warnx("Could not write strip cache %s", writer->temporary);
+    if (writer->file != NULL)
+      gzclose(writer->file);
+    writer->file = NULL;
+    return false;
+  }
+  return true;
+}
+
+void strips_add(StripWriter *writer, const AVFrame *frame) {
+  if (writer->file == NULL)
+    return;
+  const int64_t pts = frame->pts;
+  bool written = gzwrite(writer->file, &pts, sizeof(pts)) == sizeof(pts);
+  for (unsigned int i = 0; written && i < GLYPH_HEIGHT; ++i)
+    written = gzwrite(writer->file,
+      frame->data[0] + (TOP_DATA_ROW + i) * frame->linesize[0],
+      EXPECTED_VIDEO_WIDTH) == EXPECTED_VIDEO_WIDTH;
+  /* A cache with holes would give different lines: drop it. */
+  if (!written) {
+    warnx("Could not write strip cache %s", writer->temporary);
+    gzclose(writer->file);
+    writer->file = NULL;
+  }
+}
+
+bool strips_close(StripWriter *writer, bool keep) {
+  if (writer->file != NULL) {
+    if (Z_OK != gzclose(writer->file)) {
+      warnx("Could not write strip cache %s", writer->temporary);
+      keep = false;
+    }
+  }
+  else {
+    keep = false;
+  }
+  if (keep && 0 != rename(writer->temporary, writer->filename)) {
+    warn("Could not replace strip cache %s", writer->filename);
+    keep = false;
+  }
+  if (!keep)
+    remove(writer->temporary);
+  free(writer->filename);
+  free(writer->temporary);
+  writer->file = NULL;
+  return keep;
+}
+
+int strips_lines(const char filename[], unsigned int glyph_count,
+  const Glyph glyphs[glyph_count], unsigned int string_count,
+  CharLine lines[string_count], int64_t *pts) {
+  gzFile file = gzopen(filename, "rb");
+  if (file == NULL) {
+    warnx("Could not open strip cache %s", filename);
+    return -1;
+  }
+  char file_magic[sizeof(magic)];
+  uint32_t size;
+  if (gzread(file, file_magic, sizeof(file_magic)) != sizeof(file_magic)
+    || memcmp(file_magic, magic, sizeof(magic)) != 0
+    || gzread(file, &size, sizeof(size)) != sizeof(size)
+    || size != STRIP_SIZE) {
+    warnx("Not a strip cache of this build: %s", filename);
+    gzclose(file);
+    return -1;
+  }
+
+  uint8_t *strip = malloc(STRIP_SIZE);
+  if (strip == NULL)
+    errx(1, "Could not allocate strip");
+  int filled_lines = 0;
+  int64_t strip_pts;
+  int read;
+  while ((read = gzread(file, &strip_pts, sizeof(strip_pts))) > 0) {
+    if ((size_t)read != sizeof(strip_pts)
+      || gzread(file, strip, STRIP_SIZE) != STRIP_SIZE) {
+      warnx("Truncated strip cache %s", filename);
+      filled_lines = -1;
+      break;
+    }
+    /* Too few lines allocated or video too long. */
+    if ((unsigned int)filled_lines >= string_count) {
+      filled_lines = -1;
+      break;
+    }
+    fill_line_rows(glyph_count, glyphs, strip, EXPECTED_VIDEO_WIDTH,
+      &lines[filled_lines]);
+    if (pts != NULL)
+      pts[filled_lines] = strip_pts;
+    filled_lines++;
+  }
+  if (read < 0) {
+    warnx("Could not read strip cache %s", filename);
+    filled_lines = -1;
+  }
+  free(strip);
+  gzclose(file);
+  return filled_lines;
+}
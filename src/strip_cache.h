@@ -0,0 +1,54 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <zlib.h>
+#include <libavutil/frame.h>
+#include "char_line.h"
+#include "glyph.h"
+
+/* Bytes of a strip: the data rows fill_line reads from a frame, luma only. */
+#define STRIP_SIZE (GLYPH_HEIGHT * EXPECTED_VIDEO_WIDTH)
+
+/* Extension of the cache files, after the video name. */
+#define STRIP_EXTENSION ".strips"
+
+/**
+ * Writes the strips of a video’s sampled frames to its cache file. The file
+ * only appears under its name once closed with keep.
+ */
+typedef struct {
+  gzFile file;
+  char *filename;
+  char *temporary;
+} StripWriter;
+
+/**
+ * Starts the cache file of a video in the directory. Returns false, with a
+ * warning, when it can’t be written: adding then does nothing. It should be
+ * closed either way.
+ */
+bool strips_create(StripWriter *writer, const char directory[],
+  const char video_name[]);
+
+/**
+ * Adds the data rows of a frame at least EXPECTED_VIDEO_WIDTH wide, with its
+ * presentation timestamp.
+ */
+void strips_add(StripWriter *writer, const AVFrame *frame);
+
+/**
+ * Finishes the file, replacing any previous cache of the video when keep is
+ * set, dropping it otherwise. Returns whether it was kept.
+ */
+bool strips_close(StripWriter *writer, bool keep);
+
+/**
+ * Runs fill_line_rows over the strips of a cache file, as get_video_strings did
+ * over their frames, also giving their timestamps when pts isn’t NULL.
+ * Returns the number of lines read or negative in case of error.
+ */
+int strips_lines(const char filename[], unsigned int glyph_count,
+  const Glyph glyphs[glyph_count], unsigned int string_count,
+  CharLine lines[string_count], int64_t *pts);
@@ -0,0 +1,37 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#include <math.h>
+#include "tile.h"
+
+void tile_position(double lon, double lat, unsigned int zoom, double *x,
+  double *y) {
+  const double n = (double)((uint64_t)1 << zoom);
+  const double lat_rad = lat * M_PI / 180;
+  *x = (lon + 180) / 360 * n;
+  *y = (1 - asinh(tan(lat_rad)) / M_PI) / 2 * n;
+}
+
+Tile tile_at(double lon, double lat, unsigned int zoom) {
+  const double n = (double)((uint64_t)1 << zoom);
+  double x, y;
+  tile_position(lon, lat, zoom, &x, &y);
+  x = floor(x);
+  y = floor(y);
+  /* Also covers the poles, where y is not finite. */
+  x = x < 0 ? 0 : x > n - 1 ? n - 1 : x;
+  y = !(y >= 0) ? 0 : y > n - 1 ? n - 1 : y;
+  Tile ret = {
+    .zoom = zoom,
+    .x = x,
+    .y = y,
+  };
+  return ret;
+}
+
+void tile_bounds(Tile tile, double *west, double *south, double *east,
+  double *north) {
+  const double n = (double)((uint64_t)1 << tile.zoom);
+  *west = tile.x / n * 360 - 180;
+  *east = (tile.x + 1) / n * 360 - 180;
+  *north = atan(sinh(M_PI * (1 - 2 * tile.y / n))) * 180 / M_PI;
+  *south = atan(sinh(M_PI * (1 - 2 * (tile.y + 1) / n))) * 180 / M_PI;
+}
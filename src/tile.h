@@ -0,0 +1,34 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * Web map (“slippy map”, XYZ) tile: the world in Web Mercator is split in
+ * 2^zoom by 2^zoom tiles, x growing to the east and y to the south.
+ */
+typedef struct {
+  unsigned int zoom;
+  uint32_t x;
+  uint32_t y;
+} Tile;
+
+/**
+ * Position of a coordinate in tiles at the zoom level: the integer parts are
+ * the tile, the fractional parts where it is inside the tile.
+ */
+void tile_position(double lon, double lat, unsigned int zoom, double *x,
+  double *y);
+
+/**
+ * Tile containing a coordinate. Latitudes beyond the Web Mercator limits go to
+ * the border tiles.
+ */
+Tile tile_at(double lon, double lat, unsigned int zoom);
+
+/**
+ * Coordinates of the tile corners: north-west (west, north) and south-east
+ * (east, south).
+ */
+void tile_bounds(Tile tile, double *west, double *south, double *east,
+  double *north);
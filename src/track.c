@@ -0,0 +1,211 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#include <err.h>
+#include <math.h>
+#include <stdlib.h>
+#include <sqlite3.h>
+#include <spatialite/gaiageo.h>
+#include "track.h"
+
+/* “Great Circle” ellipsoid constants from GRS80. */
+#define ELLIPSE_A 6378137
+#define ELLIPSE_B 6356752.3141403561458
+
+/* Meters per degree of latitude, close enough for simplification. */
+#define METERS_PER_DEGREE (ELLIPSE_A * M_PI / 180)
+
+double great_circle_distance(double lat1, double lon1, double lat2,
+  double lon2) {
+  return gaiaGreatCircleDistance(ELLIPSE_A, ELLIPSE_B, lat1, lon1, lat2, lon2);
+}
+
+void track_each(sqlite3 *db, time_t from, time_t to,
+  void (*visit)(TrackPoint point, void *data), void *data) {
+  const char query[] =
+    "SELECT timestamp, X(place), Y(place) FROM locations"
+    "  WHERE timestamp BETWEEN ?1 AND ?2"
+    " UNION ALL "
+    "SELECT s.end_time, X(l.place), Y(l.place)"
+    "  FROM stationary AS s JOIN locations AS l USING (timestamp)"
+    "  WHERE s.end_time BETWEEN ?1 AND ?2"
+    " UNION ALL "
+    "SELECT p.timestamp, p.lon, p.lat"
+    "  FROM compact_tracks AS t, compact_points(t.track) AS p"
+    "  WHERE t.end_time >= ?1 AND t.start_time <= ?2"
+    "    AND p.timestamp BETWEEN ?1 AND ?2"
+    " ORDER BY 1;";
+  sqlite3_stmt *stmt;
+  if (SQLITE_OK != sqlite3_prepare_v2(db, query, sizeof(query), &stmt, NULL))
+    errx(1, "Could not prepare track statement");
+  if (SQLITE_OK != sqlite3_bind_int64(stmt, 1, from)
+    || SQLITE_OK != sqlite3_bind_int64(stmt, 2, to))
+    errx(1, "Could not bind track time range");
+
+  int step;
+  while (SQLITE_ROW == (step = sqlite3_step(stmt))) {
+    visit((TrackPoint){
+      .timestamp = sqlite3_column_int64(stmt, 0),
+      .lon = sqlite3_column_double(stmt, 1),
+      .lat = sqlite3_column_double(stmt, 2),
+    }, data);
+  }
+  if (SQLITE_DONE != step)
+    errx(1, "Could not step track statement");
+  if (SQLITE_OK != sqlite3_finalize(stmt))
+    errx(1, "Could not finalize track statement");
+}
+
+/* Points loaded so far by load_track. */
+typedef struct {
+  unsigned int count;
+  unsigned int allocated;
+  TrackPoint *points;
+} LoadedTrack;
+
+static void append_point(TrackPoint point, void *data) {
+  LoadedTrack *track = data;
+  if (track->count == track->allocated) {
+    track->allocated *= 2;
+    track->points = reallocarray(track->points, track->allocated,
+      sizeof(TrackPoint));
+    if (track->points == NULL)
+      errx(1, "Could not allocate %u track points", track->allocated);
+  }
+  track->points[track->count++] = point;
+}
+
+unsigned int load_track(sqlite3 *db, time_t from, time_t to,
+  TrackPoint **points) {
+  LoadedTrack track = {
+    .count = 0,
+    .allocated = 512,
+    .points = reallocarray(NULL, 512, sizeof(TrackPoint)),
+  };
+  if (track.points == NULL)
+    errx(1, "Could not allocate %u track points", track.allocated);
+  track_each(db, from, to, append_point, &track);
+  *points = track.points;
+  return track.count;
+}
+
+/**
+ * Runs a query with a timestamp parameter and a single nullable result, -1 for
+ * NULL.
+ */
+static time_t time_query(sqlite3 *db, const char query[], time_t time) {
+  sqlite3_stmt *stmt;
+  if (SQLITE_OK != sqlite3_prepare_v2(db, query, -1, &stmt, NULL))
+    errx(1, "Could not prepare track time statement");
+  if (SQLITE_OK != sqlite3_bind_int64(stmt, 1, time))
+    errx(1, "Could not bind track time");
+  if (SQLITE_ROW != sqlite3_step(stmt))
+    errx(1, "Could not step track time statement");
+  time_t ret = sqlite3_column_type(stmt, 0) == SQLITE_NULL
+    ? -1
+    : sqlite3_column_int64(stmt, 0);
+  if (SQLITE_OK != sqlite3_finalize(stmt))
+    errx(1, "Could not finalize track time statement");
+  return ret;
+}
+
+time_t track_time_before(sqlite3 *db, time_t time) {
+  return time_query(db,
+    "SELECT max(t) FROM ("
+    "  SELECT max(timestamp) AS t FROM locations WHERE timestamp < ?1"
+    "  UNION ALL"
+    "  SELECT max(end_time) FROM stationary WHERE end_time < ?1"
+    "  UNION ALL"
+    "  SELECT max(end_time) FROM compact_tracks WHERE end_time < ?1"
+    "  UNION ALL"
+    "  SELECT ?1 - 1 WHERE EXISTS (SELECT 1 FROM compact_tracks"
+    "    WHERE end_time >= ?1 AND start_time < ?1)"
+    ");",
+    time);
+}
+
+time_t track_time_after(sqlite3 *db, time_t time) {
+  return time_query(db,
+    "SELECT min(t) FROM ("
+    "  SELECT min(timestamp) AS t FROM locations WHERE timestamp > ?1"
+    "  UNION ALL"
+    "  SELECT min(end_time) FROM stationary WHERE end_time > ?1"
+    "  UNION ALL"
+    "  SELECT min(start_time) FROM compact_tracks WHERE start_time > ?1"
+    "  UNION ALL"
+    "  SELECT ?1 + 1 WHERE EXISTS (SELECT 1 FROM compact_tracks"
+    "    WHERE end_time > ?1 AND start_time <= ?1)"
+    ");",
+    time);
+}
+
+unsigned int collapse_stationary(unsigned int count, TrackPoint points[count],
+  double radius, time_t until[count]) {
+  unsigned int kept = 0;
+  for (unsigned int i = 0; i < count;) {
+    unsigned int j = i + 1;
+    while (j < count
+      && great_circle_distance(points[i].lat, points[i].lon,
+        points[j].lat, points[j].lon) <= radius)
+      j++;
+    points[kept] = points[i];
+    until[kept] = points[j - 1].timestamp;
+    kept++;
+    i = j;
+  }
+  return kept;
+}
+
+/**
+ * Distance in meters from p to the segment a–b, on a plane around a. Tracks are
+ * short enough for the plane to be a good approximation.
+ */
+static double segment_distance(TrackPoint p, TrackPoint a, TrackPoint b) {
+  const double x_scale = METERS_PER_DEGREE * cos(a.lat * M_PI / 180);
+  const double px = (p.lon - a.lon) * x_scale;
+  const double py = (p.lat - a.lat) * METERS_PER_DEGREE;
+  const double bx = (b.lon - a.lon) * x_scale;
+  const double by = (b.lat - a.lat) * METERS_PER_DEGREE;
+  const double length2 = bx * bx + by * by;
+  double t = length2 > 0 ? (px * bx + py * by) / length2 : 0;
+  t = t < 0 ? 0 : t > 1 ? 1 : t;
+  return hypot(px - t * bx, py - t * by);
+}
+
+unsigned int simplify_track(unsigned int count, const TrackPoint points[count],
+  double tolerance, bool keep[count]) {
+  if (count == 0)
+    return 0;
+  for (unsigned int i = 0; i < count; ++i)
+    keep[i] = false;
+  keep[0] = keep[count - 1] = true;
+  unsigned int kept = count > 1 ? 2 : 1;
+
+  /* Ranges still to simplify, instead of recursion. Each split adds at most
+   * one range, so count ranges are enough. */
+  struct range { unsigned int first, last; } *stack =
+    reallocarray(NULL, count, sizeof(struct range));
+  if (stack == NULL)
+    errx(1, "Could not allocate simplification stack");
+  unsigned int top = 0;
+  stack[top++] = (struct range){ 0, count - 1 };
+  while (top > 0) {
+    struct range r = stack[--top];
+    double max_distance = 0;
+    unsigned int max_index = r.first;
+    for (unsigned int i = r.first + 1; i < r.last; ++i) {
+      double distance =
+        segment_distance(points[i], points[r.first], points[r.last]);
+      if (distance > max_distance) {
+        max_distance = distance;
+        max_index = i;
+      }
+    }
+    if (max_distance > tolerance) {
+      keep[max_index] = true;
+      kept++;
+      stack[top++] = (struct range){ r.first, max_index };
+      stack[top++] = (struct range){ max_index, r.last };
+    }
+  }
+  free(stack);
+  return kept;
+}
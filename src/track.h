@@ -0,0 +1,68 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#pragma once
+
+#include <stdbool.h>
+#include <time.h>
+#include <sqlite3.h>
+
+/**
+ * A location read back from the database.
+ */
+typedef struct {
+  time_t timestamp;
+  double lon;
+  double lat;
+} TrackPoint;
+
+/**
+ * Distance in meters between two coordinates over the GRS80 ellipsoid.
+ */
+double great_circle_distance(double lat1, double lon1, double lat2,
+  double lon2);
+
+/**
+ * Calls visit with each location between the timestamps (inclusive), in
+ * timestamp order, from both the locations table and the compact tracks,
+ * without keeping them in memory. Locations collapsed from a stationary run
+ * come twice, at its start and at its end time.
+ */
+void track_each(sqlite3 *db, time_t from, time_t to,
+  void (*visit)(TrackPoint point, void *data), void *data);
+
+/**
+ * Loads the locations between the timestamps (inclusive) into memory, see
+ * track_each. The points array is allocated and should be freed by the
+ * caller. Returns the number of points.
+ */
+unsigned int load_track(sqlite3 *db, time_t from, time_t to,
+  TrackPoint **points);
+
+/**
+ * Time to continue looking for locations before the given one: there are none
+ * after it and before the given time. It is the latest location itself, except
+ * within compact tracks, which are only known by their time range. Returns -1
+ * when there are no locations before.
+ */
+time_t track_time_before(sqlite3 *db, time_t time);
+
+/**
+ * Same as track_time_before, looking after the given time.
+ */
+time_t track_time_after(sqlite3 *db, time_t time);
+
+/**
+ * Collapses each run of points no further than radius (in meters) from the
+ * first point of the run into that point, in place. Sets until to the timestamp
+ * of the last point of each run, the point’s own timestamp when it’s alone.
+ * Returns the number of points left.
+ */
+unsigned int collapse_stationary(unsigned int count, TrackPoint points[count],
+  double radius, time_t until[count]);
+
+/**
+ * Douglas–Peucker simplification: marks in keep the points needed so that no
+ * point is further than tolerance (in meters) from the simplified line. The
+ * first and last points are always kept. Returns the number of points kept.
+ */
+unsigned int simplify_track(unsigned int count, const TrackPoint points[count],
+  double tolerance, bool keep[count]);
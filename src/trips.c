@@ -0,0 +1,134 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#include <err.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <sqlite3.h>
+#include <spatialite/gaiageo.h>
+#include "track.h"
+#include "trips.h"
+
+/* Keeps the trips table: locations split by time gaps, each one stored as
+ * linestrings simplified to different tolerances, so maps can draw an overview
+ * without going through every location. Any database errors trigger errx().
+ */
+
+/* Tolerances in meters of the simplified tracks, in the order of the track_*
+ * geometry columns. */
+static const double tolerances[] = { 10, 100, 1000 };
+
+/**
+ * Binds the kept points as a linestring blob.
+ */
+static void bind_linestring(sqlite3_stmt *stmt, int index, unsigned int count,
+  const TrackPoint points[count], unsigned int kept, const bool keep[count]) {
+  unsigned char *wkb;
+  int wkb_size;
+  gaiaGeomCollPtr geo = gaiaAllocGeomColl();
+  if (geo == NULL)
+    errx(1, "Could not allocate geometry collection");
+  geo->Srid = 4326;
+  gaiaLinestringPtr line = gaiaAddLinestringToGeomColl(geo, kept);
+  unsigned int vertex = 0;
+  for (unsigned int i = 0; i < count; ++i) {
+    if (keep[i]) {
+      gaiaSetPoint(line->Coords, vertex, points[i].lon, points[i].lat);
+      vertex++;
+    }
+  }
+  gaiaToSpatiaLiteBlobWkb(geo, &wkb, &wkb_size);
+  gaiaFreeGeomColl(geo);
+  // Also frees the blob allocated for the wkb
+  if (SQLITE_OK != sqlite3_bind_blob(stmt, index, wkb, wkb_size, free))
+    errx(1, "Could not bind trip track");
+}
+
+/**
+ * Inserts a single trip with all its simplified tracks.
+ */
+static void insert_trip(sqlite3_stmt *stmt, unsigned int count,
+  const TrackPoint points[count]) {
+  bool *keep = reallocarray(NULL, count, sizeof(bool));
+  if (keep == NULL)
+    errx(1, "Could not allocate %u trip points", count);
+  if (SQLITE_OK != sqlite3_reset(stmt))
+    errx(1, "Could not reset trip statement");
+  sqlite3_clear_bindings(stmt);
+  if (SQLITE_OK != sqlite3_bind_int64(stmt, 1, points[0].timestamp)
+    || SQLITE_OK != sqlite3_bind_int64(stmt, 2, points[count - 1].timestamp)
+    || SQLITE_OK != sqlite3_bind_int(stmt, 3, count))
+    errx(1, "Could not bind trip times");
+  for (unsigned int i = 0; i < sizeof(tolerances)/sizeof(double); ++i) {
+    unsigned int kept = simplify_track(count, points, tolerances[i], keep);
+    bind_linestring(stmt, 4 + i, count, points, kept, keep);
+  }
+  if (SQLITE_DONE != sqlite3_step(stmt))
+    errx(1, "Could not insert trip");
+  free(keep);
+}
+
+void update_trips(sqlite3 *db, time_t from, time_t to) {
+  sqlite3_stmt *stmt;
+  time_t window_from = from - TRIP_MAX_GAP;
+  time_t window_to = to + TRIP_MAX_GAP;
+
+  /* Trips close to the new locations may need merging, so they are rebuilt as
+   * well. Trips are further than the gap from each other, so the ones touching
+   * the window are all that can change. */
+  const char touching[] =
+    "SELECT min(start_time), max(end_time) FROM trips"
+    "  WHERE end_time >= ? AND start_time <= ?;";
+  if (SQLITE_OK != sqlite3_prepare_v2(db, touching, sizeof(touching), &stmt,
+      NULL))
+    errx(1, "Could not prepare trip range statement");
+  if (SQLITE_OK != sqlite3_bind_int64(stmt, 1, window_from)
+    || SQLITE_OK != sqlite3_bind_int64(stmt, 2, window_to))
+    errx(1, "Could not bind trip range");
+  if (SQLITE_ROW != sqlite3_step(stmt))
+    errx(1, "Could not step trip range statement");
+  time_t rebuild_from = window_from;
+  time_t rebuild_to = window_to;
+  if (sqlite3_column_type(stmt, 0) != SQLITE_NULL) {
+    time_t start = sqlite3_column_int64(stmt, 0);
+    time_t end = sqlite3_column_int64(stmt, 1);
+    rebuild_from = start < rebuild_from ? start : rebuild_from;
+    rebuild_to = end > rebuild_to ? end : rebuild_to;
+  }
+  if (SQLITE_OK != sqlite3_finalize(stmt))
+    errx(1, "Could not finalize trip range statement");
+
+  const char delete[] =
+    "DELETE FROM trips WHERE end_time >= ? AND start_time <= ?;";
+  if (SQLITE_OK != sqlite3_prepare_v2(db, delete, sizeof(delete), &stmt,
+      NULL))
+    errx(1, "Could not prepare trip deletion");
+  if (SQLITE_OK != sqlite3_bind_int64(stmt, 1, window_from)
+    || SQLITE_OK != sqlite3_bind_int64(stmt, 2, window_to))
+    errx(1, "Could not bind trip deletion range");
+  if (SQLITE_DONE != sqlite3_step(stmt))
+    errx(1, "Could not delete trips");
+  if (SQLITE_OK != sqlite3_finalize(stmt))
+    errx(1, "Could not finalize trip deletion");
+
+  /* Split the locations again where the gap is too long. */
+  TrackPoint *points;
+  unsigned int count = load_track(db, rebuild_from, rebuild_to, &points);
+  const char insert[] =
+    "INSERT INTO trips(start_time, end_time, points,"
+    "  track_10m, track_100m, track_1000m) VALUES (?, ?, ?, ?, ?, ?);";
+  if (SQLITE_OK != sqlite3_prepare_v2(db, insert, sizeof(insert), &stmt, NULL))
+    errx(1, "Could not prepare trip insertion");
+  unsigned int first = 0;
+  for (unsigned int i = 1; i <= count; ++i) {
+    if (i < count
+      && difftime(points[i].timestamp, points[i - 1].timestamp)
+        <= TRIP_MAX_GAP)
+      continue;
+    /* A single location doesn’t make a line. */
+    if (i - first > 1)
+      insert_trip(stmt, i - first, &points[first]);
+    first = i;
+  }
+  if (SQLITE_OK != sqlite3_finalize(stmt))
+    errx(1, "Could not finalize trip insertion");
+  free(points);
+}
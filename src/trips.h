@@ -0,0 +1,15 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#pragma once
+
+#include <time.h>
+#include <sqlite3.h>
+
+/* Gap in seconds between locations that splits them into different trips. */
+#define TRIP_MAX_GAP 300
+
+/**
+ * Rebuilds the trips around locations written between the timestamps. Trips
+ * touching that range are merged or split again and their simplified tracks
+ * regenerated. Should be called within the transaction writing the locations.
+ */
+void update_trips(sqlite3 *db, time_t from, time_t to);
@@ -1,32 +1,33 @@
 /* SPDX-License-Identifier: GPL-2.0-or-later */
 #include <err.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include <strings.h>
 #include <libavformat/avformat.h>
 #include <libavcodec/avcodec.h>
+#include "stats.h"
 #include "video_data.h"
 
-/* First frame row that contains string data. */
-#define TOP_DATA_ROW 1393
-
 /* Heuristic for when to choose glyph or space. */
 #define GLYPH_THRESHOLD 16
 
 /**
- * Takes a single frame and fills the strings found in this frame.
+ * Fills the string of a half of the data rows, starting at column first: each
+ * character cell gets the best matching glyph, or ' '. Returns how many cells
+ * matched a glyph.
  */
-static void fill_line(unsigned int glyph_count, const Glyph glyphs[glyph_count],
-  const AVFrame* frame, CharLine *line)
+static unsigned long fill_half(unsigned int glyph_count,
+  const Glyph glyphs[glyph_count], const uint8_t *rows, int linesize,
+  unsigned int first, char string[FRAME_STRING_LENGTH])
 {
   /* Temporary sum storage for final statistics. */
-  int16_t left_sum[FRAME_STRING_LENGTH][glyph_count];
-  int16_t right_sum[FRAME_STRING_LENGTH][glyph_count];
-  bzero(left_sum, FRAME_STRING_LENGTH * glyph_count * sizeof(uint16_t));
-  bzero(right_sum, FRAME_STRING_LENGTH * glyph_count * sizeof(uint16_t));
+  int16_t sum[FRAME_STRING_LENGTH][glyph_count];
+  bzero(sum, FRAME_STRING_LENGTH * glyph_count * sizeof(uint16_t));
 
   /* Only care about the data rows. */
-  for (unsigned int i = TOP_DATA_ROW; i < TOP_DATA_ROW + GLYPH_HEIGHT; ++i) {
-    /* Left. */
+  for (unsigned int i = 0; i < GLYPH_HEIGHT; ++i) {
     for (unsigned int j = 0; j < FRAME_STRING_LENGTH * GLYPH_WIDTH; ++j) {
       for (unsigned int k = 0; k < glyph_count; ++k) {
         /* k for each glyph
@@ -36,108 +37,318 @@ static void fill_line(unsigned int glyph_count, const Glyph glyphs[glyph_count],
          * │↓    │     │     │     │
          * └─────┴─────┴─────┴─────┘
          */
-        left_sum[j / GLYPH_WIDTH][k] +=
-          (frame->data[0][j + i * frame->linesize[0]] - 128)
-          * glyphs[k].multiplier[i - TOP_DATA_ROW][j % GLYPH_WIDTH];
-      }
-    }
-    /* Skip the middle. */
-    /* Right. */
-    for (unsigned int j = 0; j < FRAME_STRING_LENGTH * GLYPH_WIDTH; ++j) {
-      for (unsigned int k = 0; k < glyph_count; ++k) {
-        /* Same as above but j starts from middle. */
-        right_sum[j / GLYPH_WIDTH][k] +=
-          (frame->data[0][
-              j + EXPECTED_VIDEO_WIDTH - FRAME_STRING_LENGTH * GLYPH_WIDTH
-              + i * frame->linesize[0]
-            ] - 128)
-          * glyphs[k].multiplier[i - TOP_DATA_ROW][j % GLYPH_WIDTH];
+        sum[j / GLYPH_WIDTH][k] +=
+          (rows[first + j + i * linesize] - 128)
+          * glyphs[k].multiplier[i][j % GLYPH_WIDTH];
       }
     }
   }
 
   /* Divide all and get the maximum or ' ' (space). */
+  unsigned long matched = 0;
   for (unsigned int i = 0; i < FRAME_STRING_LENGTH; ++i) {
-    /* Left. */
-    unsigned int left_max_index = 0;
-    double left_max = 0;
+    unsigned int max_index = 0;
+    double max = 0;
     for (unsigned int j = 0; j < glyph_count; ++j) {
-      double left = (double)left_sum[i][j] / (double)glyphs[j].divider;
-      if (left > left_max) {
-        left_max = left;
-        left_max_index = j;
+      double value = (double)sum[i][j] / (double)glyphs[j].divider;
+      if (value > max) {
+        max = value;
+        max_index = j;
       }
     }
+    string[i] = max >= GLYPH_THRESHOLD ? glyphs[max_index].key : ' ';
+    matched += string[i] != ' ';
+  }
+  return matched;
+}
 
-    line->left[i] = left_max >= GLYPH_THRESHOLD
-      ? glyphs[left_max_index].key
-      : ' ';
+void fill_line_rows(unsigned int glyph_count, const Glyph glyphs[glyph_count],
+  const uint8_t *rows, int linesize, CharLine *line)
+{
+  double start = stats_start();
+  /* The right string ends at the right edge, skipping the middle. */
+  unsigned long matched =
+    fill_half(glyph_count, glyphs, rows, linesize, 0, line->left)
+    + fill_half(glyph_count, glyphs, rows, linesize,
+      EXPECTED_VIDEO_WIDTH - FRAME_STRING_LENGTH * GLYPH_WIDTH, line->right);
+  stats_count(COUNTER_CELLS_MATCHED, matched);
+  stats_stop(STAGE_FILL, start);
+}
 
-    /* Right. */
-    unsigned int right_max_index = 0;
-    double right_max = 0;
-    for (unsigned int j = 0; j < glyph_count; ++j) {
-      double right = (double)right_sum[i][j] / (double)glyphs[j].divider;
-      if (right > right_max) {
-        right_max = right;
-        right_max_index = j;
-      }
-    }
+/**
+ * Same as fill_line for the left string alone, leaving the right one as is.
+ */
+static void fill_line_left(unsigned int glyph_count,
+  const Glyph glyphs[glyph_count], const AVFrame* frame, CharLine *line)
+{
+  double start = stats_start();
+  stats_count(COUNTER_CELLS_MATCHED, fill_half(glyph_count, glyphs,
+    frame->data[0] + TOP_DATA_ROW * frame->linesize[0], frame->linesize[0], 0,
+    line->left));
+  stats_stop(STAGE_FILL, start);
+}
+
+void fill_line(unsigned int glyph_count, const Glyph glyphs[glyph_count],
+  const AVFrame* frame, CharLine *line)
+{
+  fill_line_rows(glyph_count, glyphs,
+    frame->data[0] + TOP_DATA_ROW * frame->linesize[0], frame->linesize[0],
+    line);
+}
+
+bool video_gray_supported(void) {
+  return strstr(avcodec_configuration(), "--enable-gray") != NULL;
+}
+
+/**
+ * av_read_frame, timed and counted, then passed to the read hook.
+ */
+static int read_packet(AVFormatContext *fmt_context, AVPacket *pkt,
+  const VideoOptions *options) {
+  double start = stats_start();
+  int ret = av_read_frame(fmt_context, pkt);
+  stats_stop(STAGE_READ, start);
+  if (ret == 0) {
+    stats_count(COUNTER_PACKETS_READ, 1);
+    if (options->read != NULL)
+      options->read(pkt->size, options->read_data);
+  }
+  return ret;
+}
+
+/**
+ * Decodes the packet into the frame, timed and counted. Returns whether it
+ * worked.
+ */
+static bool decode_packet(AVCodecContext *dec_context, const AVPacket *pkt,
+  AVFrame *frame) {
+  double start = stats_start();
+  bool decoded = 0 == avcodec_send_packet(dec_context, pkt)
+    && 0 == avcodec_receive_frame(dec_context, frame);
+  stats_stop(STAGE_DECODE, start);
+  if (decoded)
+    stats_count(COUNTER_FRAMES_DECODED, 1);
+  return decoded;
+}
+
+/* Width of the clock in the data rows, at their right edge. */
+#define CLOCK_WIDTH (FRAME_STRING_LENGTH * GLYPH_WIDTH)
+
+/**
+ * Clock rows (GLYPH_HEIGHT rows of CLOCK_WIDTH luma pixels) of the lines whose
+ * clock was counted from the PTS since the last one read matched, to read
+ * them again when the next one doesn’t: their frames are gone by then.
+ */
+typedef struct {
+  uint8_t *rows;
+  /* Index of the line of each. */
+  unsigned int *lines;
+  unsigned int count;
+  unsigned int allocated;
+} PendingClocks;
+
+/**
+ * Keeps the clock rows of the frame, for the line at index.
+ */
+static void pending_add(PendingClocks *pending, const AVFrame *frame,
+  unsigned int index) {
+  if (pending->count == pending->allocated) {
+    pending->allocated = pending->allocated ? 2 * pending->allocated : 32;
+    pending->rows = reallocarray(pending->rows, pending->allocated,
+      GLYPH_HEIGHT * CLOCK_WIDTH);
+    pending->lines = reallocarray(pending->lines, pending->allocated,
+      sizeof(unsigned int));
+    if (pending->rows == NULL || pending->lines == NULL)
+      errx(1, "Could not allocate %u clock rows", pending->allocated);
+  }
+  uint8_t *rows = pending->rows
+    + (size_t)pending->count * GLYPH_HEIGHT * CLOCK_WIDTH;
+  for (unsigned int i = 0; i < GLYPH_HEIGHT; ++i)
+    memcpy(rows + i * CLOCK_WIDTH, frame->data[0]
+      + (TOP_DATA_ROW + i) * frame->linesize[0]
+      + EXPECTED_VIDEO_WIDTH - CLOCK_WIDTH, CLOCK_WIDTH);
+  pending->lines[pending->count++] = index;
+}
+
+/**
+ * Reads the clock of the kept rows at position into the line.
+ */
+static void pending_read(unsigned int glyph_count,
+  const Glyph glyphs[glyph_count], const PendingClocks *pending,
+  unsigned int position, CharLine *line) {
+  double start = stats_start();
+  stats_count(COUNTER_CELLS_MATCHED, fill_half(glyph_count, glyphs,
+    pending->rows + (size_t)position * GLYPH_HEIGHT * CLOCK_WIDTH,
+    CLOCK_WIDTH, 0, line->right));
+  stats_stop(STAGE_FILL, start);
+}
+
+/**
+ * Reads again the clocks of the kept rows into their lines, and forgets them.
+ */
+static void pending_reread(unsigned int glyph_count,
+  const Glyph glyphs[glyph_count], PendingClocks *pending,
+  CharLine lines[]) {
+  for (unsigned int i = 0; i < pending->count; ++i)
+    pending_read(glyph_count, glyphs, pending, i, &lines[pending->lines[i]]);
+  pending->count = 0;
+}
+
+/**
+ * Whether a clock read differs from the one counted, saying nothing when it
+ * doesn’t read. A second off is a drift too: the lines counted since the last
+ * check would all be off by that second.
+ */
+static bool clock_drifted(time_t read, time_t derived) {
+  return read != 0 && read != derived;
+}
 
-    line->right[i] = right_max >= GLYPH_THRESHOLD
-      ? glyphs[right_max_index].key
-      : ' ';
+/**
+ * Fills the line at index of the main routine: the left string always, and
+ * the clock from the frame’s seconds since clock_start, except on every
+ * clock_check-th line (see VideoOptions), which is read whole. When the clock
+ * read differs from the one derived, the clocks derived since the last one
+ * read are read again from the pending rows, and clock_start is set to 0.
+ */
+static void fill_clocked_line(unsigned int glyph_count,
+  const Glyph glyphs[glyph_count], const AVFrame *frame, unsigned int index,
+  const VideoOptions *options, time_t *clock_start, int64_t seconds,
+  const char url[], PendingClocks *pending, CharLine lines[index + 1]) {
+  const time_t derived = *clock_start != 0 ? *clock_start + seconds : 0;
+  if (derived != 0 && index % options->clock_check != 0) {
+    fill_line_left(glyph_count, glyphs, frame, &lines[index]);
+    line_set_clock(&lines[index], derived);
+    pending_add(pending, frame, index);
+    return;
+  }
+  fill_line(glyph_count, glyphs, frame, &lines[index]);
+  const time_t read = line_clock(&lines[index]);
+  if (derived == 0 || read == 0)
+    return;
+  if (clock_drifted(read, derived)) {
+    warnx("Clock %+jd s off the PTS in %s, reading the %u clocks counted since"
+      " the last check and every one from now", (intmax_t)(read - derived),
+      url, pending->count);
+    *clock_start = 0;
+    pending_reread(glyph_count, glyphs, pending, lines);
+  }
+  pending->count = 0;
+}
+
+bool video_probe(const char url[], int64_t *first_pts, unsigned int *seconds) {
+  AVFormatContext *fmt_context = NULL;
+  if (0 != avformat_open_input(&fmt_context, url, NULL, NULL)) {
+    warnx("Failed to open input url %s", url);
+    return false;
+  }
+  *first_pts = AV_NOPTS_VALUE;
+  *seconds = 0;
+  int video_stream = avformat_find_stream_info(fmt_context, NULL) < 0
+    ? -1
+    : av_find_best_stream(fmt_context, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+  if (video_stream < 0) {
+    warnx("Failed to find best video stream in %s", url);
+    avformat_close_input(&fmt_context);
+    return false;
   }
+  const AVStream *stream = fmt_context->streams[video_stream];
+  *first_pts = stream->start_time;
+  if (stream->duration != AV_NOPTS_VALUE && stream->duration > 0)
+    *seconds = (stream->duration * stream->time_base.num
+      + stream->time_base.den - 1) / stream->time_base.den;
+  else if (fmt_context->duration != AV_NOPTS_VALUE && fmt_context->duration > 0)
+    *seconds = (fmt_context->duration + AV_TIME_BASE - 1) / AV_TIME_BASE;
+  avformat_close_input(&fmt_context);
+  return true;
+}
+
+/**
+ * Moves end to that of the packet when later, for the length of the video.
+ */
+static void packet_end(const AVPacket *pkt, int64_t *end) {
+  if (pkt->pts != AV_NOPTS_VALUE && pkt->pts + pkt->duration > *end)
+    *end = pkt->pts + pkt->duration;
 }
 
 int get_video_strings(const char url[],
   unsigned int glyph_count,
   const Glyph glyphs[glyph_count],
   unsigned int string_count,
-  CharLine lines[string_count])
+  CharLine lines[string_count],
+  const VideoOptions *options)
 {
   if (string_count == 0) {
     return -1;
   }
-  unsigned int filled_lines = 0;
+  const VideoOptions defaults = { .step = NULL };
+  if (options == NULL)
+    options = &defaults;
+  int filled_lines = 0;
 
   /* Prepare the container format and get best video decoder. */
   AVFormatContext *fmt_context = NULL;
   AVPacket pkt;
   AVFrame *frame = av_frame_alloc();
   const struct AVCodec *dec;
-  AVCodecContext *dec_context;
-  if (0 != avformat_open_input(&fmt_context, url, NULL, NULL))
-    errx(1, "Failed to open input url %s", url);
+  AVCodecContext *dec_context = NULL;
+  PendingClocks pending = { .count = 0 };
+  if (0 != avformat_open_input(&fmt_context, url, NULL, NULL)) {
+    warnx("Failed to open input url %s", url);
+    filled_lines = -1;
+    goto cleanup;
+  }
   int video_stream = av_find_best_stream(
     fmt_context, AVMEDIA_TYPE_VIDEO, -1, -1, &dec, 0);
-  if (video_stream < 0)
-    errx(1, "Failed to find best video stream");
+  if (video_stream < 0) {
+    warnx("Failed to find best video stream in %s", url);
+    filled_lines = -1;
+    goto cleanup;
+  }
   dec_context = avcodec_alloc_context3(dec);
   avcodec_parameters_to_context(
     dec_context, fmt_context->streams[video_stream]->codecpar);
-  if (0 != avcodec_open2(dec_context, dec, NULL))
-    errx(1, "Could not open decoder");
+  if (options->threads > 0)
+    dec_context->thread_count = options->threads;
+  if (options->gray && video_gray_supported())
+    dec_context->flags |= AV_CODEC_FLAG_GRAY;
+  if (0 != avcodec_open2(dec_context, dec, NULL)) {
+    warnx("Could not open decoder for %s", url);
+    filled_lines = -1;
+    goto cleanup;
+  }
 
   /* Time is used for frames per second. */
   const AVRational time_base = fmt_context->streams[video_stream]->time_base;
   int64_t second = time_base.den / time_base.num;
   int64_t second_change = second;
+  /* The video packets span the video, for its length. */
+  int64_t first_pts = AV_NOPTS_VALUE;
+  int64_t end_pts = AV_NOPTS_VALUE;
 
   /* First, we read all video frames until detecting when the second’s unit
    * glyph changed. */
-  while (0 == av_read_frame(fmt_context, &pkt)) {
+  while (0 == read_packet(fmt_context, &pkt, options)) {
     if (pkt.stream_index != video_stream) {
+      stats_count(COUNTER_PACKETS_SKIPPED, 1);
       av_packet_unref(&pkt);
       continue;
     }
-    if (0 != avcodec_send_packet(dec_context, &pkt))
-      errx(1, "Could not send frame to decoder");
-    if (0 != avcodec_receive_frame(dec_context, frame))
-      errx(1, "Could not receive frame from decoder");
+    packet_end(&pkt, &end_pts);
+    if (!decode_packet(dec_context, &pkt, frame)) {
+      warnx("Could not decode frame from %s", url);
+      av_packet_unref(&pkt);
+      filled_lines = -1;
+      goto cleanup;
+    }
+    av_packet_unref(&pkt);
 
     if (filled_lines == 0) {
+      first_pts = frame->pts;
       fill_line(glyph_count, glyphs, frame, &lines[filled_lines]);
+      if (options->pts != NULL)
+        options->pts[filled_lines] = frame->pts;
+      if (options->frame != NULL)
+        options->frame(frame, options->frame_data);
       filled_lines++;
     }
     else {
@@ -153,37 +364,95 @@ int get_video_strings(const char url[],
     }
   }
 
-  /* Main routine. */
-  while (0 == av_read_frame(fmt_context, &pkt)) {
-    if (pkt.stream_index != video_stream) {
+  /* Main routine. Reads the frame when the next second to sample starts. The
+   * first line is from the second before second_change. */
+  int64_t next_time = second_change;
+  /* The clock moves with the PTS, one second past the first line’s at
+   * second_change. 0 once it can’t be trusted to. */
+  time_t clock_start = options->clock_check > 1 && filled_lines > 0
+    ? line_clock(&lines[0])
+    : 0;
+  if (clock_start != 0)
+    clock_start++;
+  int64_t last_pts = second_change;
+  unsigned int step = 1;
+  if (options->step != NULL && filled_lines > 0) {
+    step = options->step(filled_lines, lines, options->step_data);
+    next_time += (step > 1 ? step - 1 : 0) * second;
+  }
+  while (0 == read_packet(fmt_context, &pkt, options)) {
+    if (pkt.stream_index == video_stream)
+      packet_end(&pkt, &end_pts);
+    /* Other streams, or waiting until the second changes, or can only decode
+     * a key frame out of context. */
+    if (pkt.stream_index != video_stream || pkt.dts < next_time
+      || (pkt.flags & AV_PKT_FLAG_KEY) == 0) {
+      stats_count(COUNTER_PACKETS_SKIPPED, 1);
       av_packet_unref(&pkt);
       continue;
     }
-    /* Wait until the second changes. */
-    if (pkt.dts < (filled_lines - 1) * second + second_change) {
+    /* Too few lines allocated or video too long. */
+    if ((unsigned int)filled_lines >= string_count) {
       av_packet_unref(&pkt);
-      continue;
+      filled_lines = -1;
+      goto cleanup;
     }
-    /* Can only decode a key frame out of context. */
-    if ((pkt.flags & AV_PKT_FLAG_KEY) == 0) {
+
+    if (!decode_packet(dec_context, &pkt, frame)) {
+      warnx("Could not decode frame from %s", url);
       av_packet_unref(&pkt);
-      continue;
+      filled_lines = -1;
+      goto cleanup;
     }
-    /* Too few lines allocated or video too long. */
-    if (filled_lines >= string_count)
-      return -1;
 
-    if (0 != avcodec_send_packet(dec_context, &pkt))
-      errx(1, "Could not send frame to decoder");
-    if (0 != avcodec_receive_frame(dec_context, frame))
-      errx(1, "Could not receive frame from decoder");
-
-    fill_line(glyph_count, glyphs, frame, &lines[filled_lines]);
+    /* Timestamps going back, missing, or jumping further ahead than a second
+     * past the step asked break the lockstep, maybe already before. */
+    if (clock_start != 0 && (frame->pts == AV_NOPTS_VALUE
+        || frame->pts < last_pts
+        || frame->pts - last_pts > ((step > 1 ? step : 1) + 1) * second)) {
+      warnx("PTS jump in %s, reading the %u clocks counted since the last"
+        " check and every one from now", url, pending.count);
+      clock_start = 0;
+      pending_reread(glyph_count, glyphs, &pending, lines);
+    }
+    last_pts = frame->pts;
+    fill_clocked_line(glyph_count, glyphs, frame, filled_lines, options,
+      &clock_start, (frame->pts - second_change) / second, url, &pending,
+      lines);
+    if (options->pts != NULL)
+      options->pts[filled_lines] = frame->pts;
+    if (options->frame != NULL)
+      options->frame(frame, options->frame_data);
     filled_lines++;
+    step = options->step == NULL
+      ? 1
+      : options->step(filled_lines, lines, options->step_data);
+    next_time += (step > 1 ? step : 1) * second;
 
     av_frame_unref(frame);
     av_packet_unref(&pkt);
   }
+  /* The clocks counted after the last one read are checked on the last of
+   * them. */
+  if (pending.count > 0) {
+    CharLine last = lines[pending.lines[pending.count - 1]];
+    pending_read(glyph_count, glyphs, &pending, pending.count - 1, &last);
+    const time_t read = line_clock(&last);
+    const time_t derived = line_clock(&lines[pending.lines[pending.count - 1]]);
+    if (clock_drifted(read, derived)) {
+      warnx("Clock %+jd s off the PTS at the end of %s, reading the last %u"
+        " clocks", (intmax_t)(read - derived), url, pending.count);
+      pending_reread(glyph_count, glyphs, &pending, lines);
+    }
+  }
+  if (options->seconds != NULL)
+    *options->seconds = first_pts != AV_NOPTS_VALUE && end_pts > first_pts
+      ? (end_pts - first_pts + second - 1) / second
+      : 0;
+
+cleanup:
+  free(pending.rows);
+  free(pending.lines);
   av_frame_free(&frame);
   avcodec_free_context(&dec_context);
   avformat_close_input(&fmt_context);
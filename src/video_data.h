@@ -1,17 +1,91 @@
 /* SPDX-License-Identifier: GPL-2.0-or-later */
 #pragma once
 
+#include <stdbool.h>
 #include <libavutil/frame.h>
 #include "glyph.h"
 #include "char_line.h"
 
+/**
+ * How get_video_strings reads a video.
+ */
+typedef struct {
+  /* Adaptive sampling hook: called after each line read with the lines so far,
+   * returns how many seconds later to read the next one (0 or 1 for the next
+   * second). NULL reads every second. */
+  unsigned int (*step)(unsigned int count, const CharLine lines[count],
+    void *data);
+  /* Passed to step. */
+  void *step_data;
+  /* Called with each frame a line is read from, NULL for none. */
+  void (*frame)(const AVFrame *frame, void *data);
+  /* Passed to frame. */
+  void *frame_data;
+  /* Called with the size of each packet read, NULL for none. */
+  void (*read)(int size, void *data);
+  /* Passed to read. */
+  void *read_data;
+  /* Decoder threads, 0 for FFmpeg’s default. */
+  unsigned int threads;
+  /* Ask the decoder for the luma plane alone, which is all fill_line reads.
+   * The chroma planes of the frames are then undefined. Ignored when FFmpeg
+   * can’t, see video_gray_supported. */
+  bool gray;
+  /* Filled with the presentation timestamp of the frame each line is read
+   * from, in the stream’s time base, when not NULL. As long as the lines. */
+  int64_t *pts;
+  /* Filled with the length of the video in seconds (rounded up), from its
+   * first frame to the end of its last video packet, when not NULL. */
+  unsigned int *seconds;
+  /* Read the clock (the right string) whole on every clock_check-th line
+   * only, and on the others count it from the PTS, which moves in lockstep
+   * with it. Once a clock read differs from the one counted, or the PTS jump
+   * back or more than a second past the step, every clock is read, the ones
+   * counted since the last check again too (their clock rows are kept until
+   * then). The last ones are checked at the end of the video.
+   * 0 or 1 reads every clock. */
+  unsigned int clock_check;
+} VideoOptions;
+
+/**
+ * Whether decoders can skip the chroma planes: FFmpeg only honors
+ * AV_CODEC_FLAG_GRAY when configured with --enable-gray, and then only in the
+ * decoders that implement it (H.264 among them), others decode as usual.
+ */
+bool video_gray_supported(void);
+
+/**
+ * Same as fill_line, from the data rows alone: GLYPH_HEIGHT rows of
+ * EXPECTED_VIDEO_WIDTH luma pixels, linesize bytes apart, starting at the one
+ * at TOP_DATA_ROW in the frame.
+ */
+void fill_line_rows(unsigned int glyph_count, const Glyph glyphs[glyph_count],
+  const uint8_t *rows, int linesize, CharLine *line);
+
+/**
+ * Takes a single decoded frame and fills the strings found in it: each
+ * character cell gets the best matching glyph, or ' ' when none is close
+ * enough.
+ */
+void fill_line(unsigned int glyph_count, const Glyph glyphs[glyph_count],
+  const AVFrame* frame, CharLine *line);
+
+/**
+ * Reads the presentation timestamp of the first frame of the video (its
+ * stream’s start, AV_NOPTS_VALUE when unknown) and its length in seconds
+ * (rounded up, 0 when unknown) from its headers, without decoding it. Returns
+ * false, with a warning, when it can’t open it.
+ */
+bool video_probe(const char url[], int64_t *first_pts, unsigned int *seconds);
+
 /**
  * Takes a video and the glyph definitions and finds the strings in the video.
- * Non-matching slots are set to character ' '. Returns the number of lines read
- * or negative in case of error.
+ * Non-matching slots are set to character ' '. Options may be NULL for the
+ * defaults. Returns the number of lines read or negative in case of error.
  */
 int get_video_strings(const char url[],
   unsigned int glyph_count,
   const Glyph glyphs[glyph_count],
   unsigned int string_count,
-  CharLine lines[string_count]);
+  CharLine lines[string_count],
+  const VideoOptions *options);
@@ -0,0 +1,84 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include "budget.h"
+#include "my_assert.h"
+
+/* Tests the resource limits of the ingest, with made up pressure files. */
+
+char cpu_name[] = "/tmp/budget_test_cpu_XXXXXX";
+char io_name[] = "/tmp/budget_test_io_XXXXXX";
+
+static bool write_psi(char name[], double average) {
+  int fd = mkstemp(name);
+  if (fd < 0)
+    return false;
+  FILE *file = fdopen(fd, "w");
+  fprintf(file, "some avg10=%.2f avg60=0.00 avg300=0.00 total=0\n"
+    "full avg10=0.00 avg60=0.00 avg300=0.00 total=0\n", average);
+  return 0 == fclose(file);
+}
+
+static double now(void) {
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+/* The highest “some” average counts, missing files don’t. */
+static void test_pressure(void) {
+  const int test_case = 1;
+  // Arrange
+  my_assert(write_psi(cpu_name, 12.5) && write_psi(io_name, 40.25));
+  const char *const files[] = {cpu_name, "/nonexistent", io_name};
+  // Act
+  double pressure = budget_pressure(3, files);
+  // Assert
+  my_assert(pressure == 40.25);
+  unlink(cpu_name);
+  unlink(io_name);
+  ok();
+}
+
+/* Without PSI, the load average stands in. */
+static void test_load(void) {
+  const int test_case = 2;
+  // Arrange
+  const char *const files[] = {"/nonexistent"};
+  // Act
+  double pressure = budget_pressure(1, files);
+  // Assert
+  my_assert(pressure >= 0);
+  ok();
+}
+
+/* Reads over the rate wait for it, unlimited budgets don’t. */
+static void test_read_rate(void) {
+  const int test_case = 3;
+  // Arrange
+  Budget budget = { .read_rate = 10e6 };
+  my_assert(budget_file_begin(&budget) == 0);
+  // Act
+  double start = now();
+  for (unsigned int i = 0; i < 10; ++i)
+    budget_read(100000, &budget);
+  double elapsed = now() - start;
+  // Assert
+  my_assert(elapsed >= 0.09);
+  Budget unlimited = { .threads = 4 };
+  my_assert(budget_file_begin(&unlimited) == 4);
+  start = now();
+  budget_read(100000000, &unlimited);
+  my_assert(now() - start < 0.05);
+  ok();
+}
+
+int main(void) {
+  puts("1..3");
+  test_pressure();
+  test_load();
+  test_read_rate();
+  return 0;
+}
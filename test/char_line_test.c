@@ -0,0 +1,70 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "char_line.h"
+#include "my_assert.h"
+
+/* Tests reading and writing the clock of the lines. */
+
+/* 2024-08-31 09:02:20 UTC. */
+#define CLOCK 1725094940
+
+/* Written as the glyphs read it, and read back. */
+static void test_clock_round_trip(void) {
+  const int test_case = 1;
+  // Arrange
+  CharLine line;
+  memset(line.right, '_', FRAME_STRING_LENGTH);
+  const char expected[] = "31 08 2024 09 02 20 ";
+  // Act
+  line_set_clock(&line, CLOCK);
+  // Assert
+  my_assert(memcmp(line.right + FRAME_STRING_LENGTH - sizeof(expected) + 1,
+    expected, sizeof(expected) - 1) == 0);
+  my_assert(line.right[0] == ' ');
+  my_assert(line_clock(&line) == CLOCK);
+  my_assert(line_time(line) == CLOCK);
+  ok();
+}
+
+/* The clock counts whole days over, as the camera’s does. */
+static void test_clock_next_day(void) {
+  const int test_case = 2;
+  // Arrange
+  CharLine line;
+  line_set_clock(&line, CLOCK);
+  // Act
+  line_set_clock(&line, line_clock(&line) + 15 * 3600);
+  // Assert
+  my_assert(memcmp(line.right + FRAME_STRING_LENGTH - 20,
+    "01 09 2024 00 02 20", 19) == 0);
+  ok();
+}
+
+/* A clock not read is 0. */
+static void test_clock_unreadable(void) {
+  const int test_case = 3;
+  // Arrange
+  CharLine line;
+  line_set_clock(&line, CLOCK);
+  memset(line.right + FRAME_STRING_LENGTH - 9, ' ', 9);
+  // Act
+  time_t clock = line_clock(&line);
+  time_t local = line_time(line);
+  // Assert
+  my_assert(clock == 0);
+  my_assert(local == 0);
+  ok();
+}
+
+int main(void) {
+  puts("1..3");
+  setenv("TZ", "UTC", 1);
+  tzset();
+  test_clock_round_trip();
+  test_clock_next_day();
+  test_clock_unreadable();
+  return 0;
+}
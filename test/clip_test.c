@@ -0,0 +1,183 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <spatialite/gaiageo.h>
+#include <spatialite.h>
+#include "char_line_fill.h"
+#include "clip.h"
+#include "db.h"
+#include "my_assert.h"
+#include "output_data.h"
+
+/* Tests finding the seconds of the catalogued videos to copy into a clip, and
+ * their timestamps. The videos themselves aren’t read, so there are none.
+ */
+
+/* 2024-08-31 09:02:20 UTC. */
+#define START 1725094940
+#define LAT 26.4346
+
+/**
+ * Catalogues a video of a location per second for seconds, heading east about
+ * 10 m a second from lon. Returns whether every row was added.
+ */
+static bool add_video(sqlite3 *db, int id, const char path[], time_t start,
+  int seconds, double lon) {
+  sqlite3_stmt *video, *box, *location;
+  if (SQLITE_OK != sqlite3_prepare_v2(db,
+      "INSERT INTO videos(id, filename, path, start_time, end_time, points,"
+      "  first_pts) VALUES (?, ?, ?, ?, ?, ?, 126000);", -1, &video, NULL)
+    || SQLITE_OK != sqlite3_prepare_v2(db,
+      "INSERT INTO videos_bbox VALUES (?, ?, ?, ?, ?);", -1, &box, NULL)
+    || SQLITE_OK != sqlite3_prepare_v2(db,
+      "INSERT INTO locations(timestamp, place) VALUES (?, ?);", -1,
+      &location, NULL))
+    return false;
+  sqlite3_bind_int(video, 1, id);
+  sqlite3_bind_text(video, 2, strrchr(path, '/') + 1, -1, SQLITE_STATIC);
+  sqlite3_bind_text(video, 3, path, -1, SQLITE_STATIC);
+  sqlite3_bind_int64(video, 4, start);
+  sqlite3_bind_int64(video, 5, start + seconds - 1);
+  sqlite3_bind_int(video, 6, seconds);
+  sqlite3_bind_int(box, 1, id);
+  sqlite3_bind_double(box, 2, lon);
+  sqlite3_bind_double(box, 3, lon + (seconds - 1) * 0.0001);
+  sqlite3_bind_double(box, 4, LAT);
+  sqlite3_bind_double(box, 5, LAT);
+  bool added = SQLITE_DONE == sqlite3_step(video)
+    && SQLITE_DONE == sqlite3_step(box);
+  for (int i = 0; added && i < seconds; ++i) {
+    unsigned char *wkb;
+    int wkb_size;
+    gaiaGeomCollPtr geo = gaiaAllocGeomColl();
+    geo->Srid = 4326;
+    gaiaAddPointToGeomColl(geo, lon + i * 0.0001, LAT);
+    gaiaToSpatiaLiteBlobWkb(geo, &wkb, &wkb_size);
+    gaiaFreeGeomColl(geo);
+    sqlite3_bind_int64(location, 1, start + i);
+    sqlite3_bind_blob(location, 2, wkb, wkb_size, free);
+    added = SQLITE_DONE == sqlite3_step(location);
+    sqlite3_reset(location);
+  }
+  sqlite3_finalize(video);
+  sqlite3_finalize(box);
+  sqlite3_finalize(location);
+  return added;
+}
+
+/**
+ * A database with a minute of video near (-71.6, LAT) and another far away a
+ * bit later.
+ */
+static bool open_catalogue(char db_name[], SpatiaLite *sp) {
+  int fd = mkstemp(db_name);
+  if (fd < 0)
+    return false;
+  close(fd);
+  *sp = open_and_init_db(db_name);
+  return add_video(sp->db, 1, "/videos/RO/20240831090220_004709.TS", START,
+      60, -71.6)
+    && add_video(sp->db, 2, "/videos/20240831090400_004710.TS", START + 100,
+      60, -70.0);
+}
+
+/* Every video with locations in the range, clamped to it. */
+static void test_find_range(void) {
+  const int test_case = 1;
+  // Arrange
+  char db_name[] = "/tmp/clip_test_XXXXXX";
+  SpatiaLite sp;
+  my_assert(open_catalogue(db_name, &sp));
+  ClipSegment *segments;
+  // Act
+  int count = clip_find_range(sp.db, START + 50, START + 120, &segments);
+  // Assert
+  my_assert(count == 2);
+  my_assert(strcmp(segments[0].path,
+    "/videos/RO/20240831090220_004709.TS") == 0);
+  my_assert(segments[0].from == START + 50);
+  my_assert(segments[0].to == START + 59);
+  my_assert(segments[0].pts_time == START);
+  my_assert(segments[0].first_pts == 126000);
+  my_assert(segments[1].from == START + 100);
+  my_assert(segments[1].to == START + 120);
+  clip_free(count, segments);
+  close_db(sp);
+  unlink(db_name);
+  ok();
+}
+
+/* Only the video passing by, from a bit before to a bit after. */
+static void test_find_near(void) {
+  const int test_case = 2;
+  // Arrange
+  char db_name[] = "/tmp/clip_test_XXXXXX";
+  SpatiaLite sp;
+  my_assert(open_catalogue(db_name, &sp));
+  ClipSegment *segments, *far;
+  // Act
+  int count = clip_find_near(sp.db, -71.597, LAT, 25, &segments);
+  int far_count = clip_find_near(sp.db, -72, LAT, 25, &far);
+  // Assert
+  my_assert(count == 1);
+  my_assert(strcmp(segments[0].path,
+    "/videos/RO/20240831090220_004709.TS") == 0);
+  my_assert(segments[0].from == START + 28 - CLIP_PAD);
+  my_assert(segments[0].to == START + 32 + CLIP_PAD);
+  my_assert(far_count == 0);
+  clip_free(count, segments);
+  clip_free(far_count, far);
+  close_db(sp);
+  unlink(db_name);
+  ok();
+}
+
+/* Each second of a video written from its lines maps to the timestamp of the
+ * frame it was read from, even when the first line has no location. */
+static void test_pts_from_lines(void) {
+  const int test_case = 3;
+  // Arrange
+  const CharLine lines[] = {
+    {" 0 __ _ _00 000000 _00 000000  " FILL "31 08 2024 09 02 20 "},
+    {" 100 __ _ _26 435139 _71 607867" FILL "31 08 2024 09 02 21 "},
+    {" 100 __ _ _26 435398 _71 607116" FILL "31 08 2024 09 02 22 "},
+    {" 95 __ _ _26 435985 _71 612824 " FILL "31 08 2024 09 02 27 "},
+  };
+  const unsigned int count = sizeof(lines)/sizeof(CharLine);
+  int64_t pts[sizeof(lines)/sizeof(CharLine)];
+  for (unsigned int i = 0; i < count; ++i)
+    pts[i] = 126000 + 90000 * (line_time(lines[i]) - line_time(lines[0]));
+  const AppendOptions options = { .pts = pts };
+  char db_name[] = "/tmp/clip_test_XXXXXX";
+  int fd = mkstemp(db_name);
+  my_assert(fd >= 0);
+  close(fd);
+  append_lines("file:/videos/20240831090220_004711.TS", count, lines, db_name,
+    &options);
+  SpatiaLite sp = open_and_init_db(db_name);
+  ClipSegment *segments;
+  // Act
+  int found = clip_find_range(sp.db, line_time(lines[0]),
+    line_time(lines[count - 1]), &segments);
+  // Assert
+  my_assert(found == 1);
+  for (unsigned int i = 0; i < count; ++i)
+    my_assert(clip_pts(&segments[0], line_time(lines[i]), 90000, 0) == pts[i]);
+  clip_free(found, segments);
+  close_db(sp);
+  unlink(db_name);
+  ok();
+}
+
+int main(void) {
+  puts("TAP version 14");
+  puts("1..3");
+  test_find_range();
+  test_find_near();
+  test_pts_from_lines();
+  return 0;
+}
@@ -0,0 +1,108 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "compact.h"
+#include "db.h"
+#include "my_assert.h"
+#include "track.h"
+
+/* Tests the compact track encoding and reading it back through SQL. */
+
+/* Size arguments for arrays known at compile time. */
+#define tp(points) (sizeof(points)/sizeof(TrackPoint)), points
+
+/* A track with gaps, a second going back, and both hemispheres. */
+const TrackPoint track[] = {
+  {1725109340, -71.608715, 26.434600},
+  {1725109341, -71.607867, 26.435139},
+  {1725109342, -71.607116, 26.435398},
+  {1725109347, -71.612824, 26.435985},
+  {1725109346, -71.613457, 26.436418},
+  {1725109348, 0.000001, -0.000001},
+};
+
+/* Decoded points match to the microdegree. */
+static void test_round_trip(void) {
+  const int test_case = 1;
+  // Arrange
+  unsigned char *blob;
+  TrackPoint *points;
+  // Act
+  int size = compact_encode(tp(track), &blob);
+  int count = compact_decode(size, blob, &points);
+  // Assert
+  my_assert(count == sizeof(track)/sizeof(TrackPoint));
+  for (int i = 0; i < count; ++i) {
+    my_assert(points[i].timestamp == track[i].timestamp);
+    my_assert(fabs(points[i].lon - track[i].lon) < 1e-7);
+    my_assert(fabs(points[i].lat - track[i].lat) < 1e-7);
+  }
+  /* Seconds apart, a point takes about 5 bytes after the first one. */
+  my_assert(size < 16 + 6 * count);
+  free(blob);
+  free(points);
+  ok();
+}
+
+/* Truncated or corrupt blobs are rejected. */
+static void test_invalid(void) {
+  const int test_case = 2;
+  // Arrange
+  unsigned char *blob;
+  TrackPoint *points;
+  int size = compact_encode(tp(track), &blob);
+  const unsigned char huge_count[] = {0xff, 0xff, 0xff, 0x7f, 0, 0, 0};
+  // Act, Assert
+  my_assert(compact_decode(size - 1, blob, &points) < 0);
+  my_assert(points == NULL);
+  my_assert(compact_decode(0, blob, &points) < 0);
+  my_assert(compact_decode(sizeof(huge_count), huge_count, &points) < 0);
+  free(blob);
+  ok();
+}
+
+/* Compact tracks are read as locations. */
+static void test_load_track(void) {
+  const int test_case = 3;
+  // Arrange
+  SpatiaLite sp = open_and_init_db(":memory:");
+  unsigned char *blob;
+  int size = compact_encode(tp(track), &blob);
+  sqlite3_stmt *stmt;
+  sqlite3_prepare_v2(sp.db, "INSERT INTO compact_tracks"
+    "  (filename, start_time, end_time, points, track)"
+    "  VALUES ('20240831090220_004709.TS', ?, ?, 6, ?);", -1, &stmt, NULL);
+  sqlite3_bind_int64(stmt, 1, 1725109340);
+  sqlite3_bind_int64(stmt, 2, 1725109348);
+  sqlite3_bind_blob(stmt, 3, blob, size, free);
+  my_assert(SQLITE_DONE == sqlite3_step(stmt));
+  sqlite3_finalize(stmt);
+  TrackPoint *points;
+
+  // Act
+  unsigned int count = load_track(sp.db, 1725109342, 1725109347, &points);
+
+  // Assert
+  my_assert(count == 3);
+  my_assert(points[0].timestamp == 1725109342);
+  my_assert(points[1].timestamp == 1725109346);
+  my_assert(points[2].timestamp == 1725109347);
+  free(points);
+  /* Only the time range is known without decoding. */
+  my_assert(track_time_before(sp.db, 1725109345) == 1725109344);
+  my_assert(track_time_before(sp.db, 1725109360) == 1725109348);
+  my_assert(track_time_before(sp.db, 1725109340) == -1);
+  my_assert(track_time_after(sp.db, 1725109300) == 1725109340);
+  my_assert(track_time_after(sp.db, 1725109348) == -1);
+  close_db(sp);
+  ok();
+}
+
+int main(void) {
+  puts("1..3");
+  test_round_trip();
+  test_invalid();
+  test_load_track();
+  return 0;
+}
@@ -0,0 +1,94 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#include <stdio.h>
+#include "db.h"
+#include "density.h"
+#include "my_assert.h"
+#include "tile.h"
+
+/* Tests the web map tile arithmetic and the density counts kept with it. */
+
+/* Reference tiles computed independently. */
+static void test_tile_at(void) {
+  const int test_case = 1;
+  // Act
+  Tile zero = tile_at(0, 0, 1);
+  Tile low = tile_at(-71.608, 26.434, 10);
+  Tile high = tile_at(-71.608, 26.434, 18);
+  Tile clamped = tile_at(179.9999, -89, 3);
+  // Assert
+  my_assert(zero.zoom == 1 && zero.x == 1 && zero.y == 1);
+  my_assert(low.zoom == 10 && low.x == 308 && low.y == 433);
+  my_assert(high.x == 78928 && high.y == 111101);
+  my_assert(clamped.x == 7 && clamped.y == 7);
+  ok();
+}
+
+/* A coordinate is within the bounds of its tile. */
+static void test_tile_bounds(void) {
+  const int test_case = 2;
+  // Arrange
+  Tile tile = tile_at(-71.608, 26.434, 12);
+  double west, south, east, north;
+  // Act
+  tile_bounds(tile, &west, &south, &east, &north);
+  // Assert
+  my_assert(west <= -71.608 && -71.608 < east);
+  my_assert(south < 26.434 && 26.434 <= north);
+  ok();
+}
+
+/**
+ * Count on the zoom 18 cell of a coordinate, 0 if the cell doesn’t exist.
+ */
+static int cell_count(sqlite3 *db, double lon, double lat) {
+  Tile tile = tile_at(lon, lat, DENSITY_MAX_ZOOM);
+  sqlite3_stmt *stmt;
+  sqlite3_prepare_v2(db, "SELECT count FROM density"
+    "  WHERE zoom = ? AND tile_x = ? AND tile_y = ?;", -1, &stmt, NULL);
+  sqlite3_bind_int(stmt, 1, tile.zoom);
+  sqlite3_bind_int64(stmt, 2, tile.x);
+  sqlite3_bind_int64(stmt, 3, tile.y);
+  int ret = SQLITE_ROW == sqlite3_step(stmt) ? sqlite3_column_int(stmt, 0) : 0;
+  sqlite3_finalize(stmt);
+  return ret;
+}
+
+/* Replacing a location moves its count to the new cell. */
+static void test_density_replace(void) {
+  const int test_case = 3;
+  // Arrange
+  SpatiaLite sp = open_and_init_db(":memory:");
+  DensityChanges changes = { 0 };
+  density_add(&changes, -71.608, 26.434, 1);
+  density_add(&changes, -71.608, 26.434, 1);
+  density_write(sp.db, &changes);
+  my_assert(cell_count(sp.db, -71.608, 26.434) == 2);
+
+  // Act
+  density_add(&changes, -71.608, 26.434, -1);
+  density_add(&changes, -71.608, 26.434, -1);
+  density_add(&changes, -71.508, 26.434, 1);
+  density_write(sp.db, &changes);
+
+  // Assert
+  my_assert(cell_count(sp.db, -71.608, 26.434) == 0);
+  my_assert(cell_count(sp.db, -71.508, 26.434) == 1);
+  /* Both fall in the same cell at zoom 0. */
+  sqlite3_stmt *stmt;
+  sqlite3_prepare_v2(sp.db, "SELECT count(*), sum(count) FROM density"
+    "  WHERE zoom = 0;", -1, &stmt, NULL);
+  my_assert(SQLITE_ROW == sqlite3_step(stmt));
+  my_assert(sqlite3_column_int(stmt, 0) == 1);
+  my_assert(sqlite3_column_int(stmt, 1) == 1);
+  sqlite3_finalize(stmt);
+  close_db(sp);
+  ok();
+}
+
+int main(void) {
+  puts("1..3");
+  test_tile_at();
+  test_tile_bounds();
+  test_density_replace();
+  return 0;
+}
@@ -0,0 +1,195 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "flatgeobuf.h"
+#include "my_assert.h"
+
+/* Tests the FlatGeobuf writer, reading the file back with just enough of
+ * FlatBuffers.
+ */
+
+/* Size of a packed R-tree node in the file. */
+#define NODE_BYTES 40
+
+char file_name[] = "/tmp/flatgeobuf_test_XXXXXX";
+
+/**
+ * Reads the whole file. Sets its size.
+ */
+static unsigned char *read_file(size_t *size) {
+  FILE *file = fopen(file_name, "rb");
+  fseek(file, 0, SEEK_END);
+  *size = ftell(file);
+  rewind(file);
+  unsigned char *data = malloc(*size);
+  if (fread(data, 1, *size, file) != *size)
+    *size = 0;
+  fclose(file);
+  return data;
+}
+
+static uint32_t read_u32(const unsigned char *data) {
+  uint32_t ret;
+  memcpy(&ret, data, sizeof(ret));
+  return ret;
+}
+
+static double read_double(const unsigned char *data) {
+  double ret;
+  memcpy(&ret, data, sizeof(ret));
+  return ret;
+}
+
+/**
+ * Position of a field of a table in a buffer, 0 when absent.
+ */
+static size_t field(const unsigned char *buffer, size_t table,
+  unsigned int slot) {
+  int32_t to_vtable;
+  memcpy(&to_vtable, buffer + table, sizeof(to_vtable));
+  const unsigned char *vtable = buffer + table - to_vtable;
+  uint16_t vtable_size, offset;
+  memcpy(&vtable_size, vtable, sizeof(vtable_size));
+  if (4 + 2 * slot >= vtable_size)
+    return 0;
+  memcpy(&offset, vtable + 4 + 2 * slot, sizeof(offset));
+  return offset == 0 ? 0 : table + offset;
+}
+
+/**
+ * Position of what an offset field points to.
+ */
+static size_t follow(const unsigned char *buffer, size_t field) {
+  return field + read_u32(buffer + field);
+}
+
+/* Points along a diagonal, one per second. */
+static void test_points(void) {
+  const int test_case = 1;
+  // Arrange
+  const FgbColumn columns[] = { { "time", FGB_DATETIME } };
+  FgbWriter writer;
+  fgb_begin(&writer, "locations", FGB_POINT, 1, columns);
+  for (int i = 0; i < 100; ++i) {
+    const double xy[] = { -71.6 + i * 0.001, 26.4 + i * 0.001 };
+    const int64_t time[] = { 1725094940 + i };
+    fgb_add(&writer, 1, xy, time);
+  }
+  // Act
+  bool written = fgb_finish(&writer, file_name);
+  // Assert
+  my_assert(written);
+  size_t size;
+  unsigned char *data = read_file(&size);
+  my_assert(memcmp(data, "fgb\3fgb\0", 8) == 0);
+  const unsigned char *header = data + 12;
+  size_t header_table = follow(header, 0);
+  my_assert(read_u32(header + field(header, header_table, 8)) == 100);
+  my_assert(header[field(header, header_table, 2)] == FGB_POINT);
+  size_t envelope = follow(header, field(header, header_table, 1)) + 4;
+  my_assert(read_double(header + envelope) == -71.6);
+
+  /* Root, a level of 7 nodes, and the leaves. */
+  const unsigned char *index = header + read_u32(data + 8);
+  const unsigned char *features = index + 108 * NODE_BYTES;
+  my_assert(features + writer.features_size == data + size);
+  my_assert(read_double(index) == -71.6);
+  my_assert(read_u32(index + 32) == 1);
+  bool found[100] = { false };
+  for (int i = 0; i < 100; ++i) {
+    const unsigned char *leaf = index + (8 + i) * NODE_BYTES;
+    const unsigned char *feature = features + read_u32(leaf + 32) + 4;
+    size_t geometry = follow(feature, field(feature, follow(feature, 0), 0));
+    size_t xy = follow(feature, field(feature, geometry, 1));
+    my_assert(read_u32(feature + xy) == 2);
+    double x = read_double(feature + xy + 4);
+    my_assert(x == read_double(leaf));
+    found[lround((x + 71.6) * 1000)] = true;
+  }
+  for (int i = 0; i < 100; ++i)
+    my_assert(found[i]);
+  free(data);
+  ok();
+}
+
+/* A line with date time and integer attributes. */
+static void test_line(void) {
+  const int test_case = 2;
+  // Arrange
+  const FgbColumn columns[] = {
+    { "start_time", FGB_DATETIME },
+    { "points", FGB_LONG },
+  };
+  FgbWriter writer;
+  fgb_begin(&writer, "trips", FGB_LINESTRING, 2, columns);
+  const double xy[] = { -71.6, 26.4, -71.5, 26.5, -71.4, 26.4 };
+  const int64_t values[] = { 1725094940, 42 };
+  fgb_add(&writer, 3, xy, values);
+  // Act
+  bool written = fgb_finish(&writer, file_name);
+  // Assert
+  my_assert(written);
+  size_t size;
+  unsigned char *data = read_file(&size);
+  const unsigned char *header = data + 12;
+  size_t header_table = follow(header, 0);
+  size_t columns_vector = follow(header, field(header, header_table, 7));
+  my_assert(read_u32(header + columns_vector) == 2);
+  size_t column = follow(header, columns_vector + 8);
+  my_assert(strcmp((const char *)header
+      + follow(header, field(header, column, 0)) + 4, "points") == 0);
+  my_assert(header[field(header, column, 1)] == FGB_LONG);
+
+  const unsigned char *feature = header + read_u32(data + 8)
+    + 2 * NODE_BYTES + 4;
+  size_t properties = follow(feature, field(feature, follow(feature, 0), 1));
+  my_assert(read_u32(feature + properties) == 2 + 4 + 20 + 2 + 8);
+  my_assert(memcmp(feature + properties + 10, "2024-08-31T09:02:20Z", 20)
+    == 0);
+  int64_t points;
+  memcpy(&points, feature + properties + 32, sizeof(points));
+  my_assert(points == 42);
+  free(data);
+  ok();
+}
+
+/* No features and no index. */
+static void test_empty(void) {
+  const int test_case = 3;
+  // Arrange
+  FgbWriter writer;
+  fgb_begin(&writer, "locations", FGB_POINT, 0, NULL);
+  // Act
+  bool written = fgb_finish(&writer, file_name);
+  // Assert
+  my_assert(written);
+  size_t size;
+  unsigned char *data = read_file(&size);
+  my_assert(size == 12 + read_u32(data + 8));
+  const unsigned char *header = data + 12;
+  size_t header_table = follow(header, 0);
+  my_assert(read_u32(header + field(header, header_table, 8)) == 0);
+  uint16_t node_size;
+  memcpy(&node_size, header + field(header, header_table, 9), 2);
+  my_assert(node_size == 0);
+  free(data);
+  ok();
+}
+
+int main(void) {
+  puts("1..3");
+  int fd = mkstemp(file_name);
+  if (fd < 0) {
+    puts("Bail out! Could not create temporary file");
+    return 1;
+  }
+  close(fd);
+  test_points();
+  test_line();
+  test_empty();
+  unlink(file_name);
+  return 0;
+}
@@ -0,0 +1,235 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "char_line_fill.h"
+#include "db.h"
+#include "journal.h"
+#include "my_assert.h"
+
+/* Tests the ingest work journal. Each test uses a fresh in-memory database.
+ */
+
+#define FILENAME "20240831090220_004709.TS"
+
+const CharLine lines[] = {
+  {" 100 __ _ _26 434600 _71 608715" FILL "31 08 2024 09 02 20 "},
+  {" 100 __ _ _26 435139 _71 607867" FILL "31 08 2024 09 02 21 "},
+};
+
+/* Files are queued once, then follow the states. */
+static void test_queue(void) {
+  const int test_case = 1;
+  // Arrange
+  SpatiaLite sp = open_and_init_db(":memory:");
+  my_assert(journal_state(sp.db, FILENAME) == JOURNAL_ABSENT);
+
+  // Act
+  journal_queue(sp.db, FILENAME);
+
+  // Assert
+  my_assert(journal_state(sp.db, FILENAME) == JOURNAL_QUEUED);
+  journal_set_state(sp.db, FILENAME, JOURNAL_DECODING);
+  my_assert(journal_state(sp.db, FILENAME) == JOURNAL_DECODING);
+  close_db(sp);
+  ok();
+}
+
+/* Decoded lines survive re-queueing, so they aren’t decoded again. */
+static void test_resume_decoded(void) {
+  const int test_case = 2;
+  // Arrange
+  SpatiaLite sp = open_and_init_db(":memory:");
+  journal_queue(sp.db, FILENAME);
+  journal_store_lines(sp.db, FILENAME, sizeof(lines)/sizeof(CharLine), lines);
+
+  // Act
+  journal_queue(sp.db, FILENAME);
+  CharLine loaded[3];
+  int n = journal_load_lines(sp.db, FILENAME, 3, loaded);
+
+  // Assert
+  my_assert(journal_state(sp.db, FILENAME) == JOURNAL_DECODED);
+  my_assert(n == sizeof(lines)/sizeof(CharLine));
+  my_assert(memcmp(loaded, lines, sizeof(lines)) == 0);
+  /* Too few lines to load into. */
+  my_assert(journal_load_lines(sp.db, FILENAME, 1, loaded) < 0);
+  close_db(sp);
+  ok();
+}
+
+/* Interrupted and failed files are queued again, without lines. */
+static void test_requeue(void) {
+  const int test_case = 3;
+  // Arrange
+  SpatiaLite sp = open_and_init_db(":memory:");
+  journal_queue(sp.db, FILENAME);
+  journal_store_lines(sp.db, FILENAME, sizeof(lines)/sizeof(CharLine), lines);
+  journal_set_state(sp.db, FILENAME, JOURNAL_FAILED);
+
+  // Act
+  journal_queue(sp.db, FILENAME);
+
+  // Assert
+  CharLine loaded[3];
+  my_assert(journal_state(sp.db, FILENAME) == JOURNAL_QUEUED);
+  my_assert(journal_load_lines(sp.db, FILENAME, 3, loaded) < 0);
+  close_db(sp);
+  ok();
+}
+
+/* Committed files drop their lines. */
+static void test_commit(void) {
+  const int test_case = 4;
+  // Arrange
+  SpatiaLite sp = open_and_init_db(":memory:");
+  journal_queue(sp.db, FILENAME);
+  journal_store_lines(sp.db, FILENAME, sizeof(lines)/sizeof(CharLine), lines);
+
+  // Act
+  journal_commit(sp.db, FILENAME);
+
+  // Assert
+  CharLine loaded[3];
+  my_assert(journal_state(sp.db, FILENAME) == JOURNAL_COMMITTED);
+  my_assert(journal_load_lines(sp.db, FILENAME, 3, loaded) < 0);
+  close_db(sp);
+  ok();
+}
+
+/* Each file goes to one worker at a time, until its lease expires. */
+static void test_claim(void) {
+  const int test_case = 5;
+  // Arrange
+  SpatiaLite sp = open_and_init_db(":memory:");
+  journal_queue(sp.db, "1.TS");
+  journal_queue(sp.db, "2.TS");
+  journal_queue(sp.db, "3.TS");
+  sqlite3_exec(sp.db, "INSERT INTO imported(filename) VALUES ('3.TS');",
+    NULL, NULL, NULL);
+  char a[16], b[16], c[16];
+
+  // Act
+  unsigned int queued = journal_queued(sp.db, 1000);
+  bool claimed_a = journal_claim(sp.db, "a", 1000, 60, sizeof(a), a);
+  bool claimed_b = journal_claim(sp.db, "b", 1000, 60, sizeof(b), b);
+  bool claimed_c = journal_claim(sp.db, "c", 1030, 60, sizeof(c), c);
+
+  // Assert
+  my_assert(queued == 2);
+  my_assert(journal_queued(sp.db, 1030) == 0);
+  my_assert(claimed_a && strcmp(a, "1.TS") == 0);
+  my_assert(claimed_b && strcmp(b, "2.TS") == 0);
+  /* The imported one isn’t claimed. */
+  my_assert(!claimed_c);
+  my_assert(journal_heartbeat(sp.db, "1.TS", "a", 1050, 60));
+  my_assert(!journal_heartbeat(sp.db, "1.TS", "b", 1050, 60));
+  /* b’s lease expired, a’s was extended. */
+  my_assert(journal_queued(sp.db, 1100) == 1);
+  my_assert(journal_claim(sp.db, "c", 1100, 60, sizeof(c), c));
+  my_assert(strcmp(c, "2.TS") == 0);
+  my_assert(!journal_heartbeat(sp.db, "2.TS", "b", 1100, 60));
+  close_db(sp);
+  ok();
+}
+
+/* Renewing the claim every third of the lease, as while a video is read,
+ * keeps it past its first lease; it expires once renewals stop. */
+static void test_heartbeat(void) {
+  const int test_case = 6;
+  // Arrange
+  SpatiaLite sp = open_and_init_db(":memory:");
+  journal_queue(sp.db, "1.TS");
+  char a[16], b[16];
+  my_assert(journal_claim(sp.db, "a", 1000, 60, sizeof(a), a));
+
+  // Act
+  bool renewed = true;
+  for (time_t now = 1020; now <= 1100; now += 20)
+    renewed = renewed && journal_heartbeat(sp.db, a, "a", now, 60);
+  bool claimed_during = journal_claim(sp.db, "b", 1120, 60, sizeof(b), b);
+  bool claimed_after = journal_claim(sp.db, "b", 1160, 60, sizeof(b), b);
+
+  // Assert
+  my_assert(renewed);
+  my_assert(!claimed_during);
+  my_assert(claimed_after && strcmp(b, "1.TS") == 0);
+  my_assert(!journal_heartbeat(sp.db, a, "a", 1180, 60));
+  close_db(sp);
+  ok();
+}
+
+#define WORKERS 4
+#define FILES 40
+
+/* Worker processes on the same database file claim every file exactly once. */
+static void test_workers(void) {
+  const int test_case = 7;
+  // Arrange
+  char db_name[] = "/tmp/journal_test_XXXXXX";
+  int fd = mkstemp(db_name);
+  my_assert(fd >= 0);
+  close(fd);
+  SpatiaLite sp = open_and_init_db(db_name);
+  begin_transaction(sp.db, "test queue");
+  for (int i = 0; i < FILES; ++i) {
+    char name[16];
+    sprintf(name, "%02d.TS", i);
+    journal_queue(sp.db, name);
+  }
+  commit_transaction(sp.db, "test queue");
+  close_db(sp);
+  int claims[2];
+  my_assert(pipe(claims) == 0);
+
+  // Act
+  for (int w = 0; w < WORKERS; ++w) {
+    if (fork() == 0) {
+      close(claims[0]);
+      SpatiaLite worker = open_and_init_db(db_name);
+      char owner[16], name[16];
+      sprintf(owner, "%d", w);
+      while (journal_claim(worker.db, owner, 1000, 60, sizeof(name), name)) {
+        journal_commit(worker.db, name);
+        /* Short writes to a pipe aren’t interleaved. */
+        if (write(claims[1], name, 2) != 2)
+          _exit(1);
+      }
+      close_db(worker);
+      _exit(0);
+    }
+  }
+  close(claims[1]);
+  int counts[FILES] = {0};
+  char name[2];
+  while (read(claims[0], name, 2) == 2)
+    counts[(name[0] - '0') * 10 + name[1] - '0']++;
+  close(claims[0]);
+  bool exited = true;
+  for (int w = 0; w < WORKERS; ++w) {
+    int status;
+    wait(&status);
+    exited = exited && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+  }
+
+  // Assert
+  my_assert(exited);
+  for (int i = 0; i < FILES; ++i)
+    my_assert(counts[i] == 1);
+  unlink(db_name);
+  ok();
+}
+
+int main(void) {
+  puts("1..7");
+  test_queue();
+  test_resume_decoded();
+  test_requeue();
+  test_commit();
+  test_claim();
+  test_heartbeat();
+  test_workers();
+  return 0;
+}
@@ -1,9 +1,12 @@
 /* SPDX-License-Identifier: GPL-2.0-or-later */
 #include <err.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include "db.h"
 #include "ls.h"
 #include "my_assert.h"
 
@@ -17,6 +20,27 @@ struct expected {
   const char filename[28];
 };
 
+/**
+ * Copies the fixture database to a temporary file, so migrating it leaves the
+ * tracked one as is. Returns whether it could, with the name in db_name.
+ */
+static bool copy_fixture(char db_name[]) {
+  int fd = mkstemp(db_name);
+  FILE *from = fopen("../test/data/directory.sqlite", "rb");
+  FILE *to = fd >= 0 ? fdopen(fd, "wb") : NULL;
+  bool copied = from != NULL && to != NULL;
+  char buffer[4096];
+  size_t size;
+  while (copied && (size = fread(buffer, 1, sizeof(buffer), from)) > 0)
+    copied = fwrite(buffer, 1, size, to) == size;
+  copied = copied && !ferror(from);
+  if (from != NULL)
+    fclose(from);
+  if (to != NULL && 0 != fclose(to))
+    copied = false;
+  return copied;
+}
+
 /* Happy path test */
 static void test_sample_directory(void) {
   const int test_case = 1;
@@ -28,10 +52,13 @@ static void test_sample_directory(void) {
     {false, "short_name.TS"},
   };
 
+  char db_name[] = "/tmp/ls_test_db_XXXXXX";
+  my_assert(copy_fixture(db_name));
+
   // Act
   struct dirent **list;
-  int n = list_to_import("../test/data/directory",
-    "../test/data/directory.sqlite", &list);
+  int n = list_to_import("../test/data/directory", db_name, &list, NULL);
+  unlink(db_name);
 
   // Assert
 
@@ -63,7 +90,7 @@ static void test_sample_directory(void) {
 static void test_no_directory(void) {
   const int test_case = 2;
   // Act, Assert
-  my_assert(0 == list_to_import("", "", NULL));
+  my_assert(0 == list_to_import("", "", NULL, NULL));
   ok();
 }
 
@@ -72,10 +99,15 @@ static void test_no_directory(void) {
  */
 static void test_no_RO(void) {
   const int test_case = 3;
+  // Arrange
+  char db_name[] = "/tmp/ls_test_db_XXXXXX";
+  my_assert(copy_fixture(db_name));
+
   // Act
   struct dirent **list;
-  int n = list_to_import("../test/data/directory_noRO",
-    "../test/data/directory.sqlite", &list);
+  int n = list_to_import("../test/data/directory_noRO", db_name, &list,
+    NULL);
+  unlink(db_name);
 
   // Assert
   my_assert(n == 0);
@@ -83,10 +115,105 @@ static void test_no_RO(void) {
   ok();
 }
 
+char directory[] = "/tmp/ls_test_XXXXXX";
+
+/**
+ * Writes a video file of pseudo-random contents, over two fingerprint chunks,
+ * with the last byte given. Returns its path, to be freed.
+ */
+static char *write_video(const char name[], uint8_t last) {
+  char *filename = malloc(sizeof(directory) + strlen(name) + 1);
+  sprintf(filename, "%s/%s", directory, name);
+  FILE *file = fopen(filename, "wb");
+  uint32_t seed = 3;
+  for (unsigned int i = 0; i < 3 * FINGERPRINT_CHUNK - 1; ++i) {
+    seed = seed * 1664525 + 1013904223;
+    fputc(seed >> 24, file);
+  }
+  fputc(last, file);
+  fclose(file);
+  return filename;
+}
+
+/* Copies have the same fingerprint, whatever the name, and changes at the end
+ * change it. */
+static void test_fingerprint(void) {
+  const int test_case = 4;
+  // Arrange
+  char *original = write_video("20240806193829_005713.TS", 0);
+  char *copy = write_video("renamed.TS", 0);
+  char *changed = write_video("changed.TS", 1);
+  char original_print[FINGERPRINT_SIZE], copy_print[FINGERPRINT_SIZE],
+    changed_print[FINGERPRINT_SIZE];
+
+  // Act
+  bool read = fingerprint_file(original, original_print)
+    && fingerprint_file(copy, copy_print)
+    && fingerprint_file(changed, changed_print);
+
+  // Assert
+  my_assert(read);
+  my_assert(strcmp(original_print, copy_print) == 0);
+  my_assert(strcmp(original_print, changed_print) != 0);
+  my_assert(!fingerprint_file("/nonexistent.TS", copy_print));
+  free(original);
+  free(copy);
+  free(changed);
+  ok();
+}
+
+/* Copies of an imported video aren’t listed. */
+static void test_skip_copies(void) {
+  const int test_case = 5;
+  // Arrange
+  char db_name[sizeof(directory) + sizeof("/db.sqlite")];
+  sprintf(db_name, "%s/db.sqlite", directory);
+  char *original = write_video("20240806193829_005713.TS", 0);
+  char fingerprint[FINGERPRINT_SIZE];
+  my_assert(fingerprint_file(original, fingerprint));
+  unlink(original);
+  SpatiaLite sp = open_and_init_db(db_name);
+  char sql[200];
+  sprintf(sql, "INSERT INTO imported(filename, fingerprint)"
+    "  VALUES ('20240806193829_005713.TS', '%s');", fingerprint);
+  my_assert(SQLITE_OK == sqlite3_exec(sp.db, sql, NULL, NULL, NULL));
+  close_db(sp);
+
+  // Act
+  struct dirent **list;
+  char (*fingerprints)[FINGERPRINT_SIZE];
+  int n = list_to_import(directory, db_name, &list, &fingerprints);
+
+  // Assert
+  my_assert(n == 1);
+  my_assert(strcmp(list[0]->d_name, "changed.TS") == 0);
+  /* The fingerprint computed for the listing comes along. */
+  sprintf(sql, "%s/changed.TS", directory);
+  my_assert(fingerprint_file(sql, fingerprint));
+  my_assert(strcmp(fingerprints[0], fingerprint) == 0);
+  free(fingerprints);
+  free(list[0]);
+  free(list);
+  const char *names[] = {"renamed.TS", "changed.TS", "db.sqlite"};
+  for (unsigned int i = 0; i < sizeof(names) / sizeof(names[0]); ++i) {
+    sprintf(sql, "%s/%s", directory, names[i]);
+    unlink(sql);
+  }
+  free(original);
+  rmdir(directory);
+  ok();
+}
+
 int main(void) {
-  puts("1..3");
+  puts("1..5");
+  if (mkdtemp(directory) == NULL) {
+    puts("Bail out! Could not create temporary directory");
+    return 1;
+  }
   test_sample_directory();
   test_no_directory();
   test_no_RO();
+  test_fingerprint();
+  test_skip_copies();
   return 0;
 }
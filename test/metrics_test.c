@@ -0,0 +1,122 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "my_assert.h"
+#include "metrics.h"
+
+/* Tests the Prometheus text output. */
+
+char metrics_name[] = "/tmp/metrics_test_XXXXXX";
+
+/**
+ * Prints the metrics to a string, to be freed.
+ */
+static char *print(const Progress *progress, const Stats *run,
+  const Stats *last_file) {
+  char *text;
+  size_t size;
+  FILE *out = open_memstream(&text, &size);
+  metrics_print(out, progress, run, last_file);
+  fclose(out);
+  return text;
+}
+
+/* Progress is gauges and counters, rejections labelled by reason. */
+static void test_progress(void) {
+  const int test_case = 1;
+  // Arrange
+  const Progress progress = {
+    .queued = 7, .in_flight = 1, .imported = 3, .rejected = { 2, 1 },
+  };
+  const Stats none = { 0 };
+  // Act
+  char *text = print(&progress, &none, &none);
+  // Assert
+  my_assert(strstr(text, "# TYPE onde_dirigi_queue_depth gauge\n") != NULL);
+  my_assert(strstr(text, "\nonde_dirigi_queue_depth 7\n") != NULL);
+  my_assert(strstr(text, "\nonde_dirigi_files_in_flight 1\n") != NULL);
+  my_assert(strstr(text, "\nonde_dirigi_files_imported_total 3\n") != NULL);
+  my_assert(strstr(text,
+    "\nonde_dirigi_files_rejected_total{reason=\"unreadable\"} 2\n") != NULL);
+  my_assert(strstr(text,
+    "\nonde_dirigi_files_rejected_total{reason=\"invalid\"} 1\n") != NULL);
+  /* No file yet: no rate. */
+  my_assert(strstr(text, "\nonde_dirigi_decode_frames_per_second 0.000\n")
+    != NULL);
+  free(text);
+  ok();
+}
+
+/* Histogram buckets are cumulative, ending with all the calls. */
+static void test_histogram(void) {
+  const int test_case = 2;
+  // Arrange
+  const Progress progress = { 0 };
+  Stats run = { 0 };
+  run.calls[STAGE_DECODE] = 6;
+  run.seconds[STAGE_DECODE] = 0.25;
+  run.buckets[STAGE_DECODE][2] = 3;
+  run.buckets[STAGE_DECODE][4] = 2;
+  run.counters[COUNTER_FRAMES_DECODED] = 6;
+  Stats last_file = { .elapsed = 2 };
+  last_file.counters[COUNTER_FRAMES_DECODED] = 5;
+  // Act
+  char *text = print(&progress, &run, &last_file);
+  // Assert
+  const char *expected =
+    "onde_dirigi_stage_seconds_bucket{stage=\"decode\",le=\"1e-05\"} 0\n"
+    "onde_dirigi_stage_seconds_bucket{stage=\"decode\",le=\"0.0001\"} 0\n"
+    "onde_dirigi_stage_seconds_bucket{stage=\"decode\",le=\"0.001\"} 3\n"
+    "onde_dirigi_stage_seconds_bucket{stage=\"decode\",le=\"0.01\"} 3\n"
+    "onde_dirigi_stage_seconds_bucket{stage=\"decode\",le=\"0.1\"} 5\n"
+    "onde_dirigi_stage_seconds_bucket{stage=\"decode\",le=\"1\"} 5\n"
+    "onde_dirigi_stage_seconds_bucket{stage=\"decode\",le=\"10\"} 5\n"
+    "onde_dirigi_stage_seconds_bucket{stage=\"decode\",le=\"+Inf\"} 6\n"
+    "onde_dirigi_stage_seconds_sum{stage=\"decode\"} 0.250000\n"
+    "onde_dirigi_stage_seconds_count{stage=\"decode\"} 6\n";
+  my_assert(strstr(text, expected) != NULL);
+  my_assert(strstr(text, "\nonde_dirigi_frames_decoded_total 6\n") != NULL);
+  my_assert(strstr(text, "\nonde_dirigi_decode_frames_per_second 2.500\n")
+    != NULL);
+  free(text);
+  ok();
+}
+
+/* The file is replaced whole. */
+static void test_write(void) {
+  const int test_case = 3;
+  // Arrange
+  const Progress progress = { .queued = 1 };
+  const Stats none = { 0 };
+  // Act
+  bool written = metrics_write(metrics_name, &progress, &none, &none);
+  // Assert
+  my_assert(written);
+  FILE *in = fopen(metrics_name, "r");
+  my_assert(in != NULL);
+  char first[64];
+  my_assert(fgets(first, sizeof(first), in) != NULL);
+  fclose(in);
+  my_assert(strncmp(first, "# HELP onde_dirigi_queue_depth", 30) == 0);
+  char temporary[sizeof(metrics_name) + sizeof(".tmp")];
+  snprintf(temporary, sizeof(temporary), "%s.tmp", metrics_name);
+  my_assert(access(temporary, F_OK) != 0);
+  ok();
+}
+
+int main(void) {
+  puts("1..3");
+  int fd = mkstemp(metrics_name);
+  if (fd < 0) {
+    puts("Bail out! Could not create temporary file");
+    return 1;
+  }
+  close(fd);
+  test_progress();
+  test_histogram();
+  test_write();
+  unlink(metrics_name);
+  return 0;
+}
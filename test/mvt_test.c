@@ -0,0 +1,99 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "my_assert.h"
+#include "mvt.h"
+
+/* Tests the vector tile encoding against hand-encoded protocol buffers. */
+
+/**
+ * Whether the bytes appear in the tile.
+ */
+static bool contains(const unsigned char tile[], size_t size,
+  const unsigned char bytes[], size_t length) {
+  for (size_t i = 0; i + length <= size; ++i)
+    if (memcmp(tile + i, bytes, length) == 0)
+      return true;
+  return false;
+}
+
+/* The tile is a single layer, with its name, version and extent. */
+static void test_layer(void) {
+  const int test_case = 1;
+  // Arrange
+  MvtLayer layer;
+  mvt_begin(&layer, 0, NULL);
+  // Act
+  size_t size;
+  unsigned char *tile = mvt_finish(&layer, "trips", &size);
+  // Assert
+  const unsigned char expected[] = {
+    0x1a, 12,                           /* layers */
+    0x78, 2,                            /* version 2 */
+    0x0a, 5, 't', 'r', 'i', 'p', 's',   /* name */
+    0x28, 0x80, 0x20,                   /* extent 4096 */
+  };
+  my_assert(size == sizeof(expected));
+  my_assert(memcmp(tile, expected, size) == 0);
+  free(tile);
+  ok();
+}
+
+/* A line as move to and line to commands, with zigzag deltas. */
+static void test_line(void) {
+  const int test_case = 2;
+  // Arrange
+  const char *const keys[] = { "start_time" };
+  MvtLayer layer;
+  mvt_begin(&layer, 1, keys);
+  const int64_t values[] = { 300 };
+  const int32_t xy[] = { 2, 3, 12, -2, 12, -2, 13, -2 };
+  // Act
+  mvt_add_line(&layer, 7, values, 4, xy);
+  size_t size;
+  unsigned char *tile = mvt_finish(&layer, "trips", &size);
+  // Assert
+  const unsigned char feature[] = {
+    0x12, 18,                           /* features */
+    0x08, 7,                            /* id */
+    0x18, 2,                            /* linestring */
+    0x12, 2, 0, 0,                      /* tags: key 0, value 0 */
+    0x22, 8, 9, 4, 6, 18, 20, 9, 2, 0,  /* geometry */
+  };
+  const unsigned char key[] = { 0x1a, 10, 's', 't', 'a', 'r', 't' };
+  const unsigned char value[] = { 0x22, 3, 0x20, 0xac, 0x02 };
+  my_assert(contains(tile, size, feature, sizeof(feature)));
+  my_assert(contains(tile, size, key, sizeof(key)));
+  my_assert(contains(tile, size, value, sizeof(value)));
+  free(tile);
+  ok();
+}
+
+/* Lines left with a single point aren’t features. */
+static void test_degenerate(void) {
+  const int test_case = 3;
+  // Arrange
+  MvtLayer layer;
+  mvt_begin(&layer, 0, NULL);
+  const int32_t xy[] = { 5, 5, 5, 5, 5, 5 };
+  // Act
+  mvt_add_line(&layer, 1, NULL, 3, xy);
+  mvt_add_line(&layer, 2, NULL, 1, xy);
+  mvt_add_line(&layer, 3, NULL, 0, xy);
+  // Assert
+  my_assert(layer.feature_count == 0);
+  size_t size;
+  free(mvt_finish(&layer, "trips", &size));
+  my_assert(size == 14);
+  ok();
+}
+
+int main(void) {
+  puts("1..3");
+  test_layer();
+  test_line();
+  test_degenerate();
+  return 0;
+}
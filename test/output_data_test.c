@@ -3,7 +3,9 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <unistd.h>
 #include "char_line_fill.h"
+#include "db.h"
 #include "my_assert.h"
 #include "output_data.h"
 
@@ -145,13 +147,222 @@ static void test_weird_lines_still_ok(void) {
 static void test_smoke_test_append_lines(void) {
   const int test_case = 8;
   // Act, Assert
-  append_lines("20240831.TS", cl(good), ":memory:");
+  append_lines("20240831.TS", cl(good), ":memory:", NULL);
+  ok();
+}
+
+/* Same for compact tracks. */
+static void test_smoke_test_append_lines_compact(void) {
+  const int test_case = 9;
+  // Arrange
+  const AppendOptions options = { .compact = true };
+  // Act, Assert
+  append_lines("20240831.TS", cl(good), ":memory:", &options);
+  ok();
+}
+
+/* Seconds are skipped while stationary, and not as soon as it moves. */
+static void test_stationary_step(void) {
+  const int test_case = 10;
+  // Arrange
+  const CharLine parked[] = {
+    {" 0 __ _ _26 434600 _71 608715  " FILL "31 08 2024 09 02 20 "},
+    {" 0 __ _ _26 434601 _71 608715  " FILL "31 08 2024 09 02 21 "},
+    {" 0 __ _ _26 434600 _71 608716  " FILL "31 08 2024 09 02 22 "},
+    {" 0 __ _ _26 434600 _71 608715  " FILL "31 08 2024 09 02 26 "},
+    {" 20 __ _ _26 434800 _71 608715 " FILL "31 08 2024 09 02 27 "},
+  };
+  double radius = 10;
+  // Act, Assert
+  my_assert(stationary_step(1, parked, &radius) == 1);
+  my_assert(stationary_step(3, parked, &radius) == 1);
+  my_assert(stationary_step(4, parked, &radius) == 3);
+  my_assert(stationary_step(5, parked, &radius) == 1);
+  /* Collapsing the same lines. */
+  const AppendOptions options = { .stationary_radius = radius };
+  append_lines("20240831.TS", cl(parked), ":memory:", &options);
+  ok();
+}
+
+/* Seconds written by a video, by a stationary run or by a compact track are
+ * covered, and sampling skips them. */
+static void test_coverage(void) {
+  const int test_case = 11;
+  // Arrange
+  char db_name[] = "/tmp/output_data_test_XXXXXX";
+  int fd = mkstemp(db_name);
+  my_assert(fd >= 0);
+  close(fd);
+  const char video_name[] = "20240831090220_004709.TS";
+  const time_t start = video_start_time(video_name);
+  append_lines(video_name, cl(good), db_name, NULL);
+  SpatiaLite sp = open_and_init_db(db_name);
+  char sql[300];
+  sprintf(sql, "INSERT INTO stationary(timestamp, end_time) VALUES (%ld, %ld);"
+    "INSERT INTO compact_tracks(filename, start_time, end_time, points, track)"
+    "  VALUES ('rear.TS', %ld, %ld, 0, x'');", (long)start + 100,
+    (long)start + 109, (long)start + 250, (long)start + 400);
+  my_assert(SQLITE_OK == sqlite3_exec(sp.db, sql, NULL, NULL, NULL));
+  Coverage coverage = { .step = NULL };
+
+  // Act
+  unsigned int covered = coverage_load(sp.db, start, &coverage);
+
+  // Assert
+  close_db(sp);
+  unlink(db_name);
+  const unsigned int good_count = sizeof(good)/sizeof(CharLine);
+  my_assert(covered == good_count + 10 + VIDEO_SECONDS - 250);
+  my_assert(coverage.covered[3] && !coverage.covered[4]);
+  my_assert(coverage.covered[330]);
+  /* 09:02:21 is followed by 3 covered seconds, 09:02:32 by none. */
+  my_assert(coverage_step(2, good, &coverage) == 3);
+  my_assert(coverage_step(cl(good), &coverage) == 1);
+  /* A stationary step landing on covered seconds goes on to the next gap. */
+  double radius = 10;
+  coverage.step = stationary_step;
+  coverage.step_data = &radius;
+  my_assert(coverage_step(2, good, &coverage) == 3);
+  for (unsigned int i = 13; i < COVERAGE_SECONDS; ++i)
+    coverage.covered[i] = true;
+  my_assert(coverage_step(cl(good), &coverage) == COVERAGE_SECONDS);
+  ok();
+}
+
+/* Each video is catalogued once with its span from its name and length, box
+ * and first timestamp, which writing it again without them keeps. */
+static void test_videos(void) {
+  const int test_case = 12;
+  // Arrange
+  char db_name[] = "/tmp/output_data_test_XXXXXX";
+  int fd = mkstemp(db_name);
+  my_assert(fd >= 0);
+  close(fd);
+  const unsigned int good_count = sizeof(good)/sizeof(CharLine);
+  int64_t pts[sizeof(good)/sizeof(CharLine)];
+  for (unsigned int i = 0; i < good_count; ++i)
+    pts[i] = 126000 + 90000 * i;
+  const AppendOptions options = { .pts = pts, .seconds = 300 };
+
+  // Act
+  append_lines("file:/videos/RO/20240831090220_004709.TS", cl(good), db_name,
+    &options);
+  append_lines("20240831090220_004709.TS", cl(good), db_name, NULL);
+
+  // Assert
+  SpatiaLite sp = open_and_init_db(db_name);
+  sqlite3_stmt *stmt;
+  my_assert(SQLITE_OK == sqlite3_prepare_v2(sp.db,
+    "SELECT v.filename, v.path, v.end_time - v.start_time, v.points,"
+    "  v.first_pts, (SELECT count(*) FROM videos), v.pts_time - v.start_time"
+    "  FROM videos AS v JOIN videos_bbox AS b ON b.id = v.id"
+    "  WHERE b.min_lon <= -71.61 AND b.max_lon >= -71.61"
+    "  AND b.min_lat <= 26.436 AND b.max_lat >= 26.436;", -1, &stmt, NULL));
+  my_assert(SQLITE_ROW == sqlite3_step(stmt));
+  my_assert(strcmp((const char *)sqlite3_column_text(stmt, 0),
+    "20240831090220_004709.TS") == 0);
+  my_assert(strcmp((const char *)sqlite3_column_text(stmt, 1),
+    "/videos/RO/20240831090220_004709.TS") == 0);
+  my_assert(sqlite3_column_int(stmt, 2) == 299);
+  my_assert(sqlite3_column_int(stmt, 3) == (int)good_count);
+  my_assert(sqlite3_column_int64(stmt, 4) == 126000);
+  my_assert(sqlite3_column_int(stmt, 5) == 1);
+  my_assert(sqlite3_column_int(stmt, 6) == 0);
+  sqlite3_finalize(stmt);
+  close_db(sp);
+  unlink(db_name);
+  ok();
+}
+
+/* A video skipped as covered is catalogued from its file, boxed by the
+ * locations already there, and one with none has no box. */
+static void test_catalogue_covered(void) {
+  const int test_case = 13;
+  // Arrange
+  char db_name[] = "/tmp/output_data_test_XXXXXX";
+  int fd = mkstemp(db_name);
+  my_assert(fd >= 0);
+  close(fd);
+  append_lines("20240831090220_004709.TS", cl(good), db_name, NULL);
+  const int64_t first_pts = 126000;
+
+  // Act
+  catalogue_video("file:/videos/20240831090220_000012.TS", db_name,
+    &first_pts, 300);
+  catalogue_video("file:/videos/20240901090220_000013.TS", db_name, NULL, 0);
+
+  // Assert
+  SpatiaLite sp = open_and_init_db(db_name);
+  sqlite3_stmt *stmt;
+  my_assert(SQLITE_OK == sqlite3_prepare_v2(sp.db,
+    "SELECT v.path, v.end_time - v.start_time, v.points, v.first_pts,"
+    "  v.pts_time - v.start_time, b.min_lon <= -71.614991,"
+    "  b.max_lon >= -71.607116, b.min_lat <= 26.434600,"
+    "  b.max_lat >= 26.436735"
+    "  FROM videos AS v LEFT JOIN videos_bbox AS b ON b.id = v.id"
+    "  WHERE v.filename LIKE '%_0000__.TS' ORDER BY v.filename;", -1, &stmt,
+    NULL));
+  my_assert(SQLITE_ROW == sqlite3_step(stmt));
+  my_assert(strcmp((const char *)sqlite3_column_text(stmt, 0),
+    "/videos/20240831090220_000012.TS") == 0);
+  my_assert(sqlite3_column_int(stmt, 1) == 299);
+  my_assert(sqlite3_column_int(stmt, 2) == 0);
+  my_assert(sqlite3_column_int64(stmt, 3) == 126000);
+  my_assert(sqlite3_column_int(stmt, 4) == 0);
+  for (int i = 5; i < 9; ++i)
+    my_assert(sqlite3_column_int(stmt, i) == 1);
+  my_assert(SQLITE_ROW == sqlite3_step(stmt));
+  my_assert(sqlite3_column_int(stmt, 1) == 0);
+  my_assert(sqlite3_column_type(stmt, 3) == SQLITE_NULL);
+  my_assert(sqlite3_column_type(stmt, 5) == SQLITE_NULL);
+  my_assert(SQLITE_DONE == sqlite3_step(stmt));
+  sqlite3_finalize(stmt);
+  close_db(sp);
+  unlink(db_name);
+  ok();
+}
+
+/* Writing a video again with replace drops the seconds no longer read, with
+ * their density counts, and shrinks its span. */
+static void test_replace(void) {
+  const int test_case = 14;
+  // Arrange
+  char db_name[] = "/tmp/output_data_test_XXXXXX";
+  int fd = mkstemp(db_name);
+  my_assert(fd >= 0);
+  close(fd);
+  const unsigned int good_count = sizeof(good)/sizeof(CharLine);
+  append_lines("20240831090220_004709.TS", cl(good), db_name, NULL);
+  const AppendOptions options = { .replace = true };
+
+  // Act
+  append_lines("20240831090220_004709.TS", good_count - 1, good, db_name,
+    &options);
+
+  // Assert
+  SpatiaLite sp = open_and_init_db(db_name);
+  sqlite3_stmt *stmt;
+  my_assert(SQLITE_OK == sqlite3_prepare_v2(sp.db,
+    "SELECT (SELECT count(*) FROM locations),"
+    "  (SELECT count(*) FROM locations WHERE timestamp = ?),"
+    "  (SELECT sum(count) FROM density WHERE zoom = 0),"
+    "  (SELECT end_time - start_time FROM videos);", -1, &stmt, NULL));
+  my_assert(SQLITE_OK == sqlite3_bind_int64(stmt, 1,
+    line_time(good[good_count - 1])));
+  my_assert(SQLITE_ROW == sqlite3_step(stmt));
+  my_assert(sqlite3_column_int(stmt, 0) == (int)good_count - 1);
+  my_assert(sqlite3_column_int(stmt, 1) == 0);
+  my_assert(sqlite3_column_int(stmt, 2) == (int)good_count - 1);
+  my_assert(sqlite3_column_int(stmt, 3) == 11);
+  sqlite3_finalize(stmt);
+  close_db(sp);
+  unlink(db_name);
   ok();
 }
 
 int main(void) {
   puts("TAP version 14");
-  puts("1..8");
+  puts("1..14");
   test_adjacent_lines_speed();
   test_lines_time_ascending();
   test_lines_time_close_to_filename();
@@ -160,5 +371,11 @@ int main(void) {
   test_lines_ok();
   test_weird_lines_still_ok();
   test_smoke_test_append_lines();
+  test_smoke_test_append_lines_compact();
+  test_stationary_step();
+  test_coverage();
+  test_videos();
+  test_catalogue_covered();
+  test_replace();
   return 0;
 }
@@ -0,0 +1,161 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "db.h"
+#include "my_assert.h"
+#include "partition.h"
+
+/* Tests the partitioned databases. The catalog and partitions go in a
+ * temporary directory.
+ */
+
+/* 2024-08-31 09:02:20 and 2024-09-01 00:00:00 UTC. */
+#define AUGUST 1725094940
+#define SEPTEMBER 1725148800
+
+/* Room for the partition names too. */
+char catalog_name[] = "/tmp/partition_test_XXXXXX/catalog.2024-08.sqlite";
+
+/**
+ * Writes a location to a partition.
+ */
+static void add_location(const char path[], time_t timestamp) {
+  SpatiaLite sp = open_and_init_db(path);
+  unsigned char *wkb;
+  int wkb_size;
+  gaiaGeomCollPtr geo = gaiaAllocGeomColl();
+  geo->Srid = 4326;
+  gaiaAddPointToGeomColl(geo, -71.608715, 26.434600);
+  gaiaToSpatiaLiteBlobWkb(geo, &wkb, &wkb_size);
+  gaiaFreeGeomColl(geo);
+  sqlite3_stmt *stmt;
+  sqlite3_prepare_v2(sp.db,
+    "INSERT INTO locations(timestamp, place) VALUES (?, ?);", -1, &stmt, NULL);
+  sqlite3_bind_int64(stmt, 1, timestamp);
+  sqlite3_bind_blob(stmt, 2, wkb, wkb_size, free);
+  sqlite3_step(stmt);
+  sqlite3_finalize(stmt);
+  close_db(sp);
+}
+
+/**
+ * Single integer result of a query.
+ */
+static int query_int(sqlite3 *db, const char query[]) {
+  sqlite3_stmt *stmt;
+  if (SQLITE_OK != sqlite3_prepare_v2(db, query, -1, &stmt, NULL))
+    return -1;
+  int ret = SQLITE_ROW == sqlite3_step(stmt)
+    ? sqlite3_column_int(stmt, 0)
+    : -1;
+  sqlite3_finalize(stmt);
+  return ret;
+}
+
+/* A partition per month, named after the catalog, which tells their period. */
+static void test_partition_for(void) {
+  const int test_case = 1;
+  // Arrange
+  SpatiaLite sp = open_and_init_db(catalog_name);
+  PartitionPeriod period;
+  my_assert(!partition_period(sp.db, &period));
+  // Act
+  char *august = partition_for(sp.db, PARTITION_MONTH, AUGUST);
+  char *august_again = partition_for(sp.db, PARTITION_MONTH, SEPTEMBER - 1);
+  char *september = partition_for(sp.db, PARTITION_MONTH, SEPTEMBER);
+  // Assert
+  my_assert(strcmp(august, august_again) == 0);
+  my_assert(strcmp(august + strlen(august) - strlen("catalog.2024-08.sqlite"),
+    "catalog.2024-08.sqlite") == 0);
+  my_assert(strcmp(august, september) != 0);
+  my_assert(access(september, F_OK) == 0);
+  my_assert(query_int(sp.db, "SELECT count(*) FROM partitions;") == 2);
+  my_assert(partition_period(sp.db, &period) && period == PARTITION_MONTH);
+  free(august);
+  free(august_again);
+  free(september);
+  close_db(sp);
+  ok();
+}
+
+/* Partitions in the time range are attached with the unified views. */
+static void test_attach(void) {
+  const int test_case = 2;
+  // Arrange
+  SpatiaLite sp = open_and_init_db(catalog_name);
+  char *august = partition_for(sp.db, PARTITION_MONTH, AUGUST);
+  char *september = partition_for(sp.db, PARTITION_MONTH, SEPTEMBER);
+  add_location(august, AUGUST);
+  add_location(september, SEPTEMBER);
+  free(august);
+  free(september);
+
+  // Act, Assert
+  my_assert(partition_attach(sp.db, AUGUST, AUGUST) == 1);
+  my_assert(query_int(sp.db, "SELECT count(*) FROM all_locations;") == 1);
+  my_assert(partition_attach(sp.db, AUGUST, SEPTEMBER) == 1);
+  my_assert(partition_attach(sp.db, AUGUST, SEPTEMBER) == 0);
+  my_assert(query_int(sp.db, "SELECT count(*) FROM all_locations;") == 2);
+  my_assert(query_int(sp.db, "SELECT count(*) FROM all_trips;") == 0);
+  /* The tables’ names read the partitions too, for track.h and clip.h. */
+  my_assert(query_int(sp.db, "SELECT count(*) FROM locations;") == 2);
+  my_assert(query_int(sp.db, "SELECT count(*) FROM main.locations;") == 0);
+  my_assert(query_int(sp.db, "SELECT count(*) FROM videos AS v"
+    "  JOIN videos_bbox AS b ON b.id = v.id;") == 0);
+  close_db(sp);
+  ok();
+}
+
+/* Sealed partitions are attached read-only, until written again. */
+static void test_seal(void) {
+  const int test_case = 3;
+  // Arrange
+  SpatiaLite sp = open_and_init_db(catalog_name);
+
+  // Act
+  int sealed = partition_seal(sp.db, SEPTEMBER);
+
+  // Assert
+  my_assert(sealed == 1);
+  my_assert(partition_seal(sp.db, SEPTEMBER) == 0);
+  partition_attach(sp.db, AUGUST, SEPTEMBER);
+  my_assert(SQLITE_OK != sqlite3_exec(sp.db,
+    "DELETE FROM p_2024_08.locations;", NULL, NULL, NULL));
+  my_assert(SQLITE_OK == sqlite3_exec(sp.db,
+    "DELETE FROM p_2024_09.locations;", NULL, NULL, NULL));
+  free(partition_for(sp.db, PARTITION_MONTH, AUGUST));
+  my_assert(query_int(sp.db, "SELECT sum(sealed) FROM partitions;") == 0);
+  close_db(sp);
+  ok();
+}
+
+int main(void) {
+  puts("1..3");
+  setenv("TZ", "UTC", 1);
+  tzset();
+  /* Directory part of the catalog name. */
+  char *slash = strrchr(catalog_name, '/');
+  *slash = '\0';
+  if (mkdtemp(catalog_name) == NULL) {
+    puts("Bail out! Could not create temporary directory");
+    return 1;
+  }
+  strcpy(slash, "/catalog.sqlite");
+  test_partition_for();
+  test_attach();
+  test_seal();
+
+  const char *files[] = {
+    "catalog.sqlite", "catalog.2024-08.sqlite", "catalog.2024-09.sqlite",
+  };
+  for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); ++i) {
+    strcpy(slash + 1, files[i]);
+    unlink(catalog_name);
+  }
+  *slash = '\0';
+  rmdir(catalog_name);
+  return 0;
+}
@@ -0,0 +1,117 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "my_assert.h"
+#include "point_index.h"
+
+/* Tests the standalone index: a drive along a grid, queried by time, box, and
+ * distance.
+ */
+
+/* Number of points in the test index, more than a few R-tree levels. */
+#define COUNT 5000
+
+char index_name[] = "/tmp/point_index_test_XXXXXX";
+
+/**
+ * Point i of the test drive: one per second (skipping every tenth), snaking
+ * along rows of 100 points 0.001° apart.
+ */
+static TrackPoint drive(size_t i) {
+  size_t row = i / 100;
+  size_t column = row % 2 == 0 ? i % 100 : 99 - i % 100;
+  return (TrackPoint){
+    1725094940 + i + i / 9,
+    -71.6 + column * 0.001,
+    26.4 + row * 0.001,
+  };
+}
+
+static void count_visit(size_t position, void *data) {
+  (void)position;
+  (*(size_t *)data)++;
+}
+
+/* Written and mapped back. */
+static void test_write_open(void) {
+  const int test_case = 1;
+  // Arrange
+  TrackPoint *points = reallocarray(NULL, COUNT, sizeof(TrackPoint));
+  for (size_t i = 0; i < COUNT; ++i)
+    points[i] = drive(i);
+  PointIndex index;
+  // Act
+  bool written = point_index_write(index_name, COUNT, points);
+  bool opened = point_index_open(index_name, &index);
+  // Assert
+  my_assert(written && opened);
+  my_assert(index.header->count == COUNT);
+  my_assert(index.header->levels == 4);
+  my_assert(index.points[42].lon == -71558000);
+  point_index_close(&index);
+  free(points);
+  ok();
+}
+
+/* Time queries find exact times and the closest one in gaps. */
+static void test_time(void) {
+  const int test_case = 2;
+  // Arrange
+  PointIndex index;
+  my_assert(point_index_open(index_name, &index));
+  size_t first;
+  // Act, Assert
+  my_assert(point_index_at(&index, drive(100).timestamp) == 100);
+  my_assert(point_index_at(&index, 0) == 0);
+  my_assert(point_index_at(&index, INT64_MAX) == COUNT - 1);
+  /* Second 9 is skipped, 8 and 10 are equally close. */
+  my_assert(point_index_at(&index, drive(9).timestamp - 1) == 8);
+  my_assert(point_index_range(&index, drive(5).timestamp, drive(20).timestamp,
+    &first) == 16);
+  my_assert(first == 5);
+  my_assert(point_index_range(&index, 0, 10, &first) == 0);
+  point_index_close(&index);
+  ok();
+}
+
+/* Box and nearest queries agree with the grid. */
+static void test_space(void) {
+  const int test_case = 3;
+  // Arrange
+  PointIndex index;
+  my_assert(point_index_open(index_name, &index));
+  /* Columns 10 to 19 of rows 0 to 4. */
+  IndexBox box = { -71590000, 26400000, -71581000, 26404000 };
+  size_t visited = 0;
+  size_t positions[3];
+  double distances[3];
+  // Act
+  size_t in_box = point_index_box(&index, box, count_visit, &visited);
+  size_t near = point_index_nearest(&index, -71.55, 26.4301, 3, positions,
+    distances);
+  // Assert
+  my_assert(in_box == 50 && visited == 50);
+  my_assert(near == 3);
+  /* Row 30 (even, left to right) column 50. */
+  my_assert(positions[0] == 3050);
+  my_assert(distances[0] > 10 && distances[0] < 12);
+  my_assert(distances[0] <= distances[1] && distances[1] <= distances[2]);
+  point_index_close(&index);
+  ok();
+}
+
+int main(void) {
+  puts("1..3");
+  int fd = mkstemp(index_name);
+  if (fd < 0) {
+    puts("Bail out! Could not create temporary file");
+    return 1;
+  }
+  close(fd);
+  test_write_open();
+  test_time();
+  test_space();
+  unlink(index_name);
+  return 0;
+}
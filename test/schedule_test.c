@@ -0,0 +1,117 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "my_assert.h"
+#include "schedule.h"
+
+/* Tests the order videos are read in. */
+
+/**
+ * Local time of the day in January 2024.
+ */
+static time_t january(int day, int hour, int minute, int second) {
+  struct tm tm = {
+    .tm_year = 124, .tm_mon = 0, .tm_mday = day,
+    .tm_hour = hour, .tm_min = minute, .tm_sec = second, .tm_isdst = -1,
+  };
+  return mktime(&tm);
+}
+
+/* Orders are lists of known keys, windows pairs of times in order. */
+static void test_parse(void) {
+  const int test_case = 1;
+  // Arrange
+  Schedule schedule;
+  // Act, Assert
+  my_assert(schedule_parse_order("ro,newest", &schedule));
+  my_assert(schedule.key_count == 2);
+  my_assert(schedule.keys[0] == SCHEDULE_READ_ONLY);
+  my_assert(schedule.keys[1] == SCHEDULE_NEWEST);
+  my_assert(!schedule_parse_order("", &schedule));
+  my_assert(!schedule_parse_order("ro,", &schedule));
+  my_assert(!schedule_parse_order("oldest", &schedule));
+  my_assert(!schedule_parse_order("ro,newest,window,ro", &schedule));
+  my_assert(schedule_parse_window("20240101000400,20240101001000", &schedule));
+  my_assert(schedule.window_from == january(1, 0, 4, 0));
+  my_assert(schedule.window_to == january(1, 0, 10, 0));
+  my_assert(!schedule_parse_window("20240101001000,20240101000400",
+    &schedule));
+  my_assert(!schedule_parse_window("20240101000400", &schedule));
+  ok();
+}
+
+/* Locked videos first, then the newest, the ones without a time last. */
+static void test_sort(void) {
+  const int test_case = 2;
+  // Arrange
+  const char *names[] = {
+    "20240101000000_000001.TS", "RO/20231231000000_000002.TS",
+    "20240102000000_000003.TS", "short_name.TS",
+  };
+  const time_t starts[] = {
+    january(1, 0, 0, 0), january(0, 0, 0, 0), january(2, 0, 0, 0), -1,
+  };
+  const int n = sizeof(names) / sizeof(names[0]);
+  struct dirent *list[n];
+  int64_t priorities[n];
+  Schedule schedule;
+  schedule_parse_order("ro,newest", &schedule);
+  for (int i = 0; i < n; ++i) {
+    list[i] = calloc(1, sizeof(struct dirent));
+    strcpy(list[i]->d_name, names[i]);
+    priorities[i] = schedule_priority(&schedule, i == 1, starts[i]);
+  }
+
+  // Act
+  schedule_sort(n, list, priorities);
+
+  // Assert
+  my_assert(strcmp(list[0]->d_name, names[1]) == 0);
+  my_assert(strcmp(list[1]->d_name, names[2]) == 0);
+  my_assert(strcmp(list[2]->d_name, names[0]) == 0);
+  my_assert(strcmp(list[3]->d_name, names[3]) == 0);
+  for (int i = 1; i < n; ++i)
+    my_assert(priorities[i - 1] >= priorities[i]);
+  for (int i = 0; i < n; ++i)
+    free(list[i]);
+  ok();
+}
+
+/* Videos overlapping the window, over their five minutes, go first. */
+static void test_window(void) {
+  const int test_case = 3;
+  // Arrange
+  Schedule schedule;
+  schedule_parse_order("window", &schedule);
+  schedule_parse_window("20240101000400,20240101001000", &schedule);
+  // Act, Assert
+  my_assert(schedule_priority(&schedule, false, january(1, 0, 0, 0)) == 1);
+  my_assert(schedule_priority(&schedule, false, january(1, 0, 10, 0)) == 1);
+  my_assert(schedule_priority(&schedule, false, january(1, 0, 10, 1)) == 0);
+  my_assert(schedule_priority(&schedule, false, january(0, 23, 59, 0)) == 0);
+  my_assert(schedule_priority(&schedule, true, -1) == 0);
+  ok();
+}
+
+/* A key given twice would shift the priority past its 64 bits. */
+static void test_repeated_keys(void) {
+  const int test_case = 4;
+  // Arrange
+  Schedule schedule;
+  // Act, Assert
+  my_assert(!schedule_parse_order("newest,newest", &schedule));
+  my_assert(!schedule_parse_order("ro,newest,ro", &schedule));
+  my_assert(!schedule_parse_order("window,window", &schedule));
+  my_assert(schedule_parse_order("newest,ro", &schedule));
+  ok();
+}
+
+int main(void) {
+  puts("1..4");
+  test_parse();
+  test_sort();
+  test_window();
+  test_repeated_keys();
+  return 0;
+}
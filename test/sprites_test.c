@@ -0,0 +1,134 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <libavutil/avutil.h>
+#include "my_assert.h"
+#include "sprites.h"
+
+/* Tests the thumbnail sheets on synthetic frames the size of the videos. */
+
+char directory[] = "/tmp/sprites_test_XXXXXX";
+#define VIDEO_NAME "20240831090220_000001.TS"
+#define VIDEO_START 1725094940
+#define FRAME_WIDTH 2560
+#define FRAME_HEIGHT 1440
+
+/**
+ * Adds count gray frames, each a shade lighter, then closes the sprites with a
+ * time per frame, the second one unknown, or none if not kept. Returns whether
+ * they were written.
+ */
+static bool write_sprites(unsigned int count, bool keep) {
+  SpriteWriter writer;
+  sprites_create(&writer, directory, VIDEO_NAME, 10, count, false);
+  AVFrame *frame = av_frame_alloc();
+  frame->format = AV_PIX_FMT_YUV420P;
+  frame->width = FRAME_WIDTH;
+  frame->height = FRAME_HEIGHT;
+  if (0 != av_frame_get_buffer(frame, 0))
+    return false;
+  time_t times[count];
+  for (unsigned int i = 0; i < count; ++i) {
+    memset(frame->data[0], 16 + i, frame->linesize[0] * FRAME_HEIGHT);
+    memset(frame->data[1], 128, frame->linesize[1] * FRAME_HEIGHT / 2);
+    memset(frame->data[2], 128, frame->linesize[2] * FRAME_HEIGHT / 2);
+    sprites_add(&writer, frame);
+    times[i] = i == 10 ? 0 : VIDEO_START + i;
+  }
+  av_frame_free(&frame);
+  return sprites_close(&writer, count, keep ? times : NULL);
+}
+
+/* A thumbnail every 10 frames, indexed when their time is known. */
+static void test_sheet(void) {
+  const int test_case = 1;
+  // Arrange
+  char sheet[sizeof(directory) + sizeof("/" VIDEO_NAME SPRITE_EXTENSION)];
+  char index[sizeof(directory) + sizeof("/" VIDEO_NAME SPRITE_INDEX_EXTENSION)];
+  sprintf(sheet, "%s/" VIDEO_NAME SPRITE_EXTENSION, directory);
+  sprintf(index, "%s/" VIDEO_NAME SPRITE_INDEX_EXTENSION, directory);
+  // Act
+  bool written = write_sprites(25, true);
+  // Assert
+  my_assert(written);
+  FILE *file = fopen(sheet, "rb");
+  my_assert(file != NULL);
+  unsigned char jpeg_start[2];
+  my_assert(fread(jpeg_start, 1, 2, file) == 2);
+  my_assert(jpeg_start[0] == 0xff && jpeg_start[1] == 0xd8);
+  fclose(file);
+  file = fopen(index, "r");
+  my_assert(file != NULL);
+  char text[200] = { 0 };
+  my_assert(fread(text, 1, sizeof(text) - 1, file) > 0);
+  fclose(file);
+  char expected[200];
+  sprintf(expected, "%d\t0\t0\t160\t90\n%d\t320\t0\t160\t90\n",
+    VIDEO_START, VIDEO_START + 20);
+  my_assert(strcmp(text, expected) == 0);
+  unlink(sheet);
+  unlink(index);
+  ok();
+}
+
+/**
+ * Reads the file into text, which has room for size bytes. Returns whether
+ * it could.
+ */
+static bool read_text(const char filename[], size_t size, char text[size]) {
+  FILE *file = fopen(filename, "rb");
+  if (file == NULL)
+    return false;
+  size_t read = fread(text, 1, size - 1, file);
+  text[read] = '\0';
+  fclose(file);
+  return read > 0;
+}
+
+/* Sprites of lines not OK are dropped, leaving the previous ones of the video
+ * as they were. */
+static void test_not_kept(void) {
+  const int test_case = 2;
+  // Arrange
+  char sheet[sizeof(directory) + sizeof("/" VIDEO_NAME SPRITE_EXTENSION)];
+  char index[sizeof(directory) + sizeof("/" VIDEO_NAME SPRITE_INDEX_EXTENSION)];
+  char temporary[sizeof(index) + sizeof(".tmp")];
+  sprintf(sheet, "%s/" VIDEO_NAME SPRITE_EXTENSION, directory);
+  sprintf(index, "%s/" VIDEO_NAME SPRITE_INDEX_EXTENSION, directory);
+  my_assert(write_sprites(25, true));
+  char previous[200], text[200];
+  my_assert(read_text(index, sizeof(previous), previous));
+  struct stat previous_sheet, kept_sheet;
+  my_assert(0 == stat(sheet, &previous_sheet));
+  // Act
+  bool written = write_sprites(5, false);
+  // Assert
+  my_assert(!written);
+  my_assert(0 == stat(sheet, &kept_sheet));
+  my_assert(kept_sheet.st_ino == previous_sheet.st_ino);
+  my_assert(kept_sheet.st_size == previous_sheet.st_size);
+  my_assert(read_text(index, sizeof(text), text));
+  my_assert(strcmp(text, previous) == 0);
+  sprintf(temporary, "%s.tmp", sheet);
+  my_assert(access(temporary, F_OK) != 0);
+  sprintf(temporary, "%s.tmp", index);
+  my_assert(access(temporary, F_OK) != 0);
+  unlink(sheet);
+  unlink(index);
+  ok();
+}
+
+int main(void) {
+  puts("1..2");
+  if (mkdtemp(directory) == NULL) {
+    puts("Bail out! Could not create temporary directory");
+    return 1;
+  }
+  test_sheet();
+  test_not_kept();
+  rmdir(directory);
+  return 0;
+}
@@ -0,0 +1,88 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "my_assert.h"
+#include "stats.h"
+
+/* Tests the stage timers, counters and the trace file. */
+
+char trace_name[] = "/tmp/stats_test_XXXXXX";
+
+/* Nothing is recorded before the stats begin. */
+static void test_disabled(void) {
+  const int test_case = 1;
+  // Arrange
+  double start = stats_start();
+  // Act
+  stats_stop(STAGE_DECODE, start);
+  stats_count(COUNTER_FRAMES_DECODED, 5);
+  // Assert
+  my_assert(start == 0);
+  my_assert(stats_run()->calls[STAGE_DECODE] == 0);
+  my_assert(stats_run()->counters[COUNTER_FRAMES_DECODED] == 0);
+  ok();
+}
+
+/* Files add up to the run, as do calls outside files. */
+static void test_files(void) {
+  const int test_case = 2;
+  // Arrange
+  stats_begin(false, trace_name);
+  // Act
+  stats_stop(STAGE_LIST, stats_start());
+  for (unsigned int i = 0; i < 2; ++i) {
+    stats_file_begin();
+    stats_stop(STAGE_READ, stats_start());
+    stats_stop(STAGE_DECODE, stats_start());
+    stats_count(COUNTER_PACKETS_READ, 30);
+    stats_file_end(i == 0 ? "first.TS" : "\"second\".TS");
+  }
+  // Assert
+  const Stats *run = stats_run();
+  my_assert(run->calls[STAGE_LIST] == 1);
+  my_assert(run->calls[STAGE_READ] == 2 && run->calls[STAGE_DECODE] == 2);
+  my_assert(run->counters[COUNTER_PACKETS_READ] == 60);
+  my_assert(run->seconds[STAGE_DECODE] >= 0);
+  ok();
+}
+
+/* The trace is a JSON array of complete events, without each packet read. */
+static void test_trace(void) {
+  const int test_case = 3;
+  // Act
+  stats_end();
+  // Assert
+  FILE *trace = fopen(trace_name, "r");
+  my_assert(trace != NULL);
+  char content[4096];
+  size_t size = fread(content, 1, sizeof(content) - 1, trace);
+  content[size] = '\0';
+  fclose(trace);
+  my_assert(content[0] == '[');
+  my_assert(strcmp(content + size - 3, "\n]\n") == 0);
+  my_assert(strstr(content, "\"name\": \"list\"}") != NULL);
+  my_assert(strstr(content, "\"name\": \"decode\"}") != NULL);
+  my_assert(strstr(content, "\"name\": \"read\"}") == NULL);
+  /* Their total is on each file instead. */
+  my_assert(strstr(content, "\"reads\": 1}") != NULL);
+  my_assert(strstr(content, "\"name\": \"\\\"second\\\".TS\"}") != NULL);
+  my_assert(!stats_enabled);
+  ok();
+}
+
+int main(void) {
+  puts("1..3");
+  int fd = mkstemp(trace_name);
+  if (fd < 0) {
+    puts("Bail out! Could not create temporary file");
+    return 1;
+  }
+  close(fd);
+  test_disabled();
+  test_files();
+  test_trace();
+  unlink(trace_name);
+  return 0;
+}
@@ -0,0 +1,80 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#include <stdio.h>
+#include <stdlib.h>
+#include "my_assert.h"
+#include "stays.h"
+
+/* Tests finding stays on tracks. */
+
+/* Size arguments for arrays known at compile time. */
+#define tp(points) (sizeof(points)/sizeof(TrackPoint)), points
+
+/* Stopped at a traffic light, then going. Too short to be a stay. */
+static void test_short_stop(void) {
+  const int test_case = 1;
+  // Arrange
+  const TrackPoint light[] = {
+    {0, -71.600, 26.430},
+    {60, -71.60001, 26.43001},
+    {61, -71.601, 26.431},
+  };
+  Stay *stays;
+  // Act
+  unsigned int n = find_stays(tp(light), &stays);
+  // Assert
+  my_assert(n == 0);
+  free(stays);
+  ok();
+}
+
+/* Parked with the camera off: the gap is part of the stay. */
+static void test_parked(void) {
+  const int test_case = 2;
+  // Arrange
+  const TrackPoint parked[] = {
+    {0, -71.610, 26.430},
+    {1, -71.600, 26.430},
+    /* GPS wanders a bit. */
+    {2, -71.60010, 26.43010},
+    {3600, -71.60020, 26.43000},
+    {3601, -71.610, 26.430},
+  };
+  Stay *stays;
+  // Act
+  unsigned int n = find_stays(tp(parked), &stays);
+  // Assert
+  my_assert(n == 1);
+  my_assert(stays[0].start == 1);
+  my_assert(stays[0].end == 3600);
+  my_assert(stays[0].points == 3);
+  my_assert(stays[0].lon < -71.6000 && stays[0].lon > -71.6002);
+  my_assert(stays[0].lat > 26.4300 && stays[0].lat < 26.4301);
+  free(stays);
+  ok();
+}
+
+/* Driving doesn’t make stays, and an empty track has none. */
+static void test_driving(void) {
+  const int test_case = 3;
+  // Arrange
+  const TrackPoint driving[] = {
+    {0, -71.600, 26.430},
+    {400, -71.610, 26.430},
+    {800, -71.620, 26.430},
+  };
+  Stay *stays;
+  // Act, Assert
+  my_assert(find_stays(tp(driving), &stays) == 0);
+  free(stays);
+  my_assert(find_stays(0, NULL, &stays) == 0);
+  free(stays);
+  ok();
+}
+
+int main(void) {
+  puts("1..3");
+  test_short_stop();
+  test_parked();
+  test_driving();
+  return 0;
+}
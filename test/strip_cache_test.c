@@ -0,0 +1,142 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "my_assert.h"
+#include "overlay.h"
+#include "strip_cache.h"
+
+/* Tests the strip cache round trip on synthetic frames, with made up glyphs so
+ * no video or image is decoded. */
+
+char directory[] = "/tmp/strip_cache_test_XXXXXX";
+#define VIDEO_NAME "20240831090220_000001.TS"
+#define VIDEO_START 1725094940
+
+static const char keys[] = "0123456789_";
+#define GLYPH_COUNT (sizeof(keys) - 1)
+Glyph glyphs[GLYPH_COUNT];
+
+/**
+ * Glyphs of pseudo-random white, black and ignored pixels.
+ */
+static void make_glyphs(void) {
+  uint32_t seed = 7;
+  for (unsigned int k = 0; k < GLYPH_COUNT; ++k) {
+    glyphs[k].key = keys[k];
+    glyphs[k].divider = 0;
+    for (unsigned int i = 0; i < GLYPH_HEIGHT; ++i) {
+      for (unsigned int j = 0; j < GLYPH_WIDTH; ++j) {
+        seed = seed * 1664525 + 1013904223;
+        glyphs[k].multiplier[i][j] = (seed >> 29) % 3 - 1;
+        glyphs[k].divider += glyphs[k].multiplier[i][j] != 0;
+      }
+    }
+  }
+}
+
+/**
+ * Writes a cache of count frames, a second apart, with the route drawn on them.
+ * Returns whether it was kept.
+ */
+static bool write_cache(unsigned int count, bool keep) {
+  StripWriter writer;
+  if (!strips_create(&writer, directory, VIDEO_NAME))
+    return false;
+  AVFrame frame = { .linesize = { EXPECTED_VIDEO_WIDTH + 64 } };
+  frame.data[0] = malloc(frame.linesize[0] * EXPECTED_VIDEO_HEIGHT);
+  uint32_t seed = 1;
+  for (unsigned int i = 0; i < count; ++i) {
+    overlay_noise(frame.data[0], frame.linesize[0], EXPECTED_VIDEO_WIDTH,
+      EXPECTED_VIDEO_HEIGHT, &seed);
+    CharLine line;
+    overlay_route(&line, VIDEO_START, i);
+    overlay_draw(frame.data[0], frame.linesize[0], GLYPH_COUNT, glyphs, &line);
+    frame.pts = 90000 * (int64_t)i + 126000;
+    strips_add(&writer, &frame);
+  }
+  free(frame.data[0]);
+  return strips_close(&writer, keep);
+}
+
+static char *cache_name(void) {
+  char *name =
+    malloc(sizeof(directory) + sizeof("/" VIDEO_NAME STRIP_EXTENSION));
+  sprintf(name, "%s/" VIDEO_NAME STRIP_EXTENSION, directory);
+  return name;
+}
+
+/* The lines come back as fill_line read them from the frames. */
+static void test_round_trip(void) {
+  const int test_case = 1;
+  // Arrange
+  char *name = cache_name();
+  my_assert(write_cache(3, true));
+  CharLine lines[4];
+  int64_t pts[4];
+  // Act
+  int read_lines = strips_lines(name, GLYPH_COUNT, glyphs, 4, lines, pts);
+  // Assert
+  my_assert(read_lines == 3);
+  for (unsigned int i = 0; i < 3; ++i) {
+    CharLine expected;
+    overlay_route(&expected, VIDEO_START, i);
+    overlay_readable(GLYPH_COUNT, glyphs, &expected);
+    my_assert(memcmp(&expected, &lines[i], sizeof(CharLine)) == 0);
+    my_assert(pts[i] == 90000 * (int64_t)i + 126000);
+  }
+  free(name);
+  ok();
+}
+
+/* Too many strips for the lines is an error, like a video too long. */
+static void test_too_long(void) {
+  const int test_case = 2;
+  // Arrange
+  char *name = cache_name();
+  CharLine lines[2];
+  // Act
+  int read_lines = strips_lines(name, GLYPH_COUNT, glyphs, 2, lines, NULL);
+  // Assert
+  my_assert(read_lines < 0);
+  free(name);
+  ok();
+}
+
+/* A cache not kept is dropped, leaving the previous one of the video as it
+ * was. */
+static void test_not_kept(void) {
+  const int test_case = 3;
+  // Arrange
+  char *name = cache_name();
+  my_assert(write_cache(3, true));
+  // Act
+  bool kept = write_cache(1, false);
+  // Assert
+  my_assert(!kept);
+  char temporary[sizeof(directory) + sizeof("/" VIDEO_NAME STRIP_EXTENSION)
+    + sizeof(".tmp")];
+  sprintf(temporary, "%s.tmp", name);
+  my_assert(access(temporary, F_OK) != 0);
+  CharLine lines[4];
+  my_assert(strips_lines(name, GLYPH_COUNT, glyphs, 4, lines, NULL) == 3);
+  unlink(name);
+  free(name);
+  ok();
+}
+
+int main(void) {
+  puts("1..3");
+  if (mkdtemp(directory) == NULL) {
+    puts("Bail out! Could not create temporary directory");
+    return 1;
+  }
+  setenv("TZ", "UTC", 1);
+  make_glyphs();
+  test_round_trip();
+  test_too_long();
+  test_not_kept();
+  rmdir(directory);
+  return 0;
+}
@@ -0,0 +1,108 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+#include <stdio.h>
+#include "my_assert.h"
+#include "track.h"
+
+/* Tests the track helpers used to build the derived tables: distances and the
+ * simplification of the trips.
+ */
+
+/* Size arguments for arrays known at compile time. */
+#define tp(points) (sizeof(points)/sizeof(TrackPoint)), points
+
+/* One thousandth of a degree of latitude is about 110 m. */
+static void test_distance(void) {
+  const int test_case = 1;
+  // Act
+  double distance = great_circle_distance(26.434, -71.608, 26.435, -71.608);
+  // Assert
+  my_assert(distance > 109 && distance < 112);
+  ok();
+}
+
+/* Points along a straight line are dropped, the ends are always kept. */
+static void test_simplify_straight(void) {
+  const int test_case = 2;
+  // Arrange
+  const TrackPoint straight[] = {
+    {0, -71.600, 26.430},
+    {1, -71.601, 26.431},
+    {2, -71.602, 26.432},
+    {3, -71.603, 26.433},
+  };
+  bool keep[sizeof(straight)/sizeof(TrackPoint)];
+  // Act
+  unsigned int kept = simplify_track(tp(straight), 10, keep);
+  // Assert
+  my_assert(kept == 2);
+  my_assert(keep[0] && !keep[1] && !keep[2] && keep[3]);
+  ok();
+}
+
+/* A corner further than the tolerance is kept, a small wobble is not. */
+static void test_simplify_corner(void) {
+  const int test_case = 3;
+  // Arrange
+  const TrackPoint corner[] = {
+    {0, -71.600, 26.430},
+    /* About 5 m off the line. */
+    {1, -71.60005, 26.435},
+    {2, -71.600, 26.440},
+    /* Turn about 1 km east. */
+    {3, -71.590, 26.440},
+  };
+  bool keep[sizeof(corner)/sizeof(TrackPoint)];
+  // Act
+  unsigned int kept = simplify_track(tp(corner), 10, keep);
+  // Assert
+  my_assert(kept == 3);
+  my_assert(keep[0] && !keep[1] && keep[2] && keep[3]);
+  /* Everything goes with a large enough tolerance. */
+  my_assert(simplify_track(tp(corner), 1000, keep) == 2);
+  ok();
+}
+
+/* Degenerate tracks keep all their points. */
+static void test_simplify_short(void) {
+  const int test_case = 4;
+  // Arrange
+  const TrackPoint single[] = {{0, -71.600, 26.430}};
+  bool keep[1];
+  // Act, Assert
+  my_assert(simplify_track(tp(single), 10, keep) == 1);
+  my_assert(keep[0]);
+  ok();
+}
+
+/* Stationary runs become their first point with the end time of the run. */
+static void test_collapse_stationary(void) {
+  const int test_case = 5;
+  // Arrange
+  TrackPoint jam[] = {
+    {0, -71.600, 26.430},
+    /* About 5 m away. */
+    {1, -71.60005, 26.430},
+    {2, -71.600, 26.43003},
+    {3, -71.601, 26.430},
+    {4, -71.602, 26.430},
+  };
+  time_t until[sizeof(jam)/sizeof(TrackPoint)];
+  // Act
+  unsigned int kept = collapse_stationary(tp(jam), 10, until);
+  // Assert
+  my_assert(kept == 3);
+  my_assert(jam[0].timestamp == 0 && until[0] == 2);
+  my_assert(jam[1].timestamp == 3 && until[1] == 3);
+  my_assert(jam[2].timestamp == 4 && until[2] == 4);
+  ok();
+}
+
+int main(void) {
+  puts("1..5");
+  test_distance();
+  test_simplify_straight();
+  test_simplify_corner();
+  test_simplify_short();
+  test_collapse_stationary();
+  return 0;
+}
@@ -1,6 +1,10 @@
 /* SPDX-License-Identifier: GPL-2.0-or-later */
 #include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <strings.h>
+#include <unistd.h>
 #include "glyph.h"
 #include "my_assert.h"
 #include "video_data.h"
@@ -8,7 +12,8 @@
 /* Tests the video to string logic. Most tests here require an actual dashboard
  * camera recording, which usually contains private data. The tests are skipped
  * when this data is not present. A template directory is provided under
- * test/data/private.template.
+ * test/data/private.template. Others read synthetic videos, written with
+ * make_videos, whose path is the first argument.
  */
 
 /* This is defined by the meson build system conditionally on the presence of
@@ -24,6 +29,15 @@ const char keys[] = "0123456789_";
 #define GLYPH_COUNT (sizeof(keys) - 1)
 Glyph glyphs[GLYPH_COUNT];
 
+/* Path of make_videos, NULL when not given. */
+const char *make_videos;
+
+/* Length of the synthetic videos, name of the one make_videos writes, and
+ * room for their lines. */
+#define SYNTHETIC_SECONDS 60
+#define SYNTHETIC_NAME "20240831090220_000001.TS"
+#define SYNTHETIC_LINES (SYNTHETIC_SECONDS + 10)
+
 #if HAS_PRIVATE_DATA
 /* Only used on tests that require private data. */
 static bool valid_character(char x)
@@ -45,7 +59,7 @@ static void test_expected(void) {
   // Act
   int ret = get_video_strings("file:../test/data/private/" VIDEO_FILENAME,
     GLYPH_COUNT, glyphs,
-    TEST_VIDEO_SECONDS_PLUS_1, lines);
+    TEST_VIDEO_SECONDS_PLUS_1, lines, NULL);
 
   // Assert
   my_assert(ret + 1 == TEST_VIDEO_SECONDS_PLUS_1);
@@ -87,7 +101,7 @@ static void test_too_few_lines(void)
   // Act
   int ret = get_video_strings("file:../test/data/private/" VIDEO_FILENAME,
     GLYPH_COUNT, glyphs,
-    sizeof(lines) / sizeof(CharLine), lines);
+    sizeof(lines) / sizeof(CharLine), lines, NULL);
 
   // Assert
   my_assert(ret < 0);
@@ -107,21 +121,160 @@ static void test_zero_lines(void)
   // Act
   int ret = get_video_strings("file:this_should_not_be_open.TS",
     GLYPH_COUNT, glyphs,
-    0, NULL);
+    0, NULL, NULL);
 
   // Assert
   my_assert(ret < 0);
   ok();
 }
 
-int main(void)
+/* Clocks counted from the PTS read the same as the ones recognized. */
+static void test_clock_check(void)
+{
+  const int test_case = 4;
+#if HAS_PRIVATE_DATA
+  // Arrange
+  CharLine read[TEST_VIDEO_SECONDS_PLUS_1];
+  CharLine counted[TEST_VIDEO_SECONDS_PLUS_1];
+  const VideoOptions options = { .clock_check = 30 };
+
+  // Act
+  int read_count = get_video_strings(
+    "file:../test/data/private/" VIDEO_FILENAME, GLYPH_COUNT, glyphs,
+    TEST_VIDEO_SECONDS_PLUS_1, read, NULL);
+  int counted_count = get_video_strings(
+    "file:../test/data/private/" VIDEO_FILENAME, GLYPH_COUNT, glyphs,
+    TEST_VIDEO_SECONDS_PLUS_1, counted, &options);
+
+  // Assert
+  my_assert(counted_count == read_count);
+  for (int i = 0; i < read_count; ++i) {
+    my_assert(memcmp(read[i].left, counted[i].left, FRAME_STRING_LENGTH) == 0);
+    my_assert(line_clock(&read[i]) == 0
+      || line_clock(&read[i]) == line_clock(&counted[i]));
+  }
+
+  ok();
+#else
+  skip("Missing private data");
+#endif
+}
+
+/**
+ * Writes a synthetic video of SYNTHETIC_SECONDS with the make_videos options
+ * into a temporary directory. Returns its URL, to be freed by remove_video,
+ * or NULL when it couldn’t.
+ */
+static char *make_video(const char options[]) {
+  char directory[] = "/tmp/video_data_test_XXXXXX";
+  if (mkdtemp(directory) == NULL)
+    return NULL;
+  char *command = malloc(strlen(make_videos) + strlen(options)
+    + strlen(directory) + 64);
+  sprintf(command, "%s --seconds=%d --fps=5 %s %s > /dev/null", make_videos,
+    SYNTHETIC_SECONDS, options, directory);
+  const bool made = system(command) == 0;
+  free(command);
+  char *url = malloc(strlen(directory) + sizeof("file:/" SYNTHETIC_NAME));
+  sprintf(url, "file:%s/" SYNTHETIC_NAME, directory);
+  if (!made) {
+    rmdir(directory);
+    free(url);
+    return NULL;
+  }
+  return url;
+}
+
+/**
+ * Deletes the video written by make_video and its directory.
+ */
+static void remove_video(char *url) {
+  const char *path = url + strlen("file:");
+  unlink(path);
+  *strrchr(url, '/') = '\0';
+  rmdir(path);
+  free(url);
+}
+
+/* A clock set a second ahead mid-video isn’t counted on from the PTS: the
+ * clocks checked tell it apart. */
+static void test_clock_jump(void)
+{
+  const int test_case = 5;
+  if (make_videos == NULL) {
+    skip("Missing make_videos");
+    return;
+  }
+  // Arrange
+  char *url = make_video("--clock-jump=20");
+  my_assert(url != NULL);
+  CharLine read[SYNTHETIC_LINES];
+  CharLine counted[SYNTHETIC_LINES];
+  const VideoOptions options = { .clock_check = 30 };
+
+  // Act
+  int read_count = get_video_strings(url, GLYPH_COUNT, glyphs,
+    SYNTHETIC_LINES, read, NULL);
+  int counted_count = get_video_strings(url, GLYPH_COUNT, glyphs,
+    SYNTHETIC_LINES, counted, &options);
+  remove_video(url);
+
+  // Assert
+  my_assert(read_count >= SYNTHETIC_SECONDS);
+  /* The overlay has the jump. */
+  my_assert(line_clock(&read[25]) - line_clock(&read[15]) == 11);
+  my_assert(counted_count == read_count);
+  for (int i = 0; i < read_count; ++i)
+    my_assert(line_clock(&read[i]) == line_clock(&counted[i]));
+  ok();
+}
+
+/* Timestamps skipping ahead while the clock goes on aren’t counted from. */
+static void test_pts_gap(void)
+{
+  const int test_case = 6;
+  if (make_videos == NULL) {
+    skip("Missing make_videos");
+    return;
+  }
+  // Arrange
+  char *url = make_video("--pts-gap=20");
+  my_assert(url != NULL);
+  CharLine read[SYNTHETIC_LINES];
+  CharLine counted[SYNTHETIC_LINES];
+  const VideoOptions options = { .clock_check = 30 };
+
+  // Act
+  int read_count = get_video_strings(url, GLYPH_COUNT, glyphs,
+    SYNTHETIC_LINES, read, NULL);
+  int counted_count = get_video_strings(url, GLYPH_COUNT, glyphs,
+    SYNTHETIC_LINES, counted, &options);
+  remove_video(url);
+
+  // Assert
+  my_assert(read_count >= SYNTHETIC_SECONDS);
+  /* A line a second of the clock, the gap in the PTS notwithstanding. */
+  for (int i = 1; i < read_count; ++i)
+    my_assert(line_clock(&read[i]) - line_clock(&read[i - 1]) == 1);
+  my_assert(counted_count == read_count);
+  for (int i = 0; i < read_count; ++i)
+    my_assert(line_clock(&read[i]) == line_clock(&counted[i]));
+  ok();
+}
+
+int main(int argc, char *argv[])
 {
-  puts("1..3");
+  puts("1..6");
+  if (argc > 1)
+    make_videos = argv[1];
   /* Globally initialize glyphs for all tests. */
   load_glyphs("file:../data/glyphs.png", GLYPH_COUNT, keys, glyphs);
 
   test_expected();
   test_too_few_lines();
   test_zero_lines();
+  test_clock_check();
+  test_clock_jump();
+  test_pts_gap();
   return 0;
 }